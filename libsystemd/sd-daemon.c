@@ -11,6 +11,8 @@
 
 #define _GNU_SOURCE 1
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <inttypes.h>
 #include <signal.h>
 #include <stdbool.h>
@@ -135,6 +137,11 @@ int sd_pid_notify(pid_t pid, int unset_environment, const char *state)
 		pid = getpid();
 
 	env = getenv("NOTIFY_SOCKET");
+
+	/* Shared socket, Finit finds the service from our credentials */
+	if (env && !strcmp(env, "@run/finit/notify"))
+		return sd_notify(unset_environment, state);
+
 	if (env) {
 		env = strdup(env);
 		if (!env)
@@ -180,35 +187,133 @@ int sd_pid_notifyf(pid_t pid, int unset_environment, const char *format, ...)
 }
 
 /*
- * Socket activation stub - Finit doesn't support socket activation yet
- * Returns 0 (no file descriptors passed)
+ * Socket activation, Finit passes listening sockets starting at fd 3
+ * (SD_LISTEN_FDS_START) when a service has socket stanzas.  Returns
+ * the number of fds passed, 0 if none, or negative errno.
  */
 int sd_listen_fds(int unset_environment)
 {
+	const char *e;
+	char *end;
+	long pid, num;
+	int rc, fd;
+
+	e = getenv("LISTEN_PID");
+	if (!e) {
+		rc = 0;
+		goto done;
+	}
+
+	errno = 0;
+	pid = strtol(e, &end, 10);
+	if (errno || *end || pid <= 0) {
+		rc = -EINVAL;
+		goto done;
+	}
+
+	/* Not for us, e.g. inherited by a child of the service */
+	if (pid != getpid()) {
+		rc = 0;
+		goto done;
+	}
+
+	e = getenv("LISTEN_FDS");
+	if (!e) {
+		rc = 0;
+		goto done;
+	}
+
+	errno = 0;
+	num = strtol(e, &end, 10);
+	if (errno || *end || num < 0 || num > INT_MAX - SD_LISTEN_FDS_START) {
+		rc = -EINVAL;
+		goto done;
+	}
+
+	for (fd = SD_LISTEN_FDS_START; fd < SD_LISTEN_FDS_START + num; fd++) {
+		int flags;
+
+		flags = fcntl(fd, F_GETFD);
+		if (flags < 0) {
+			rc = -errno;
+			goto done;
+		}
+
+		if (flags & FD_CLOEXEC)
+			continue;
+		if (fcntl(fd, F_SETFD, flags | FD_CLOEXEC) < 0) {
+			rc = -errno;
+			goto done;
+		}
+	}
+
+	rc = (int)num;
+done:
 	if (unset_environment) {
 		unsetenv("LISTEN_PID");
 		unsetenv("LISTEN_FDS");
 		unsetenv("LISTEN_FDNAMES");
 	}
 
-	return 0;
+	return rc;
 }
 
 /*
- * Watchdog stub - Finit doesn't support watchdog yet
- * Returns 0 (no watchdog enabled)
+ * Watchdog, Finit sets WATCHDOG_USEC and WATCHDOG_PID for services with
+ * the watchdog:MSEC option.  Returns 1 and the interval in @usec if the
+ * service is expected to send WATCHDOG=1 keep-alives, 0 if not, or
+ * negative errno.  Send keep-alives at about half the interval.
  */
 int sd_watchdog_enabled(int unset_environment, uint64_t *usec)
 {
+	unsigned long long val;
+	const char *e;
+	char *end;
+	long pid;
+	int rc;
+
+	if (usec)
+		*usec = 0;
+
+	e = getenv("WATCHDOG_USEC");
+	if (!e) {
+		rc = 0;
+		goto done;
+	}
+
+	errno = 0;
+	val = strtoull(e, &end, 10);
+	if (errno || *end || val == 0) {
+		rc = -EINVAL;
+		goto done;
+	}
+
+	e = getenv("WATCHDOG_PID");
+	if (e) {
+		errno = 0;
+		pid = strtol(e, &end, 10);
+		if (errno || *end || pid <= 0) {
+			rc = -EINVAL;
+			goto done;
+		}
+
+		/* Not for us, e.g. inherited by a child of the service */
+		if (pid != getpid()) {
+			rc = 0;
+			goto done;
+		}
+	}
+
+	if (usec)
+		*usec = val;
+	rc = 1;
+done:
 	if (unset_environment) {
 		unsetenv("WATCHDOG_PID");
 		unsetenv("WATCHDOG_USEC");
 	}
 
-	if (usec)
-		*usec = 0;
-
-	return 0;
+	return rc;
 }
 
 /*
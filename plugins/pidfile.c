@@ -139,7 +139,7 @@ static void pidfile_update_conds(char *dir, char *name, uint32_t mask)
 			if (pid != svc->pid) {
 				dbg("Forking service %s (cmd %s) changed PID from %d to %d",
 				   svc_ident(svc, NULL, 0), svc->cmd, svc->pid, pid);
-				svc->pid = pid;
+				svc_set_pid(svc, pid);
 
 				/* Complement log in service.c for non-forking services */
 				logit(LOG_CONSOLE | LOG_NOTICE, "Started %s[%d]", svc_ident(svc, NULL, 0), pid);
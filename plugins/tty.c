@@ -75,7 +75,7 @@ static void do_tty(char *tty, size_t len, int creat)
 			svc_missing(svc);
 		}
 
-		service_step_all(SVC_TYPE_TTY);
+		service_step(svc);
 	}
 }
 
@@ -0,0 +1,612 @@
+/* Boot timeline analysis, initctl analyze
+ *
+ * Copyright (c) 2025  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _LIBITE_LITE
+# include <libite/lite.h>
+#else
+# include <lite/lite.h>
+#endif
+
+#include "analyze.h"
+#include "client.h"
+#include "cond.h"
+#include "initctl.h"
+
+#define MAX_DEPTH 32
+
+/*
+ * A service, or plugin hook, with the time of each milestone from the
+ * boot timeline, zero if not reached.  Kept in order of first event,
+ * which is the order they were started in.
+ */
+struct unit {
+	char     *name;
+	char     *cond;
+	int       svctype;
+	int       hook;
+	int       status;
+	uint64_t  t[INIT_TL_MAX];
+};
+
+static struct unit *units;
+static size_t       units_num;
+
+static uint64_t     boot;		/* Finit started */
+static uint64_t     boot_done;		/* Bootstrap completed */
+
+static struct client_event *events;
+static size_t               events_num;
+
+static double sec(uint64_t ns)
+{
+	return (double)ns / 1000000000.0;
+}
+
+static uint64_t usec(uint64_t ns)
+{
+	return ns / 1000;
+}
+
+static struct unit *unit_find(const char *name)
+{
+	size_t i;
+
+	for (i = 0; i < units_num; i++) {
+		if (!strcmp(units[i].name, name))
+			return &units[i];
+	}
+
+	return NULL;
+}
+
+static struct unit *unit_get(struct client_event *ev)
+{
+	struct unit *u;
+
+	u = unit_find(ev->name);
+	if (u)
+		return u;
+
+	u = realloc(units, (units_num + 1) * sizeof(*units));
+	if (!u)
+		ERR(70, "Failed allocating memory");
+	units = u;
+
+	u = &units[units_num++];
+	memset(u, 0, sizeof(*u));
+	u->name = ev->name;
+
+	return u;
+}
+
+static int timeline(void)
+{
+	size_t i;
+
+	events = client_timeline(&events_num);
+	if (!events)
+		ERRX(69, "Failed fetching boot timeline from Finit");
+
+	for (i = 0; i < events_num; i++) {
+		struct client_event *ev = &events[i];
+		struct unit *u;
+
+		switch (ev->type) {
+		case INIT_TL_BOOT:
+			boot = ev->ns;
+			continue;
+
+		case INIT_TL_BOOT_DONE:
+			boot_done = ev->ns;
+			continue;
+
+		case INIT_TL_RUNLEVEL:
+			continue;
+
+		default:
+			if (!ev->name || ev->type <= 0 || ev->type >= INIT_TL_MAX)
+				continue;
+			break;
+		}
+
+		u = unit_get(ev);
+		u->t[ev->type] = ev->ns;
+		switch (ev->type) {
+		case INIT_TL_HOOK_BEGIN:
+		case INIT_TL_HOOK_END:
+			u->hook = 1;
+			break;
+
+		case INIT_TL_SVC_COND:
+			u->cond = ev->cond;
+			break;
+
+		case INIT_TL_SVC_DONE:
+			u->status = ev->arg;
+			break;
+
+		default:
+			break;
+		}
+		if (ev->svctype)
+			u->svctype = ev->svctype;
+	}
+
+	return 0;
+}
+
+/* When the unit started: hook called, pre: script, or process started */
+static uint64_t t_start(struct unit *u)
+{
+	if (u->hook)
+		return u->t[INIT_TL_HOOK_BEGIN];
+	if (u->t[INIT_TL_SVC_PRE])
+		return u->t[INIT_TL_SVC_PRE];
+	if (u->t[INIT_TL_SVC_FORK])
+		return u->t[INIT_TL_SVC_FORK];
+
+	return u->t[INIT_TL_SVC_COND];
+}
+
+/* When the unit was up: hook done, run/task done, or service ready */
+static uint64_t t_up(struct unit *u)
+{
+	if (u->hook)
+		return u->t[INIT_TL_HOOK_END];
+	if (u->svctype & (SVC_TYPE_RUN | SVC_TYPE_TASK))
+		return u->t[INIT_TL_SVC_DONE];
+	if (u->t[INIT_TL_SVC_READY])
+		return u->t[INIT_TL_SVC_READY];
+
+	return u->t[INIT_TL_SVC_RUNNING];
+}
+
+static uint64_t t_active(struct unit *u)
+{
+	uint64_t start = t_start(u), up = t_up(u);
+
+	if (!start || up < start)
+		return 0;
+
+	return up - start;
+}
+
+static const char *unit_type(struct unit *u)
+{
+	if (u->hook)
+		return "hook";
+
+	switch (u->svctype) {
+	case SVC_TYPE_SERVICE:
+		return "service";
+	case SVC_TYPE_TASK:
+		return "task";
+	case SVC_TYPE_RUN:
+		return "run";
+	case SVC_TYPE_TTY:
+		return "tty";
+	case SVC_TYPE_SYSV:
+		return "sysv";
+	default:
+		break;
+	}
+
+	return "";
+}
+
+/*
+ * Find the unit providing condition @cond, e.g. pid/NAME,
+ * service/NAME/ready, task/NAME/success, or hook/sys/up.
+ */
+static struct unit *unit_provider(const char *cond)
+{
+	char name[MAX_COND_LEN];
+	const char *ptr;
+	struct unit *u;
+	size_t len;
+	size_t i;
+
+	if (!strncmp(cond, "hook/", 5))
+		return unit_find(cond);
+
+	if (!strncmp(cond, "pid/", 4))
+		ptr = &cond[4];
+	else if (!strncmp(cond, "service/", 8))
+		ptr = &cond[8];
+	else if (!strncmp(cond, "task/", 5))
+		ptr = &cond[5];
+	else if (!strncmp(cond, "run/", 4))
+		ptr = &cond[4];
+	else
+		return NULL;
+
+	strlcpy(name, ptr, sizeof(name));
+	if (strncmp(cond, "pid/", 4)) {
+		char *slash = strrchr(name, '/');
+
+		if (slash)
+			*slash = 0;
+	}
+
+	u = unit_find(name);
+	if (u)
+		return u;
+
+	/* Condition without :ID, any instance */
+	len = strlen(name);
+	for (i = 0; i < units_num; i++) {
+		if (!strncmp(units[i].name, name, len) && units[i].name[len] == ':')
+			return &units[i];
+	}
+
+	return NULL;
+}
+
+/*
+ * The condition that was satisfied last, i.e., the one that held up
+ * @u the longest.  Conditions without a provider in the timeline, e.g.
+ * net/ or usr/ conditions, are returned in @ext.
+ */
+static struct unit *unit_blocker(struct unit *u, char *ext, size_t len)
+{
+	struct unit *last = NULL;
+	uint64_t max = 0;
+	char *conds, *c;
+
+	ext[0] = 0;
+	if (!u->cond)
+		return NULL;
+
+	conds = strdupa(u->cond);
+	for (c = strtok(conds, COND_EXPR_DELIM); c; c = strtok(NULL, COND_EXPR_DELIM)) {
+		struct unit *dep;
+
+		while (*c == '!' || *c == '~' || *c == '<')
+			c++;
+		c[strcspn(c, ">")] = 0;
+
+		dep = unit_provider(c);
+		if (!dep || dep == u) {
+			if (!last)
+				strlcpy(ext, c, len);
+			continue;
+		}
+
+		if (t_up(dep) >= max) {
+			max  = t_up(dep);
+			last = dep;
+			ext[0] = 0;
+		}
+	}
+
+	return last;
+}
+
+static void chain(struct unit *u, int depth)
+{
+	char ext[MAX_COND_LEN];
+	struct unit *dep;
+
+	printf("%*s%s%s @%.3fs", depth > 1 ? (depth - 1) * 2 : 0, "",
+	       depth ? "└─" : "", u->name, sec(t_up(u)));
+	if (t_active(u))
+		printf(" +%.3fs", sec(t_active(u)));
+	puts("");
+
+	if (depth >= MAX_DEPTH)
+		return;
+
+	dep = unit_blocker(u, ext, sizeof(ext));
+	if (dep) {
+		chain(dep, depth + 1);
+		return;
+	}
+
+	if (ext[0])
+		printf("%*s└─%s\n", depth * 2, "", ext);
+}
+
+static struct unit *unit_last(void)
+{
+	struct unit *last = NULL;
+	size_t i;
+
+	for (i = 0; i < units_num; i++) {
+		struct unit *u = &units[i];
+
+		if (u->hook || u->svctype == SVC_TYPE_TTY)
+			continue;
+		if (!last || t_up(u) > t_up(last))
+			last = u;
+	}
+
+	return last;
+}
+
+static void summary(void)
+{
+	struct unit *last = unit_last();
+
+	printf("Finit started @%.3fs", sec(boot));
+	if (boot_done)
+		printf(", bootstrap done @%.3fs (+%.3fs)", sec(boot_done), sec(boot_done - boot));
+	if (last && t_up(last))
+		printf(", last up @%.3fs (%s)", sec(t_up(last)), last->name);
+	puts("");
+}
+
+static int cmp_active(const void *a, const void *b)
+{
+	uint64_t ta = t_active(*(struct unit **)a);
+	uint64_t tb = t_active(*(struct unit **)b);
+
+	return ta < tb ? 1 : ta > tb ? -1 : 0;
+}
+
+static int blame(void)
+{
+	struct unit **list;
+	size_t i;
+
+	list = calloc(units_num, sizeof(*list));
+	if (!list)
+		ERR(70, "Failed allocating memory");
+	for (i = 0; i < units_num; i++)
+		list[i] = &units[i];
+	qsort(list, units_num, sizeof(*list), cmp_active);
+
+	if (heading)
+		print_header("%-9s  %-9s  %-9s  %-7s  %s", "UP", "ACTIVE", "PRE", "TYPE", "NAME");
+
+	for (i = 0; i < units_num; i++) {
+		struct unit *u = list[i];
+		uint64_t pre = 0;
+
+		if (!t_up(u))
+			continue;
+		if (u->t[INIT_TL_SVC_PRE_DONE] > u->t[INIT_TL_SVC_PRE])
+			pre = u->t[INIT_TL_SVC_PRE_DONE] - u->t[INIT_TL_SVC_PRE];
+
+		printf("%8.3fs  %8.3fs  %8.3fs  %-7s  %s\n", sec(t_up(u)),
+		       sec(t_active(u)), sec(pre), unit_type(u), u->name);
+	}
+	free(list);
+
+	return 0;
+}
+
+static void trace_event(const char *name, const char *cat, int tid,
+			uint64_t begin, uint64_t end, int *prev)
+{
+	if (!begin || end < begin)
+		return;
+
+	printf("%s\n    { \"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", "
+	       "\"pid\": 1, \"tid\": %d, \"ts\": %llu, \"dur\": %llu }",
+	       *prev ? "," : "", json_escape(name), cat, tid,
+	       (unsigned long long)usec(begin), (unsigned long long)usec(end - begin));
+	*prev = 1;
+}
+
+/* Trace Event Format, for chrome://tracing, Perfetto and similar tools */
+static int trace(void)
+{
+	int prev = 0;
+	size_t i;
+
+	printf("{\n  \"displayTimeUnit\": \"ms\",\n  \"traceEvents\": [");
+	for (i = 0; i < events_num; i++) {
+		struct client_event *ev = &events[i];
+		char name[32];
+
+		switch (ev->type) {
+		case INIT_TL_BOOT:
+			strlcpy(name, "finit", sizeof(name));
+			break;
+		case INIT_TL_BOOT_DONE:
+			strlcpy(name, "bootstrap done", sizeof(name));
+			break;
+		case INIT_TL_RUNLEVEL:
+			snprintf(name, sizeof(name), "runlevel %d", ev->arg);
+			break;
+		default:
+			continue;
+		}
+
+		printf("%s\n    { \"name\": \"%s\", \"cat\": \"system\", \"ph\": \"i\", "
+		       "\"s\": \"g\", \"pid\": 1, \"tid\": 0, \"ts\": %llu }",
+		       prev ? "," : "", name, (unsigned long long)usec(ev->ns));
+		prev = 1;
+	}
+
+	for (i = 0; i < units_num; i++) {
+		struct unit *u = &units[i];
+		int tid = i + 1;
+
+		if (u->hook) {
+			trace_event(u->name, "hook", tid, u->t[INIT_TL_HOOK_BEGIN],
+				    u->t[INIT_TL_HOOK_END], &prev);
+			continue;
+		}
+
+		trace_event("waiting", u->name, tid, u->t[INIT_TL_SVC_WAITING],
+			    u->t[INIT_TL_SVC_COND], &prev);
+		trace_event("pre", u->name, tid, u->t[INIT_TL_SVC_PRE],
+			    u->t[INIT_TL_SVC_PRE_DONE], &prev);
+		trace_event(u->name, unit_type(u), tid, u->t[INIT_TL_SVC_FORK],
+			    t_up(u), &prev);
+	}
+	printf("\n  ]\n}\n");
+
+	return 0;
+}
+
+#define SVG_ROW    20
+#define SVG_LABEL  220
+#define SVG_TOP    40
+
+static void svg_bar(uint64_t begin, uint64_t end, double scale, int y, const char *class)
+{
+	if (!begin || end < begin)
+		return;
+
+	printf("<rect class=\"%s\" x=\"%.1f\" y=\"%d\" width=\"%.1f\" height=\"%d\"/>\n",
+	       class, SVG_LABEL + (begin - boot) * scale, y + 2,
+	       (end - begin) * scale + 1, SVG_ROW - 4);
+}
+
+static int plot(void)
+{
+	uint64_t end = boot_done;
+	double scale, width;
+	size_t i;
+	int height;
+
+	for (i = 0; i < units_num; i++) {
+		if (t_up(&units[i]) > end)
+			end = t_up(&units[i]);
+	}
+	if (end <= boot)
+		end = boot + 1000000000ULL;
+
+	/* 100 px/s, at least 800 px wide */
+	width = sec(end - boot) * 100;
+	if (width < 800)
+		width = 800;
+	scale  = width / (end - boot);
+	height = SVG_TOP + (units_num + 1) * SVG_ROW;
+
+	printf("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+	       "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%.0f\" height=\"%d\">\n"
+	       "<style>\n"
+	       "  text { font-family: sans-serif; font-size: 12px; }\n"
+	       "  line { stroke: #ddd; }\n"
+	       "  .waiting { fill: #e0e0e0; }\n"
+	       "  .pre     { fill: #f5d76e; }\n"
+	       "  .start   { fill: #f39c12; }\n"
+	       "  .hook    { fill: #8e44ad; }\n"
+	       "  .up      { fill: #27ae60; }\n"
+	       "</style>\n", SVG_LABEL + width + 20, height);
+
+	for (i = 0; i * 1000000000ULL <= end - boot; i++) {
+		double x = SVG_LABEL + i * 1000000000ULL * scale;
+
+		printf("<line x1=\"%.1f\" y1=\"%d\" x2=\"%.1f\" y2=\"%d\"/>\n"
+		       "<text x=\"%.1f\" y=\"%d\">%.0fs</text>\n",
+		       x, SVG_TOP - 10, x, height, x + 2, SVG_TOP - 14, sec(boot) + i);
+	}
+
+	printf("<text x=\"4\" y=\"16\">Finit started @%.3fs", sec(boot));
+	if (boot_done)
+		printf(", bootstrap done @%.3fs", sec(boot_done));
+	printf("</text>\n");
+
+	for (i = 0; i < units_num; i++) {
+		struct unit *u = &units[i];
+		int y = SVG_TOP + i * SVG_ROW;
+
+		printf("<text x=\"4\" y=\"%d\">%s</text>\n", y + SVG_ROW - 6, u->name);
+		if (u->hook) {
+			svg_bar(u->t[INIT_TL_HOOK_BEGIN], u->t[INIT_TL_HOOK_END], scale, y, "hook");
+			continue;
+		}
+
+		svg_bar(u->t[INIT_TL_SVC_WAITING], u->t[INIT_TL_SVC_COND], scale, y, "waiting");
+		svg_bar(u->t[INIT_TL_SVC_PRE], u->t[INIT_TL_SVC_PRE_DONE], scale, y, "pre");
+		svg_bar(u->t[INIT_TL_SVC_FORK], t_up(u), scale, y, "start");
+		svg_bar(t_up(u), t_up(u) + 2 / scale, scale, y, "up");
+	}
+	printf("</svg>\n");
+
+	return 0;
+}
+
+int analyze_show(char *arg)
+{
+	timeline();
+	if (json)
+		return trace();
+
+	summary();
+	puts("");
+	analyze_chain(arg);
+	puts("");
+
+	return blame();
+}
+
+int analyze_blame(char *arg)
+{
+	timeline();
+	if (json)
+		return trace();
+
+	return blame();
+}
+
+int analyze_chain(char *arg)
+{
+	struct unit *u;
+
+	if (!events)
+		timeline();
+
+	if (arg) {
+		u = unit_find(arg);
+		if (!u)
+			ERRX(69, "No such service in boot timeline: %s", arg);
+	} else {
+		u = unit_last();
+		if (!u)
+			ERRX(69, "No services in boot timeline");
+	}
+
+	if (heading)
+		print_header("Critical chain, @up and +active time");
+	chain(u, 0);
+
+	return 0;
+}
+
+int analyze_trace(char *arg)
+{
+	timeline();
+	return trace();
+}
+
+int analyze_plot(char *arg)
+{
+	timeline();
+	return plot();
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
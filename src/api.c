@@ -49,9 +49,189 @@
 #include "service.h"
 #include "sm.h"
 #include "sig.h"
+#include "timeline.h"
 #include "util.h"
 
+#define API_MAX_CLIENTS	32	/* Simultaneous client connections */
+#define API_MAX_BATCH	16	/* Pipelined requests per wakeup   */
+#define API_TIMEOUT	30000	/* msec, idle clients are dropped  */
+#define API_MAX_QUEUE	1024	/* Events queued, monitor is stuck */
+#define API_MAX_MONITORS 16	/* Leave room for other requests   */
+
+/*
+ * A reply waiting for the client to drain its socket.  The socket is
+ * SOCK_SEQPACKET, a write is either all of one message or nothing at
+ * all, so replies are always queued whole.
+ */
+struct api_msg {
+	TAILQ_ENTRY(api_msg) link;
+	size_t len;
+	char   data[];
+};
+
+struct api_client {
+	TAILQ_ENTRY(api_client) link;
+	TAILQ_HEAD(, api_msg) outq;
+
+	uev_t  io;
+	uev_t  tmo;
+	int    sd;
+	int    events;		/* UEV_READ or UEV_WRITE            */
+	int    leave;		/* Close when outq has been drained */
+	int    qlen;		/* Number of messages in outq       */
+	int    monitor;		/* INIT_CMD_MONITOR, gets events    */
+};
+
 static uev_t api_watcher;
+static int   api_num;
+static int   api_monitors;
+
+static TAILQ_HEAD(, api_client) api_clients = TAILQ_HEAD_INITIALIZER(api_clients);
+static TAILQ_HEAD(, api_client) api_gc_list = TAILQ_HEAD_INITIALIZER(api_gc_list);
+
+/*
+ * Clients are closed from their own callbacks, and more events for
+ * them may already be pending in this round of the event loop, so
+ * they are freed later from a work item instead.
+ */
+static void api_gc(void *arg)
+{
+	struct api_client *c, *next;
+
+	(void)arg;
+
+	TAILQ_FOREACH_SAFE(c, &api_gc_list, link, next) {
+		TAILQ_REMOVE(&api_gc_list, c, link);
+		free(c);
+	}
+}
+
+static struct wq api_gc_work = {
+	.cb    = api_gc,
+	.delay = 1
+};
+
+static void api_close(struct api_client *c)
+{
+	struct api_msg *m;
+
+	if (c->sd < 0)
+		return;
+
+	uev_io_stop(&c->io);
+	uev_timer_stop(&c->tmo);
+	close(c->sd);
+	c->sd = -1;
+
+	while ((m = TAILQ_FIRST(&c->outq))) {
+		TAILQ_REMOVE(&c->outq, m, link);
+		free(m);
+	}
+	c->qlen = 0;
+
+	if (c->monitor)
+		api_monitors--;
+
+	TAILQ_REMOVE(&api_clients, c, link);
+	TAILQ_INSERT_TAIL(&api_gc_list, c, link);
+	api_num--;
+
+	schedule_work(&api_gc_work);
+}
+
+static int api_poll(struct api_client *c, int events)
+{
+	if (c->events == events)
+		return 0;
+
+	c->events = events;
+	return uev_io_set(&c->io, c->sd, events);
+}
+
+/*
+ * Write queued replies until the socket would block.  While replies
+ * are pending we only wait for the socket to become writable, this
+ * keeps the replies to pipelined requests in order, and prevents a
+ * client that never reads its replies from queueing up more in PID 1.
+ */
+static void api_flush(struct api_client *c)
+{
+	struct api_msg *m;
+
+	while ((m = TAILQ_FIRST(&c->outq))) {
+		if (send(c->sd, m->data, m->len, MSG_NOSIGNAL) == -1) {
+			if (EINTR == errno)
+				continue;
+			if (EAGAIN == errno || EWOULDBLOCK == errno)
+				break;
+
+			dbg("Failed sending reply to client: %s", strerror(errno));
+			api_close(c);
+			return;
+		}
+
+		TAILQ_REMOVE(&c->outq, m, link);
+		c->qlen--;
+		free(m);
+	}
+
+	if (!TAILQ_EMPTY(&c->outq)) {
+		api_poll(c, UEV_WRITE);
+		return;
+	}
+
+	if (c->leave) {
+		api_close(c);
+		return;
+	}
+
+	api_poll(c, UEV_READ);
+}
+
+/*
+ * Send a reply, or queue it if the client socket is full.  On error
+ * the client is closed and -1 is returned.
+ */
+static int api_send(struct api_client *c, const void *buf, size_t len)
+{
+	struct api_msg *m;
+
+	if (c->sd < 0)
+		return -1;
+
+	if (TAILQ_EMPTY(&c->outq)) {
+		ssize_t rc;
+
+		do
+			rc = send(c->sd, buf, len, MSG_NOSIGNAL);
+		while (rc == -1 && EINTR == errno);
+
+		if (rc != -1)
+			return 0;
+
+		if (EAGAIN != errno && EWOULDBLOCK != errno) {
+			dbg("Failed sending reply to client: %s", strerror(errno));
+			api_close(c);
+			return -1;
+		}
+	}
+
+	m = malloc(sizeof(*m) + len);
+	if (!m) {
+		dbg("Failed queueing %zu byte reply to client", len);
+		api_close(c);
+		return -1;
+	}
+	memcpy(m->data, buf, len);
+	m->len = len;
+
+	TAILQ_INSERT_TAIL(&c->outq, m, link);
+	c->qlen++;
+	api_poll(c, UEV_WRITE);
+
+	return 0;
+}
+
 
 static int call(int (*action)(svc_t *, void *), char *buf, size_t len)
 {
@@ -68,8 +248,6 @@ static int stop(svc_t *svc, void *user_data)
 	service_timeout_cancel(svc);
 	svc_stop(svc);
 	service_step(svc);
-	if (!IS_RESERVED_RUNLEVEL(runlevel))
-		service_step_all(SVC_TYPE_ANY);
 
 	return 0;
 }
@@ -84,8 +262,6 @@ static int start(svc_t *svc, void *user_data)
 	service_timeout_cancel(svc);
 	svc_start(svc);
 	service_step(svc);
-	if (!IS_RESERVED_RUNLEVEL(runlevel))
-		service_step_all(SVC_TYPE_ANY);
 
 	return 0;
 }
@@ -162,7 +338,7 @@ static int do_signal_svc(svc_t *svc, void *user_data)
 		return 1;
 
 	signo = *(int *)user_data;
-	return !!kill(svc->pid, signo);
+	return !!service_signal(svc, signo);
 }
 
 static int do_signal(char *buf, size_t len, int sig)
@@ -272,7 +448,7 @@ static void bypass_shutdown(void *unused)
  * Sends ACK before attempting switch_root since it doesn't return on success.
  * Returns: result from switch_root() on failure, doesn't return on success.
  */
-static int do_switch_root_api(int sd, struct init_request *rq)
+static int do_switch_root_api(struct api_client *c, struct init_request *rq)
 {
 	char *newroot, *newinit = NULL;
 	char *ptr;
@@ -294,9 +470,9 @@ static int do_switch_root_api(int sd, struct init_request *rq)
 	 * switch_root() on success.
 	 */
 	rq->cmd = INIT_CMD_ACK;
-	if (write(sd, rq, sizeof(*rq)) != sizeof(*rq))
+	if (api_send(c, rq, sizeof(*rq)))
 		dbg("Failed sending ACK to client");
-	close(sd);
+	api_close(c);
 
 	/* This does not return on success */
 	result = switch_root(newroot, newinit);
@@ -384,286 +560,853 @@ ev_t ev_list[] = {
 	{ NULL, NULL }
 };
 
-static void send_svc(int sd, svc_t *svc)
+static size_t put_str(char *buf, const char *str)
 {
-	svc_t empty = { 0 };
+	uint16_t len = str ? strlen(str) : 0;
+
+	if (buf) {
+		memcpy(buf, &len, sizeof(len));
+		if (len)
+			memcpy(&buf[sizeof(len)], str, len);
+	}
+
+	return sizeof(len) + len;
+}
+
+/*
+ * The svc_t is followed by its heap allocated strings, each sent as a
+ * 16-bit length and the string without NUL, zero length means unset.
+ * The svc_strv() strings are sent first, then the number of args[].
+ */
+static size_t pack_svc(char *buf, svc_t *svc)
+{
+	size_t len = sizeof(*svc);
+	uint16_t argc = 0;
+	char **str;
+	size_t i;
+
+	if (buf)
+		memcpy(buf, svc, sizeof(*svc));
+
+	for (i = 0; (str = svc_strv(svc, i)); i++)
+		len += put_str(buf ? &buf[len] : NULL, *str);
+
+	while (svc->args && svc->args[argc])
+		argc++;
+	if (buf)
+		memcpy(&buf[len], &argc, sizeof(argc));
+	len += sizeof(argc);
+
+	for (i = 0; i < argc; i++)
+		len += put_str(buf ? &buf[len] : NULL, svc->args[i]);
+
+	return len;
+}
+
+static void send_svc(struct api_client *c, svc_t *svc)
+{
+	svc_t empty = { .pid = -1 };
 	size_t len;
+	char *buf;
 
-	if (!svc) {
-		empty.pid = -1;
+	if (!svc)
 		svc = &empty;
+
+	len = pack_svc(NULL, svc);
+	buf = malloc(len);
+	if (!buf) {
+		dbg("Failed allocating %zu bytes for svc_t to client", len);
+		return;
 	}
+	pack_svc(buf, svc);
 
-	len = write(sd, svc, sizeof(*svc));
-	if (len != sizeof(*svc))
+	if (api_send(c, buf, len))
 		dbg("Failed sending svc_t to client");
+	free(buf);
 }
 
-static void api_cb(uev_t *w, void *arg, int events)
+static int tlv_add(char *buf, size_t *len, size_t max, int type, const void *val, size_t vlen)
 {
-	static svc_t *iter = NULL;
-	struct init_request rq;
-	int sd, lvl;
-	svc_t *svc;
+	struct init_tlv tlv = { .type = type, .len = vlen };
+	size_t sz = sizeof(tlv) + INIT_TLV_ALIGN(vlen);
 
-	(void)arg;
+	if (vlen > UINT16_MAX || *len + sz > max)
+		return -1;
 
-	if (UEV_ERROR == events) {
-		dbg("%s(): api socket %d invalid.", __func__, w->fd);
-		goto error;
+	memcpy(&buf[*len], &tlv, sizeof(tlv));
+	memcpy(&buf[*len + sizeof(tlv)], val, vlen);
+	memset(&buf[*len + sizeof(tlv) + vlen], 0, INIT_TLV_ALIGN(vlen) - vlen);
+	*len += sz;
+
+	return 0;
+}
+
+static int tlv_int(char *buf, size_t *len, size_t max, int type, int32_t val)
+{
+	return tlv_add(buf, len, max, type, &val, sizeof(val));
+}
+
+static int tlv_str(char *buf, size_t *len, size_t max, int type, const char *str)
+{
+	if (!str || !str[0])
+		return 0;
+
+	return tlv_add(buf, len, max, type, str, strlen(str));
+}
+
+/*
+ * Encode one INIT_TLV_SVC record.  Arguments are added last, and are
+ * truncated if they do not fit, so a record always fits in a packet.
+ */
+static size_t svc_record(svc_t *svc, char *buf, size_t max)
+{
+	struct init_tlv tlv = { .type = INIT_TLV_SVC };
+	int64_t start_time = svc->start_time;
+	size_t len = sizeof(tlv);
+	int i;
+
+	tlv_int(buf, &len, max, INIT_TLV_JOB,         svc->job);
+	tlv_str(buf, &len, max, INIT_TLV_NAME,        svc->name);
+	tlv_str(buf, &len, max, INIT_TLV_ID,          svc->id);
+	tlv_int(buf, &len, max, INIT_TLV_TYPE,        svc->type);
+	tlv_int(buf, &len, max, INIT_TLV_STATE,       svc->state);
+	tlv_int(buf, &len, max, INIT_TLV_BLOCK,       svc->block);
+	tlv_int(buf, &len, max, INIT_TLV_PID,         svc->pid);
+	tlv_int(buf, &len, max, INIT_TLV_STARTED,     svc->started);
+	tlv_int(buf, &len, max, INIT_TLV_STATUS,      svc->status);
+	tlv_add(buf, &len, max, INIT_TLV_START_TIME,  &start_time, sizeof(start_time));
+	tlv_int(buf, &len, max, INIT_TLV_RUNLEVELS,   svc->runlevels);
+	tlv_int(buf, &len, max, INIT_TLV_DIRTY,       svc->dirty);
+	tlv_int(buf, &len, max, INIT_TLV_REMOVED,     svc->removed);
+	tlv_int(buf, &len, max, INIT_TLV_MANUAL,      svc->manual);
+	tlv_int(buf, &len, max, INIT_TLV_FORKING,     svc->forking);
+	tlv_int(buf, &len, max, INIT_TLV_ONCE,        svc->once);
+	tlv_int(buf, &len, max, INIT_TLV_RESTART_TOT, svc->restart_tot);
+	tlv_int(buf, &len, max, INIT_TLV_RESTART_CNT, svc->restart_cnt);
+	tlv_int(buf, &len, max, INIT_TLV_RESTART_MAX, svc->restart_max);
+	tlv_int(buf, &len, max, INIT_TLV_RESTART_TMO, svc->restart_tmo);
+	tlv_int(buf, &len, max, INIT_TLV_RESTART_BACKOFF, svc->restart_backoff);
+	tlv_int(buf, &len, max, INIT_TLV_RESTART_JITTER, svc->restart_jitter);
+	tlv_int(buf, &len, max, INIT_TLV_NOTIFY,      svc->notify);
+	tlv_int(buf, &len, max, INIT_TLV_PRIORITY,    svc->priority);
+	tlv_int(buf, &len, max, INIT_TLV_WATCHDOG,    svc->watchdog);
+	tlv_str(buf, &len, max, INIT_TLV_FILE,        svc->file);
+	tlv_str(buf, &len, max, INIT_TLV_COND,        svc->cond);
+	tlv_str(buf, &len, max, INIT_TLV_DESC,        svc->desc);
+	tlv_str(buf, &len, max, INIT_TLV_CMD,         svc->cmd);
+	tlv_str(buf, &len, max, INIT_TLV_ENV,         svc->env);
+	tlv_str(buf, &len, max, INIT_TLV_PIDFILE,     svc->pidfile);
+	tlv_str(buf, &len, max, INIT_TLV_USER,        svc->username);
+	tlv_str(buf, &len, max, INIT_TLV_GROUP,       svc->group);
+	tlv_str(buf, &len, max, INIT_TLV_NOTIFY_STATUS, svc->notify_status);
+
+	for (i = 0; svc->args && svc->args[i]; i++) {
+		if (tlv_str(buf, &len, max, INIT_TLV_ARG, svc->args[i]))
+			break;
 	}
 
-	/*
-	 * TODO: refactor to use accept4() and a new uev handler for the
-	 * client socket instead of risking blocking PID 1 if the client
-	 * is misbehaving.
-	 */
-//	sd = accept4(w->fd, NULL, NULL, SOCK_NONBLOCK);
-	sd = accept(w->fd, NULL, NULL);
-	if (sd < 0) {
-		err(1, "Failed serving API request");
-		goto error;
+	tlv.len = len - sizeof(tlv);
+	memcpy(buf, &tlv, sizeof(tlv));
+
+	return len;
+}
+
+/*
+ * filter: 'foo'   should match foo:1 foo:2, etc. but not foobar
+ * filter: 'foo:1' should only match foo:1
+ * filter: 'foo:'  is allowed to fail, unsupported syntax atm
+ * filter: 'foo:*' is allowed to fail, unsupported syntax atm
+ * filter: '3'     should match job 3, all instances, like do_find()
+ * filter: '3:1'   should only match job 3, instance 1
+ */
+static int svc_match(svc_t *svc, char *filter)
+{
+	char ident[MAX_IDENT_LEN];
+	char *ptr;
+
+	if (!filter || !filter[0])
+		return 1;
+
+	if (isdigit(filter[0])) {
+		if (atoi(filter) != svc->job)
+			return 0;
+
+		ptr = strchr(filter, ':');
+		return !ptr || !strcmp(&ptr[1], svc->id);
 	}
 
-	while (1) {
-		int result = 0;
-		ssize_t len;
+	svc_ident(svc, ident, sizeof(ident));
+	ptr = strchr(ident, ':');
+	if (ptr && !strchr(filter, ':'))
+		*ptr = 0;
 
-		len = read(sd, &rq, sizeof(rq));
-		if (len <= 0) {
-			if (-1 == len) {
-				if (EINTR == errno)
-					continue;
+	return !strcmp(ident, filter);
+}
 
-				if (EAGAIN == errno)
-					break;
+/*
+ * Reply to INIT_CMD_SVC_LIST with all services matching @filter, as
+ * many records per packet as fit.  The cursor is local to the request,
+ * unlike the iterator shared by all clients for INIT_CMD_SVC_ITER.
+ */
+static void send_svc_list(struct api_client *c, char *filter)
+{
+	char pkt[INIT_SVC_LIST_PKTSZ], rec[INIT_SVC_LIST_PKTSZ];
+	struct init_svc_hdr *hdr = (struct init_svc_hdr *)pkt;
+	size_t len = sizeof(*hdr);
+	svc_t *svc, *iter = NULL;
 
-				/* we get here when client restarts itself */
-				if (ECONNRESET == errno)
-					break;
+	hdr->version = INIT_SVC_LIST_VERSION;
+	hdr->flags   = 0;
+	hdr->count   = 0;
 
-				errx(1, "Failed reading initctl request, error %d: %s", errno, strerror(errno));
-			}
+	for (svc = svc_iterator(&iter, 1); svc; svc = svc_iterator(&iter, 0)) {
+		size_t sz;
 
-			break;
+		if (!svc_match(svc, filter))
+			continue;
+
+		sz = svc_record(svc, rec, sizeof(rec) - sizeof(*hdr));
+		if (len + sz > sizeof(pkt)) {
+			if (api_send(c, pkt, len))
+				return;
+
+			len = sizeof(*hdr);
+			hdr->count = 0;
 		}
 
-		if (rq.magic != INIT_MAGIC || len != sizeof(rq)) {
-			errx(1, "Invalid initctl request");
-			break;
+		memcpy(&pkt[len], rec, sz);
+		len += sz;
+		hdr->count++;
+	}
+
+	hdr->flags = INIT_SVC_LIST_LAST;
+	api_send(c, pkt, len);
+}
+
+static size_t tl_record(struct timeline_event *ev, char *buf, size_t max)
+{
+	struct init_tlv tlv = { .type = INIT_TLV_EVENT };
+	int64_t ns = ev->ns;
+	size_t len = sizeof(tlv);
+
+	tlv_int(buf, &len, max, INIT_TLV_EVENT_TYPE, ev->type);
+	tlv_add(buf, &len, max, INIT_TLV_EVENT_TIME, &ns, sizeof(ns));
+	tlv_int(buf, &len, max, INIT_TLV_EVENT_ARG,  ev->arg);
+	tlv_str(buf, &len, max, INIT_TLV_NAME,       ev->name);
+	if (ev->svctype)
+		tlv_int(buf, &len, max, INIT_TLV_TYPE, ev->svctype);
+	tlv_str(buf, &len, max, INIT_TLV_COND,       ev->cond);
+
+	tlv.len = len - sizeof(tlv);
+	memcpy(buf, &tlv, sizeof(tlv));
+
+	return len;
+}
+
+/* Stream boot timeline, framed like send_svc_list() */
+static void send_timeline(struct api_client *c)
+{
+	char pkt[INIT_SVC_LIST_PKTSZ], rec[INIT_SVC_LIST_PKTSZ];
+	struct init_svc_hdr *hdr = (struct init_svc_hdr *)pkt;
+	struct timeline_event ev;
+	size_t len = sizeof(*hdr);
+	size_t pos;
+
+	hdr->version = INIT_SVC_LIST_VERSION;
+	hdr->flags   = 0;
+	hdr->count   = 0;
+
+	for (pos = 0; !timeline_get(pos, &ev); pos++) {
+		size_t sz;
+
+		sz = tl_record(&ev, rec, sizeof(rec) - sizeof(*hdr));
+		if (len + sz > sizeof(pkt)) {
+			if (api_send(c, pkt, len))
+				return;
+
+			len = sizeof(*hdr);
+			hdr->count = 0;
 		}
 
-		switch (rq.cmd) {
-		case INIT_CMD_REBOOT:
-		case INIT_CMD_HALT:
-		case INIT_CMD_POWEROFF:
-		case INIT_CMD_SUSPEND:
-			if (IS_RESERVED_RUNLEVEL(runlevel)) {
-				strterm(rq.data, sizeof(rq.data));
-				warnx("Unsupported command (cmd: %d, data: %s) in runlevel S and 6/0.",
-				      rq.cmd, rq.data);
-				goto leave;
-			}
-			break;
+		memcpy(&pkt[len], rec, sz);
+		len += sz;
+		hdr->count++;
+	}
 
-		case INIT_CMD_SWITCH_ROOT:
-			if (runlevel != INIT_LEVEL && runlevel != 1) {
-				warnx("switch-root only allowed in runlevel S or 1");
-				goto done;
-			}
-			break;
+	hdr->flags = INIT_SVC_LIST_LAST;
+	api_send(c, pkt, len);
+}
 
-		default:
-			break;
+/* Reply in progress, records are added to @pkt until it is full */
+struct api_stream {
+	struct api_client   *c;
+	struct init_svc_hdr *hdr;
+	char                *pkt;
+	size_t               len;
+};
+
+static void stream_init(struct api_stream *st, struct api_client *c, char *pkt)
+{
+	st->c   = c;
+	st->hdr = (struct init_svc_hdr *)pkt;
+	st->pkt = pkt;
+	st->len = sizeof(struct init_svc_hdr);
+
+	st->hdr->version = INIT_SVC_LIST_VERSION;
+	st->hdr->flags   = 0;
+	st->hdr->count   = 0;
+}
+
+static int stream_add(struct api_stream *st, const char *rec, size_t sz)
+{
+	if (st->len + sz > INIT_SVC_LIST_PKTSZ) {
+		if (api_send(st->c, st->pkt, st->len))
+			return 1;
+
+		st->len = sizeof(*st->hdr);
+		st->hdr->count = 0;
+	}
+
+	memcpy(&st->pkt[st->len], rec, sz);
+	st->len += sz;
+	st->hdr->count++;
+
+	return 0;
+}
+
+static int stream_end(struct api_stream *st)
+{
+	st->hdr->flags = INIT_SVC_LIST_LAST;
+	return api_send(st->c, st->pkt, st->len);
+}
+
+static size_t cond_record(const char *name, enum cond_state state, char *buf, size_t max)
+{
+	struct init_tlv tlv = { .type = INIT_TLV_CONDITION };
+	size_t len = sizeof(tlv);
+
+	tlv_str(buf, &len, max, INIT_TLV_NAME,  name);
+	tlv_int(buf, &len, max, INIT_TLV_STATE, state);
+
+	tlv.len = len - sizeof(tlv);
+	memcpy(buf, &tlv, sizeof(tlv));
+
+	return len;
+}
+
+static int cond_list_cb(const char *name, enum cond_state state, void *arg)
+{
+	char rec[INIT_SVC_LIST_PKTSZ - sizeof(struct init_svc_hdr)];
+
+	return stream_add(arg, rec, cond_record(name, state, rec, sizeof(rec)));
+}
+
+/* Stream conditions matching @prefix, framed like send_svc_list() */
+static void send_cond_list(struct api_client *c, char *prefix)
+{
+	char pkt[INIT_SVC_LIST_PKTSZ];
+	struct api_stream st;
+
+	stream_init(&st, c, pkt);
+	if (cond_walk(prefix, cond_list_cb, &st))
+		return;
+
+	stream_end(&st);
+}
+
+/*
+ * Start monitoring, send current state of all conditions and services,
+ * after that the client gets events from api_svc_event() and
+ * api_cond_event().  Monitor clients are never idle, so there may be
+ * at most API_MAX_MONITORS of them, the rest of API_MAX_CLIENTS are
+ * for other requests.
+ */
+static void send_monitor(struct api_client *c)
+{
+	char pkt[INIT_SVC_LIST_PKTSZ], rec[INIT_SVC_LIST_PKTSZ];
+	svc_t *svc, *iter = NULL;
+	struct api_stream st;
+
+	if (api_monitors >= API_MAX_MONITORS) {
+		logit(LOG_WARNING, "Too many API monitor clients, dropping connection.");
+		c->leave = 1;
+		return;
+	}
+
+	stream_init(&st, c, pkt);
+	if (cond_walk(NULL, cond_list_cb, &st))
+		return;
+
+	for (svc = svc_iterator(&iter, 1); svc; svc = svc_iterator(&iter, 0)) {
+		size_t sz;
+
+		sz = svc_record(svc, rec, sizeof(rec) - sizeof(*st.hdr));
+		if (stream_add(&st, rec, sz))
+			return;
+	}
+
+	if (stream_end(&st))
+		return;
+
+	uev_timer_stop(&c->tmo);
+	c->monitor = 1;
+	api_monitors++;
+}
+
+/* Send event, a packet with one record, to all monitor clients */
+static void api_event(char *pkt, size_t len)
+{
+	struct init_svc_hdr *hdr = (struct init_svc_hdr *)pkt;
+	struct api_client *c, *next;
+
+	hdr->version = INIT_SVC_LIST_VERSION;
+	hdr->flags   = INIT_SVC_LIST_LAST;
+	hdr->count   = 1;
+
+	TAILQ_FOREACH_SAFE(c, &api_clients, link, next) {
+		if (!c->monitor)
+			continue;
+
+		if (c->qlen >= API_MAX_QUEUE) {
+			warnx("API client %d not reading events, dropping it.", c->sd);
+			api_close(c);
+			continue;
 		}
 
-		switch (rq.cmd) {
-		case INIT_CMD_RUNLVL:
-			/* Allow changing cfglevel in runlevel S */
-			if (IS_RESERVED_RUNLEVEL(runlevel)) {
-				if (runlevel != INIT_LEVEL) {
-					warnx("Cannot abort runlevel 6/0.");
-					break;
-				}
-			}
+		api_send(c, pkt, len);
+	}
+}
 
-			switch (rq.runlevel) {
-			case 's':
-			case 'S':
-				rq.runlevel = '1'; /* Single user mode */
-				/* fallthrough */
-
-			case '0'...'9':
-				dbg("Setting new runlevel %c", rq.runlevel);
-				lvl = rq.runlevel - '0';
-				if (lvl == 0)
-					halt = SHUT_OFF;
-				if (lvl == 6)
-					halt = SHUT_REBOOT;
-
-				/* User requested change in next runlevel */
-				if (runlevel == INIT_LEVEL)
-					cfglevel = lvl;
-				else
-					sm_runlevel(lvl);
-				break;
+/**
+ * api_svc_event - Tell monitor clients about a service status change
+ * @svc: Service that may have changed, see svc_set_state() and service_step()
+ *
+ * The svc_status() depends on both the state and the block reason, the
+ * latter may change without a state change, e.g., a halted service that
+ * keeps crashing.  So this is called on every state change and after
+ * each service_step(), only actual changes are sent.
+ */
+void api_svc_event(svc_t *svc)
+{
+	char pkt[INIT_SVC_LIST_PKTSZ];
+	size_t len = sizeof(struct init_svc_hdr);
+	const char *status;
+
+	status = svc_status(svc);
+	if (svc->evstatus && !strcmp(svc->evstatus, status))
+		return;
+	svc->evstatus = status;
+
+	if (!api_monitors)
+		return;
+
+	len += svc_record(svc, &pkt[len], sizeof(pkt) - len);
+	api_event(pkt, len);
+}
+
+/**
+ * api_cond_event - Tell monitor clients about a condition change
+ * @name:  Condition name, e.g. net/eth0/up
+ * @state: New state, %COND_OFF when cleared
+ */
+void api_cond_event(const char *name, enum cond_state state)
+{
+	char pkt[INIT_SVC_LIST_PKTSZ];
+	size_t len = sizeof(struct init_svc_hdr);
+
+	if (!api_monitors)
+		return;
+
+	len += cond_record(name, state, &pkt[len], sizeof(pkt) - len);
+	api_event(pkt, len);
+}
+
+/*
+ * Handle one request from a client.  The reply is sent, or queued if
+ * the client socket is full, unless the request sets c->leave, then
+ * the connection is closed after any reply has been sent.
+ */
+static void api_req(struct api_client *c, struct init_request *rq)
+{
+	static svc_t *iter = NULL;
+	int result = 0;
+	int lvl;
+	svc_t *svc;
 
-			default:
-				dbg("Unsupported runlevel: %d", rq.runlevel);
+	switch (rq->cmd) {
+	case INIT_CMD_REBOOT:
+	case INIT_CMD_HALT:
+	case INIT_CMD_POWEROFF:
+	case INIT_CMD_SUSPEND:
+		if (IS_RESERVED_RUNLEVEL(runlevel)) {
+			strterm(rq->data, sizeof(rq->data));
+			warnx("Unsupported command (cmd: %d, data: %s) in runlevel S and 6/0.",
+			      rq->cmd, rq->data);
+			goto leave;
+		}
+		break;
+
+	case INIT_CMD_SWITCH_ROOT:
+		if (runlevel != INIT_LEVEL && runlevel != 1) {
+			warnx("switch-root only allowed in runlevel S or 1");
+			goto done;
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	switch (rq->cmd) {
+	case INIT_CMD_RUNLVL:
+		/* Allow changing cfglevel in runlevel S */
+		if (IS_RESERVED_RUNLEVEL(runlevel)) {
+			if (runlevel != INIT_LEVEL) {
+				warnx("Cannot abort runlevel 6/0.");
 				break;
 			}
-			break;
+		}
 
-		case INIT_CMD_DEBUG:
-			dbg("debug");
-			log_debug();
+		switch (rq->runlevel) {
+		case 's':
+		case 'S':
+			rq->runlevel = '1'; /* Single user mode */
+			/* fallthrough */
+
+		case '0'...'9':
+			dbg("Setting new runlevel %c", rq->runlevel);
+			lvl = rq->runlevel - '0';
+			if (lvl == 0)
+				halt = SHUT_OFF;
+			if (lvl == 6)
+				halt = SHUT_REBOOT;
+
+			/* User requested change in next runlevel */
+			if (runlevel == INIT_LEVEL)
+				cfglevel = lvl;
+			else
+				sm_runlevel(lvl);
 			break;
 
-		case INIT_CMD_RELOAD: /* 'init q' and 'initctl reload' */
-			if (IS_RESERVED_RUNLEVEL(runlevel)) {
-				warnx("Ignoring reload in runlevel S and 6/0.");
-				goto done;
-			}
-			dbg("reload");
-			sm_reload();
+		default:
+			dbg("Unsupported runlevel: %d", rq->runlevel);
 			break;
+		}
+		break;
 
-		case INIT_CMD_START_SVC:
-			dbg("start %s", rq.data);
-			strterm(rq.data, sizeof(rq.data));
-			result = do_start(rq.data, sizeof(rq.data));
-			break;
+	case INIT_CMD_DEBUG:
+		dbg("debug");
+		log_debug();
+		break;
 
-		case INIT_CMD_RESTART_SVC:
-			dbg("restart %s", rq.data);
-			strterm(rq.data, sizeof(rq.data));
-			result = do_restart(rq.data, sizeof(rq.data));
-			break;
+	case INIT_CMD_RELOAD: /* 'init q' and 'initctl reload' */
+		if (IS_RESERVED_RUNLEVEL(runlevel)) {
+			warnx("Ignoring reload in runlevel S and 6/0.");
+			goto done;
+		}
+		dbg("reload");
+		sm_reload();
+		break;
 
-		case INIT_CMD_STOP_SVC:
-			dbg("stop %s", rq.data);
-			strterm(rq.data, sizeof(rq.data));
-			result = do_stop(rq.data, sizeof(rq.data));
-			break;
+	case INIT_CMD_START_SVC:
+		dbg("start %s", rq->data);
+		strterm(rq->data, sizeof(rq->data));
+		result = do_start(rq->data, sizeof(rq->data));
+		break;
 
-		case INIT_CMD_RELOAD_SVC:
-			dbg("reload %s", rq.data);
-			strterm(rq.data, sizeof(rq.data));
-			result = do_reload(rq.data, sizeof(rq.data));
-			break;
+	case INIT_CMD_RESTART_SVC:
+		dbg("restart %s", rq->data);
+		strterm(rq->data, sizeof(rq->data));
+		result = do_restart(rq->data, sizeof(rq->data));
+		break;
 
-		case INIT_CMD_GET_PLUGINS:
-			result = plugin_list(rq.data, sizeof(rq.data));
-			break;
+	case INIT_CMD_STOP_SVC:
+		dbg("stop %s", rq->data);
+		strterm(rq->data, sizeof(rq->data));
+		result = do_stop(rq->data, sizeof(rq->data));
+		break;
 
-		case INIT_CMD_PLUGIN_DEPS:
-			result = plugin_deps(rq.data, sizeof(rq.data));
-			break;
+	case INIT_CMD_RELOAD_SVC:
+		dbg("reload %s", rq->data);
+		strterm(rq->data, sizeof(rq->data));
+		result = do_reload(rq->data, sizeof(rq->data));
+		break;
+
+	case INIT_CMD_GET_PLUGINS:
+		result = plugin_list(rq->data, sizeof(rq->data));
+		break;
+
+	case INIT_CMD_PLUGIN_DEPS:
+		result = plugin_deps(rq->data, sizeof(rq->data));
+		break;
+
+	case INIT_CMD_GET_RUNLEVEL:
+		dbg("get runlevel");
+		rq->runlevel  = runlevel;
+		rq->sleeptime = prevlevel;
+		break;
+
+	case INIT_CMD_GET_STATS:
+		memset(rq->data, 0, sizeof(rq->data));
+		service_stats((struct init_stats *)rq->data);
+		break;
+
+	case INIT_CMD_REBOOT:
+	case INIT_CMD_HALT:
+	case INIT_CMD_POWEROFF:
+	case INIT_CMD_SUSPEND:
+		result = do_reboot(rq->cmd, rq->sleeptime, rq->data, sizeof(rq->data));
+		break;
 
-		case INIT_CMD_GET_RUNLEVEL:
-			dbg("get runlevel");
-			rq.runlevel  = runlevel;
-			rq.sleeptime = prevlevel;
+	case INIT_CMD_SWITCH_ROOT:
+		do_switch_root_api(c, rq);
+		goto leave;
+
+	case INIT_CMD_ACK:
+		dbg("Client failed reading ACK");
+		goto leave;
+
+	case INIT_CMD_WDOG_HELLO:
+		dbg("wdog hello");
+		if (rq->runlevel <= 0) {
+			result = 1;
 			break;
+		}
 
-		case INIT_CMD_REBOOT:
-		case INIT_CMD_HALT:
-		case INIT_CMD_POWEROFF:
-		case INIT_CMD_SUSPEND:
-			result = do_reboot(rq.cmd, rq.sleeptime, rq.data, sizeof(rq.data));
+		dbg("Request to hand-over wdog ... to PID %d", rq->runlevel);
+		svc = svc_find_by_pid(rq->runlevel);
+		if (!svc) {
+			logit(LOG_ERR, "Cannot find PID %d, not registered.", rq->runlevel);
 			break;
+		}
 
-		case INIT_CMD_SWITCH_ROOT:
-			do_switch_root_api(sd, &rq);
-			goto leave;
+		if (wdog && wdog != svc) {
+			char name[32];
 
-		case INIT_CMD_ACK:
-			dbg("Client failed reading ACK");
-			goto leave;
+			svc_ident(svc, name, sizeof(name));
+			logit(LOG_NOTICE, "Handing over wdog ctrl from %s[%d] to %s[%d]",
+			      svc_ident(wdog, NULL, 0), wdog->pid, name, svc->pid);
 
-		case INIT_CMD_WDOG_HELLO:
-			dbg("wdog hello");
-			if (rq.runlevel <= 0) {
-				result = 1;
-				break;
+			if (wdog->protect) {
+				logit(LOG_NOTICE, "Stopping and deleting built-in watchdog.");
+				stop(wdog, NULL);
+				svc_del(wdog);
 			}
+		}
+		wdog = svc;
+		break;
 
-			dbg("Request to hand-over wdog ... to PID %d", rq.runlevel);
-			svc = svc_find_by_pid(rq.runlevel);
-			if (!svc) {
-				logit(LOG_ERR, "Cannot find PID %d, not registered.", rq.runlevel);
-				break;
-			}
+	case INIT_CMD_SVC_ITER:
+//			dbg("svc iter, first: %d", rq->runlevel);
+		/*
+		 * XXX: This iterator is shared by all clients, use
+		 *      INIT_CMD_SVC_LIST instead.
+		 */
+		svc = svc_iterator(&iter, rq->runlevel);
+		send_svc(c, svc);
+		goto leave;
+
+	case INIT_CMD_SVC_LIST:
+		strterm(rq->data, sizeof(rq->data));
+		send_svc_list(c, rq->data);
+		goto leave;
+
+	case INIT_CMD_GET_TIMELINE:
+		send_timeline(c);
+		goto leave;
+
+	case INIT_CMD_MONITOR:
+		send_monitor(c);
+		return;
+
+	case INIT_CMD_COND_LIST:
+		strterm(rq->data, sizeof(rq->data));
+		send_cond_list(c, rq->data);
+		goto leave;
+
+	case INIT_CMD_SVC_QUERY:
+		dbg("svc query: %s", rq->data);
+		strterm(rq->data, sizeof(rq->data));
+		result = do_query(rq->data, sizeof(rq->data));
+		break;
 
-			if (wdog && wdog != svc) {
-				char name[32];
+	case INIT_CMD_SVC_FIND:
+		dbg("svc find: %s", rq->data);
+		strterm(rq->data, sizeof(rq->data));
+		send_svc(c, do_find(rq->data, sizeof(rq->data)));
+		goto leave;
+
+	case INIT_CMD_SVC_FIND_BYC:
+		dbg("svc find by cond: %s", rq->data);
+		strterm(rq->data, sizeof(rq->data));
+		send_svc(c, do_find_byc(rq->data, sizeof(rq->data)));
+		goto leave;
+
+	case INIT_CMD_SIGNAL:
+		/* runlevel is reused for signal */
+		dbg("svc signal %d: %s", rq->runlevel, rq->data);
+		strterm(rq->data, sizeof(rq->data));
+		result = do_signal(rq->data, sizeof(rq->data), rq->runlevel);
+		break;
 
-				svc_ident(svc, name, sizeof(name));
-				logit(LOG_NOTICE, "Handing over wdog ctrl from %s[%d] to %s[%d]",
-				      svc_ident(wdog, NULL, 0), wdog->pid, name, svc->pid);
+	default:
+		dbg("Unsupported cmd: %d", rq->cmd);
+		break;
+	}
+done:
+	if (result)
+		rq->cmd = INIT_CMD_NACK;
+	else
+		rq->cmd = INIT_CMD_ACK;
+	if (api_send(c, rq, sizeof(*rq)))
+		dbg("Failed sending ACK/NACK back to client");
+	return;
+leave:
+	c->leave = 1;
+}
 
-				if (wdog->protect) {
-					logit(LOG_NOTICE, "Stopping and deleting built-in watchdog.");
-					stop(wdog, NULL);
-					svc_del(wdog);
-				}
+static void api_timeout_cb(uev_t *w, void *arg, int events)
+{
+	struct api_client *c = arg;
+
+	(void)w;
+	(void)events;
+
+	dbg("Dropping idle API client %d", c->sd);
+	api_close(c);
+}
+
+/*
+ * Client socket callback.  Requests may be pipelined, so we read and
+ * handle up to API_MAX_BATCH of them per wakeup, unless replies have
+ * to be queued, then we wait for the client to catch up first.
+ */
+static void api_client_cb(uev_t *w, void *arg, int events)
+{
+	struct api_client *c = arg;
+	int i;
+
+	(void)w;
+
+	if (events & UEV_ERROR) {
+		dbg("API client %d socket error.", c->sd);
+		api_close(c);
+		return;
+	}
+
+	if (!c->monitor)
+		uev_timer_set(&c->tmo, API_TIMEOUT, 0);
+
+	if (c->events & UEV_WRITE) {
+		api_flush(c);
+		return;
+	}
+
+	for (i = 0; i < API_MAX_BATCH; i++) {
+		struct init_request rq;
+		ssize_t len;
+
+		len = read(c->sd, &rq, sizeof(rq));
+		if (len <= 0) {
+			if (-1 == len) {
+				if (EINTR == errno)
+					continue;
+
+				if (EAGAIN == errno || EWOULDBLOCK == errno)
+					break;
+
+				/* we get here when client restarts itself */
+				if (ECONNRESET != errno)
+					errx(1, "Failed reading initctl request, error %d: %s", errno, strerror(errno));
 			}
-			wdog = svc;
-			break;
 
-		case INIT_CMD_SVC_ITER:
-//			dbg("svc iter, first: %d", rq.runlevel);
-			/*
-			 * XXX: This severely limits the number of
-			 * simultaneous client connections, but will
-			 * have to do for now.
-			 */
-			svc = svc_iterator(&iter, rq.runlevel);
-			send_svc(sd, svc);
-			goto leave;
+			api_close(c);
+			return;
+		}
+
+		/* SOCK_SEQPACKET, so a short read is not a partial request */
+		if (rq.magic != INIT_MAGIC || len != sizeof(rq)) {
+			errx(1, "Invalid initctl request");
+			api_close(c);
+			return;
+		}
 
-		case INIT_CMD_SVC_QUERY:
-			dbg("svc query: %s", rq.data);
-			strterm(rq.data, sizeof(rq.data));
-			result = do_query(rq.data, sizeof(rq.data));
+		api_req(c, &rq);
+		if (c->sd < 0)
+			return;
+
+		if (c->leave || !TAILQ_EMPTY(&c->outq))
 			break;
+	}
 
-		case INIT_CMD_SVC_FIND:
-			dbg("svc find: %s", rq.data);
-			strterm(rq.data, sizeof(rq.data));
-			send_svc(sd, do_find(rq.data, sizeof(rq.data)));
-			goto leave;
+	if (c->leave && TAILQ_EMPTY(&c->outq))
+		api_close(c);
+}
 
-		case INIT_CMD_SVC_FIND_BYC:
-			dbg("svc find by cond: %s", rq.data);
-			strterm(rq.data, sizeof(rq.data));
-			send_svc(sd, do_find_byc(rq.data, sizeof(rq.data)));
-			goto leave;
+static int api_client(uev_ctx_t *ctx, int sd)
+{
+	struct api_client *c;
 
-		case INIT_CMD_SIGNAL:
-			/* runlevel is reused for signal */
-			dbg("svc signal %d: %s", rq.runlevel, rq.data);
-			strterm(rq.data, sizeof(rq.data));
-			result = do_signal(rq.data, sizeof(rq.data), rq.runlevel);
-			break;
+	c = calloc(1, sizeof(*c));
+	if (!c) {
+		err(1, "Failed allocating API client");
+		return -1;
+	}
 
-		default:
-			dbg("Unsupported cmd: %d", rq.cmd);
-			break;
+	TAILQ_INIT(&c->outq);
+	c->sd     = sd;
+	c->events = UEV_READ;
+
+	if (uev_io_init(ctx, &c->io, api_client_cb, c, sd, UEV_READ))
+		goto fail;
+	if (uev_timer_init(ctx, &c->tmo, api_timeout_cb, c, API_TIMEOUT, 0)) {
+		uev_io_stop(&c->io);
+		goto fail;
+	}
+
+	TAILQ_INSERT_TAIL(&api_clients, c, link);
+	api_num++;
+
+	return 0;
+fail:
+	err(1, "Failed setting up API client");
+	free(c);
+	return -1;
+}
+
+static void api_cb(uev_t *w, void *arg, int events)
+{
+	int sd;
+
+	(void)arg;
+
+	if (UEV_ERROR == events) {
+		dbg("%s(): api socket %d invalid.", __func__, w->fd);
+		goto error;
+	}
+
+	while (1) {
+		sd = accept4(w->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (sd < 0) {
+			if (EINTR == errno || ECONNABORTED == errno)
+				continue;
+			if (EAGAIN == errno || EWOULDBLOCK == errno)
+				return;
+
+			err(1, "Failed serving API request");
+			goto error;
 		}
-	done:
-		if (result)
-			rq.cmd = INIT_CMD_NACK;
-		else
-			rq.cmd = INIT_CMD_ACK;
-		len = write(sd, &rq, sizeof(rq));
-		if (len != sizeof(rq))
-			dbg("Failed sending ACK/NACK back to client");
+
+		if (api_num >= API_MAX_CLIENTS) {
+			logit(LOG_WARNING, "Too many API clients, dropping connection.");
+			close(sd);
+			continue;
+		}
+
+		if (api_client(w->ctx, sd))
+			close(sd);
 	}
 
-leave:
-	close(sd);
-	return;
 error:
 	api_exit();
 	if (api_init(w->ctx))
@@ -712,6 +1455,10 @@ error:
 	return 1;
 }
 
+/*
+ * Connected clients are not affected, they are served until they
+ * disconnect or time out.
+ */
 int api_exit(void)
 {
 	uev_io_stop(&api_watcher);
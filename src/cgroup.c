@@ -219,6 +219,57 @@ int cgroup_move_svc(svc_t *svc)
 			       svc->pid, svc->cgroup.delegate);
 }
 
+/*
+ * Find the running service that @pid belongs to by its cgroup, used for
+ * helper processes that are not the main PID of a service.  A process in
+ * a delegated sub-cgroup matches the service that owns the parent.
+ */
+svc_t *cgroup_find_svc(pid_t pid)
+{
+	char buf[512], *path = NULL;
+	svc_t *svc, *iter = NULL;
+	FILE *fp;
+
+	if (!avail || pid <= 1)
+		return NULL;
+
+	fp = fopenf("r", "/proc/%d/cgroup", pid);
+	if (!fp)
+		return NULL;
+
+	/* Unified hierarchy: "0::/system/foo" */
+	while (fgets(buf, sizeof(buf), fp)) {
+		if (!strncmp(buf, "0::/", 4)) {
+			path = chomp(&buf[3]);
+			break;
+		}
+	}
+	fclose(fp);
+	if (!path)
+		return NULL;
+
+	for (svc = svc_iterator(&iter, 1); svc; svc = svc_iterator(&iter, 0)) {
+		const char *group = "system";
+		char name[MAX_ARG_LEN];
+		char cg[256];
+		size_t len;
+
+		if (svc->pid <= 1)
+			continue;
+
+		if (svc_is_tty(svc))
+			group = "user";
+		else if (svc->cgroup.name[0])
+			group = svc->cgroup.name;
+
+		len = snprintf(cg, sizeof(cg), "/%s/%s", group, cgroup_svc_name(svc, name, sizeof(name)));
+		if (!strncmp(path, cg, len) && (path[len] == 0 || path[len] == '/'))
+			return svc;
+	}
+
+	return NULL;
+}
+
 static void cgset(const char *path, char *ctrl, char *prop)
 {
 	char *val;
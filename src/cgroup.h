@@ -55,6 +55,7 @@ int   cgroup_watch   (const char *group, const char *name);
 
 int   cgroup_move_pid(const char *group, const char *name, int pid, int delegate);
 int   cgroup_move_svc(svc_t *svc);
+svc_t *cgroup_find_svc(pid_t pid);
 
 void  cgroup_prune   (void);
 
@@ -23,11 +23,15 @@
 
 #include <errno.h>
 #include <poll.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <time.h>
 
 #include "client.h"
 #include "log.h"
+#include "util.h"
 
 #define REQUEST_TIMEOUT 15000
 
@@ -143,38 +147,805 @@ int client_command(int cmd)
 	return client_request(&rq, sizeof(rq));
 }
 
-svc_t *client_svc_iterator(int first)
+static char *get_str(char **ptr, char *end)
+{
+	uint16_t len;
+	char *str;
+
+	if (end - *ptr < (ssize_t)sizeof(len))
+		return NULL;
+	memcpy(&len, *ptr, sizeof(len));
+	*ptr += sizeof(len);
+
+	if (!len || end - *ptr < len)
+		return NULL;
+	str = strndup(*ptr, len);
+	*ptr += len;
+
+	return str;
+}
+
+/* Release heap allocated strings of a svc_t received from Finit */
+static void svc_release(svc_t *svc)
+{
+	char **str;
+	size_t i;
+
+	for (i = 0; (str = svc_strv(svc, i)); i++) {
+		free(*str);
+		*str = NULL;
+	}
+	free(svc->args);
+	svc->args = NULL;
+}
+
+/*
+ * Read svc_t and its heap allocated strings, see send_svc() in api.c.
+ * The strings from any previous reply in @svc are free'd first.
+ */
+static int recv_svc(svc_t *svc)
+{
+	char *argv[MAX_NUM_SVC_ARGS];
+	char *buf, *ptr, *end;
+	uint16_t argc = 0;
+	ssize_t len;
+	char **str;
+	size_t i;
+
+	svc_release(svc);
+
+	len = recv(sd, NULL, 0, MSG_PEEK | MSG_TRUNC);
+	if (len < (ssize_t)sizeof(*svc))
+		return -1;
+
+	buf = malloc(len);
+	if (!buf)
+		return -1;
+	if (read(sd, buf, len) != len) {
+		free(buf);
+		return -1;
+	}
+
+	memcpy(svc, buf, sizeof(*svc));
+	svc->args   = NULL;
+	svc->rlimit = NULL;
+	svc->rlimit_num = 0;
+
+	ptr = &buf[sizeof(*svc)];
+	end = &buf[len];
+	for (i = 0; (str = svc_strv(svc, i)); i++)
+		*str = get_str(&ptr, end);
+
+	if (end - ptr >= (ssize_t)sizeof(argc)) {
+		memcpy(&argc, ptr, sizeof(argc));
+		ptr += sizeof(argc);
+	}
+	if (argc > NELEMS(argv))
+		argc = NELEMS(argv);
+	for (i = 0; i < argc; i++) {
+		argv[i] = get_str(&ptr, end);
+		if (!argv[i])
+			argv[i] = strdup("");
+	}
+	if (argc)
+		svc->args = strvdup(argv, argc);
+	for (i = 0; i < argc; i++)
+		free(argv[i]);
+	free(buf);
+
+	return 0;
+}
+
+static int64_t tlv_num(struct init_tlv *tlv, char *val)
+{
+	int64_t v64;
+	int32_t v32;
+
+	if (tlv->len == sizeof(v64)) {
+		memcpy(&v64, val, sizeof(v64));
+		return v64;
+	}
+	if (tlv->len == sizeof(v32)) {
+		memcpy(&v32, val, sizeof(v32));
+		return v32;
+	}
+
+	return 0;
+}
+
+static void tlv_strcpy(char *dst, size_t len, struct init_tlv *tlv, char *val)
+{
+	size_t n = tlv->len < len ? tlv->len : len - 1;
+
+	memcpy(dst, val, n);
+	dst[n] = 0;
+}
+
+/*
+ * Decode the fields of one INIT_TLV_SVC record into @svc, which only
+ * has what initctl needs.  Unknown fields, from a newer Finit, are
+ * skipped.
+ */
+static void svc_decode(svc_t *svc, char *buf, size_t len)
+{
+	char *argv[MAX_NUM_SVC_ARGS];
+	struct init_tlv tlv;
+	size_t off = 0;
+	int argc = 0;
+	int i;
+
+	memset(svc, 0, sizeof(*svc));
+	while (off + sizeof(tlv) <= len) {
+		char *val = &buf[off + sizeof(tlv)];
+
+		memcpy(&tlv, &buf[off], sizeof(tlv));
+		if (off + sizeof(tlv) + tlv.len > len)
+			break;
+		off += sizeof(tlv) + INIT_TLV_ALIGN(tlv.len);
+
+		switch (tlv.type) {
+		case INIT_TLV_JOB:
+			svc->job = tlv_num(&tlv, val);
+			break;
+		case INIT_TLV_NAME:
+			tlv_strcpy(svc->name, sizeof(svc->name), &tlv, val);
+			break;
+		case INIT_TLV_ID:
+			tlv_strcpy(svc->id, sizeof(svc->id), &tlv, val);
+			break;
+		case INIT_TLV_TYPE:
+			svc->type = tlv_num(&tlv, val);
+			break;
+		case INIT_TLV_STATE:
+			*((svc_state_t *)&svc->state) = tlv_num(&tlv, val);
+			break;
+		case INIT_TLV_BLOCK:
+			svc->block = tlv_num(&tlv, val);
+			break;
+		case INIT_TLV_PID:
+			*((pid_t *)&svc->pid) = tlv_num(&tlv, val);
+			break;
+		case INIT_TLV_STARTED:
+			svc->started = tlv_num(&tlv, val);
+			break;
+		case INIT_TLV_STATUS:
+			svc->status = tlv_num(&tlv, val);
+			break;
+		case INIT_TLV_START_TIME:
+			svc->start_time = tlv_num(&tlv, val);
+			break;
+		case INIT_TLV_RUNLEVELS:
+			svc->runlevels = tlv_num(&tlv, val);
+			break;
+		case INIT_TLV_DIRTY:
+			*((int *)&svc->dirty) = tlv_num(&tlv, val);
+			break;
+		case INIT_TLV_REMOVED:
+			*((int *)&svc->removed) = tlv_num(&tlv, val);
+			break;
+		case INIT_TLV_MANUAL:
+			svc->manual = tlv_num(&tlv, val);
+			break;
+		case INIT_TLV_FORKING:
+			svc->forking = tlv_num(&tlv, val);
+			break;
+		case INIT_TLV_ONCE:
+			svc->once = tlv_num(&tlv, val);
+			break;
+		case INIT_TLV_RESTART_TOT:
+			svc->restart_tot = tlv_num(&tlv, val);
+			break;
+		case INIT_TLV_RESTART_CNT:
+			*((char *)&svc->restart_cnt) = tlv_num(&tlv, val);
+			break;
+		case INIT_TLV_RESTART_MAX:
+			svc->restart_max = tlv_num(&tlv, val);
+			break;
+		case INIT_TLV_RESTART_TMO:
+			svc->restart_tmo = tlv_num(&tlv, val);
+			break;
+		case INIT_TLV_RESTART_BACKOFF:
+			svc->restart_backoff = tlv_num(&tlv, val);
+			break;
+		case INIT_TLV_RESTART_JITTER:
+			svc->restart_jitter = tlv_num(&tlv, val);
+			break;
+		case INIT_TLV_NOTIFY:
+			svc->notify = tlv_num(&tlv, val);
+			break;
+		case INIT_TLV_PRIORITY:
+			svc->priority = tlv_num(&tlv, val);
+			break;
+		case INIT_TLV_WATCHDOG:
+			svc->watchdog = tlv_num(&tlv, val);
+			break;
+		case INIT_TLV_FILE:
+			tlv_strcpy(svc->file, sizeof(svc->file), &tlv, val);
+			break;
+		case INIT_TLV_COND:
+			tlv_strcpy(svc->cond, sizeof(svc->cond), &tlv, val);
+			break;
+		case INIT_TLV_DESC:
+			tlv_strcpy(svc->desc, sizeof(svc->desc), &tlv, val);
+			break;
+		case INIT_TLV_USER:
+			tlv_strcpy(svc->username, sizeof(svc->username), &tlv, val);
+			break;
+		case INIT_TLV_GROUP:
+			tlv_strcpy(svc->group, sizeof(svc->group), &tlv, val);
+			break;
+		case INIT_TLV_CMD:
+			svc->cmd = strndup(val, tlv.len);
+			break;
+		case INIT_TLV_ENV:
+			svc->env = strndup(val, tlv.len);
+			break;
+		case INIT_TLV_PIDFILE:
+			svc->pidfile = strndup(val, tlv.len);
+			break;
+		case INIT_TLV_NOTIFY_STATUS:
+			svc->notify_status = strndup(val, tlv.len);
+			break;
+		case INIT_TLV_ARG:
+			if (argc >= (int)NELEMS(argv))
+				break;
+			argv[argc] = strndup(val, tlv.len);
+			if (argv[argc])
+				argc++;
+			break;
+		default:
+			break;
+		}
+	}
+
+	if (argc)
+		svc->args = strvdup(argv, argc);
+
+	/* strvdup() has packed them into svc->args */
+	for (i = 0; i < argc; i++)
+		free(argv[i]);
+}
+
+/* Services from last INIT_CMD_SVC_LIST, used by client_svc_iterator() */
+static svc_t *list;
+static size_t list_num;
+static size_t list_pos;
+
+static void list_free(void)
+{
+	size_t i;
+
+	for (i = 0; i < list_num; i++)
+		svc_release(&list[i]);
+	free(list);
+
+	list     = NULL;
+	list_num = 0;
+	list_pos = 0;
+}
+
+static int list_add(char *pkt, size_t len, uint32_t count)
+{
+	struct init_tlv tlv;
+	size_t off;
+	svc_t *tmp;
+
+	if (!count)
+		return 0;
+
+	tmp = realloc(list, (list_num + count) * sizeof(svc_t));
+	if (!tmp)
+		return -1;
+	list = tmp;
+
+	off = sizeof(struct init_svc_hdr);
+	while (count && off + sizeof(tlv) <= len) {
+		memcpy(&tlv, &pkt[off], sizeof(tlv));
+		if (off + sizeof(tlv) + tlv.len > len)
+			break;
+
+		if (tlv.type == INIT_TLV_SVC) {
+			svc_decode(&list[list_num++], &pkt[off + sizeof(tlv)], tlv.len);
+			count--;
+		}
+		off += sizeof(tlv) + INIT_TLV_ALIGN(tlv.len);
+	}
+
+	return 0;
+}
+
+/*
+ * Send request @rq and read the reply, one or more packets framed by
+ * struct init_svc_hdr, passing each packet to @add().
+ */
+static int client_stream(struct init_request *rq, int (*add)(char *, size_t, uint32_t))
+{
+	struct init_svc_hdr hdr;
+	char *pkt;
+
+	pkt = malloc(INIT_SVC_LIST_PKTSZ);
+	if (!pkt)
+		return -1;
+
+	if (client_connect() == -1) {
+		free(pkt);
+		return -1;
+	}
+
+	if (write(sd, rq, sizeof(*rq)) != sizeof(*rq))
+		goto error;
+
+	do {
+		struct pollfd pfd = {
+			.fd     = sd,
+			.events = POLLIN,
+		};
+		ssize_t len;
+
+		if (poll(&pfd, 1, REQUEST_TIMEOUT) <= 0)
+			goto error;
+
+		len = read(sd, pkt, INIT_SVC_LIST_PKTSZ);
+		if (len < (ssize_t)sizeof(hdr))
+			goto error;
+
+		memcpy(&hdr, pkt, sizeof(hdr));
+		if (hdr.version != INIT_SVC_LIST_VERSION) {
+			warnx("Unsupported service list version %d from Finit", hdr.version);
+			errno = EPROTO;
+			goto fail;
+		}
+
+		if (add(pkt, len, hdr.count))
+			goto error;
+	} while (!(hdr.flags & INIT_SVC_LIST_LAST));
+
+	client_disconnect();
+	free(pkt);
+
+	return 0;
+error:
+	warn("Failed communicating with finit, error %d", errno);
+fail:
+	client_disconnect();
+	free(pkt);
+
+	return -1;
+}
+
+/**
+ * client_svc_list - Fetch status of all, or a subset of, services
+ * @filter: Optional NAME or NAME:ID, NAME matches all instances
+ * @num:    Optional pointer to number of services returned
+ *
+ * Fetches all matching services in one request, independent of the
+ * memory layout of svc_t in Finit.  The returned array is valid until
+ * the next call, or call to client_svc_iterator().
+ *
+ * Returns:
+ * Array of @num services, or %NULL on error or if no services match.
+ */
+svc_t *client_svc_list(const char *filter, size_t *num)
 {
 	struct init_request rq = {
 		.magic = INIT_MAGIC,
-		.cmd   = INIT_CMD_SVC_ITER,
+		.cmd   = INIT_CMD_SVC_LIST,
 	};
-	static svc_t svc;
 
-	if (client_connect() == -1)
+	list_free();
+	if (num)
+		*num = 0;
+
+	if (filter)
+		strlcpy(rq.data, filter, sizeof(rq.data));
+	if (client_stream(&rq, list_add)) {
+		list_free();
 		return NULL;
+	}
 
-	if (first)
-		rq.runlevel = 1;
-	else
-		rq.runlevel = 0;
+	if (num)
+		*num = list_num;
+
+	return list_num ? list : NULL;
+}
+
+/* Events from last INIT_CMD_GET_TIMELINE */
+static struct client_event *events;
+static size_t events_num;
+
+static void events_free(void)
+{
+	size_t i;
+
+	for (i = 0; i < events_num; i++) {
+		free(events[i].name);
+		free(events[i].cond);
+	}
+	free(events);
+
+	events     = NULL;
+	events_num = 0;
+}
+
+static void event_decode(struct client_event *ev, char *buf, size_t len)
+{
+	struct init_tlv tlv;
+	size_t off = 0;
+
+	memset(ev, 0, sizeof(*ev));
+	while (off + sizeof(tlv) <= len) {
+		char *val = &buf[off + sizeof(tlv)];
+
+		memcpy(&tlv, &buf[off], sizeof(tlv));
+		if (off + sizeof(tlv) + tlv.len > len)
+			break;
+		off += sizeof(tlv) + INIT_TLV_ALIGN(tlv.len);
+
+		switch (tlv.type) {
+		case INIT_TLV_EVENT_TYPE:
+			ev->type = tlv_num(&tlv, val);
+			break;
+		case INIT_TLV_EVENT_TIME:
+			ev->ns = tlv_num(&tlv, val);
+			break;
+		case INIT_TLV_EVENT_ARG:
+			ev->arg = tlv_num(&tlv, val);
+			break;
+		case INIT_TLV_TYPE:
+			ev->svctype = tlv_num(&tlv, val);
+			break;
+		case INIT_TLV_NAME:
+			ev->name = strndup(val, tlv.len);
+			break;
+		case INIT_TLV_COND:
+			ev->cond = strndup(val, tlv.len);
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+static int events_add(char *pkt, size_t len, uint32_t count)
+{
+	struct client_event *tmp;
+	struct init_tlv tlv;
+	size_t off;
+
+	if (!count)
+		return 0;
+
+	tmp = realloc(events, (events_num + count) * sizeof(*events));
+	if (!tmp)
+		return -1;
+	events = tmp;
+
+	off = sizeof(struct init_svc_hdr);
+	while (count && off + sizeof(tlv) <= len) {
+		memcpy(&tlv, &pkt[off], sizeof(tlv));
+		if (off + sizeof(tlv) + tlv.len > len)
+			break;
+
+		if (tlv.type == INIT_TLV_EVENT) {
+			event_decode(&events[events_num++], &pkt[off + sizeof(tlv)], tlv.len);
+			count--;
+		}
+		off += sizeof(tlv) + INIT_TLV_ALIGN(tlv.len);
+	}
+
+	return 0;
+}
+
+/**
+ * client_timeline - Fetch boot timeline
+ * @num: Pointer to number of events returned
+ *
+ * The returned array, in the order recorded, is valid until the next
+ * call.
+ *
+ * Returns:
+ * Array of @num events, or %NULL on error.
+ */
+struct client_event *client_timeline(size_t *num)
+{
+	struct init_request rq = {
+		.magic = INIT_MAGIC,
+		.cmd   = INIT_CMD_GET_TIMELINE,
+	};
+
+	events_free();
+	*num = 0;
+
+	if (client_stream(&rq, events_add)) {
+		events_free();
+		return NULL;
+	}
+
+	*num = events_num;
+
+	return events;
+}
+
+/* Conditions from last INIT_CMD_COND_LIST */
+static struct client_cond *conds;
+static size_t conds_num;
+
+static void conds_free(void)
+{
+	size_t i;
+
+	for (i = 0; i < conds_num; i++)
+		free(conds[i].name);
+	free(conds);
+
+	conds     = NULL;
+	conds_num = 0;
+}
+
+static void cond_decode(struct client_cond *cond, char *buf, size_t len)
+{
+	struct init_tlv tlv;
+	size_t off = 0;
+
+	memset(cond, 0, sizeof(*cond));
+	while (off + sizeof(tlv) <= len) {
+		char *val = &buf[off + sizeof(tlv)];
+
+		memcpy(&tlv, &buf[off], sizeof(tlv));
+		if (off + sizeof(tlv) + tlv.len > len)
+			break;
+		off += sizeof(tlv) + INIT_TLV_ALIGN(tlv.len);
+
+		switch (tlv.type) {
+		case INIT_TLV_NAME:
+			cond->name = strndup(val, tlv.len);
+			break;
+		case INIT_TLV_STATE:
+			cond->state = tlv_num(&tlv, val);
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+static int conds_add(char *pkt, size_t len, uint32_t count)
+{
+	struct client_cond *tmp;
+	struct init_tlv tlv;
+	size_t off;
+
+	if (!count)
+		return 0;
+
+	tmp = realloc(conds, (conds_num + count) * sizeof(*conds));
+	if (!tmp)
+		return -1;
+	conds = tmp;
+
+	off = sizeof(struct init_svc_hdr);
+	while (count && off + sizeof(tlv) <= len) {
+		memcpy(&tlv, &pkt[off], sizeof(tlv));
+		if (off + sizeof(tlv) + tlv.len > len)
+			break;
+
+		if (tlv.type == INIT_TLV_CONDITION) {
+			cond_decode(&conds[conds_num], &pkt[off + sizeof(tlv)], tlv.len);
+			if (conds[conds_num].name)
+				conds_num++;
+			count--;
+		}
+		off += sizeof(tlv) + INIT_TLV_ALIGN(tlv.len);
+	}
+
+	return 0;
+}
+
+/**
+ * client_cond_list - Fetch asserted conditions
+ * @prefix: Optional condition prefix, e.g. net/, or wildcard
+ * @num:    Pointer to number of conditions returned
+ *
+ * The returned array, in alphabetical order per path component, is
+ * valid until the next call.
+ *
+ * Returns:
+ * Array of @num conditions, or %NULL on error or if none match.
+ */
+struct client_cond *client_cond_list(const char *prefix, size_t *num)
+{
+	struct init_request rq = {
+		.magic = INIT_MAGIC,
+		.cmd   = INIT_CMD_COND_LIST,
+	};
+
+	conds_free();
+	*num = 0;
+
+	if (prefix)
+		strlcpy(rq.data, prefix, sizeof(rq.data));
+	if (client_stream(&rq, conds_add)) {
+		conds_free();
+		return NULL;
+	}
+
+	*num = conds_num;
+
+	return conds;
+}
+
+/* Pass each record in @pkt to @cb, decoded copies are released after */
+static int monitor_decode(char *pkt, size_t len, int (*cb)(svc_t *, struct client_cond *, void *), void *arg)
+{
+	static svc_t svc;
+	struct client_cond cond;
+	struct init_tlv tlv;
+	size_t off;
+	int rc = 0;
+
+	off = sizeof(struct init_svc_hdr);
+	while (!rc && off + sizeof(tlv) <= len) {
+		char *val = &pkt[off + sizeof(tlv)];
+
+		memcpy(&tlv, &pkt[off], sizeof(tlv));
+		if (off + sizeof(tlv) + tlv.len > len)
+			break;
+		off += sizeof(tlv) + INIT_TLV_ALIGN(tlv.len);
+
+		switch (tlv.type) {
+		case INIT_TLV_SVC:
+			svc_decode(&svc, val, tlv.len);
+			rc = cb(&svc, NULL, arg);
+			svc_release(&svc);
+			break;
+
+		case INIT_TLV_CONDITION:
+			cond_decode(&cond, val, tlv.len);
+			if (cond.name)
+				rc = cb(NULL, &cond, arg);
+			free(cond.name);
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	return rc;
+}
+
+/* Milliseconds left until @deadline, CLOCK_MONOTONIC */
+static int msec_left(struct timespec *deadline)
+{
+	struct timespec now;
+	long long msec;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	msec = (deadline->tv_sec - now.tv_sec) * 1000LL +
+		(deadline->tv_nsec - now.tv_nsec) / 1000000;
+
+	return msec > 0 ? (int)msec : 0;
+}
+
+/**
+ * client_monitor - Follow service state and condition changes
+ * @cb:   Callback for each service or condition, see below
+ * @arg:  Optional argument to @cb
+ * @msec: Timeout, or -1 to wait forever
+ *
+ * First @cb is called with the current state of all asserted conditions
+ * and all services, then once with both @svc and @cond %NULL, and after
+ * that for each change, until @cb returns non-zero.  Only one of @svc
+ * and @cond is set, they are only valid during the callback.
+ *
+ * Returns:
+ * The non-zero value from @cb, or -1 with errno set on error, which is
+ * %ETIMEDOUT on timeout, and %ECONNRESET if Finit hung up.
+ */
+int client_monitor(int (*cb)(svc_t *svc, struct client_cond *cond, void *arg), void *arg, int msec)
+{
+	struct init_request rq = {
+		.magic = INIT_MAGIC,
+		.cmd   = INIT_CMD_MONITOR,
+	};
+	struct timespec deadline;
+	int synced = 0, rc = 0;
+	char *pkt;
+
+	if (msec >= 0) {
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_sec  += msec / 1000;
+		deadline.tv_nsec += (msec % 1000) * 1000000L;
+		if (deadline.tv_nsec >= 1000000000L) {
+			deadline.tv_nsec -= 1000000000L;
+			deadline.tv_sec++;
+		}
+	}
+
+	pkt = malloc(INIT_SVC_LIST_PKTSZ);
+	if (!pkt)
+		return -1;
+
+	if (client_connect() == -1) {
+		free(pkt);
+		return -1;
+	}
 
 	if (write(sd, &rq, sizeof(rq)) != sizeof(rq))
 		goto error;
-	if (read(sd, &svc, sizeof(svc)) != sizeof(svc))
-		goto error;
+
+	while (!rc) {
+		struct pollfd pfd = {
+			.fd     = sd,
+			.events = POLLIN,
+		};
+		struct init_svc_hdr hdr;
+		ssize_t len;
+		int n;
+
+		n = poll(&pfd, 1, msec >= 0 ? msec_left(&deadline) : -1);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			goto error;
+		}
+		if (!n) {
+			errno = ETIMEDOUT;
+			goto error;
+		}
+
+		len = read(sd, pkt, INIT_SVC_LIST_PKTSZ);
+		if (len == -1)
+			goto error;
+		if (len < (ssize_t)sizeof(hdr)) {
+			errno = ECONNRESET;
+			goto error;
+		}
+
+		memcpy(&hdr, pkt, sizeof(hdr));
+		if (hdr.version != INIT_SVC_LIST_VERSION) {
+			errno = EPROTO;
+			goto error;
+		}
+
+		rc = monitor_decode(pkt, len, cb, arg);
+		if (!rc && !synced && (hdr.flags & INIT_SVC_LIST_LAST)) {
+			rc = cb(NULL, NULL, arg);
+			synced = 1;
+		}
+	}
 
 	client_disconnect();
-	if (svc.pid < 0)
-		return NULL;
+	free(pkt);
 
-	return &svc;
+	return rc;
 error:
-	warn("Failed communicating with finit, error %d", errno);
+	rc = errno;
 	client_disconnect();
-	sd = -1;
+	free(pkt);
+	errno = rc;
 
-	return NULL;
+	return -1;
+}
+
+/**
+ * client_svc_iterator - Iterate over all services
+ * @first: Set to fetch all services from Finit, restarting the iteration
+ *
+ * Returns:
+ * Next service, or %NULL when done.
+ */
+svc_t *client_svc_iterator(int first)
+{
+	if (first) {
+		if (!client_svc_list(NULL, NULL))
+			return NULL;
+	}
+
+	if (list_pos >= list_num)
+		return NULL;
+
+	return &list[list_pos++];
 }
 
 static svc_t *do_find(int cmd, const char *arg)
@@ -191,7 +962,7 @@ static svc_t *do_find(int cmd, const char *arg)
 	strlcpy(rq.data, arg, sizeof(rq.data));
 	if (write(sd, &rq, sizeof(rq)) != sizeof(rq))
 		goto error;
-	if (read(sd, &svc, sizeof(svc)) != sizeof(svc))
+	if (recv_svc(&svc))
 		goto error;
 
 	client_disconnect();
@@ -35,8 +35,31 @@ int    client_request          (struct init_request *rq, ssize_t len);
 int    client_send             (struct init_request *rq, ssize_t len);
 int    client_command          (int cmd);
 
+/* Boot timeline event, see INIT_TL_* */
+struct client_event {
+	uint64_t  ns;			/* CLOCK_MONOTONIC */
+	int       type;
+	int       arg;
+	int       svctype;
+	char     *name;
+	char     *cond;
+};
+
+/* Asserted condition, see INIT_CMD_COND_LIST */
+struct client_cond {
+	char     *name;
+	int       state;		/* enum cond_state */
+};
+
+svc_t *client_svc_list         (const char *filter, size_t *num);
 svc_t *client_svc_iterator     (int first);
 svc_t *client_svc_find         (const char *arg);
 svc_t *client_svc_find_by_cond (const char *arg);
 
+struct client_event *client_timeline (size_t *num);
+struct client_cond  *client_cond_list(const char *prefix, size_t *num);
+
+int    client_monitor          (int (*cb)(svc_t *svc, struct client_cond *cond, void *arg),
+				void *arg, int msec);
+
 #endif /* FINIT_CLIENT_H_ */
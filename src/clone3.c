@@ -24,6 +24,7 @@
 #include "config.h"
 
 #include <errno.h>
+#include <limits.h>
 #include <sched.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -42,7 +43,18 @@
 #define __NR_clone3 435
 #endif
 
+/* pidfd_send_signal() was added in Linux 5.1, 424 on all archs */
+#ifndef __NR_pidfd_send_signal
+#define __NR_pidfd_send_signal 424
+#endif
+
+/* Stack for the child of call_vfork(), only used until execve() */
+#define VFORK_STACK_SIZE 65536
+
 /* Clone3 flags from linux/sched.h */
+#ifndef CLONE_PIDFD
+#define CLONE_PIDFD 0x00001000
+#endif
 #ifndef CLONE_INTO_CGROUP
 #define CLONE_INTO_CGROUP 0x200000000ULL
 #endif
@@ -63,13 +75,38 @@ struct clone3_args {
 } __attribute__((aligned(8)));
 
 static int use_clone3 = 1;
+static int use_pidfd  = -1;
 
 int has_clone3(void)
 {
 	return use_clone3 == 1;
 }
 
-pid_t call_clone3(uint64_t flags,  int cgroup_fd)
+/*
+ * clone3() with CLONE_PIDFD is from Linux 5.3, but waitid() P_PIDFD is
+ * from 5.4, without it we cannot reap a child without exit signal.
+ */
+static int has_pidfd(void)
+{
+	if (use_pidfd == -1) {
+		siginfo_t info;
+
+		use_pidfd = 1;
+		/* Not a valid fd: EBADF if supported, otherwise EINVAL */
+		if (waitid(P_PIDFD, INT_MAX, &info, WEXITED | WNOHANG) == -1 && errno == EINVAL)
+			use_pidfd = 0;
+	}
+
+	return use_pidfd;
+}
+
+/*
+ * With @pidfd the child is started with CLONE_PIDFD and no exit signal,
+ * so it is not reaped by waitpid(-1) in the SIGCHLD handler, only by
+ * waitid(P_PIDFD, ..., __WALL) when its pidfd becomes readable.  On
+ * fallback to fork() *pidfd is -1 and the child is a regular child.
+ */
+pid_t call_clone3(uint64_t flags,  int cgroup_fd, int *pidfd)
 {
 	struct clone3_args cl = {
 		.flags = flags,
@@ -77,6 +114,9 @@ pid_t call_clone3(uint64_t flags,  int cgroup_fd)
 	};
 	pid_t pid;
 
+	if (pidfd)
+		*pidfd = -1;
+
 	if (!use_clone3)
 		goto fallback;
 
@@ -85,6 +125,12 @@ pid_t call_clone3(uint64_t flags,  int cgroup_fd)
 		cl.cgroup = cgroup_fd;
 	}
 
+	if (pidfd && has_pidfd()) {
+		cl.flags |= CLONE_PIDFD;
+		cl.pidfd = (uint64_t)(uintptr_t)pidfd;
+		cl.exit_signal = 0;
+	}
+
 	pid = syscall(__NR_clone3, &cl, sizeof(cl));
 	if (pid != -1)
 		return pid;
@@ -94,3 +140,32 @@ pid_t call_clone3(uint64_t flags,  int cgroup_fd)
 fallback:
 	return fork();
 }
+
+int pidfd_signal(int pidfd, int sig)
+{
+	return syscall(__NR_pidfd_send_signal, pidfd, sig, NULL, 0);
+}
+
+/*
+ * Start @fn in a child that shares our memory until it calls execve()
+ * or _exit(), like vfork(), and we are suspended until then.  Unlike
+ * fork() nothing is copied, but the child must not touch the heap,
+ * stdio, or anything else in PID 1, only make syscalls.  The child
+ * runs on a static stack, which is safe since we are single threaded
+ * and suspended.  With @pidfd, same as call_clone3().
+ */
+pid_t call_vfork(int (*fn)(void *), void *arg, int *pidfd)
+{
+	static char stack[VFORK_STACK_SIZE] __attribute__((aligned(16)));
+	int flags = CLONE_VM | CLONE_VFORK;
+
+	if (pidfd)
+		*pidfd = -1;
+
+	if (pidfd && has_pidfd())
+		flags |= CLONE_PIDFD;
+	else
+		flags |= SIGCHLD;
+
+	return clone(fn, &stack[sizeof(stack)], flags, arg, pidfd);
+}
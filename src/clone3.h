@@ -26,8 +26,17 @@
 
 #include <stdint.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 
-pid_t call_clone3 (uint64_t flags,  int cgroup_fd);
-int   has_clone3  (void);
+/* For waitid(), from linux/wait.h, since Linux 5.4 */
+#ifndef P_PIDFD
+#define P_PIDFD 3
+#endif
+
+pid_t call_clone3  (uint64_t flags,  int cgroup_fd, int *pidfd);
+int   has_clone3   (void);
+int   pidfd_signal (int pidfd, int sig);
+
+pid_t call_vfork   (int (*fn)(void *), void *arg, int *pidfd);
 
 #endif /* FINIT_CLONE3_H_ */
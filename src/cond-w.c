@@ -22,9 +22,11 @@
  */
 
 #include <dirent.h>
+#include <fnmatch.h>
 #include <ftw.h>
 #include <libgen.h>
 #include <stdio.h>
+#include <sys/stat.h>
 #ifdef _LIBITE_LITE
 # include <libite/lite.h>
 #else
@@ -34,9 +36,72 @@
 #include "finit.h"
 #include "cond.h"
 #include "pid.h"
+#include "private.h"
+#include "schedule.h"
 #include "service.h"
 #include "sm.h"
 
+/*
+ * The authoritative state of all conditions is kept in memory, in PID
+ * 1, and mirrored to the file system under /run/finit/cond for initctl
+ * and other external readers.  Mirror updates are write-behind, queued
+ * on the dirty list and flushed from the event loop.
+ *
+ * Nodes are never freed while Finit runs, a cleared condition is only
+ * set to generation zero.  This means each node also has a stable ID,
+ * used by services to refer to their conditions without string ops,
+ * and each node has a list of the services subscribing to it.
+ *
+ * Besides the hash table, for lookups by name, the nodes also form a
+ * trie of the namespace, one level per path component, e.g., net/eth0
+ * is a child of net.  Clearing net/eth0 clears everything below it,
+ * and initctl cond dump walks all conditions with a given prefix.
+ *
+ * Wildcard conditions, e.g. net/eth?/up or dev/ttyUSB*, are nodes too,
+ * but they are not part of the namespace.  They hang off the node of
+ * their literal prefix, net or dev, and their state is the highest of
+ * all matching conditions.  A change to a condition only needs to
+ * check the wildcards of the nodes on its path to the root.
+ */
+#define COND_HASH_SIZE 256
+
+struct cond {
+	TAILQ_ENTRY(cond) dlink;	/* dirty, mirror needs update */
+	struct cond *next;		/* hash chain */
+	unsigned int hash;
+	unsigned int gen;		/* 0: off, or reconf generation when set */
+	char         oneshot;		/* always on, symlink to reconf in mirror */
+	char         dirty;
+	char         wildcard;		/* in parent's pats list, see cond_match() */
+	int          id;		/* index in cond_vec[] */
+
+	struct cond *parent;		/* trie, root for top level */
+	struct cond *child;		/* first child, sorted by comp */
+	struct cond *sibling;
+	struct cond *pats;		/* wildcards with this node as prefix */
+	const char  *comp;		/* last path component, or the rest of
+					 * a wildcard after its prefix */
+
+	svc_t      **subs;		/* services with this cond, in order */
+	int          nsubs;
+	int          maxsubs;
+
+	char         name[];
+};
+
+static TAILQ_HEAD(, cond) dirty_list = TAILQ_HEAD_INITIALIZER(dirty_list);
+static struct cond *cond_hash[COND_HASH_SIZE];
+static struct cond  root;		/* top of trie, has no name */
+static struct cond **cond_vec;		/* ID -> node */
+static int           cond_num;
+static unsigned int rgen;		/* cached reconf generation */
+
+static int  cond_notify(const char *name);
+static void cond_flush(void *arg);
+static struct wq flush_work = {
+	.cb = cond_flush,
+};
+
 struct cond_boot {
 	TAILQ_ENTRY(cond_boot) link;
 	char *name;
@@ -145,6 +210,541 @@ char *mkcond(svc_t *svc, char *buf, size_t len)
 	return buf;
 }
 
+static unsigned int cond_hashfn(const char *name)
+{
+	unsigned int h = 2166136261u;
+
+	while (*name)
+		h = (h ^ (unsigned char)*name++) * 16777619u;
+
+	return h;
+}
+
+static struct cond *cond_find(const char *name)
+{
+	unsigned int h = cond_hashfn(name);
+	struct cond *c;
+
+	for (c = cond_hash[h % COND_HASH_SIZE]; c; c = c->next) {
+		if (c->hash == h && !strcmp(c->name, name))
+			return c;
+	}
+
+	return NULL;
+}
+
+static struct cond *cond_node(const char *name);
+
+/*
+ * Parent of @name in the trie, optionally created.  For wildcards this
+ * is the node of the path components before the first wildcard.
+ */
+static struct cond *cond_parent(const char *name, const char **comp, int create)
+{
+	const char *end;
+	size_t len;
+
+	end = strpbrk(name, COND_WILDCARD);
+	if (end) {
+		while (end > name && end[-1] != '/')
+			end--;
+		*comp = end;
+	} else {
+		end = strrchr(name, '/');
+		*comp = end ? end + 1 : name;
+	}
+
+	len = *comp - name;
+	if (len < 2)
+		return &root;
+
+	if (!create)
+		return cond_find(strndupa(name, len - 1));
+
+	return cond_node(strndupa(name, len - 1));
+}
+
+/* Children are kept sorted, so walks are in alphabetical order */
+static void cond_link(struct cond *parent, struct cond *c)
+{
+	struct cond **pp;
+
+	if (c->wildcard) {
+		c->sibling = parent->pats;
+		parent->pats = c;
+		return;
+	}
+
+	for (pp = &parent->child; *pp; pp = &(*pp)->sibling) {
+		if (strcmp((*pp)->comp, c->comp) > 0)
+			break;
+	}
+	c->sibling = *pp;
+	*pp = c;
+}
+
+/* Find or create condition node */
+static struct cond *cond_node(const char *name)
+{
+	struct cond *c, *parent;
+	const char *comp;
+	size_t len;
+
+	c = cond_find(name);
+	if (c)
+		return c;
+
+	parent = cond_parent(name, &comp, 1);
+	if (!parent)
+		return NULL;
+
+	if (cond_num % 64 == 0) {
+		struct cond **vec;
+
+		vec = realloc(cond_vec, (cond_num + 64) * sizeof(*vec));
+		if (!vec) {
+			err(1, "Out of memory tracking condition %s", name);
+			return NULL;
+		}
+		cond_vec = vec;
+	}
+
+	len = strlen(name) + 1;
+	c = calloc(1, sizeof(*c) + len);
+	if (!c) {
+		err(1, "Out of memory tracking condition %s", name);
+		return NULL;
+	}
+
+	memcpy(c->name, name, len);
+	c->id = cond_num;
+	cond_vec[cond_num++] = c;
+	c->hash = cond_hashfn(name);
+	c->next = cond_hash[c->hash % COND_HASH_SIZE];
+	cond_hash[c->hash % COND_HASH_SIZE] = c;
+
+	c->wildcard = cond_is_wildcard(name);
+	c->comp     = &c->name[comp - name];
+	c->parent   = parent;
+	cond_link(parent, c);
+
+	return c;
+}
+
+/* Call @cb for each node below @c, depth first, until @cb returns non-zero */
+static int cond_walk_below(struct cond *c, int (*cb)(struct cond *, void *), void *arg)
+{
+	struct cond *n;
+
+	for (n = c->child; n; n = n->sibling) {
+		if (cb(n, arg) || cond_walk_below(n, cb, arg))
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Call @cb for each node below @c that matches @pat, until @cb returns
+ * non-zero.  Each path component of @pat is matched against one level
+ * of the trie, so only matching branches are visited.
+ */
+static int cond_walk_match(struct cond *c, const char *pat, int (*cb)(struct cond *, void *), void *arg)
+{
+	const char *next;
+	struct cond *n;
+	char *comp;
+
+	next = strchr(pat, '/');
+	comp = next ? strndupa(pat, next - pat) : (char *)pat;
+
+	for (n = c->child; n; n = n->sibling) {
+		if (fnmatch(comp, n->comp, 0))
+			continue;
+
+		if (next) {
+			if (cond_walk_match(n, next + 1, cb, arg))
+				return 1;
+		} else if (cb(n, arg)) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static enum cond_state cond_state(struct cond *c);
+
+static int cond_match_cb(struct cond *c, void *arg)
+{
+	enum cond_state *s = arg;
+
+	*s = max(*s, cond_state(c));
+
+	return *s == COND_ON;
+}
+
+/* State of wildcard, the highest state of all matching conditions */
+static enum cond_state cond_match(struct cond *parent, const char *pat)
+{
+	enum cond_state s = COND_OFF;
+
+	if (parent)
+		cond_walk_match(parent, pat, cond_match_cb, &s);
+
+	return s;
+}
+
+static enum cond_state cond_state(struct cond *c)
+{
+	if (!c)
+		return COND_OFF;
+	if (c->wildcard)
+		return cond_match(c->parent, c->comp);
+	if (c->oneshot)
+		return rgen ? COND_ON : COND_OFF;
+	if (!c->gen || !rgen)
+		return COND_OFF;
+
+	return (c->gen == rgen) ? COND_ON : COND_FLUX;
+}
+
+static void cond_dirty(struct cond *c)
+{
+	if (c->dirty)
+		return;
+
+	c->dirty = 1;
+	TAILQ_INSERT_TAIL(&dirty_list, c, dlink);
+	schedule_work(&flush_work);
+}
+
+/* Tell monitor clients, if any, when the state of @c has changed */
+static void cond_event(struct cond *c, enum cond_state prev)
+{
+	enum cond_state next = cond_state(c);
+
+	if (next != prev)
+		api_cond_event(c->name, next);
+}
+
+/* Condition name from path, e.g. /run/finit/cond/pid/foo => pid/foo */
+static const char *cond_name(const char *path)
+{
+	const char *ptr;
+
+	ptr = strstr(path, COND_BASE "/");
+	if (!ptr)
+		return NULL;
+
+	ptr += strlen(COND_BASE) + 1;
+	while (*ptr == '/')
+		ptr++;
+
+	return ptr;
+}
+
+/*
+ * Refresh a condition from the mirror.  Used for conditions managed
+ * by external processes, e.g., keventd and `initctl cond set`, which
+ * are picked up by the sys and usr plugins.  Conditions with pending
+ * writes are skipped, they are newer than the mirror.
+ */
+static void cond_load(const char *name)
+{
+	enum cond_state prev;
+	const char *path;
+	struct cond *c;
+	struct stat st;
+
+	c = cond_node(name);
+	if (!c || c->dirty)
+		return;
+
+	prev = cond_state(c);
+	path = cond_path(name);
+	if (lstat(path, &st)) {
+		c->oneshot = 0;
+		c->gen = 0;
+	} else if (S_ISLNK(st.st_mode)) {
+		c->oneshot = 1;
+		c->gen = rgen;
+	} else if (S_ISREG(st.st_mode)) {
+		c->oneshot = 0;
+		c->gen = cond_get_gen(path);
+	} else {
+		c->oneshot = 0;
+		c->gen = 0;
+	}
+	cond_event(c, prev);
+}
+
+/**
+ * cond_lookup - Get state of condition from in-memory store
+ * @name: Condition name, e.g. pid/syslogd
+ *
+ * This is what cond_get() uses in PID 1, no file system access.  A
+ * wildcard @name is on if any matching condition is on.
+ *
+ * Returns:
+ * The &enum cond_state of @name, %COND_OFF if unknown.
+ */
+enum cond_state cond_lookup(const char *name)
+{
+	struct cond *parent;
+	const char *pat;
+
+	if (cond_is_wildcard(name)) {
+		parent = cond_parent(name, &pat, 0);
+		return cond_match(parent, pat);
+	}
+
+	return cond_state(cond_find(name));
+}
+
+/**
+ * cond_intern - Get ID of condition
+ * @name: Condition name, e.g. net/eth0/up
+ *
+ * Returns:
+ * A stable ID for the condition, or -1 on error.
+ */
+int cond_intern(const char *name)
+{
+	struct cond *c;
+
+	c = cond_node(name);
+	if (!c)
+		return -1;
+
+	return c->id;
+}
+
+/**
+ * cond_get_svc - Get aggregate state of a service's conditions
+ * @svc: Pointer to &svc_t object
+ *
+ * Same as cond_get_agg(svc->cond), but uses the condition IDs and the
+ * program compiled by conf_parse_cond().  Without a program, i.e., a
+ * plain list of conditions, all conditions are AND'ed.  Conditions
+ * that failed to parse are never on.
+ *
+ * Returns:
+ * The &enum cond_state of the conditions in @svc.
+ */
+enum cond_state cond_get_svc(svc_t *svc)
+{
+	enum cond_state state[MAX_NUM_SVC_COND];
+	enum cond_state s = COND_ON;
+	int i;
+
+	if (svc->cond_len < 0)
+		return COND_OFF;
+
+	if (!svc->cond_len) {
+		for (i = 0; s && i < svc->cond_num; i++)
+			s = min(s, cond_state(cond_vec[svc->cond_id[i]]));
+
+		return s;
+	}
+
+	for (i = 0; i < svc->cond_num; i++)
+		state[i] = cond_state(cond_vec[svc->cond_id[i]]);
+
+	return cond_expr_eval(svc->cond_op, svc->cond_len, state);
+}
+
+/*
+ * Conditions in if:<cond,!cond> do not take part in cond_get_svc(),
+ * but are checked by svc_enabled(), so a change must step the svc.
+ */
+static void cond_parse_ifstmt(svc_t *svc)
+{
+	char buf[sizeof(svc->ifstmt)];
+	struct cond_expr ce;
+	char *ptr;
+	int i;
+
+	svc->cond_nsub = svc->cond_num;
+	if (svc->ifstmt[0] != '<')
+		return;
+
+	strlcpy(buf, &svc->ifstmt[1], sizeof(buf));
+	ptr = strchr(buf, '>');
+	if (ptr)
+		*ptr = 0;
+
+	if (cond_expr_parse(buf, &ce))
+		return;
+
+	for (i = 0; i < ce.num && svc->cond_nsub < MAX_NUM_SVC_COND; i++) {
+		int id;
+
+		id = cond_intern(ce.name[i]);
+		if (id >= 0)
+			svc->cond_id[svc->cond_nsub++] = id;
+	}
+}
+
+/**
+ * cond_subscribe - Add service to subscriber list of all its conditions
+ * @svc: Pointer to &svc_t object, with pre-parsed condition IDs
+ *
+ * Also subscribes to any conditions in the if:<cond> statement.
+ */
+void cond_subscribe(svc_t *svc)
+{
+	int i;
+
+	cond_parse_ifstmt(svc);
+	for (i = 0; i < svc->cond_nsub; i++) {
+		struct cond *c = cond_vec[svc->cond_id[i]];
+		int j;
+
+		for (j = 0; j < c->nsubs; j++) {
+			if (c->subs[j] == svc)
+				break;
+		}
+		if (j < c->nsubs)
+			continue;
+
+		if (c->nsubs == c->maxsubs) {
+			int max = c->maxsubs ? c->maxsubs * 2 : 4;
+			svc_t **subs;
+
+			subs = realloc(c->subs, max * sizeof(*subs));
+			if (!subs) {
+				err(1, "Out of memory subscribing %s to %s", svc_ident(svc, NULL, 0), c->name);
+				continue;
+			}
+			c->subs = subs;
+			c->maxsubs = max;
+		}
+
+		c->subs[c->nsubs++] = svc;
+	}
+}
+
+/**
+ * cond_unsubscribe - Remove service from subscriber list of all its conditions
+ * @svc: Pointer to &svc_t object
+ */
+void cond_unsubscribe(svc_t *svc)
+{
+	int i;
+
+	for (i = 0; i < svc->cond_nsub; i++) {
+		struct cond *c = cond_vec[svc->cond_id[i]];
+		int j;
+
+		for (j = 0; j < c->nsubs; j++) {
+			if (c->subs[j] != svc)
+				continue;
+
+			c->nsubs--;
+			memmove(&c->subs[j], &c->subs[j + 1], (c->nsubs - j) * sizeof(*c->subs));
+			break;
+		}
+	}
+	svc->cond_nsub = 0;
+}
+
+/* Generation of the current subscriber walk, see svc->subs_gen */
+static unsigned int subs_gen;
+
+/* Add subscribers of wildcard @c to @subs, unless already marked */
+static int cond_subs_add(struct cond *c, svc_t **subs, int num)
+{
+	int i;
+
+	for (i = 0; i < c->nsubs; i++) {
+		svc_t *svc = c->subs[i];
+
+		if (svc->subs_gen == subs_gen)
+			continue;
+
+		svc->subs_gen = subs_gen;
+		subs[num++] = svc;
+	}
+
+	return num;
+}
+
+/**
+ * cond_foreach_subscriber - Run callback for each service subscribing to a condition
+ * @name: Condition name
+ * @cb:   Callback
+ * @arg:  Optional argument to callback
+ *
+ * The callback is free to change the set of subscribers, it is called
+ * for a snapshot of the subscribers of @name, including subscribers of
+ * wildcards matching @name.  Services that have been deleted by
+ * svc_del() in the meantime are skipped.
+ *
+ * Returns:
+ * Number of subscribers, i.e., number of services affected by @name.
+ */
+int cond_foreach_subscriber(const char *name, void (*cb)(svc_t *, void *), void *arg)
+{
+	struct cond *c, *a, *p;
+	svc_t **subs;
+	int i, num;
+	int wild;
+
+	if (!name)
+		return 0;
+
+	c = cond_find(name);
+	if (!c)
+		return 0;
+
+	/* Wildcards on the path to the root that match */
+	num = c->nsubs;
+	for (a = c->parent; a; a = a->parent) {
+		for (p = a->pats; p; p = p->sibling) {
+			if (p->nsubs && !fnmatch(p->name, name, FNM_PATHNAME))
+				num += p->nsubs;
+		}
+	}
+	if (!num)
+		return 0;
+	wild = num > c->nsubs;
+
+	subs = malloc(num * sizeof(*subs));
+	if (!subs) {
+		err(1, "Out of memory walking subscribers of %s", name);
+		return 0;
+	}
+
+	/* Subscribers of a condition are unique, see cond_subscribe() */
+	memcpy(subs, c->subs, c->nsubs * sizeof(*subs));
+	num = c->nsubs;
+
+	/* A service may also subscribe to matching wildcards, mark the rest */
+	if (wild) {
+		if (!++subs_gen)
+			subs_gen++;
+		for (i = 0; i < num; i++)
+			subs[i]->subs_gen = subs_gen;
+
+		for (a = c->parent; a; a = a->parent) {
+			for (p = a->pats; p; p = p->sibling) {
+				if (p->nsubs && !fnmatch(p->name, name, FNM_PATHNAME))
+					num = cond_subs_add(p, subs, num);
+			}
+		}
+	}
+
+	for (i = 0; i < num; i++) {
+		if (!subs[i]->hlive)
+			continue;
+		cb(subs[i], arg);
+	}
+	free(subs);
+
+	return num;
+}
+
 static int cond_set_gen(const char *file, unsigned int gen)
 {
 	char *ptr, path[256];
@@ -166,13 +766,12 @@ static int cond_set_gen(const char *file, unsigned int gen)
 
 static void cond_bump_reconf(void)
 {
-	unsigned int rgen;
-
 	/*
 	 * If %_PATH_RECONF does not exist, cond_get_gen() returns 0
 	 * meaning that rgen++ is always what we want.
 	 */
-	rgen = cond_get_gen(_PATH_RECONF);
+	if (!rgen)
+		rgen = cond_get_gen(_PATH_RECONF);
 	rgen++;
 
 	if (cond_set_gen(_PATH_RECONF, rgen))
@@ -241,40 +840,143 @@ static void cond_delpath(const char *path)
 	}
 }
 
-int cond_set_path(const char *path, enum cond_state next)
+/* Remove mirror of condition, and anything below it, without updates */
+static int do_remove(const char *fpath, const struct stat *sb, int tflag, struct FTW *ftw)
+{
+	(void)sb;
+	(void)tflag;
+	(void)ftw;
+
+	if (remove(fpath) && errno != ENOENT)
+		err(1, "Failed removing condition %s", fpath);
+
+	return 0;
+}
+
+static void cond_mirror(struct cond *c)
+{
+	const char *path;
+	struct stat st;
+
+	path = cond_path(c->name);
+	if (c->oneshot) {
+		if (cond_checkpath(path))
+			return;
+
+		if (!lstat(path, &st) && S_ISREG(st.st_mode))
+			unlink(path);
+		if (symlink(_PATH_RECONF, path) && errno != EEXIST)
+			err(1, "Failed creating oneshot cond %s", c->name);
+		return;
+	}
+
+	if (c->gen) {
+		if (cond_checkpath(path))
+			return;
+
+		/* Never write through a oneshot symlink to reconf */
+		if (!lstat(path, &st) && S_ISLNK(st.st_mode))
+			unlink(path);
+		if (cond_set_gen(path, c->gen))
+			err(1, "Failed writing condition %s", c->name);
+		return;
+	}
+
+	if (unlink(path)) {
+		switch (errno) {
+		case ENOENT:
+			break;
+		case EISDIR:
+			nftw(path, do_remove, 20, FTW_DEPTH | FTW_PHYS);
+			break;
+		default:
+			err(1, "Failed removing condition '%s'", path);
+			break;
+		}
+	}
+}
+
+/* Write-behind of dirty conditions to the file system mirror */
+static void cond_flush(void *arg)
+{
+	struct cond *c;
+
+	(void)arg;
+
+	while ((c = TAILQ_FIRST(&dirty_list))) {
+		TAILQ_REMOVE(&dirty_list, c, dlink);
+		c->dirty = 0;
+		cond_mirror(c);
+	}
+}
+
+static int cond_clear_cb(struct cond *c, void *arg)
 {
 	enum cond_state prev;
-	unsigned int rgen;
 
-	dbg("%s <= %d", path, next);
-	prev = cond_get_path(path);
+	(void)arg;
+
+	if (!c->gen && !c->oneshot)
+		return 0;
+
+	prev = cond_state(c);
+	c->gen = 0;
+	c->oneshot = 0;
+	cond_dirty(c);
+	cond_event(c, prev);
+
+	if (!sm_in_reload())
+		cond_notify(c->name);
+
+	return 0;
+}
+
+/*
+ * Clearing a condition also clears all conditions below it, e.g.,
+ * net/eth0 clears net/eth0/up, net/eth0/running, etc.
+ */
+static void cond_clear_below(struct cond *c)
+{
+	cond_walk_below(c, cond_clear_cb, NULL);
+}
+
+static int cond_store(const char *name, enum cond_state next)
+{
+	enum cond_state prev;
+	struct cond *c;
+
+	c = cond_node(name);
+	if (!c)
+		return 0;
+	if (c->wildcard) {
+		errx(1, "Cannot set or clear wildcard condition %s", name);
+		return 0;
+	}
 
+	prev = cond_state(c);
 	switch (next) {
 	case COND_ON:
-		if (cond_checkpath(path))
-		    return 0;
-
-		rgen = cond_get_gen(_PATH_RECONF);
 		if (!rgen) {
-			errx(1, "Unable to read configuration generation (%s)", path);
+			errx(1, "Unable to read configuration generation (%s)", name);
 			return -1;
 		}
-		cond_set_gen(path, rgen);
+		if (c->gen == rgen && !c->oneshot)
+			break;
+
+		c->oneshot = 0;
+		c->gen = rgen;
+		cond_dirty(c);
+		cond_event(c, prev);
 		break;
 
 	case COND_OFF:
-		if (unlink(path)) {
-			switch (errno) {
-			case ENOENT:
-				break;
-			case EISDIR:
-				cond_delpath(path);
-				break;
-			default:
-				err(1, "Failed removing condition '%s'", path);
-				break;
-			}
+		if (c->gen || c->oneshot) {
+			c->oneshot = 0;
+			c->gen = 0;
+			cond_dirty(c);
+			cond_event(c, prev);
 		}
+		cond_clear_below(c);
 		break;
 
 	default:
@@ -285,29 +987,49 @@ int cond_set_path(const char *path, enum cond_state next)
 	return next != prev;
 }
 
-/* Should only be used by cond_set*(), cond_clear(), and usr/sys plugins! */
-int cond_update(const char *name)
+int cond_set_path(const char *path, enum cond_state next)
 {
-	svc_t *svc, *iter = NULL;
-	int affects = 0;
+	const char *name;
 
-//	dbg("%s", name);
-	for (svc = svc_iterator(&iter, 1); svc; svc = svc_iterator(&iter, 0)) {
-		if (!svc_has_cond(svc) || !cond_affects(name, svc->cond))
-			continue;
+	dbg("%s <= %d", path, next);
+	name = cond_name(path);
+	if (!name || !name[0]) {
+		errx(1, "Invalid condition path %s", path);
+		return 0;
+	}
 
-		affects++;
-		dbg("%s: match <%s> %s(%s)", name ?: "nil", svc->cond, svc->desc, svc->cmd);
-		/* Fix bug #314: race condition between crashing services and conditions */
-		if (svc_is_restart(svc) && cond_get_agg(svc->cond) == COND_OFF) {
-			dbg("%s: cancel timer & unblock => WAITING state.", name ?: "nil");
-			service_timeout_cancel(svc);
-			svc_unblock(svc);
-		}
-		service_step(svc);
+	return cond_store(name, next);
+}
+
+static void cond_step(svc_t *svc, void *arg)
+{
+	const char *name = arg;
+
+	dbg("%s: match <%s> %s(%s)", name, svc->cond, svc->desc, svc->cmd);
+	/* Fix bug #314: race condition between crashing services and conditions */
+	if (svc_has_cond(svc) && svc_is_restart(svc) && cond_get_svc(svc) == COND_OFF) {
+		dbg("%s: cancel timer & unblock => WAITING state.", name);
+		service_timeout_cancel(svc);
+		svc_unblock(svc);
 	}
+	service_step(svc);
+}
 
-	return affects;
+/* Step all services affected by a change in condition @name */
+static int cond_notify(const char *name)
+{
+	return cond_foreach_subscriber(name, cond_step, (void *)name);
+}
+
+/* Should only be used by usr/sys plugins, refreshes @name from file system! */
+int cond_update(const char *name)
+{
+	if (!name)
+		return 0;
+
+	cond_load(name);
+
+	return cond_notify(name);
 }
 
 int cond_set_noupdate(const char *name)
@@ -316,7 +1038,7 @@ int cond_set_noupdate(const char *name)
 	if (string_compare(name, "nop"))
 		return 1;
 
-	if (!cond_set_path(cond_path(name), COND_ON))
+	if (!cond_store(name, COND_ON))
 		return 1;
 
 	return 0;
@@ -328,27 +1050,34 @@ void cond_set(const char *name)
 	if (cond_set_noupdate(name))
 		return;
 
-	cond_update(name);
+	cond_notify(name);
 }
 
 int cond_set_oneshot_noupdate(const char *name)
 {
-	const char *path;
+	struct cond *c;
 
 	if (string_compare(name, "nop"))
 		return 1;
 
-	path = cond_path(name);
-	dbg("%s => %s", name, path);
-
-	if (cond_checkpath(path))
+	dbg("%s", name);
+	c = cond_node(name);
+	if (!c)
 		return 1;
-
-	if (symlink(_PATH_RECONF, path) && errno != EEXIST) {
-		err(1, "Failed creating onshot cond %s", name);
+	if (c->wildcard) {
+		errx(1, "Cannot set wildcard condition %s", name);
 		return 1;
 	}
 
+	if (!c->oneshot) {
+		enum cond_state prev = cond_state(c);
+
+		c->oneshot = 1;
+		c->gen = rgen;
+		cond_dirty(c);
+		cond_event(c, prev);
+	}
+
 	return 0;
 }
 
@@ -358,7 +1087,7 @@ void cond_set_oneshot(const char *name)
 	if (cond_set_oneshot_noupdate(name))
 		return;
 
-	cond_update(name);
+	cond_notify(name);
 }
 
 int cond_clear_noupdate(const char *name)
@@ -367,7 +1096,7 @@ int cond_clear_noupdate(const char *name)
 	if (string_compare(name, "nop"))
 		return 1;
 
-	if (!cond_set_path(cond_path(name), COND_OFF))
+	if (!cond_store(name, COND_OFF))
 		return 1;
 
 	return 0;
@@ -379,52 +1108,114 @@ void cond_clear(const char *name)
 	if (cond_clear_noupdate(name))
 		return;
 
-	cond_update(name);
+	cond_notify(name);
+}
+
+/* Conditions set in the previous generation, @arg, are now in flux */
+static int cond_flux_cb(struct cond *c, void *arg)
+{
+	if (!c->oneshot && c->gen == *(unsigned int *)arg)
+		api_cond_event(c->name, COND_FLUX);
+
+	return 0;
 }
 
 void cond_reload(void)
 {
+	unsigned int prev;
+
 	dbg("");
 
 	cond_bump_reconf();
+
+	prev = rgen - 1;
+	if (prev)
+		cond_walk_below(&root, cond_flux_cb, &prev);
 }
 
-static int do_assert(const char *fpath, const struct stat *sb, int tflg, struct FTW *ftw, int set)
+struct cond_walk {
+	const char *prefix;
+	size_t      len;
+	int       (*cb)(const char *name, enum cond_state state, void *arg);
+	void       *arg;
+};
+
+/*
+ * Trie node to start a prefix walk from, the node of all complete path
+ * components in @prefix, e.g., net for both net/ and net/eth
+ */
+static struct cond *cond_prefix(const char *prefix)
 {
-	char *nm;
+	const char *slash;
 
-	(void)sb;
+	slash = strrchr(prefix, '/');
+	if (!slash || slash == prefix)
+		return &root;
 
-	if (ftw->level == 0)
-		return 1;
+	return cond_find(strndupa(prefix, slash - prefix));
+}
 
-	if (tflg != FTW_F)
+static int cond_walk_cb(struct cond *c, void *arg)
+{
+	struct cond_walk *w = arg;
+
+	if (!c->gen && !c->oneshot)
+		return 0;
+	if (w->len && strncmp(c->name, w->prefix, w->len))
 		return 0;
 
-	nm = strstr((char *)fpath, COND_BASE);
-	if (!nm) {
-		errx(1, "Incorrect condition path %s, cannot %sassert", fpath, set ? "re" : "de");
-		return 1;
+	return w->cb(c->name, cond_state(c), w->arg);
+}
+
+/**
+ * cond_walk - Call a function for each asserted condition
+ * @prefix: Condition name prefix, e.g. net/ or pid/foo, or a wildcard
+ * @cb:     Callback, return non-zero to stop the walk
+ * @arg:    Optional argument to callback
+ *
+ * Conditions are walked in alphabetical order, per path component,
+ * only the branch of the trie for @prefix is visited.  A wildcard
+ * @prefix, e.g. net/eth?/up, must match the whole name.
+ *
+ * Returns:
+ * Non-zero if stopped by @cb, otherwise zero.
+ */
+int cond_walk(const char *prefix, int (*cb)(const char *, enum cond_state, void *), void *arg)
+{
+	struct cond_walk w = {
+		.prefix = prefix ? prefix : "",
+		.cb     = cb,
+		.arg    = arg,
+	};
+	struct cond *c;
+
+	if (cond_is_wildcard(w.prefix)) {
+		const char *pat;
+
+		c = cond_parent(w.prefix, &pat, 0);
+		if (!c)
+			return 0;
+
+		return cond_walk_match(c, pat, cond_walk_cb, &w);
 	}
 
-	nm += strlen(COND_BASE);
-	dbg("%sasserting %s => %s", set ? "Re" : "De", fpath, nm);
-	if (set)
-		cond_set(nm);
-	else
-		cond_clear_noupdate(nm); /* important, see netlink plugin! */
+	c = cond_prefix(w.prefix);
+	if (!c)
+		return 0;
+	w.len = strlen(w.prefix);
 
-	return 0;
+	return cond_walk_below(c, cond_walk_cb, &w);
 }
 
-static int reassert(const char *fpath, const struct stat *sb, int tflg, struct FTW *ftw)
+static int cond_reassert_cb(const char *name, enum cond_state state, void *arg)
 {
-	return do_assert(fpath, sb, tflg, ftw, 1);
-}
+	(void)state;
+	(void)arg;
 
-static int deassert(const char *fpath, const struct stat *sb, int tflg, struct FTW *ftw)
-{
-	return do_assert(fpath, sb, tflg, ftw, 0);
+	dbg("Reasserting %s", name);
+	cond_set(name);
+
+	return 0;
 }
 
 /*
@@ -434,7 +1225,18 @@ static int deassert(const char *fpath, const struct stat *sb, int tflg, struct F
 void cond_reassert(const char *pat)
 {
 	dbg("%s", pat);
-	nftw(cond_path(pat), reassert, 20, FTW_DEPTH);
+	cond_walk(pat, cond_reassert_cb, NULL);
+}
+
+static int cond_deassert_cb(const char *name, enum cond_state state, void *arg)
+{
+	(void)state;
+	(void)arg;
+
+	dbg("Deasserting %s", name);
+	cond_clear_noupdate(name); /* important, see netlink plugin! */
+
+	return 0;
 }
 
 /*
@@ -443,7 +1245,7 @@ void cond_reassert(const char *pat)
 void cond_deassert(const char *pat)
 {
 	dbg("%s", pat);
-	nftw(cond_path(pat), deassert, 20, FTW_DEPTH);
+	cond_walk(pat, cond_deassert_cb, NULL);
 }
 
 /*
@@ -470,6 +1272,14 @@ void cond_init(void)
 
 void cond_exit(void)
 {
+	struct cond *c;
+
+	/* Drop any pending writes, the whole mirror is removed */
+	while ((c = TAILQ_FIRST(&dirty_list))) {
+		TAILQ_REMOVE(&dirty_list, c, dlink);
+		c->dirty = 0;
+	}
+
 	cond_delpath(_PATH_COND);
 }
 
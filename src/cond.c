@@ -21,6 +21,10 @@
  * THE SOFTWARE.
  */
 
+#include <ctype.h>
+#include <errno.h>
+#include <fnmatch.h>
+#include <glob.h>
 #include <stdio.h>
 #ifdef _LIBITE_LITE
 # include <libite/lite.h>
@@ -89,25 +93,278 @@ enum cond_state cond_get_path(const char *path)
 	return (cgen == rgen) ? COND_ON : COND_FLUX;
 }
 
+int cond_is_wildcard(const char *name)
+{
+	return name && strpbrk(name, COND_WILDCARD) != NULL;
+}
+
+#ifndef __FINIT__
+/* Highest state of all conditions matching wildcard @name */
+static enum cond_state cond_get_glob(const char *name)
+{
+	enum cond_state s = COND_OFF;
+	glob_t gl;
+	size_t i;
+
+	if (glob(cond_path(name), GLOB_NOSORT, NULL, &gl))
+		return COND_OFF;
+
+	for (i = 0; s != COND_ON && i < gl.gl_pathc; i++)
+		s = max(s, cond_get_path(gl.gl_pathv[i]));
+	globfree(&gl);
+
+	return s;
+}
+#endif
+
 enum cond_state cond_get(const char *name)
 {
+#ifdef __FINIT__
+	/* PID 1 has the authoritative state in memory */
+	return cond_lookup(name);
+#else
+	if (cond_is_wildcard(name))
+		return cond_get_glob(name);
+
 	return cond_get_path(cond_path(name));
+#endif
 }
 
-enum cond_state cond_get_agg(const char *names)
+/*
+ * Recursive descent parser for condition expressions:
+ *
+ *     expr   := term { '|' term }
+ *     term   := factor { ('&' | ',') factor }
+ *     factor := '!' factor | '(' expr ')' | ['~'] name
+ */
+struct cond_parser {
+	const char       *pos;
+	struct cond_expr *ce;
+	size_t            used;		/* of ce->buf[] */
+	int               err;
+};
+
+static int parse_expr(struct cond_parser *p);
+
+static void parse_skip(struct cond_parser *p)
 {
-	enum cond_state s = COND_ON;
+	while (isspace((unsigned char)*p->pos))
+		p->pos++;
+}
 
-	if (names) {
-		char conds[strlen(names) + 1];
-		const char *cond;
+static int parse_emit(struct cond_parser *p, int op)
+{
+	struct cond_expr *ce = p->ce;
 
-		strlcpy(conds, names, sizeof(conds));
-		for (cond = strtok(conds, ","); s && cond; cond = strtok(NULL, ","))
-			s = min(s, cond_get(cond));
+	if (ce->len >= MAX_COND_EXPR) {
+		p->err = E2BIG;
+		return -1;
 	}
+	ce->op[ce->len++] = op;
 
-	return s;
+	return 0;
+}
+
+static int parse_name(struct cond_parser *p)
+{
+	struct cond_expr *ce = p->ce;
+	const char *name;
+	size_t len;
+	int i;
+
+	if (*p->pos == '~') {
+		ce->reload = 1;
+		p->pos++;
+	}
+
+	name = p->pos;
+	len = strcspn(name, COND_EXPR_DELIM " \t");
+	if (!len)
+		return -1;
+	p->pos += len;
+
+	for (i = 0; i < ce->num; i++) {
+		if (!strncmp(ce->name[i], name, len) && !ce->name[i][len])
+			return parse_emit(p, i);
+	}
+
+	if (ce->num >= MAX_NUM_SVC_COND || p->used + len + 1 > sizeof(ce->buf)) {
+		p->err = E2BIG;
+		return -1;
+	}
+
+	ce->name[ce->num] = &ce->buf[p->used];
+	memcpy(ce->name[ce->num], name, len);
+	ce->name[ce->num][len] = 0;
+	p->used += len + 1;
+
+	return parse_emit(p, ce->num++);
+}
+
+static int parse_factor(struct cond_parser *p)
+{
+	parse_skip(p);
+	switch (*p->pos) {
+	case '!':
+		p->pos++;
+		p->ce->plain = 0;
+		if (parse_factor(p))
+			return -1;
+		return parse_emit(p, COND_OP_NOT);
+
+	case '(':
+		p->pos++;
+		if (parse_expr(p))
+			return -1;
+		parse_skip(p);
+		if (*p->pos != ')')
+			return -1;
+		p->pos++;
+		return 0;
+
+	default:
+		return parse_name(p);
+	}
+}
+
+static int parse_term(struct cond_parser *p)
+{
+	if (parse_factor(p))
+		return -1;
+
+	while (1) {
+		parse_skip(p);
+		if (*p->pos != '&' && *p->pos != ',')
+			return 0;
+		p->pos++;
+
+		if (parse_factor(p) || parse_emit(p, COND_OP_AND))
+			return -1;
+	}
+}
+
+static int parse_expr(struct cond_parser *p)
+{
+	if (parse_term(p))
+		return -1;
+
+	while (1) {
+		parse_skip(p);
+		if (*p->pos != '|')
+			return 0;
+		p->pos++;
+		p->ce->plain = 0;
+
+		if (parse_term(p) || parse_emit(p, COND_OP_OR))
+			return -1;
+	}
+}
+
+/**
+ * cond_expr_parse - Compile a condition expression
+ * @expr: Conditions, e.g. "pid/zebra,(net/eth0/up|net/eth1/up)"
+ * @ce:   Compiled expression, names point into @ce
+ *
+ * Conditions are combined with '&' (or ','), '|', and '!', grouped
+ * with parentheses.  A '~' prefix on a condition sets @ce->reload.
+ * An empty @expr has no conditions and evaluates to %COND_ON.
+ *
+ * Returns:
+ * 0 on success, or -1 with errno set on syntax error, or if there are
+ * too many conditions.
+ */
+int cond_expr_parse(const char *expr, struct cond_expr *ce)
+{
+	struct cond_parser p = {
+		.pos = expr,
+		.ce  = ce,
+	};
+
+	ce->num    = 0;
+	ce->len    = 0;
+	ce->plain  = 1;
+	ce->reload = 0;
+
+	if (!expr) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	parse_skip(&p);
+	if (!*p.pos)
+		return 0;
+
+	if (parse_expr(&p))
+		goto fail;
+
+	parse_skip(&p);
+	if (*p.pos)
+		goto fail;
+
+	return 0;
+fail:
+	errno = p.err ? p.err : EINVAL;
+	return -1;
+}
+
+/**
+ * cond_expr_eval - Evaluate compiled condition expression
+ * @op:    Program from cond_expr_parse()
+ * @len:   Number of ops in @op
+ * @state: State of each condition operand
+ *
+ * Three-valued logic: AND is the lowest state of its operands, OR the
+ * highest, and NOT swaps on and off, a condition in flux stays in flux.
+ *
+ * Returns:
+ * The &enum cond_state of the expression, %COND_ON if empty.
+ */
+enum cond_state cond_expr_eval(const signed char *op, int len, const enum cond_state *state)
+{
+	enum cond_state stack[MAX_COND_EXPR];
+	int i, sp = 0;
+
+	for (i = 0; i < len; i++) {
+		switch (op[i]) {
+		case COND_OP_AND:
+			sp--;
+			stack[sp - 1] = min(stack[sp - 1], stack[sp]);
+			break;
+		case COND_OP_OR:
+			sp--;
+			stack[sp - 1] = max(stack[sp - 1], stack[sp]);
+			break;
+		case COND_OP_NOT:
+			stack[sp - 1] = COND_ON - stack[sp - 1];
+			break;
+		default:
+			stack[sp++] = state[(int)op[i]];
+			break;
+		}
+	}
+
+	return sp ? stack[0] : COND_ON;
+}
+
+/*
+ * Aggregate state of a condition expression, as seen by initctl.  An
+ * invalid expression is never on, same as cond_get_svc() in PID 1.
+ */
+enum cond_state cond_get_agg(const char *names)
+{
+	enum cond_state state[MAX_NUM_SVC_COND];
+	struct cond_expr ce;
+	int i;
+
+	if (!names)
+		return COND_ON;
+	if (cond_expr_parse(names, &ce))
+		return COND_OFF;
+
+	for (i = 0; i < ce.num; i++)
+		state[i] = cond_get(ce.name[i]);
+
+	return cond_expr_eval(ce.op, ce.len, state);
 }
 
 int cond_affects(const char *name, const char *names)
@@ -119,9 +376,11 @@ int cond_affects(const char *name, const char *names)
 		return 0;
 
 	strlcpy(conds, names, sizeof(conds));
-	for (cond = strtok(conds, ","); cond; cond = strtok(NULL, ",")) {
+	for (cond = strtok(conds, COND_EXPR_DELIM); cond; cond = strtok(NULL, COND_EXPR_DELIM)) {
 		if (!strcmp(cond, name))
 			return 1;
+		if (cond_is_wildcard(cond) && !fnmatch(cond, name, FNM_PATHNAME))
+			return 1;
 	}
 
 	return 0;
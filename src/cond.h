@@ -24,6 +24,31 @@ typedef enum cond_state {
 	COND_ON
 } cond_state_t;
 
+/* Operators in condition expressions, ',' is the same as '&' */
+#define COND_EXPR_DELIM ",&|!()"
+
+/* Condition names with any of these are wildcards, see fnmatch(3) */
+#define COND_WILDCARD   "*?["
+
+#define COND_OP_AND    -1
+#define COND_OP_OR     -2
+#define COND_OP_NOT    -3
+
+/*
+ * Condition expression compiled by cond_expr_parse().  The program in
+ * op[] is in postfix order, operands are indexes into name[], which
+ * holds each unique condition once.
+ */
+struct cond_expr {
+	int          num;		/* Conditions in name[] */
+	int          len;		/* Ops in op[] */
+	int          plain;		/* Only AND, no OR or NOT */
+	int          reload;	/* Any condition with '~' prefix */
+	signed char  op[MAX_COND_EXPR];
+	char        *name[MAX_NUM_SVC_COND];
+	char         buf[MAX_COND_LEN];
+};
+
 char           *mkcond       (svc_t *svc, char *buf, size_t len);
 const char     *condstr      (enum cond_state s);
 const char     *cond_path    (const char *name);
@@ -31,8 +56,19 @@ unsigned int    cond_get_gen (const char *path);
 enum cond_state cond_get_path(const char *path);
 enum cond_state cond_get     (const char *name);
 enum cond_state cond_get_agg (const char *names);
+int             cond_is_wildcard(const char *name);
+int             cond_expr_parse(const char *expr, struct cond_expr *ce);
+enum cond_state cond_expr_eval (const signed char *op, int len, const enum cond_state *state);
 int             cond_affects (const char *name, const char *names);
 
+enum cond_state cond_lookup   (const char *name);
+int             cond_intern   (const char *name);
+enum cond_state cond_get_svc  (svc_t *svc);
+void            cond_subscribe  (svc_t *svc);
+void            cond_unsubscribe(svc_t *svc);
+int             cond_foreach_subscriber(const char *name, void (*cb)(svc_t *, void *), void *arg);
+int             cond_walk     (const char *prefix, int (*cb)(const char *, enum cond_state, void *), void *arg);
+
 void cond_boot_parse  (char *arg);
 int  cond_update      (const char *name);
 int  cond_set_path    (const char *path, enum cond_state new);
@@ -44,8 +44,11 @@
 #include "iwatch.h"
 #include "private.h"
 #include "service.h"
+#include "sock.h"
+#include "spawn.h"
 #include "tty.h"
 #include "helpers.h"
+#include "logmux.h"
 #include "util.h"
 
 #define BOOTSTRAP (runlevel == INIT_LEVEL)
@@ -72,6 +75,8 @@ char *osheading = NULL;
 
 int logfile_size_max = 200000;	/* 200 kB */
 int logfile_count_max = 5;
+int logfile_buffer = 0;		/* Flush every line */
+int logfile_fsync = LOG_FSYNC_INTERVAL;
 
 struct env_entry {
 	TAILQ_ENTRY(env_entry) link;
@@ -414,6 +419,7 @@ void conf_reset_env(void)
 		setenv("SHELL", _PATH_BSHELL, 1);
 	setenv("LOGNAME", "root", 1);
 	setenv("USER", "root", 1);
+	spawn_flush();
 }
 
 /*
@@ -601,6 +607,7 @@ static void parse_env(char *line)
 
 	dbg("Global env '%s'='%s'", key, val);
 	setenv(key, val, 1);
+	spawn_flush();
 
 	node = malloc(sizeof(*node));
 	if (!node) {
@@ -698,8 +705,23 @@ int conf_parse_runlevels(char *runlevels)
 	return bitmask;
 }
 
+/*
+ * Fail closed on invalid conditions, the service must not start without
+ * them, or keep running with an old set after a reload.  It is marked
+ * missing and its conditions are never satisfied, see cond_get_svc().
+ */
+static void conf_cond_invalid(svc_t *svc, const char *cond)
+{
+	cond_unsubscribe(svc);
+	svc->cond_num = 0;
+	svc->cond_len = -1;
+	strlcpy(svc->cond, cond, sizeof(svc->cond));
+	svc_missing(svc);
+}
+
 void conf_parse_cond(svc_t *svc, char *cond)
 {
+	struct cond_expr ce;
 	size_t i = 0;
 	char *ptr;
 	char *c;
@@ -714,7 +736,11 @@ void conf_parse_cond(svc_t *svc, char *cond)
 		svc->sighup = 1;
 
 	if (!cond) {
+		cond_unsubscribe(svc);
+		svc->cond_num = 0;
+		svc->cond_len = 0;
 		memset(svc->cond, 0, sizeof(svc->cond));
+		cond_subscribe(svc);
 		return;
 	}
 
@@ -742,29 +768,67 @@ void conf_parse_cond(svc_t *svc, char *cond)
 
 	if (i >= sizeof(svc->cond)) {
 		logit(LOG_WARNING, "%s: too long list of conditions: %s", svc_ident(svc, NULL, 0), ptr);
+		conf_cond_invalid(svc, ptr);
 		return;
 	}
 
+	/*
+	 * Conditions are AND'ed, with ',' or '&', or OR'ed with '|', can
+	 * be negated with '!', and grouped with parentheses.  Compiled
+	 * once here, to a program over condition IDs for cond_get_svc().
+	 * Syntax: <pid/foo,(net/eth0/up|net/eth1/up),!usr/maint>
+	 */
+	if (cond_expr_parse(ptr, &ce)) {
+		logit(LOG_WARNING, "%s: %s conditions <%s>", svc_ident(svc, NULL, 0),
+		      errno == E2BIG ? "too many" : "invalid", ptr);
+		conf_cond_invalid(svc, ptr);
+		return;
+	}
+
+	/* Drop any previous condition IDs and subscriptions */
+	cond_unsubscribe(svc);
+	svc->cond_num = 0;
+	svc->cond_len = 0;
+
 	/*
 	 * The '~' prefix means a reload of the upstream service is
 	 * propagated to this service -- it will be reloaded (SIGHUP)
 	 * or restarted (noreload), not just paused and resumed.
 	 * Syntax: <!~pid/foo,~pid/bar> or <~pid/foo>
 	 *
-	 * Strip '~' from each condition and set the service-level
-	 * flag.  This allows '~' on any condition in the list.
+	 * The parser strips '~' from each condition, it is a service-
+	 * level flag.  This allows '~' on any condition in the list.
 	 */
-	svc->cond[0] = 0;
-	for (i = 0, c = strtok(ptr, ","); c; c = strtok(NULL, ","), i++) {
-		if (c[0] == '~') {
-			c++;
-			svc->flux_reload = 1;
+	if (ce.reload)
+		svc->flux_reload = 1;
+
+	/* Copy for initctl, without '~' and whitespace */
+	for (c = ptr, i = 0; *c && i < sizeof(svc->cond) - 1; c++) {
+		if (*c == '~' || isspace((unsigned char)*c))
+			continue;
+		svc->cond[i++] = *c;
+	}
+	svc->cond[i] = 0;
+
+	for (i = 0; i < (size_t)ce.num; i++) {
+		svc->cond_id[i] = cond_intern(ce.name[i]);
+		if (svc->cond_id[i] < 0) {
+			logit(LOG_WARNING, "%s: failed adding condition %s", svc_ident(svc, NULL, 0), ce.name[i]);
+			conf_cond_invalid(svc, ptr);
+			return;
 		}
-		devmon_add_cond(c);
-		if (i)
-			strlcat(svc->cond, ",", sizeof(svc->cond));
-		strlcat(svc->cond, c, sizeof(svc->cond));
+		devmon_add_cond(ce.name[i]);
+	}
+	svc->cond_num = i;
+
+	/* Plain AND lists need no program, see cond_get_svc() */
+	if (!ce.plain) {
+		memcpy(svc->cond_op, ce.op, ce.len);
+		svc->cond_len = ce.len;
 	}
+
+	/* Services are stepped only on changes to their conditions */
+	cond_subscribe(svc);
 }
 
 struct rlimit_name {
@@ -990,7 +1054,7 @@ static int parse_static(char *line, int is_rcsd)
 
 	if (MATCH_CMD(line, "log ", x)) {
 		char *tok;
-		static int size = 200000, count = 5;
+		static int size = 200000, count = 5, buffer = 0;
 
 		tok = strtok(x, ":= ");
 		while (tok) {
@@ -998,6 +1062,22 @@ static int parse_static(char *line, int is_rcsd)
 				size = strtobytes(strtok(NULL, ":= "));
 			else if (!strncmp(tok, "count", 5))
 				count = strtobytes(strtok(NULL, ":= "));
+			else if (!strncmp(tok, "buffer", 6))
+				buffer = strtobytes(strtok(NULL, ":= "));
+			else if (!strncmp(tok, "fsync", 5)) {
+				char *arg = strtok(NULL, ":= ");
+
+				if (!arg)
+					break;
+				if (!strcmp(arg, "never"))
+					logfile_fsync = LOG_FSYNC_NEVER;
+				else if (!strcmp(arg, "interval"))
+					logfile_fsync = LOG_FSYNC_INTERVAL;
+				else if (!strcmp(arg, "always"))
+					logfile_fsync = LOG_FSYNC_ALWAYS;
+				else
+					logit(LOG_WARNING, "Invalid log fsync:%s", arg);
+			}
 
 			tok = strtok(NULL, ":= ");
 		}
@@ -1006,10 +1086,28 @@ static int parse_static(char *line, int is_rcsd)
 			logfile_size_max = size;
 		if (count >= 0)
 			logfile_count_max = count;
+		if (buffer >= 0)
+			logfile_buffer = buffer;
 
 		return 0;
 	}
 
+	/*
+	 * Output of services with `log` is read by PID 1, or by one
+	 * logger/logit process per service.  Applies on next start.
+	 */
+	if (MATCH_CMD(line, "log-collector ", x)) {
+		char *token = strip_line(x);
+
+		if (!strcmp(token, "builtin"))
+			log_builtin = 1;
+		else if (!strcmp(token, "external"))
+			log_builtin = 0;
+		else
+			logit(LOG_WARNING, "Invalid log-collector %s", token);
+		return 0;
+	}
+
 	if (MATCH_CMD(line, "shutdown ", x)) {
 		if (sdown) free(sdown);
 		sdown = strdup(strip_line(x));
@@ -1045,6 +1143,63 @@ static int parse_static(char *line, int is_rcsd)
 			readiness = SVC_NOTIFY_NONE;
 	}
 
+	/*
+	 * One notify socket for all notify:systemd services instead of
+	 * one per service.  Only read at bootstrap, the socket path is
+	 * in the environment of already running services.
+	 */
+	if (BOOTSTRAP && MATCH_CMD(line, "notify-socket ", x)) {
+		char *token = strip_line(x);
+
+		if (!strcmp(token, "shared"))
+			notify_shared = 1;
+		else if (!strcmp(token, "private"))
+			notify_shared = 0;
+		else
+			logit(LOG_WARNING, "Invalid notify-socket %s", token);
+		return 0;
+	}
+
+	/*
+	 * Max number of services starting at the same time, 0: no limit
+	 */
+	if (MATCH_CMD(line, "start-concurrency ", x)) {
+		const char *err = NULL;
+		int val;
+
+		val = strtonum(strip_line(x), 0, 1024, &err);
+		if (err)
+			logit(LOG_WARNING, "Invalid start-concurrency %s, %s", x, err);
+		else
+			start_concurrency = val;
+		return 0;
+	}
+
+	/*
+	 * System-wide limit of restarts of crashing services, N[/SEC]
+	 */
+	if (MATCH_CMD(line, "restart-budget ", x)) {
+		const char *err = NULL;
+		char *token, *sec;
+		int num, per = 1;
+
+		token = strip_line(x);
+		sec = strchr(token, '/');
+		if (sec) {
+			*sec++ = 0;
+			per = strtonum(sec, 1, 3600, &err);
+		}
+		if (!err)
+			num = strtonum(token, 0, 10000, &err);
+		if (err) {
+			logit(LOG_WARNING, "Invalid restart-budget %s, %s", x, err);
+		} else {
+			restart_budget = num;
+			restart_budget_sec = per;
+		}
+		return 0;
+	}
+
 	if (MATCH_CMD(line, "reboot-delay ", x)) {
 		syncsec = strtonum(strip_line(x), 0, 60, NULL);
 		return 0;
@@ -1155,6 +1310,12 @@ static int parse_dynamic(char *line, struct rlimit rlimit[], char *file)
 		return 0;
 	}
 
+	/* Listening socket, service is started on first activity */
+	if (MATCH_CMD(line, "socket ", x)) {
+		sock_register(x);
+		return 0;
+	}
+
 	/* Regular or serial TTYs to run getty */
 	if (MATCH_CMD(line, "tty ", x)) {
 		service_register(SVC_TYPE_TTY, strip_line(x), rlimit, file);
@@ -1314,6 +1475,7 @@ int conf_reload(void)
 
 	/* Mark and sweep */
 	cgroup_mark_all();
+	sock_mark_all();
 	svc_mark_dynamic();
 	conf_reset_env();
 
@@ -1460,6 +1622,9 @@ done:
 	/* Remove all unused top-level cgroups */
 	cgroup_cleanup();
 
+	/* Close listening sockets no longer in any .conf */
+	sock_cleanup();
+
 	/* Drop record of all .conf changes */
 	drop_changes();
 
@@ -48,6 +48,8 @@ extern char *osheading;
 
 extern int logfile_size_max;
 extern int logfile_count_max;
+extern int logfile_buffer;
+extern int logfile_fsync;
 
 extern struct rlimit global_rlimit[];
 extern char cgroup_current[];
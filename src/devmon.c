@@ -58,6 +58,37 @@ static struct dev_node *find_node(const char *cond)
 	return NULL;
 }
 
+/* Exact match, or any wildcard node matching device condition @cond */
+static struct dev_node *match_node(const char *cond)
+{
+	struct dev_node *node;
+
+	TAILQ_FOREACH(node, &dev_node_list, link) {
+		if (string_compare(node->name, cond))
+			return node;
+		if (cond_is_wildcard(node->name) && !fnmatch(node->name, cond, FNM_PATHNAME))
+			return node;
+	}
+
+	return NULL;
+}
+
+/* Set conditions of all existing devices matching wildcard @cond */
+static void glob_cond(const char *cond)
+{
+	char path[PATH_MAX];
+	glob_t gl;
+	size_t i;
+
+	snprintf(path, sizeof(path), "/%s", cond);
+	if (glob(path, GLOB_NOSORT, NULL, &gl))
+		return;
+
+	for (i = 0; i < gl.gl_pathc; i++)
+		cond_set(&gl.gl_pathv[i][1]);
+	globfree(&gl);
+}
+
 static void drop_node(struct dev_node *node)
 {
 	if (!node)
@@ -105,6 +136,11 @@ void devmon_add_cond(const char *cond)
 
 	TAILQ_INSERT_TAIL(&dev_node_list, node, link);
 
+	if (cond_is_wildcard(cond)) {
+		glob_cond(cond);
+		return;
+	}
+
 	snprintf(path, sizeof(path), "/%s", cond);
 	if (fexist(path))
 		cond_set(cond);
@@ -124,6 +160,11 @@ void devmon_reconf(void)
 	char path[PATH_MAX];
 
 	TAILQ_FOREACH_SAFE(node, &dev_node_list, link, tmp) {
+		if (cond_is_wildcard(node->name)) {
+			glob_cond(node->name);
+			continue;
+		}
+
 		snprintf(path, sizeof(path), "/%s", node->name);
 		if (fexist(path))
 			cond_set(node->name);
@@ -164,7 +205,7 @@ static void devmon_update_conds(char *dir, char *name, uint32_t mask)
 	cond = &fn[1];
 
 //	dbg("path: %s, mask: %08x, cond: %s", fn, mask, cond);
-	if (!find_node(cond)) {
+	if (!match_node(cond)) {
 //		dbg("unregistered, skipping %s", cond);
 		return;
 	}
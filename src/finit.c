@@ -39,6 +39,9 @@
 #include <sys/sysmacros.h>
 #endif
 #include <sys/prctl.h>
+#ifdef HAVE_SYS_RANDOM_H
+#include <sys/random.h>
+#endif
 #include <paths.h>
 #ifdef _LIBITE_LITE
 # include <libite/lite.h>
@@ -57,6 +60,8 @@
 #include "service.h"
 #include "sig.h"
 #include "sm.h"
+#include "svcmap.h"
+#include "timeline.h"
 #include "tty.h"
 #include "util.h"
 #include "utmp-api.h"
@@ -568,6 +573,38 @@ static int usage(int rc)
 	return rc;
 }
 
+/*
+ * Seed random(), used for restart jitter, once at boot.  Early on the
+ * kernel entropy pool may not be ready, then we fall back to time and
+ * the boot_id, which is unique for each boot.
+ */
+static void seed_random(void)
+{
+	unsigned int seed = 0;
+	struct timespec ts;
+	char buf[64];
+	FILE *fp;
+
+#ifdef HAVE_GETRANDOM
+	if (getrandom(&seed, sizeof(seed), GRND_NONBLOCK) == sizeof(seed)) {
+		srandom(seed);
+		return;
+	}
+#endif
+
+	fp = fopen("/proc/sys/kernel/random/boot_id", "r");
+	if (fp) {
+		if (fgets(buf, sizeof(buf), fp)) {
+			for (char *ptr = buf; *ptr; ptr++)
+				seed = seed * 31 + *ptr;
+		}
+		fclose(fp);
+	}
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	srandom(seed ^ ts.tv_sec ^ ts.tv_nsec);
+}
+
 /*
  * wrapper for old-style init/telinit commands, for compat with
  * /usr/bin/shutdown from sysvinit, and old fingers
@@ -631,6 +668,11 @@ int main(int argc, char *argv[])
 		return EX_NOPERM;
 	}
 
+	/*
+	 * Start of boot timeline, see initctl analyze
+	 */
+	timeline_init();
+
 	/*
 	 * Sanity check critical environment variables.  We need PATH
 	 * and SHELL for early commands like mount in fs_init().
@@ -645,6 +687,11 @@ int main(int argc, char *argv[])
 	 */
 	fs_init();
 
+	/*
+	 * Restart jitter and deferred restarts use random()
+	 */
+	seed_random();
+
 	/*
 	 * Parse /proc/cmdline (debug, rescue, console=, etc.)
 	 */
@@ -752,6 +799,7 @@ int main(int argc, char *argv[])
 
 	dbg("Starting initctl API responder ...");
 	api_init(&loop);
+	svcmap_init();
 
 	dbg("Starting service interval monitor ...");
 	service_init(&loop);
@@ -28,6 +28,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <paths.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sysexits.h>
@@ -94,17 +95,22 @@
 #define INIT_CMD_GET_PLUGINS    14   /* Fill data[] with loaded plugins */
 #define INIT_CMD_PLUGIN_DEPS    15   /* Fill data[] with plugin deps */
 #define INIT_CMD_GET_RUNLEVEL   16
+#define INIT_CMD_GET_STATS      17   /* Fill data[] with struct init_stats */
+#define INIT_CMD_GET_TIMELINE   18   /* Stream boot timeline event records */
+#define INIT_CMD_COND_LIST      19   /* Stream conditions, data[] prefix */
 #define INIT_CMD_REBOOT         20
 #define INIT_CMD_HALT           21
 #define INIT_CMD_POWEROFF       22
 #define INIT_CMD_SUSPEND        23
 #define INIT_CMD_SWITCH_ROOT    24   /* Switch to new root filesystem */
 #define INIT_CMD_WDOG_HELLO     128  /* Watchdog register and hello */
-#define INIT_CMD_SVC_ITER       129
+#define INIT_CMD_SVC_ITER       129  /* Deprecated, see INIT_CMD_SVC_LIST */
 #define INIT_CMD_SVC_QUERY      130
 #define INIT_CMD_SVC_FIND       131
 #define INIT_CMD_SVC_FIND_BYC   132
 #define INIT_CMD_SIGNAL         133
+#define INIT_CMD_SVC_LIST       134  /* Stream svc records, data[] filter */
+#define INIT_CMD_MONITOR        135  /* Stream svc and condition changes */
 #define INIT_CMD_NACK           254
 #define INIT_CMD_ACK            255
 
@@ -117,6 +123,130 @@ struct init_request {
 	char	data[368];
 };
 
+/* Reply to INIT_CMD_GET_STATS, in data[] of struct init_request */
+struct init_stats {
+	unsigned long long steps;	/* Total number of service steps */
+	unsigned int	   steps_sec;	/* Steps during the last second */
+	unsigned int	   sweeps;	/* Full sweeps of all services */
+	unsigned int	   queued;	/* Services queued for stepping */
+	unsigned int	   svc_num;	/* Number of registered services */
+	unsigned int	   svc_size;	/* sizeof(svc_t) */
+	unsigned long long heap;	/* Bytes of heap in use, 0: unknown */
+	unsigned int	   start_max;	/* Max services starting, 0: no limit */
+	unsigned int	   starting;	/* Services holding a start slot */
+	unsigned int	   start_queued; /* Services waiting for a start slot */
+	unsigned int	   log_pipes;	/* Service output pipes read by PID 1 */
+};
+
+/*
+ * Reply to INIT_CMD_SVC_LIST, one or more packets on the API socket.
+ * Each packet starts with a struct init_svc_hdr, followed by records.
+ * A record is a struct init_tlv of type INIT_TLV_SVC with a list of
+ * field TLVs as its value.  Numbers are host endian 32 or 64 bit, and
+ * strings are sent without NUL.  Values are padded to 4 byte boundary.
+ * Readers must skip unknown types, new fields are only ever appended.
+ */
+#define INIT_SVC_LIST_VERSION   1
+#define INIT_SVC_LIST_LAST      1    /* Flag set on last packet of reply */
+#define INIT_SVC_LIST_PKTSZ     8192 /* Max size of a packet */
+
+struct init_svc_hdr {
+	uint16_t version;	/* INIT_SVC_LIST_VERSION		*/
+	uint16_t flags;		/* INIT_SVC_LIST_LAST			*/
+	uint32_t count;		/* Number of records in this packet	*/
+};
+
+struct init_tlv {
+	uint16_t type;
+	uint16_t len;		/* Length of value, excluding padding	*/
+};
+
+#define INIT_TLV_ALIGN(len)     (((len) + 3) & ~3)
+
+enum {
+	INIT_TLV_SVC = 1,	/* Record, value is a list of fields	*/
+	INIT_TLV_JOB,
+	INIT_TLV_NAME,
+	INIT_TLV_ID,
+	INIT_TLV_TYPE,
+	INIT_TLV_STATE,
+	INIT_TLV_BLOCK,
+	INIT_TLV_PID,
+	INIT_TLV_STARTED,
+	INIT_TLV_STATUS,
+	INIT_TLV_START_TIME,
+	INIT_TLV_RUNLEVELS,
+	INIT_TLV_DIRTY,
+	INIT_TLV_REMOVED,
+	INIT_TLV_MANUAL,
+	INIT_TLV_FORKING,
+	INIT_TLV_ONCE,
+	INIT_TLV_RESTART_TOT,
+	INIT_TLV_RESTART_CNT,
+	INIT_TLV_RESTART_MAX,
+	INIT_TLV_FILE,
+	INIT_TLV_COND,
+	INIT_TLV_DESC,
+	INIT_TLV_CMD,
+	INIT_TLV_ARG,		/* One per argument, in order, cmd first */
+	INIT_TLV_ENV,
+	INIT_TLV_PIDFILE,
+	INIT_TLV_USER,
+	INIT_TLV_GROUP,
+	INIT_TLV_NOTIFY,
+	INIT_TLV_EVENT,		/* Record, one INIT_CMD_GET_TIMELINE event */
+	INIT_TLV_EVENT_TYPE,	/* INIT_TL_* */
+	INIT_TLV_EVENT_TIME,	/* CLOCK_MONOTONIC, nanoseconds */
+	INIT_TLV_EVENT_ARG,	/* Runlevel, hook number, PID, exit status */
+	INIT_TLV_PRIORITY,
+	INIT_TLV_WATCHDOG,
+	INIT_TLV_NOTIFY_STATUS,	/* Last STATUS= from notify:systemd service */
+	INIT_TLV_RESTART_TMO,	/* Current restart delay, msec */
+	INIT_TLV_RESTART_BACKOFF, /* Max restart delay, msec, 0: no back-off */
+	INIT_TLV_RESTART_JITTER,  /* Percent */
+	INIT_TLV_CONDITION,	/* Record, one INIT_CMD_COND_LIST condition */
+};
+
+/*
+ * Asserted conditions, reply to INIT_CMD_COND_LIST.  Framed like
+ * INIT_CMD_SVC_LIST, with INIT_TLV_CONDITION records of INIT_TLV_NAME
+ * and INIT_TLV_STATE, the enum cond_state.
+ */
+
+/*
+ * Reply to INIT_CMD_MONITOR, framed like INIT_CMD_SVC_LIST.  First the
+ * current state: all asserted conditions, as INIT_TLV_CONDITION records,
+ * and all services, as INIT_TLV_SVC records, the last packet flagged
+ * INIT_SVC_LIST_LAST.  After that, for as long as the client stays
+ * connected, one packet, also flagged INIT_SVC_LIST_LAST, per service
+ * state change or condition change.  A cleared condition is sent with
+ * state COND_OFF.  Clients that do not keep up are disconnected.
+ */
+
+/*
+ * Boot timeline events, reply to INIT_CMD_GET_TIMELINE.  Framed like
+ * INIT_CMD_SVC_LIST, with INIT_TLV_EVENT records of INIT_TLV_EVENT_*
+ * fields, INIT_TLV_NAME, and for service events INIT_TLV_TYPE and, on
+ * INIT_TL_SVC_COND, the conditions satisfied in INIT_TLV_COND.  Each
+ * service milestone is only recorded the first time it is reached.
+ */
+enum {
+	INIT_TL_BOOT = 1,	/* Finit started				*/
+	INIT_TL_RUNLEVEL,	/* Entered runlevel in arg			*/
+	INIT_TL_HOOK_BEGIN,	/* Plugin hook arg, name is hook condition	*/
+	INIT_TL_HOOK_END,
+	INIT_TL_BOOT_DONE,	/* Bootstrap completed, starting TTYs		*/
+	INIT_TL_SVC_WAITING,	/* Enabled, waiting for conditions		*/
+	INIT_TL_SVC_COND,	/* Conditions satisfied				*/
+	INIT_TL_SVC_PRE,	/* pre: script started				*/
+	INIT_TL_SVC_PRE_DONE,	/* pre: script done				*/
+	INIT_TL_SVC_FORK,	/* Process started				*/
+	INIT_TL_SVC_READY,	/* Ready, from pidfile or notify		*/
+	INIT_TL_SVC_RUNNING,	/* Entered running state			*/
+	INIT_TL_SVC_DONE,	/* run/task completed, arg is exit status	*/
+	INIT_TL_MAX
+};
+
 #endif /* FINIT_H_ */
 
 /**
@@ -23,7 +23,6 @@
 
 #include "config.h"
 
-#include <ftw.h>
 #include <ctype.h>
 #include <getopt.h>
 #include <paths.h>
@@ -35,10 +34,13 @@
 #include <arpa/inet.h>
 
 #include "initctl.h"
+#include "analyze.h"
 #include "client.h"
 #include "cond.h"
+#include "monitor.h"
 #include "serv.h"
 #include "service.h"
+#include "svcmap.h"
 #include "cgutil.h"
 #include "utmp-api.h"
 
@@ -74,16 +76,17 @@ extern int reboot_main(int argc, char *argv[]);
 
 
 /* figure ut width of IDENT and PID columns */
-static void col_widths(void)
+static void col_widths(svc_t *list, size_t num)
 {
 	char ident[MAX_IDENT_LEN];
 	char pid[10];
-	svc_t *svc;
+	size_t i;
 
 	iw = 0;
 	pw = 0;
 
-	for (svc = client_svc_iterator(1); svc; svc = client_svc_iterator(0)) {
+	for (i = 0; i < num; i++) {
+		svc_t *svc = &list[i];
 		int w, p;
 
 		svc_ident(svc, ident, sizeof(ident));
@@ -330,26 +333,13 @@ int do_signal(int argc, char *argv[])
 	return client_send(&rq, sizeof(rq));
 }
 
-int dump_once;
-char *dump_filter;
-static int dump_one_cond(const char *fpath, const struct stat *sb, int tflag, struct FTW *ftwbuf)
+static void dump_one_cond(const char *cond, enum cond_state state, int first)
 {
-	const char *cond, *asserted;
+	const char *asserted;
 	char *nm = "init";
 	pid_t pid = 1;
 
-	if (tflag != FTW_F)
-		return 0;
-
-	if (!strcmp(fpath, _PATH_RECONF))
-		return 0;
-
-	asserted = condstr(cond_get_path(fpath));
-	cond = &fpath[strlen(_PATH_COND)];
-
-	if (dump_filter && dump_filter[0] && strncmp(cond, dump_filter, strlen(dump_filter)))
-		return 0;
-
+	asserted = condstr(state);
 	if (strncmp("pid/", cond, 4) == 0) {
 		svc_t *svc;
 
@@ -370,7 +360,7 @@ static int dump_one_cond(const char *fpath, const struct stat *sb, int tflag, st
 	}
 
 	if (json) {
-		if (!dump_once)
+		if (first)
 			puts("[");
 
 		printf("%s  {\n"
@@ -379,30 +369,35 @@ static int dump_one_cond(const char *fpath, const struct stat *sb, int tflag, st
 		       "    \"status\": \"%s\",\n"
 		       "    \"condition\": \"%s\"\n"
 		       "  }",
-		       dump_once ? ",\n" : "",
+		       first ? "" : ",\n",
 		       pid, nm, asserted, cond);
-
-		dump_once++;
 	} else
 		printf("%-*d  %-*s  %-6s  <%s>\n", pw, pid, iw, nm, asserted, cond);
-
-	return 0;
 }
 
+/* Conditions are listed by PID 1, a prefix walk of its condition trie */
 static int do_cond_dump(char *arg)
 {
-	col_widths();
+	struct client_cond *conds;
+	size_t i, num, nconds;
+	svc_t *list;
+
+	list = client_svc_list(NULL, &num);
+	col_widths(list, num);
 	if (heading && !json)
 		print_header("%-*s  %-*s  %-6s  %s", pw, "PID", iw, "IDENT",
 			     "STATUS", "CONDITION");
 
-	dump_once = 0;
-	dump_filter = arg;
-	if (nftw(_PATH_COND, dump_one_cond, 20, 0) == -1) {
-		WARNX("Failed parsing %s", _PATH_COND);
+	errno = 0;
+	conds = client_cond_list(arg, &nconds);
+	if (!nconds && errno) {
+		WARNX("Failed fetching conditions from Finit");
 		return 1;
 	}
-	if (dump_once)
+
+	for (i = 0; i < nconds; i++)
+		dump_one_cond(conds[i].name, conds[i].state, i == 0);
+	if (json && nconds)
 		puts("\n]");
 
 	return 0;
@@ -501,29 +496,41 @@ static int do_cond_get(char *arg) { return do_cond_act(arg, COND_GET); }
 static int do_cond_set(char *arg) { return do_cond_act(arg, COND_SET); }
 static int do_cond_clr(char *arg) { return do_cond_act(arg, COND_CLR); }
 
+/*
+ * Conditions of @svc with their current state.  Operators of condition
+ * expressions are kept as-is, except in JSON, which is only a list.
+ */
 static char *svc_cond(svc_t *svc, char *buf, size_t len, int ansi)
 {
-	char *cond, *conds;
+	const char *ptr;
+	int num = 0;
 
 	buf[0] = 0;
 
 	if (!svc->cond[0])
 		return buf;
 
-	conds = strdupa(svc->cond);
-	if (!conds)
-		return buf;
-
 	if (json)
 		strlcat(buf, "[ ", len);
 
-	for (cond = strtok(conds, ","); cond; cond = strtok(NULL, ",")) {
-		if (cond != conds) {
-			strlcat(buf, ",", len);
-			if (json)
-				strlcat(buf, " ", len);
+	for (ptr = svc->cond; *ptr; ) {
+		size_t n = strcspn(ptr, COND_EXPR_DELIM);
+		char *cond;
+
+		if (!n) {
+			char op[2] = { *ptr++, 0 };
+
+			if (!json)
+				strlcat(buf, op, len);
+			continue;
 		}
 
+		cond = strndupa(ptr, n);
+		ptr += n;
+		if (json && num)
+			strlcat(buf, ", ", len);
+		num++;
+
 		if (json)
 			strlcat(buf, "\"", len);
 
@@ -565,16 +572,20 @@ static char *svc_cond(svc_t *svc, char *buf, size_t len, int ansi)
 static int do_cond_show(char *arg)
 {
 	enum cond_state cond;
+	size_t i, num;
 	char buf[512];
+	svc_t *list;
 	int once = 0;
-	svc_t *svc;
 
-	col_widths();
+	list = client_svc_list(NULL, &num);
+	col_widths(list, num);
 	if (heading && !json)
 		print_header("%-*s  %-*s  %-6s  %s", pw, "PID", iw, "IDENT",
 			     "STATUS", "CONDITION (+ ON, ~ FLUX, - OFF)");
 
-	for (svc = client_svc_iterator(1); svc; svc = client_svc_iterator(0)) {
+	for (i = 0; i < num; i++) {
+		svc_t *svc = &list[i];
+
 		if (!svc->cond[0])
 			continue;
 
@@ -804,6 +815,56 @@ static int plugins_list(char *arg)
 	return 0;
 }
 
+static int show_stats(char *arg)
+{
+	struct init_request rq = {
+		.magic = INIT_MAGIC,
+		.cmd   = INIT_CMD_GET_STATS,
+	};
+	struct init_stats st;
+
+	if (client_send(&rq, sizeof(rq)))
+		ERRX(69, "Failed fetching statistics from Finit");
+	memcpy(&st, rq.data, sizeof(st));
+
+	if (json) {
+		printf("{\n"
+		       "  \"steps\": %llu,\n"
+		       "  \"steps_per_sec\": %u,\n"
+		       "  \"sweeps\": %u,\n"
+		       "  \"queued\": %u,\n"
+		       "  \"services\": %u,\n"
+		       "  \"svc_size\": %u,\n"
+		       "  \"heap\": %llu,\n"
+		       "  \"start_max\": %u,\n"
+		       "  \"starting\": %u,\n"
+		       "  \"start_queued\": %u,\n"
+		       "  \"log_pipes\": %u\n"
+		       "}\n", st.steps, st.steps_sec, st.sweeps, st.queued,
+		       st.svc_num, st.svc_size, st.heap, st.start_max,
+		       st.starting, st.start_queued, st.log_pipes);
+		return 0;
+	}
+
+	printf("Service steps   : %llu\n", st.steps);
+	printf("Steps/sec       : %u\n", st.steps_sec);
+	printf("Full sweeps     : %u\n", st.sweeps);
+	printf("Queued services : %u\n", st.queued);
+	if (st.start_max)
+		printf("Start slots     : %u/%u in use, %u waiting\n",
+		       st.starting, st.start_max, st.start_queued);
+	else
+		printf("Start slots     : unlimited\n");
+	printf("Services        : %u, %u bytes each\n", st.svc_num, st.svc_size);
+	printf("Log pipes       : %u\n", st.log_pipes);
+	if (st.heap)
+		printf("Heap in use     : %llu bytes\n", st.heap);
+	else
+		printf("Heap in use     : unknown\n");
+
+	return 0;
+}
+
 /**
  * runlevel_string - Convert a bit encoded runlevel to .conf syntax
  * @levels: Bit encoded runlevels
@@ -892,10 +953,7 @@ static char *svc_command(svc_t *svc, char *buf, size_t len, int ansi)
 	strlcpy(buf, bold ? "\e[1m" : "", len);
 	strlcat(buf, svc->cmd, len);
 
-	for (int i = 1; i < MAX_NUM_SVC_ARGS; i++) {
-		if (!svc->args[i][0])
-			break;
-
+	for (int i = 1; svc->args && svc->args[i]; i++) {
 		strlcat(buf, " ", len);
 		strlcat(buf, svc->args[i], len);
 	}
@@ -920,7 +978,8 @@ static char *svc_environ(svc_t *svc, char *buf, size_t len, int ansi)
 		bold = 0;
 
 	strlcpy(buf, bold ? "\e[1m" : "", len);
-	strlcat(buf, svc->env, len);
+	if (svc->env)
+		strlcat(buf, svc->env, len);
 	strlcat(buf, bold ? "\e[0m" : "", len);
 
 	return buf;
@@ -1014,33 +1073,11 @@ static void show_cgroup_tree(char *group, char *pfx)
 	cgroup_tree(path, pfx, 0, 0);
 }
 
-/*
- * arg: 'foo'   should match foo:1 foo:2, etc. but not foobar
- * arg: 'foo:1' should only match foo:1
- * arg: 'foo:'  is allowed to fail, unsupported syntax atm
- * arg: 'foo:*' is allowed to fail, unsupported syntax atm
- */
-static int svc_compare(svc_t *svc, char *arg)
-{
-	char ident[MAX_IDENT_LEN];
-	char *ptr;
-
-	svc_ident(svc, ident, sizeof(ident));
-	ptr = strchr(ident, ':');
-	if (ptr && !strchr(arg, ':'))
-		*ptr = 0;
-
-	if (!strcmp(ident, arg))
-		return 1;
-
-	return 0;
-}
-
 /*
  * Escape a string for safe JSON output. Handles quotes, backslashes,
  * and control characters.  Returns pointer to static buffer.
  */
-static char *json_escape(const char *str)
+char *json_escape(const char *str)
 {
 	static char buf[1024];
 	char *ptr = buf;
@@ -1099,10 +1136,10 @@ static int json_status_one(FILE *fp, svc_t *svc, char *indent, int prev)
 	char buf[512];
 
 	pidfn = svc->pidfile;
-	if (pidfn[0] == '!')
-		pidfn++;
-	else if (pidfn[0] == 0)
+	if (!pidfn)
 		pidfn = "none";
+	else if (pidfn[0] == '!')
+		pidfn++;
 
 	fprintf(fp,
 		"%s"
@@ -1121,6 +1158,11 @@ static int json_status_one(FILE *fp, svc_t *svc, char *indent, int prev)
 		indent, svc->forking ? "true" : "false",
 		indent, svc_status(svc));
 
+	if (svc->notify_status)
+		fprintf(fp,
+			"%s  \"message\": \"%s\",\n",
+			indent, json_escape(svc->notify_status));
+
 	if (svc->state != SVC_RUNNING_STATE) {
 		int rc, sig;
 
@@ -1161,6 +1203,10 @@ static int json_status_one(FILE *fp, svc_t *svc, char *indent, int prev)
 
 	fprintf(fp,
 		"%s  \"restarts\": %d,\n", indent, svc->restart_tot); /* XXX: add restart_cnt and restart_max */
+	if (svc->restart_backoff)
+		fprintf(fp,
+			"%s  \"backoff\": { \"delay\": %d, \"max\": %d, \"jitter\": %d },\n",
+			indent, svc->restart_tmo, svc->restart_backoff, svc->restart_jitter);
 
 	/* Add memory and CPU information if cgroup support is available */
 	if (cgrp && svc->pid > 1) {
@@ -1285,27 +1331,86 @@ static int json_status_one(FILE *fp, svc_t *svc, char *indent, int prev)
 	return 0;
 }
 
+/*
+ * Fast path for `initctl -q status NAME`, polled by monitoring tools,
+ * answered from the status table published by PID 1 without an API
+ * request.  Returns -1 to fall back to the API, e.g., if the table is
+ * missing or NAME matches more than one instance.
+ */
+static int fast_status(char *arg)
+{
+	struct svcmap_reader r = { 0 };
+	struct svcmap_svc *list, *svc = NULL;
+	char *name, *id;
+	int i, num, job = 0;
+
+	if (svcmap_open(&r))
+		return -1;
+
+	list = calloc(r.map->capacity, sizeof(*list));
+	if (!list) {
+		svcmap_close(&r);
+		return -1;
+	}
+	num = svcmap_snapshot(&r, NULL, list, r.map ? r.map->capacity : 0);
+	svcmap_close(&r);
+
+	name = strdupa(arg);
+	id = strchr(name, ':');
+	if (id)
+		*id++ = 0;
+	if (isdigit(name[0]))
+		job = atoi(name);
+
+	for (i = 0; i < num; i++) {
+		if (job ? list[i].job != job : strcmp(list[i].name, name))
+			continue;
+		if (id && strcmp(list[i].id, id))
+			continue;
+		if (svc) {
+			svc = NULL;	/* Ambiguous, let PID 1 decide */
+			break;
+		}
+		svc = &list[i];
+	}
+
+	if (!svc)
+		num = -1;
+	else if (svc->type & SVC_TYPE_RUNTASK)
+		num = !(svc->flags & SVCMAP_STARTED);
+	else
+		num = svc->state != SVC_RUNNING_STATE;
+	free(list);
+
+	return num;
+}
+
 static int show_status(char *arg)
 {
 	char ident[MAX_IDENT_LEN];
+	size_t i, num = 0;
 	char buf[512];
-	int num = 0;
+	svc_t *list;
 	svc_t *svc;
+	int rc;
+
+	if (quiet && arg && arg[0] && (rc = fast_status(arg)) >= 0)
+		return rc;
 
 	runlevel = runlevel_get(NULL);
 
+	/* All services, or all instances matching NAME, in one request */
+	list = client_svc_list(arg, &num);
+
 	while (arg && arg[0]) {
 		long now = jiffies();
 		char uptm[42] = "N/A";
 		char *pidfn = NULL;
 
-		for (svc = client_svc_iterator(1); svc; svc = client_svc_iterator(0))
-			num += svc_compare(svc, arg);
-
 		if (num > 1)
 			break;
 
-		svc = client_svc_find(arg);
+		svc = list;
 		if (!svc)
 			ERRX(noerr ? 0 : 69, "no such task or service(s): %s", arg);
 
@@ -1327,12 +1432,14 @@ static int show_status(char *arg)
 		}
 
 		pidfn = svc->pidfile;
-		if (pidfn[0] == '!')
-			pidfn++;
-		else if (pidfn[0] == 0)
+		if (!pidfn)
 			pidfn = "none";
+		else if (pidfn[0] == '!')
+			pidfn++;
 
 		printf("     Status : %s\n", status(svc, 1));
+		if (svc->notify_status)
+			printf("    Message : %s\n", svc->notify_status);
 		printf("   Identity : %s\n", svc_ident(svc, ident, sizeof(ident)));
 		printf("Description : %s\n", svc->desc);
 		printf("     Origin : %s\n", svc->file[0] ? svc->file : "built-in");
@@ -1351,6 +1458,15 @@ static int show_status(char *arg)
 		if (svc->manual)
 			printf("     Starts : %d\n", svc->once);
 		printf("   Restarts : %d (%d/%d)\n", svc->restart_tot, svc->restart_cnt, svc->restart_max);
+		if (svc->restart_backoff)
+			printf("    Backoff : %.1f sec (max %d sec, jitter %d%%)\n", svc->restart_tmo / 1000.0,
+			       svc->restart_backoff / 1000, svc->restart_jitter);
+		else if (svc->restart_cnt)
+			printf("    Backoff : %.1f sec\n", svc->restart_tmo / 1000.0);
+		if (svc->priority)
+			printf("   Priority : %d\n", svc->priority);
+		if (svc->watchdog)
+			printf("   Watchdog : %d msec\n", svc->watchdog);
 		printf("  Runlevels : %s\n", runlevel_string(runlevel, svc->runlevels));
 
 		if (cgrp && svc->pid > 1) {
@@ -1390,11 +1506,8 @@ static int show_status(char *arg)
 	if (json) {
 		int prev = 0;
 
-		for (svc = client_svc_iterator(1); svc; svc = client_svc_iterator(0)) {
-			svc_ident(svc, ident, sizeof(ident));
-			if (num && !svc_compare(svc, arg))
-				continue;
-
+		for (i = 0; i < num; i++) {
+			svc = &list[i];
 			if (!prev)
 				fputs("[\n", stdout);
 			json_status_one(stdout, svc, "  ", prev++);
@@ -1405,7 +1518,7 @@ static int show_status(char *arg)
 		return 0;
 	}
 
-	col_widths();
+	col_widths(list, num);
 	if (heading) {
 		char title[80];
 
@@ -1419,12 +1532,11 @@ static int show_status(char *arg)
 		print_header("%s", title);
 	}
 
-	for (svc = client_svc_iterator(1); svc; svc = client_svc_iterator(0)) {
+	for (i = 0; i < num; i++) {
 		char *lvls;
 
+		svc = &list[i];
 		svc_ident(svc, ident, sizeof(ident));
-		if (num && !svc_compare(svc, arg))
-			continue;
 
 		printf("%-*d  ", pw, svc->pid);
 		printf("%-*s  %s ", iw, ident, status(svc, 0));
@@ -1519,6 +1631,7 @@ static int usage(int rc)
 		"  -p, --plain               Use plain table headings, no ctrl chars\n"
 		"  -q, --quiet               Silent, only return status of command\n"
 		"  -t, --no-heading          Skip table headings\n"
+		"  -T, --timeout=SEC         Timeout for 'monitor' and 'wait', or forced reboot\n"
 		"  -v, --verbose             Verbose output\n"
 		"  -V, --version             Show program version\n"
 		"\n"
@@ -1572,7 +1685,9 @@ static int usage(int rc)
 		"  kill     <NAME>[:ID] <S>  Send signal S to service by name, with optional ID\n"
 		"  ident    [NAME]           Show matching identities for NAME, or all\n"
 		"  status   <NAME>[:ID]      Show service status, by name\n"
-		"  status                    Show status of services, default command\n");
+		"  status                    Show status of services, default command\n"
+		"  monitor                   Show service and condition changes as they happen\n"
+		"  wait     <COND>...        Wait for conditions, or NAME[:ID]=STATE of services\n");
 	if (cgrp)
 		fprintf(stderr,
 			"\n"
@@ -1582,6 +1697,12 @@ static int usage(int rc)
 	fprintf(stderr,
 		"\n"
 		"  plugins                   List installed plugins\n"
+		"  stats                     Show state machine statistics, e.g. steps/sec\n"
+		"  analyze  [show]           Show boot time summary, critical chain and blame\n"
+		"  analyze  blame            List services by time to start, pre: script to ready\n"
+		"  analyze  chain [NAME]     Show critical chain to NAME, or last service up\n"
+		"  analyze  plot             Boot timeline as SVG, e.g. initctl analyze plot >boot.svg\n"
+		"  analyze  trace            Boot timeline in Trace Event Format (JSON), for Perfetto\n"
 		"\n"
 		"  runlevel [0-9]            Show or set runlevel: 0 halt, 6 reboot\n"
 		"  reboot                    Reboot system\n"
@@ -1714,6 +1835,7 @@ int main(int argc, char *argv[])
 		{ "plain",      0, NULL, 'p' },
 		{ "quiet",      0, NULL, 'q' },
 		{ "no-heading", 0, NULL, 't' },
+		{ "timeout",    1, NULL, 'T' },
 		{ "verbose",    0, NULL, 'v' },
 		{ "version",    0, NULL, 'V' },
 		{ NULL, 0, NULL, 0 }
@@ -1727,9 +1849,19 @@ int main(int argc, char *argv[])
 		{ "clear",    NULL, do_cond_clr,  NULL, NULL  },
 		{ NULL, NULL, NULL, NULL, NULL  }
 	};
+	struct cmd analyze[] = {
+		{ "show",     NULL, analyze_show,  NULL, NULL }, /* default cmd */
+		{ "blame",    NULL, analyze_blame, NULL, NULL },
+		{ "chain",    NULL, analyze_chain, NULL, NULL },
+		{ "plot",     NULL, analyze_plot,  NULL, NULL },
+		{ "trace",    NULL, analyze_trace, NULL, NULL },
+		{ NULL, NULL, NULL, NULL, NULL  }
+	};
 	struct cmd command[] = {
 		{ "status",   NULL, show_status,  NULL, NULL  }, /* default cmd */
 		{ "ident",    NULL, show_ident,   NULL, NULL  },
+		{ "monitor",  NULL, do_monitor,   NULL, NULL  },
+		{ "wait",     NULL, NULL,         NULL, do_wait },
 
 		{ "debug",    NULL, toggle_debug, NULL, NULL  },
 		{ "devel",    NULL, do_devel,     NULL, NULL  },
@@ -1762,6 +1894,8 @@ int main(int argc, char *argv[])
 		{ "top",      NULL, show_cgtop,  &cgrp, NULL  },
 
 		{ "plugins",  NULL, plugins_list, NULL, NULL  },
+		{ "stats",    NULL, show_stats,   NULL, NULL  },
+		{ "analyze",  analyze, NULL, NULL, NULL       },
 
 		{ "runlevel", NULL, do_runlevel,  NULL, NULL  },
 		{ "reboot",   NULL, do_reboot,    NULL, NULL  },
@@ -1783,7 +1917,7 @@ int main(int argc, char *argv[])
 	cgrp = cgroup_avail();
 	utmp = has_utmp();
 
-	while ((c = getopt_long(argc, argv, "1bcdfh?jnpqtvV", long_options, NULL)) != EOF) {
+	while ((c = getopt_long(argc, argv, "1bcdfh?jnpqtT:vV", long_options, NULL)) != EOF) {
 		switch(c) {
 		case '1':
 			ionce = 1;
@@ -1829,6 +1963,10 @@ int main(int argc, char *argv[])
 			heading = 0;
 			break;
 
+		case 'T':
+			timeout = atoi(optarg);
+			break;
+
 		case 'v':
 			verbose = 1;
 			break;
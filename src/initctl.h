@@ -41,6 +41,7 @@ extern int noerr;			/* initctl -n */
 extern int verbose;			/* initctl -v */
 extern int plain;			/* initctl -p */
 extern int quiet;			/* initctl -q */
+extern int timeout;			/* initctl -T */
 
 #define ERR(rc, fmt, args...)  do { if (!quiet) err(rc, fmt, ##args);  else exit(rc); } while (0)
 #define ERRX(rc, fmt, args...) do { if (!quiet) errx(rc, fmt, ##args); else exit(rc); } while (0)
@@ -48,6 +49,7 @@ extern int quiet;			/* initctl -q */
 #define WARNX(fmt, args...)    do { if (!quiet) warnx(fmt, ##args); } while (0)
 
 extern void print_header(const char *fmt, ...) __attribute__ ((format (printf, 1, 2)));
+extern char *json_escape(const char *str);
 
 #endif /* FINIT_INITCTL_H_ */
 
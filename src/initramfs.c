@@ -215,7 +215,7 @@ int switch_root(const char *newroot, const char *newinit)
 	iterate_proc(kill_cb, &signo);
 
 	/* Reap zombies */
-	while (waitpid(-1, NULL, WNOHANG) > 0)
+	while (waitpid(-1, NULL, WNOHANG | __WALL) > 0)
 		;
 
 	/* Exit plugins */
@@ -23,6 +23,7 @@
 #include <config.h>
 #include <errno.h>
 #include <getopt.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -30,6 +31,7 @@
 #include <syslog.h>
 #include <unistd.h>
 #include <sys/stat.h>
+#include <time.h>
 #ifdef _LIBITE_LITE
 # include <libite/lite.h>
 #else
@@ -43,51 +45,312 @@ static const char version_info[] = PACKAGE_NAME " v" PACKAGE_VERSION;
 extern int logrotate(char *file, int num, off_t sz);
 
 
-static int checksz(FILE *fp, off_t sz)
+enum {
+	FSYNC_NEVER,
+	FSYNC_INTERVAL,
+	FSYNC_ALWAYS,
+};
+
+/* Log file writer state, the size is tracked instead of fstat() per line */
+struct flog {
+	char   *file;
+	int     num;
+	off_t   sz;
+
+	FILE   *fp;
+	off_t   off;		/* Size of file, incl. buffered data */
+	int     lines;		/* Lines since last flush */
+	int     dirty;		/* Unflushed data */
+	int     unsynced;	/* Flushed, but not fsync()'ed data */
+	time_t  tick;		/* Last interval flush */
+};
+
+static size_t bufsz    = 0;	/* -b SIZE, 0: flush every line */
+static int    maxlines = 0;	/* -l NUM, 0: no limit */
+static int    interval = 1;	/* -i SEC */
+static int    fsyncpol = FSYNC_ALWAYS;
+
+static int    rate     = 0;	/* -R LINES/SEC[,BURST], 0: no limit */
+static int    rate_sec = 1;
+static int    burst    = 0;
+static int    block    = 0;	/* -w, wait instead of dropping lines */
+
+static double          tokens;
+static struct timespec refill;
+static unsigned int    suppressed;
+
+static time_t now(void)
 {
-	struct stat st;
+	struct timespec ts;
 
-	if (sz <= 0)
-		return 0;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec;
+}
+
+static int flog_open(struct flog *fl)
+{
+	struct stat st;
 
-	if (!fstat(fileno(fp), &st) && st.st_size > sz) {
-		fclose(fp);
+	fl->fp = fopen(fl->file, "a");
+	if (!fl->fp) {
+		syslog(LOG_ERR | LOG_PERROR, "Failed opening %s: %s", fl->file, strerror(errno));
 		return 1;
 	}
+	if (bufsz > 0)
+		setvbuf(fl->fp, NULL, _IOFBF, bufsz);
+
+	if (fstat(fileno(fl->fp), &st))
+		fl->off = 0;
+	else
+		fl->off = st.st_size;
+	fl->tick = now();
 
 	return 0;
 }
 
-static int flogit(char *logfile, int num, off_t sz, char *buf, size_t len)
+/*
+ * Flush buffered lines to the file, fsync() depends on the policy:
+ * always on every flush, interval only on @sync, which is set for
+ * the interval timer and before rotation.
+ */
+static void flog_flush(struct flog *fl, int sync)
+{
+	if (fl->dirty) {
+		fflush(fl->fp);
+		fl->lines    = 0;
+		fl->dirty    = 0;
+		fl->unsynced = 1;
+	}
+
+	if (fl->unsynced && (fsyncpol == FSYNC_ALWAYS || (sync && fsyncpol != FSYNC_NEVER))) {
+		fsync(fileno(fl->fp));
+		fl->unsynced = 0;
+	}
+
+	if (sync)
+		fl->tick = now();
+}
+
+static int flog_close(struct flog *fl)
+{
+	int rc;
+
+	flog_flush(fl, 1);
+	rc = fclose(fl->fp);
+	fl->fp = NULL;
+
+	return rc;
+}
+
+/*
+ * Token bucket, refilled with @rate lines every @rate_sec seconds, up
+ * to @burst lines.  With -w we sleep until the next line may be logged,
+ * the pipe from the service fills up and it blocks in write().
+ */
+static int rate_allow(void)
+{
+	struct timespec ts;
+	double elapsed, wait;
+
+	if (!rate)
+		return 1;
+
+	while (1) {
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		elapsed = (ts.tv_sec - refill.tv_sec) + (ts.tv_nsec - refill.tv_nsec) / 1e9;
+		refill  = ts;
+
+		tokens += elapsed * rate / rate_sec;
+		if (tokens > burst)
+			tokens = burst;
+		if (tokens >= 1) {
+			tokens--;
+			return 1;
+		}
+
+		if (!block) {
+			suppressed++;
+			return 0;
+		}
+
+		wait = (1 - tokens) * rate_sec / rate;
+		ts.tv_sec  = wait;
+		ts.tv_nsec = (wait - ts.tv_sec) * 1e9;
+		nanosleep(&ts, NULL);
+	}
+}
+
+static int parse_rate(char *arg)
 {
-	FILE *fp;
+	char *ptr;
+
+	rate = strtol(arg, &ptr, 10);
+	if (*ptr == '/')
+		rate_sec = strtol(ptr + 1, &ptr, 10);
+	if (*ptr == ',')
+		burst = strtol(ptr + 1, &ptr, 10);
+	if (*ptr || rate < 1 || rate_sec < 1 || burst < 0)
+		return 1;
+
+	if (!burst)
+		burst = rate;
+	tokens = burst;
+	clock_gettime(CLOCK_MONOTONIC, &refill);
+
+	return 0;
+}
 
-reopen:
-	fp = fopen(logfile, "a");
-	if (!fp) {
-		syslog(LOG_ERR | LOG_PERROR, "Failed opening %s: %s", logfile, strerror(errno));
+/*
+ * Write one line, or part of one, and rotate when the file has grown
+ * past @sz, same as before but without a stat() of every line.
+ */
+static int flog_write(struct flog *fl, const char *buf, size_t len)
+{
+	if (fwrite(buf, 1, len, fl->fp) != len)
 		return 1;
+
+	fl->off  += len;
+	fl->dirty = 1;
+	if (buf[len - 1] == '\n')
+		fl->lines++;
+
+	if (!bufsz || (maxlines > 0 && fl->lines >= maxlines))
+		flog_flush(fl, 0);
+	if (now() - fl->tick >= interval)
+		flog_flush(fl, 1);
+
+	if (fl->sz > 0 && fl->off > fl->sz) {
+		flog_close(fl);
+		logrotate(fl->file, fl->num, fl->sz);
+		return flog_open(fl);
 	}
 
-	if (buf[0]) {
-		fprintf(fp, "%s\n", buf);
-		fsync(fileno(fp));
-		if (checksz(fp, sz))
-			return logrotate(logfile, num, sz);
-	} else {
-		while ((fgets(buf, len, stdin))) {
-			fputs(buf, fp);
-			fsync(fileno(fp));
-
-			if (checksz(fp, sz)) {
-				logrotate(logfile, num, sz);
-				buf[0] = 0;
-				goto reopen;
-			}
+	return 0;
+}
+
+static int flog_summary(struct flog *fl)
+{
+	char msg[80];
+
+	if (!suppressed)
+		return 0;
+
+	snprintf(msg, sizeof(msg), "%u lines suppressed by log rate limit\n", suppressed);
+	suppressed = 0;
+
+	return flog_write(fl, msg, strlen(msg));
+}
+
+/* Rate limited flog_write(), lines over the limit are counted, not logged */
+static int flog_line(struct flog *fl, const char *buf, size_t len)
+{
+	if (!rate_allow())
+		return 0;
+	if (flog_summary(fl))
+		return 1;
+
+	return flog_write(fl, buf, len);
+}
+
+/*
+ * Read stdin line by line, with a timeout when we have buffered data,
+ * so the last lines of a quiet service reach the file, and the disk,
+ * within @interval.
+ */
+static int flog_stdin(struct flog *fl, char *buf, size_t len)
+{
+	size_t pos = 0;
+
+	while (1) {
+		struct pollfd pfd = { .fd = STDIN_FILENO, .events = POLLIN };
+		int timeout = -1;
+		char *line, *nl;
+		ssize_t num;
+		int rc;
+
+		if (fl->dirty || (fl->unsynced && fsyncpol == FSYNC_INTERVAL))
+			timeout = interval * 1000;
+
+		rc = poll(&pfd, 1, timeout);
+		if (rc == -1) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		if (rc == 0) {
+			flog_flush(fl, 1);
+			continue;
+		}
+
+		num = read(STDIN_FILENO, &buf[pos], len - pos - 1);
+		if (num == -1 && (errno == EINTR || errno == EAGAIN))
+			continue;
+		if (num <= 0)
+			break;
+
+		pos += num;
+		buf[pos] = 0;
+
+		line = buf;
+		while ((nl = strchr(line, '\n'))) {
+			if (flog_line(fl, line, nl - line + 1))
+				return 1;
+			line = nl + 1;
+		}
+
+		pos = &buf[pos] - line;
+		if (pos == len - 1) {
+			/* Overlong line, write what we have */
+			if (flog_line(fl, buf, pos))
+				return 1;
+			pos = 0;
+		} else if (pos > 0 && line != buf) {
+			memmove(buf, line, pos);
 		}
 	}
 
-	return fclose(fp);
+	if (pos > 0)
+		flog_line(fl, buf, pos);
+
+	return flog_summary(fl);
+}
+
+static int flogit(char *logfile, int num, off_t sz, char *buf, size_t len)
+{
+	struct flog fl = {
+		.file = logfile,
+		.num  = num,
+		.sz   = sz,
+	};
+	int rc;
+
+	if (flog_open(&fl))
+		return 1;
+
+	if (buf[0]) {
+		strlcat(buf, "\n", len);
+		rc = flog_write(&fl, buf, strlen(buf));
+	} else
+		rc = flog_stdin(&fl, buf, len);
+
+	if (fl.fp && flog_close(&fl))
+		rc = 1;
+
+	return rc;
+}
+
+static int parse_fsync(const char *arg)
+{
+	if (!strcmp(arg, "never"))
+		fsyncpol = FSYNC_NEVER;
+	else if (!strcmp(arg, "interval"))
+		fsyncpol = FSYNC_INTERVAL;
+	else if (!strcmp(arg, "always"))
+		fsyncpol = FSYNC_ALWAYS;
+	else
+		return 1;
+
+	return 0;
 }
 
 /*
@@ -130,13 +393,27 @@ static int do_log(int level, char *msg)
 	return 0;
 }
 
+static void summary(void)
+{
+	if (!suppressed)
+		return;
+
+	syslog(LOG_WARNING, "%u lines suppressed by log rate limit", suppressed);
+	suppressed = 0;
+}
+
 static int logit(int level, char *buf, size_t len)
 {
 	if (buf[0])
 		return do_log(level, buf);
 
-	while ((fgets(buf, len, stdin)))
+	while ((fgets(buf, len, stdin))) {
+		if (!rate_allow())
+			continue;
+		summary();
 		do_log(level, buf);
+	}
+	summary();
 
 	return 0;
 }
@@ -209,6 +486,13 @@ static int usage(int code)
 		"  -f FILE  File to write log messages to, instead of syslog\n"
 		"  -n SIZE  Number of bytes before rotating, default: 200 kB\n"
 		"  -r NUM   Number of rotated files to keep, default: 5\n"
+		"  -b SIZE  Buffer up to SIZE bytes before writing to FILE, default: 0\n"
+		"  -l NUM   With -b, write to FILE at least every NUM lines\n"
+		"  -i SEC   With -b, write to FILE at least every SEC seconds, default: 1\n"
+		"  -S WHEN  fsync() FILE: never, interval (-i), or always (default)\n"
+		"\n"
+		"  -R RATE  Log at most LINES/SEC[,BURST] from stdin, drop the rest\n"
+		"  -w       With -R, wait instead of dropping lines over the limit\n"
 		"  -v       Show program version\n"
 		"\n"
 		"This version of logit is distributed as part of Finit.\n"
@@ -228,8 +512,12 @@ int main(int argc, char *argv[])
 	int num = LOG_NUM;
 	int c, rc;
 
-	while ((c = getopt(argc, argv, "f:hn:p:r:st:v")) != EOF) {
+	while ((c = getopt(argc, argv, "b:f:hi:l:n:p:r:R:sS:t:vw")) != EOF) {
 		switch (c) {
+		case 'b':
+			bufsz = atoi(optarg);
+			break;
+
 		case 'f':
 			logfile = optarg;
 			break;
@@ -237,6 +525,16 @@ int main(int argc, char *argv[])
 		case 'h':
 			return usage(0);
 
+		case 'i':
+			interval = atoi(optarg);
+			if (interval < 1)
+				interval = 1;
+			break;
+
+		case 'l':
+			maxlines = atoi(optarg);
+			break;
+
 		case 'n':
 			size = atoi(optarg);
 			break;
@@ -250,10 +548,20 @@ int main(int argc, char *argv[])
 			num = atoi(optarg);
 			break;
 
+		case 'R':
+			if (parse_rate(optarg))
+				return usage(1);
+			break;
+
 		case 's':
 			log_opts |= LOG_PERROR;
 			break;
 
+		case 'S':
+			if (parse_fsync(optarg))
+				return usage(1);
+			break;
+
 		case 't':
 			ident = optarg;
 			break;
@@ -262,6 +570,10 @@ int main(int argc, char *argv[])
 			fprintf(stderr, "%s\n", version_info);
 			return 0;
 
+		case 'w':
+			block = 1;
+			break;
+
 		default:
 			return usage(1);
 		}
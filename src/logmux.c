@@ -0,0 +1,622 @@
+/* Built-in log collector for stdout/stderr of services
+ *
+ * Copyright (c) 2025  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Instead of one logger/logit process per service with `log`, PID 1
+ * holds the read end of each service's output pipe and reads it from
+ * the event loop.  Lines are sent to syslog, tagged with ident and PID
+ * of the service, or appended to the service's log file, which is
+ * rotated with the global `log size:N count:N` setting.  Rotation, and
+ * compression of older files, is done by a child process.
+ *
+ * Until syslogd is up, lines go to /dev/kmsg, like our own logit().
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <paths.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef _LIBITE_LITE
+# include <libite/lite.h>
+# include <libite/queue.h>	/* BSD sys/queue.h API */
+#else
+# include <lite/lite.h>
+# include <lite/queue.h>	/* BSD sys/queue.h API */
+#endif
+#include <uev/uev.h>
+
+#include "conf.h"
+#include "finit.h"
+#include "helpers.h"
+#include "log.h"
+#include "logmux.h"
+#include "private.h"
+#include "sig.h"
+#include "util.h"
+
+struct logmux {
+	TAILQ_ENTRY(logmux) link;
+
+	uev_t   watcher;		/* Read end of service output pipe */
+	pid_t   pid;			/* For tagging, like logger -I PID */
+	char    ident[MAX_IDENT_LEN];
+	int     prio;			/* facility | level */
+
+	char   *file;			/* log:/path/to/file, or NULL */
+	int     fd;			/* Open log file, or -1 */
+	off_t   size;			/* Current size of log file */
+	time_t  synced;			/* Last fsync(), for fsync:interval */
+	pid_t   rotor;			/* Child rotating the log file, or 0 */
+
+	int     rate;			/* log:rate=LINES/SEC, 0: unlimited */
+	int     interval;
+	int     burst;
+	int     block;			/* log:block, stop reading when limited */
+	double  tokens;			/* Lines we may log right now */
+	struct timespec refill;		/* Last refill of tokens */
+	unsigned int suppressed;	/* Lines dropped since last summary */
+	uev_t   timer;			/* Resume reading after block */
+	int     timer_init;
+
+	size_t  len;			/* Partial line in buf[] */
+	char    buf[LOGMUX_LINE];
+};
+
+static TAILQ_HEAD(, logmux) mux = TAILQ_HEAD_INITIALIZER(mux);
+
+int log_builtin = 1;			/* log-collector builtin|external */
+
+static int logsd  = -1;
+static int kmsgfd = -1;
+
+/*
+ * Parse possible systemd style log <level> prefix from message, same
+ * as logit does.  For details, see libsystemd/sd-daemon.h
+ */
+static int parse_level(char **buf, int prio)
+{
+	char *msg = *buf;
+
+	if (msg[0] == '<' && msg[1] >= '0' && msg[1] <= '7' && msg[2] == '>') {
+		*buf = msg + 3;
+		return LOG_FAC(prio) << 3 | (msg[1] - '0');
+	}
+
+	return prio;
+}
+
+static int syslog_open(void)
+{
+	struct sockaddr_un sun = { .sun_family = AF_UNIX };
+
+	if (logsd != -1)
+		return 0;
+
+	logsd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (logsd == -1)
+		return -1;
+
+	strlcpy(sun.sun_path, _PATH_LOG, sizeof(sun.sun_path));
+	if (connect(logsd, (struct sockaddr *)&sun, sizeof(sun))) {
+		close(logsd);
+		logsd = -1;
+		return -1;
+	}
+
+	return 0;
+}
+
+static void kmsg_write(const char *msg, size_t len)
+{
+	if (kmsgfd == -1) {
+		if (in_container())
+			return;
+
+		kmsgfd = open("/dev/kmsg", O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+		if (kmsgfd == -1)
+			return;
+	}
+
+	if (write(kmsgfd, msg, len) == -1)
+		dbg("Failed writing to /dev/kmsg: %s", strerror(errno));
+}
+
+/*
+ * Same format as syslog(3), <PRI>TIMESTAMP IDENT[PID]: MSG
+ * Returns non-zero if syslogd cannot keep up, we never block.
+ */
+static int syslog_write(struct logmux *lm, char *line)
+{
+	char msg[LOGMUX_LINE + MAX_IDENT_LEN + 64];
+	time_t now = time(NULL);
+	int prio, hdr;
+	size_t len;
+
+	prio = parse_level(&line, lm->prio);
+	if (LOG_PRI(prio) > LOG_DEBUG)
+		return 0;
+
+	hdr = snprintf(msg, sizeof(msg), "<%d>", prio);
+	hdr += strftime(&msg[hdr], sizeof(msg) - hdr, "%h %e %T ", localtime(&now));
+	len = hdr + snprintf(&msg[hdr], sizeof(msg) - hdr, "%s[%d]: %s", lm->ident, lm->pid, line);
+	if (len >= sizeof(msg))
+		len = sizeof(msg) - 1;
+
+	if (debug)
+		fprintf(stderr, "%s[%d]: %s\n", lm->ident, lm->pid, line);
+
+	if (!syslog_open()) {
+		if (send(logsd, msg, len, MSG_NOSIGNAL) != -1)
+			return 0;
+
+		if (errno == EAGAIN || errno == ENOBUFS)
+			return 1;
+
+		/* syslogd restarted, try once more */
+		close(logsd);
+		logsd = -1;
+		if (!syslog_open() && send(logsd, msg, len, MSG_NOSIGNAL) != -1)
+			return 0;
+	}
+
+	/* No syslogd (yet), skip the timestamp, the kernel adds its own */
+	len = snprintf(msg, sizeof(msg), "<%d>%s[%d]: %s\n", prio, lm->ident, lm->pid, line);
+	if (len >= sizeof(msg))
+		len = sizeof(msg) - 1;
+	kmsg_write(msg, len);
+
+	return 0;
+}
+
+static int file_open(struct logmux *lm)
+{
+	struct stat st;
+
+	lm->fd = open(lm->file, O_WRONLY | O_APPEND | O_CREAT | O_NOCTTY | O_CLOEXEC, 0644);
+	if (lm->fd == -1) {
+		logit(LOG_ERR, "%s: failed opening %s: %s", lm->ident, lm->file, strerror(errno));
+		return -1;
+	}
+
+	if (fstat(lm->fd, &st))
+		lm->size = 0;
+	else
+		lm->size = st.st_size;
+
+	return 0;
+}
+
+/* One fsync() per read from the service, see `log fsync:` */
+static void file_sync(struct logmux *lm)
+{
+	time_t now;
+
+	if (logfile_fsync == LOG_FSYNC_NEVER)
+		return;
+
+	now = time(NULL);
+	if (logfile_fsync == LOG_FSYNC_INTERVAL && now == lm->synced)
+		return;
+
+	fsync(lm->fd);
+	lm->synced = now;
+}
+
+/*
+ * Rotate, and compress older, log files in a child process so we do not
+ * hold up PID 1.  Meanwhile lines are still written to the open file,
+ * which the child renames to file.1, and it is reopened when the child
+ * has been collected, see logmux_collect().
+ */
+static void file_rotate(struct logmux *lm)
+{
+	pid_t pid;
+
+	pid = fork();
+	if (pid == 0) {
+		sig_unblock();
+		_exit(logrotate(lm->file, logfile_count_max, logfile_size_max));
+	}
+
+	if (pid == -1) {
+		dbg("%s: failed fork() to rotate %s: %s", lm->ident, lm->file, strerror(errno));
+		close(lm->fd);
+		lm->fd = -1;
+		logrotate(lm->file, logfile_count_max, logfile_size_max);
+		return;
+	}
+
+	lm->rotor = pid;
+}
+
+/*
+ * Same as logit -f, lines are written as-is, and the size is tracked
+ * here so we only need to stat() the file when it's time to rotate.
+ */
+static void file_write(struct logmux *lm, const char *buf, size_t len)
+{
+	ssize_t num;
+
+	if (lm->fd == -1 && file_open(lm))
+		return;
+
+	num = write(lm->fd, buf, len);
+	if (num == -1) {
+		dbg("%s: failed writing to %s: %s", lm->ident, lm->file, strerror(errno));
+		return;
+	}
+	lm->size += num;
+
+	if (logfile_size_max > 0 && lm->size > logfile_size_max && !lm->rotor)
+		file_rotate(lm);
+}
+
+/*
+ * Token bucket, refilled with @rate lines per @interval seconds, up to
+ * @burst lines.  Returns non-zero if a line may be logged.
+ */
+static int rate_allow(struct logmux *lm)
+{
+	struct timespec now;
+	double elapsed;
+
+	if (!lm->rate)
+		return 1;
+
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+	elapsed = (now.tv_sec - lm->refill.tv_sec) + (now.tv_nsec - lm->refill.tv_nsec) / 1e9;
+	lm->refill = now;
+
+	lm->tokens += elapsed * lm->rate / lm->interval;
+	if (lm->tokens > lm->burst)
+		lm->tokens = lm->burst;
+	if (lm->tokens < 1)
+		return 0;
+
+	lm->tokens--;
+	return 1;
+}
+
+/* Milliseconds until the next line may be logged */
+static int rate_wait(struct logmux *lm)
+{
+	int msec;
+
+	if (!lm->rate || lm->tokens >= 1)
+		return 50;	/* Slow syslogd, try again soon */
+
+	msec = (1 - lm->tokens) * lm->interval * 1000 / lm->rate;
+	return msec < 10 ? 10 : msec;
+}
+
+/* Tell the reader of the log how many lines were lost, and why */
+static void rate_summary(struct logmux *lm)
+{
+	char msg[80];
+
+	if (!lm->suppressed)
+		return;
+
+	if (lm->file) {
+		snprintf(msg, sizeof(msg), "%u lines suppressed by log rate limit\n", lm->suppressed);
+		file_write(lm, msg, strlen(msg));
+	} else {
+		snprintf(msg, sizeof(msg), "<%d>%u lines suppressed by log rate limit",
+			 LOG_WARNING, lm->suppressed);
+		if (syslog_write(lm, msg))
+			return;	/* Try again later */
+	}
+
+	lm->suppressed = 0;
+}
+
+static void logmux_lines(struct logmux *lm, int eof);
+
+static void logmux_resume(uev_t *w, void *arg, int events)
+{
+	struct logmux *lm = (struct logmux *)arg;
+
+	uev_io_start(&lm->watcher);
+	logmux_lines(lm, 0);
+}
+
+/* Stop reading, the pipe fills up and the service blocks in write() */
+static void logmux_block(struct logmux *lm)
+{
+	int msec = rate_wait(lm);
+
+	uev_io_stop(&lm->watcher);
+	if (!lm->timer_init) {
+		lm->timer_init = 1;
+		uev_timer_init(ctx, &lm->timer, logmux_resume, lm, msec, 0);
+	} else
+		uev_timer_set(&lm->timer, msec, 0);
+}
+
+/*
+ * Log all complete lines in buf[], and an overlong or, on @eof, last
+ * partial one.  Lines over the rate limit, or when syslogd cannot keep
+ * up, are dropped, or with log:block left in buf[] while we stop
+ * reading the pipe.  Lines to a file are written in runs, one write()
+ * for all consecutive lines that pass the rate limit.
+ */
+static void logmux_lines(struct logmux *lm, int eof)
+{
+	char *end = &lm->buf[lm->len];
+	char *line = lm->buf;
+	char *run = lm->buf;
+	int blocked = 0;
+	size_t num;
+
+	while (line < end) {
+		char *nl, *next;
+
+		nl = memchr(line, '\n', end - line);
+		if (!nl) {
+			/* Partial line, wait for the rest unless buf[] is full */
+			if (!eof && (line != lm->buf || lm->len < sizeof(lm->buf) - 1))
+				break;
+			nl = end;
+		}
+		next = nl < end ? nl + 1 : end;
+
+		if (!rate_allow(lm)) {
+			if (lm->block && !eof) {
+				blocked = 1;
+				break;
+			}
+			if (lm->file && line > run)
+				file_write(lm, run, line - run);
+			run = next;
+			lm->suppressed++;
+		} else if (lm->file) {
+			if (lm->suppressed) {
+				if (line > run)
+					file_write(lm, run, line - run);
+				run = line;
+				rate_summary(lm);
+			}
+		} else {
+			rate_summary(lm);
+
+			*nl = 0;
+			if (nl > line && nl[-1] == '\r')
+				nl[-1] = 0;
+			if (syslog_write(lm, line)) {
+				if (lm->block && !eof) {
+					*nl = '\n';
+					lm->tokens++;
+					blocked = 1;
+					break;
+				}
+				lm->suppressed++;
+			}
+		}
+
+		line = next;
+	}
+
+	if (lm->file && line > run)
+		file_write(lm, run, line - run);
+	if (lm->file && lm->fd != -1)
+		file_sync(lm);
+
+	num = line - lm->buf;
+	lm->len -= num;
+	memmove(lm->buf, line, lm->len);
+	lm->buf[lm->len] = 0;
+
+	if (eof)
+		rate_summary(lm);
+	else if (blocked)
+		logmux_block(lm);
+}
+
+static void logmux_del(struct logmux *lm)
+{
+	/* Flush what we have, incl. any trailing line without newline */
+	logmux_lines(lm, 1);
+
+	TAILQ_REMOVE(&mux, lm, link);
+	uev_io_stop(&lm->watcher);
+	if (lm->timer_init)
+		uev_timer_stop(&lm->timer);
+	close(lm->watcher.fd);
+	if (lm->fd != -1)
+		close(lm->fd);
+	free(lm->file);
+	free(lm);
+}
+
+/*
+ * One read per event, so a chatty service cannot starve the others,
+ * the pipe is level triggered so we get called again for the rest.
+ */
+static void logmux_cb(uev_t *w, void *arg, int events)
+{
+	struct logmux *lm = (struct logmux *)arg;
+	ssize_t len;
+
+	if (UEV_ERROR == events) {
+		dbg("%s: spurious problem with log pipe, restarting.", lm->ident);
+		uev_io_start(w);
+		return;
+	}
+
+	len = read(w->fd, &lm->buf[lm->len], sizeof(lm->buf) - lm->len - 1);
+	if (len == -1) {
+		if (errno == EAGAIN || errno == EINTR)
+			return;
+		len = 0;
+	}
+	if (len == 0) {
+		/* Service, and any children holding the pipe, has exited */
+		logmux_del(lm);
+		return;
+	}
+
+	lm->len += len;
+	lm->buf[lm->len] = 0;
+	logmux_lines(lm, 0);
+}
+
+/**
+ * logmux_wanted - Check if output of @svc should go to the log collector
+ * @svc: Service to check
+ *
+ * Returns:
+ * %TRUE(1) if the service has `log` to syslog or file, and the built-in
+ * log collector is enabled, otherwise %FALSE(0).
+ */
+int logmux_wanted(svc_t *svc)
+{
+	if (!log_builtin || svc_is_tty(svc))
+		return 0;
+
+	return svc->log.enabled && !svc->log.null && !svc->log.console;
+}
+
+/**
+ * logmux_add - Start collecting output from a service
+ * @svc: Service that was started
+ * @pid: PID of the process started, used for tagging
+ * @fd:  Read end of output pipe, owned by the log collector on return
+ *
+ * Returns:
+ * POSIX OK(0), or non-zero on error, in which case @fd is closed.
+ */
+int logmux_add(svc_t *svc, pid_t pid, int fd)
+{
+	int facility = LOG_DAEMON;
+	int level = LOG_INFO;
+	struct logmux *lm;
+	char prio[20];
+
+	lm = calloc(1, sizeof(*lm));
+	if (!lm)
+		goto fail;
+
+	lm->pid = pid;
+	lm->fd  = -1;
+	if (svc->log.ident[0])
+		strlcpy(lm->ident, svc->log.ident, sizeof(lm->ident));
+	else
+		svc_ident(svc, lm->ident, sizeof(lm->ident));
+
+	if (svc->log.prio[0]) {
+		strlcpy(prio, svc->log.prio, sizeof(prio));
+		log_parse(prio, &facility, &level);
+	}
+	lm->prio = facility | level;
+
+	if (svc->log.file[0] == '/') {
+		lm->file = strdup(svc->log.file);
+		if (!lm->file)
+			goto fail;
+	}
+
+	if (svc->log.rate > 0) {
+		lm->rate     = svc->log.rate;
+		lm->interval = svc->log.interval ?: 1;
+		lm->burst    = svc->log.burst ?: svc->log.rate;
+		lm->block    = svc->log.block;
+		lm->tokens   = lm->burst;
+		clock_gettime(CLOCK_MONOTONIC_COARSE, &lm->refill);
+	}
+
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	if (uev_io_init(ctx, &lm->watcher, logmux_cb, lm, fd, UEV_READ))
+		goto fail;
+
+	TAILQ_INSERT_TAIL(&mux, lm, link);
+
+	return 0;
+fail:
+	err(1, "%s: failed setting up log collector", svc_ident(svc, NULL, 0));
+	if (lm) {
+		free(lm->file);
+		free(lm);
+	}
+	close(fd);
+
+	return -1;
+}
+
+/**
+ * logmux_collect - Collect log rotation child
+ * @pid: PID of collected child, see service_monitor()
+ *
+ * Returns:
+ * %TRUE(1) if @pid was rotating a log file, otherwise %FALSE(0).
+ */
+int logmux_collect(pid_t pid)
+{
+	struct logmux *lm;
+
+	TAILQ_FOREACH(lm, &mux, link) {
+		if (lm->rotor != pid)
+			continue;
+
+		/* Lines written meanwhile went to the rotated file, reopen */
+		lm->rotor = 0;
+		if (lm->fd != -1) {
+			file_sync(lm);
+			close(lm->fd);
+			lm->fd = -1;
+		}
+
+		return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * logmux_count - Number of service output pipes collected
+ */
+int logmux_count(void)
+{
+	struct logmux *lm;
+	int num = 0;
+
+	TAILQ_FOREACH(lm, &mux, link)
+		num++;
+
+	return num;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -0,0 +1,56 @@
+/* Built-in log collector for stdout/stderr of services
+ *
+ * Copyright (c) 2025  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#ifndef FINIT_LOGMUX_H_
+#define FINIT_LOGMUX_H_
+
+#include "svc.h"
+
+#define LOGMUX_LINE 1024		/* Max line length, longer are split */
+
+/* log fsync:never|interval|always */
+enum {
+	LOG_FSYNC_NEVER,
+	LOG_FSYNC_INTERVAL,
+	LOG_FSYNC_ALWAYS,
+};
+
+extern int log_builtin;
+
+int   logmux_wanted (svc_t *svc);
+int   logmux_add    (svc_t *svc, pid_t pid, int fd);
+int   logmux_collect(pid_t pid);
+int   logmux_count  (void);
+
+/* logrotate.c */
+int   logrotate     (char *file, int num, off_t sz);
+
+#endif /* FINIT_LOGMUX_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -20,11 +20,19 @@
  * THE SOFTWARE.
  */
 
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
+#include <string.h>
 #include <syslog.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
 #ifdef _LIBITE_LITE
 # include <libite/lite.h>
 #else
@@ -41,11 +49,78 @@ static int recreate(char *path, mode_t mode, uid_t uid, gid_t gid)
 	return 0;
 }
 
+#ifdef HAVE_ZLIB
+/*
+ * Compress @file to @file.gz with zlib, keeping mode and owner, then
+ * remove @file.  Same result as gzip(1), without fork + exec of a shell
+ * and gzip while the writer of the log waits for us.
+ */
+static int logcompress(const char *file)
+{
+	size_t len = strlen(file) + 4;
+	char   gzfile[len];
+	char   buf[16384];
+	struct stat st;
+	int    in, out;
+	int    saved;
+	gzFile gz;
+	ssize_t num;
+
+	in = open(file, O_RDONLY | O_CLOEXEC);
+	if (in == -1)
+		return -1;
+	if (fstat(in, &st))
+		goto err_in;
+
+	snprintf(gzfile, len, "%s.gz", file);
+	out = open(gzfile, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, st.st_mode & 0777);
+	if (out == -1)
+		goto err_in;
+	/* Not fatal, same as gzip(1) */
+	if (fchown(out, st.st_uid, st.st_gid))
+		syslog(LOG_WARNING, "Failed chown %s: %s", gzfile, strerror(errno));
+
+	gz = gzdopen(out, "wb");
+	if (!gz) {
+		close(out);
+		goto err_out;
+	}
+
+	while ((num = read(in, buf, sizeof(buf))) > 0) {
+		if (gzwrite(gz, buf, num) != num) {
+			gzclose(gz);
+			goto err_out;
+		}
+	}
+	if (num == -1 || gzclose(gz) != Z_OK)
+		goto err_out;
+
+	close(in);
+	return remove(file);
+err_out:
+	saved = errno;
+	(void)remove(gzfile);
+	errno = saved;
+err_in:
+	syslog(LOG_ERR, "Failed compressing %s: %s", file, strerror(errno));
+	close(in);
+	return -1;
+}
+#else
+static int logcompress(const char *file)
+{
+	if (systemf("gzip %s 2>/dev/null", file))
+		return -1; /* no gzip, probably */
+
+	return remove(file);
+}
+#endif
+
 /*
  * This function triggers a log rotates of @file when size >= @sz bytes
  * At most @num old versions are kept and by default it starts gzipping
- * .2 and older log files.  If gzip is not available in $PATH then @num
- * files are kept uncompressed.
+ * .2 and older log files.  Without zlib, gzip is called, and if it is
+ * not available in $PATH then @num files are kept uncompressed.
  */
 int logrotate(char *file, int num, off_t sz)
 {
@@ -83,12 +158,8 @@ int logrotate(char *file, int num, off_t sz)
 					continue;
 				}
 
-				if (cnt == 2 && fexist(nfile)) {
-					if (systemf("gzip %s 2>/dev/null", nfile))
-						continue; /* no gzip, probably */
-
-					(void)remove(nfile);
-				}
+				if (cnt == 2 && fexist(nfile))
+					(void)logcompress(nfile);
 			}
 
 			if (rename(file, nfile))
@@ -0,0 +1,282 @@
+/* Follow service and condition changes, initctl monitor and wait
+ *
+ * Copyright (c) 2025  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+#include <errno.h>
+#include <fnmatch.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _LIBITE_LITE
+# include <libite/lite.h>
+#else
+# include <lite/lite.h>
+#endif
+
+#include "client.h"
+#include "cond.h"
+#include "initctl.h"
+#include "monitor.h"
+
+/*
+ * What initctl wait waits for, each argument is either a service in a
+ * given state, NAME[:ID]=STATE, or a condition expression.
+ */
+struct want {
+	char             *ident;	/* NAME[:ID], NULL for conditions */
+	char             *status;	/* see svc_status() */
+	struct cond_expr  ce;
+};
+
+/* Last known state of a condition, or a service, from Finit */
+struct seen {
+	char             *name;		/* Condition name, or service ident */
+	enum cond_state   state;
+	const char       *status;	/* svc_status(), static strings */
+};
+
+static struct want *wants;
+static int          wants_num;
+
+static struct seen *conds;
+static size_t       conds_num;
+static struct seen *svcs;
+static size_t       svcs_num;
+
+static int msec(void)
+{
+	return timeout > 0 ? timeout * 1000 : -1;
+}
+
+static int print_cb(svc_t *svc, struct client_cond *cond, void *arg)
+{
+	char ident[MAX_IDENT_LEN];
+	int *synced = arg;
+
+	if (!svc && !cond) {
+		*synced = 1;
+		return 0;
+	}
+
+	/* Current state is only shown in verbose mode */
+	if (!*synced && !verbose)
+		return 0;
+
+	if (cond) {
+		if (json)
+			printf("{ \"type\": \"condition\", \"name\": \"%s\", \"state\": \"%s\" }\n",
+			       json_escape(cond->name), condstr(cond->state));
+		else
+			printf("%-8s%-40s %s\n", "cond", cond->name, condstr(cond->state));
+	} else {
+		svc_ident(svc, ident, sizeof(ident));
+		if (json)
+			printf("{ \"type\": \"%s\", \"identity\": \"%s\", \"status\": \"%s\", \"pid\": %d }\n",
+			       svc_typestr(svc), json_escape(ident), svc_status(svc), svc->pid);
+		else
+			printf("%-8s%-40s %s\n", svc_typestr(svc), ident, svc_status(svc));
+	}
+	fflush(stdout);
+
+	return 0;
+}
+
+/*
+ * Print changes to services and conditions as they happen, until
+ * interrupted, or for the given timeout.  With -v also the current
+ * state of everything first.
+ */
+int do_monitor(char *arg)
+{
+	int synced = 0;
+
+	(void)arg;
+
+	if (client_monitor(print_cb, &synced, msec()) == -1) {
+		if (errno == ETIMEDOUT)
+			return 0;
+		ERR(69, "Failed monitoring Finit");
+	}
+
+	return 0;
+}
+
+static struct seen *seen(struct seen **list, size_t *num, const char *name)
+{
+	struct seen *tmp;
+	size_t i;
+
+	for (i = 0; i < *num; i++) {
+		if (!strcmp((*list)[i].name, name))
+			return &(*list)[i];
+	}
+
+	tmp = realloc(*list, (*num + 1) * sizeof(**list));
+	if (!tmp)
+		ERR(70, "Out of memory");
+	*list = tmp;
+
+	tmp = &(*list)[(*num)++];
+	memset(tmp, 0, sizeof(*tmp));
+	tmp->name = strdup(name);
+	if (!tmp->name)
+		ERR(70, "Out of memory");
+
+	return tmp;
+}
+
+/* Same as 'initctl cond get', a name without slashes is a usr/ condition */
+static enum cond_state cond_seen(const char *name)
+{
+	enum cond_state state = COND_OFF;
+	char usr[MAX_COND_LEN];
+	int wildcard;
+	size_t i;
+
+	if (!strchr(name, '/')) {
+		snprintf(usr, sizeof(usr), COND_USR "%s", name);
+		name = usr;
+	}
+
+	/* A wildcard is on if any matching condition is on */
+	wildcard = cond_is_wildcard(name);
+	for (i = 0; i < conds_num; i++) {
+		if (wildcard ? fnmatch(name, conds[i].name, FNM_PATHNAME) : strcmp(name, conds[i].name))
+			continue;
+
+		if (conds[i].state > state)
+			state = conds[i].state;
+		if (!wildcard)
+			break;
+	}
+
+	return state;
+}
+
+/* NAME matches all instances, and all of them must be in @w->status */
+static int svc_done(struct want *w)
+{
+	size_t i, len;
+	int found = 0;
+
+	len = strlen(w->ident);
+	for (i = 0; i < svcs_num; i++) {
+		const char *ident = svcs[i].name;
+
+		if (strncmp(ident, w->ident, len) || (ident[len] && (strchr(w->ident, ':') || ident[len] != ':')))
+			continue;
+
+		if (strcmp(svcs[i].status, w->status))
+			return 0;
+		found++;
+	}
+
+	return found;
+}
+
+static int wait_cb(svc_t *svc, struct client_cond *cond, void *arg)
+{
+	enum cond_state state[MAX_NUM_SVC_COND];
+	char ident[MAX_IDENT_LEN];
+	int *synced = arg;
+	int i, j;
+
+	if (cond)
+		seen(&conds, &conds_num, cond->name)->state = cond->state;
+	else if (svc)
+		seen(&svcs, &svcs_num, svc_ident(svc, ident, sizeof(ident)))->status = svc_status(svc);
+	else
+		*synced = 1;
+
+	if (!*synced)
+		return 0;
+
+	for (i = 0; i < wants_num; i++) {
+		struct want *w = &wants[i];
+
+		if (w->ident) {
+			if (!svc_done(w))
+				return 0;
+			continue;
+		}
+
+		for (j = 0; j < w->ce.num; j++)
+			state[j] = cond_seen(w->ce.name[j]);
+		if (cond_expr_eval(w->ce.op, w->ce.len, state) != COND_ON)
+			return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * Wait for all arguments, each a condition expression or a service in
+ * a given state, e.g., 'net/eth0/up|net/eth1/up' or 'sshd=running'.
+ * Returns 0 when done, or 1 on timeout.
+ */
+int do_wait(int argc, char *argv[])
+{
+	int synced = 0;
+	int i;
+
+	if (argc < 1)
+		ERRX(2, "Missing condition or service to wait for");
+
+	wants = calloc(argc, sizeof(*wants));
+	if (!wants)
+		ERR(70, "Out of memory");
+	wants_num = argc;
+
+	for (i = 0; i < argc; i++) {
+		struct want *w = &wants[i];
+		char *ptr;
+
+		ptr = strchr(argv[i], '=');
+		if (ptr) {
+			*ptr++ = 0;
+			if (!argv[i][0] || !*ptr)
+				ERRX(2, "Invalid service state, should be NAME[:ID]=STATE");
+			w->ident  = argv[i];
+			w->status = ptr;
+			continue;
+		}
+
+		if (cond_expr_parse(argv[i], &w->ce))
+			ERRX(2, "Invalid condition expression: %s", argv[i]);
+	}
+
+	if (client_monitor(wait_cb, &synced, msec()) == -1) {
+		if (errno == ETIMEDOUT)
+			ERRX(1, "Timed out");
+		ERR(69, "Failed monitoring Finit");
+	}
+
+	return 0;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -38,6 +38,7 @@
 #include "pid.h"
 #include "svc.h"
 #include "helpers.h"
+#include "util.h"
 
 
 /**
@@ -102,7 +103,7 @@ char *pid_get_name(pid_t pid, char *name, size_t len)
 
 char *pid_file(svc_t *svc)
 {
-	if (svc->pidfile[0]) {
+	if (svc->pidfile) {
 		if (svc->pidfile[0] == '!')
 			return &svc->pidfile[1];
 		return svc->pidfile;
@@ -136,7 +137,7 @@ int pid_file_create(svc_t *svc)
 {
 	FILE *fp;
 
-	if (!svc->pidfile[0] || svc->pidfile[0] == '!')
+	if (!svc->pidfile || svc->pidfile[0] == '!')
 		return 1;
 
 	fp = fopen(svc->pidfile, "w");
@@ -149,7 +150,7 @@ int pid_file_create(svc_t *svc)
 
 int pid_file_set(svc_t *svc, char *file, int not)
 {
-	char buf[sizeof(svc->pidfile)];
+	char buf[MAX_CMD_LEN + 1];
 
 	if (!file) {
 		file = pid_file(svc);
@@ -168,10 +169,11 @@ int pid_file_set(svc_t *svc, char *file, int not)
 	}
 
 	de_dotdot(file);
-	pid_runpath(file, buf, sizeof(buf));
-	strlcpy(&svc->pidfile[not], buf, sizeof(svc->pidfile) - not);
-	if (not)
-		svc->pidfile[0] = '!';
+	buf[0] = '!';
+	pid_runpath(file, &buf[1], sizeof(buf) - 1);
+	if (strset(&svc->pidfile, not ? buf : &buf[1]))
+		return -1;
+	svc_reindex(svc);
 
 	return 0;
 }
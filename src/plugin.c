@@ -43,6 +43,7 @@
 #include "private.h"
 #include "service.h"
 #include "sig.h"
+#include "timeline.h"
 #include "util.h"
 
 #define is_io_plugin(p) ((p)->io.cb && (p)->io.fd > 0)
@@ -255,12 +256,14 @@ void plugin_run_hook(hook_point_t no, void *arg)
 	}
 #endif
 
+	timeline_hook(no, 0);
 	PLUGIN_ITERATOR(p, tmp) {
 		if (p->hook[no].cb) {
 			dbg("Calling %s hook n:o %d (arg: %p) ...", basenm(p->name), no, arg ?: "NIL");
 			p->hook[no].cb(arg ? arg : p->hook[no].arg);
 		}
 	}
+	timeline_hook(no, 1);
 
 	/*
 	 * Conditions are stored in /run, so don't try to signal
@@ -25,6 +25,7 @@
 #ifndef FINIT_PRIVATE_H_
 #define FINIT_PRIVATE_H_
 
+#include "cond.h"
 #include "svc.h"
 #include "plugin.h"
 
@@ -38,6 +39,9 @@ extern char *finit_conf;
 extern char *finit_rcsd;
 extern svc_t *wdog;
 extern int   service_interval;
+extern int   start_concurrency;
+extern int   restart_budget;
+extern int   restart_budget_sec;
 extern char *fsck_mode;
 extern char *fsck_repair;
 
@@ -45,6 +49,8 @@ extern uev_ctx_t *ctx;
 
 int          api_init         (uev_ctx_t *ctx);
 int          api_exit         (void);
+void         api_svc_event    (svc_t *svc);
+void         api_cond_event   (const char *name, enum cond_state state);
 void         conf_flush_events(void);
 
 void         service_monitor  (pid_t lost, int status);
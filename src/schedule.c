@@ -29,18 +29,12 @@
 #define SC_INIT 0x494E4954	/* "INIT", see ascii(7) */
 
 /*
- * libuEv callback wrapper
+ * Timer wheel callback wrapper
  */
-static void cb(uev_t *w, void *arg, int events)
+static void cb(struct wtimer *t, void *arg)
 {
 	struct wq *work = (struct wq *)arg;
 
-	if (UEV_ERROR == events) {
-		dbg("%s(): spurious problem with schedule work timer, restarting.", __func__);
-		uev_timer_start(w);
-		return;
-	}
-
 	work->cb(work);
 }
 
@@ -49,18 +43,15 @@ static void cb(uev_t *w, void *arg, int events)
  */
 int schedule_work(struct wq *work)
 {
-	int msec;
-
 	if (!work)
 		return errno = EINVAL;
 
-	msec = work->delay;
 	if (work->init != SC_INIT) {
 		work->init = SC_INIT;
-		return uev_timer_init(ctx, &work->watcher, cb, work, msec, 0);
+		wheel_timer_init(&work->timer, cb, work);
 	}
 
-	return uev_timer_set(&work->watcher, msec, 0);
+	return wheel_timer_set(&work->timer, work->delay);
 }
 
 /**
@@ -24,8 +24,10 @@
 #ifndef FINIT_SCHEDULE_H_
 #define FINIT_SCHEDULE_H_
 
+#include "wheel.h"
+
 struct wq {
-	uev_t   watcher;
+	struct wtimer timer;
 	int     init;
 	int     delay;		/* msec delay before starting work */
 	void  (*cb)(void *);
@@ -26,11 +26,15 @@
 
 #include <ctype.h>		/* isblank() */
 #include <grp.h>			/* setgroups() */
+#ifdef HAVE_MALLINFO2
+#include <malloc.h>		/* mallinfo2() */
+#endif
 #include <sched.h>		/* sched_yield() */
 #include <string.h>
 #include <sys/reboot.h>
 #include <sys/prctl.h>
 #include <sys/resource.h>
+#include <sys/socket.h>		/* SO_PASSCRED, SCM_CREDENTIALS */
 #include <sys/un.h>
 #include <sys/wait.h>
 #include <net/if.h>
@@ -52,18 +56,21 @@
 #include "devmon.h"
 #include "finit.h"
 #include "helpers.h"
+#include "logmux.h"
 #include "pid.h"
 #include "private.h"
 #include "sig.h"
 #include "service.h"
 #include "sm.h"
+#include "sock.h"
+#include "spawn.h"
+#include "svcmap.h"
+#include "timeline.h"
 #include "tty.h"
 #include "util.h"
 #include "utmp-api.h"
 #include "schedule.h"
 
-#define NOTIFY_PATH "@run/finit/notify/%d"
-
 
 /*
  * run tasks block other tasks/services from starting, we track the
@@ -71,33 +78,255 @@
  */
 static pid_t run_block_pid;
 
+/* Write end of log pipe in a service_fork() child, see lredirect() */
+static int logpipe = -1;
+
 static struct wq work = {
 	.cb = service_worker,
 };
 int service_interval = SERVICE_INTERVAL_DEFAULT;
+int start_concurrency = 0;
+int restart_budget = 0;
+int restart_budget_sec = 1;
+int notify_shared = 0;
+
+/*
+ * Services with changed inputs are queued for service_step(), which
+ * is drained by service_worker() and sm_step().  Services waiting for
+ * a run task to complete are parked on the blocked queue until the run
+ * task is collected.
+ */
+#define SVC_QUEUED_STEP    1
+#define SVC_QUEUED_BLOCKED 2
+
+static TAILQ_HEAD(, svc) step_queue    = TAILQ_HEAD_INITIALIZER(step_queue);
+static TAILQ_HEAD(, svc) blocked_queue = TAILQ_HEAD_INITIALIZER(blocked_queue);
+
+/* Statistics for initctl stats */
+static struct {
+	unsigned long long steps;
+	unsigned int       sweeps;
+	unsigned int       queued;
+	time_t             sec;		/* current second, monotonic */
+	unsigned int       cnt;		/* steps in current second */
+	unsigned int       last;	/* steps in previous second */
+} stats;
+
+/**
+ * service_dequeue - Remove service from step queues
+ * @svc: Pointer to &svc_t object
+ *
+ * Called by svc_del() before a service is garbage collected.
+ */
+void service_dequeue(svc_t *svc)
+{
+	switch (svc->queued) {
+	case SVC_QUEUED_STEP:
+		TAILQ_REMOVE(&step_queue, svc, qlink);
+		stats.queued--;
+		break;
+	case SVC_QUEUED_BLOCKED:
+		TAILQ_REMOVE(&blocked_queue, svc, qlink);
+		break;
+	default:
+		return;
+	}
+	svc->queued = 0;
+}
+
+/**
+ * service_enqueue - Queue service for service_step()
+ * @svc: Service whose inputs have changed
+ *
+ * Used when a service may need to change state, but it is not safe
+ * or not necessary to step it right away.  The queue is drained by
+ * service_worker() from the event loop, or sm_step().
+ */
+void service_enqueue(svc_t *svc)
+{
+	if (!svc || !svc->hlive || svc->queued == SVC_QUEUED_STEP)
+		return;
+
+	service_dequeue(svc);
+	TAILQ_INSERT_TAIL(&step_queue, svc, qlink);
+	svc->queued = SVC_QUEUED_STEP;
+	stats.queued++;
+
+	schedule_work(&work);
+}
+
+/* Park service until the current run task has been collected */
+static void service_enqueue_blocked(svc_t *svc)
+{
+	if (svc->queued)
+		return;
+
+	TAILQ_INSERT_TAIL(&blocked_queue, svc, qlink);
+	svc->queued = SVC_QUEUED_BLOCKED;
+}
+
+static void service_unblock_queued(void)
+{
+	svc_t *svc;
+
+	while ((svc = TAILQ_FIRST(&blocked_queue)))
+		service_enqueue(svc);
+}
+
+/* A service stopped, retry any services blocked in conflict */
+static void service_enqueue_conflicts(svc_t *stopped)
+{
+	svc_t *svc, *iter = NULL;
+
+	for (svc = svc_iterator(&iter, 1); svc; svc = svc_iterator(&iter, 0)) {
+		if (svc != stopped && svc_is_conflict(svc))
+			service_enqueue(svc);
+	}
+}
+
+/*
+ * Start slots, with `start-concurrency N` in finit.conf at most N
+ * services may be starting at the same time: from leaving WAITING,
+ * through any pre: script, until the service is ready, or run/task
+ * is done.  The rest wait on the slot queue, ordered by priority:,
+ * and are stepped when a slot is released.  A service that takes
+ * longer than SVC_SLOT_TIMEOUT to become ready gives up its slot, so
+ * a service without working readiness notification cannot stall the
+ * boot.  TTYs are never held back.
+ */
+#define SVC_SLOT_QUEUED    1
+#define SVC_SLOT_ACTIVE    2
+#define SVC_SLOT_TIMEOUT   10	/* sec */
+
+static TAILQ_HEAD(, svc) slot_queue = TAILQ_HEAD_INITIALIZER(slot_queue);
+static unsigned int slot_queued;
+static unsigned int slot_num;
+
+/* Step as many services from the slot queue as there are free slots */
+static void service_slot_dispatch(void)
+{
+	int avail = start_concurrency - slot_num;
+	svc_t *svc;
+
+	TAILQ_FOREACH(svc, &slot_queue, slink) {
+		if (avail-- <= 0)
+			break;
+		service_enqueue(svc);
+	}
+}
+
+/**
+ * service_slot_release - Give up start slot, or place in slot queue
+ * @svc: Pointer to &svc_t object
+ *
+ * Called when @svc is ready, leaves the starting states, or by
+ * svc_del() before a service is garbage collected.
+ */
+void service_slot_release(svc_t *svc)
+{
+	switch (svc->slot) {
+	case SVC_SLOT_QUEUED:
+		TAILQ_REMOVE(&slot_queue, svc, slink);
+		slot_queued--;
+		break;
+	case SVC_SLOT_ACTIVE:
+		wheel_timer_stop(&svc->slot_tmo);
+		slot_num--;
+		break;
+	default:
+		return;
+	}
+	svc->slot = 0;
+
+	service_slot_dispatch();
+}
+
+static void service_slot_timeout(struct wtimer *t, void *arg)
+{
+	svc_t *svc = arg;
+
+	logit(LOG_NOTICE, "%s not ready after %d sec, releasing start slot",
+	      svc_ident(svc, NULL, 0), SVC_SLOT_TIMEOUT);
+	service_slot_release(svc);
+}
+
+/*
+ * Try to get a start slot for @svc.  Only services ahead of @svc in the
+ * slot queue, or with at least the same priority if @svc is not queued
+ * yet, are considered before @svc.
+ *
+ * Returns:
+ * %TRUE(1) if @svc may start, otherwise %FALSE(0) and @svc is queued.
+ */
+static int service_slot_get(svc_t *svc)
+{
+	int ahead = 0;
+	svc_t *s;
+
+	if (svc->slot == SVC_SLOT_ACTIVE)
+		return 1;
+	if (!start_concurrency || svc_is_tty(svc)) {
+		service_slot_release(svc);
+		return 1;
+	}
+
+	TAILQ_FOREACH(s, &slot_queue, slink) {
+		if (s == svc)
+			break;
+		if (svc->slot == SVC_SLOT_QUEUED || s->priority >= svc->priority)
+			ahead++;
+	}
+
+	if (slot_num + ahead < (unsigned int)start_concurrency) {
+		if (svc->slot == SVC_SLOT_QUEUED) {
+			TAILQ_REMOVE(&slot_queue, svc, slink);
+			slot_queued--;
+		}
+
+		svc->slot = SVC_SLOT_ACTIVE;
+		slot_num++;
+
+		wheel_timer_init(&svc->slot_tmo, service_slot_timeout, svc);
+		wheel_timer_set(&svc->slot_tmo, SVC_SLOT_TIMEOUT * 1000);
+
+		return 1;
+	}
+
+	if (svc->slot != SVC_SLOT_QUEUED) {
+		dbg("%s: no free start slot, %u starting, queueing", svc_ident(svc, NULL, 0), slot_num);
+		TAILQ_FOREACH(s, &slot_queue, slink) {
+			if (s->priority < svc->priority)
+				break;
+		}
+		if (s)
+			TAILQ_INSERT_BEFORE(s, svc, slink);
+		else
+			TAILQ_INSERT_TAIL(&slot_queue, svc, slink);
+		svc->slot = SVC_SLOT_QUEUED;
+		slot_queued++;
+	}
+
+	return 0;
+}
 
 static void svc_set_state(svc_t *svc, svc_state_t new_state);
 static void service_notify_cb(uev_t *w, void *arg, int events);
+static int  service_notify_shared(void);
+static void service_collect(svc_t *svc, pid_t lost, int status);
+static void service_retry(svc_t *svc);
 
 
 /**
- * service_timeout_cb - libuev callback wrapper for service timeouts
- * @w:      Watcher
- * @arg:    Callback argument, from init
- * @events: Error, or ready to read/write (N/A for relative timers)
+ * service_timeout_cb - Timer wheel callback wrapper for service timeouts
+ * @t:   Timer
+ * @arg: Callback argument, the service
  *
  * Run callback registered when calling service_timeout_after().
  */
-static void service_timeout_cb(uev_t *w, void *arg, int events)
+static void service_timeout_cb(struct wtimer *t, void *arg)
 {
 	svc_t *svc = arg;
 
-	if (UEV_ERROR == events) {
-		dbg("%s: spurious problem", svc_ident(svc, NULL, 0));
-		uev_timer_start(w);
-		return;
-	}
-
 	if (svc->timer_cb)
 		svc->timer_cb(svc);
 }
@@ -123,7 +352,9 @@ int service_timeout_after(svc_t *svc, int timeout, void (*cb)(svc_t *svc))
 		return -EBUSY;
 
 	svc->timer_cb = cb;
-	return uev_timer_init(ctx, &svc->timer, service_timeout_cb, svc, timeout, 0);
+	wheel_timer_init(&svc->timer, service_timeout_cb, svc);
+
+	return wheel_timer_set(&svc->timer, timeout);
 }
 
 /**
@@ -137,15 +368,13 @@ int service_timeout_after(svc_t *svc, int timeout, void (*cb)(svc_t *svc))
  */
 int service_timeout_cancel(svc_t *svc)
 {
-	int err;
-
 	if (!svc->timer_cb)
 		return 0;
 
-	err = uev_timer_stop(&svc->timer);
+	wheel_timer_stop(&svc->timer);
 	svc->timer_cb = NULL;
 
-	return err;
+	return 0;
 }
 
 struct assoc {
@@ -269,36 +498,33 @@ static void fallback_logger(char *ident, char *prio)
 	closelog();
 }
 
+/* Command line for the logger of a service, see logger_args() */
+struct logger {
+	char  *cmd;
+	char  *argv[16];
+	char  *tag;
+	char  *prio;
+	char   ident[MAX_IDENT_LEN];
+	char   pid[16];
+	char   rot[25];
+	char   sz[20];
+	char   num[3];
+	char   buf[20];
+	char   rate[40];
+};
+
 /*
- * Redirect output to syslog using the command line logit tool
+ * First time, check if we have sysklogd logger tool.
+ * It supports logging the actual PID of the service.
  */
-static int lredirect(svc_t *svc)
+static int have_sysklogd(void)
 {
-	static int have_sysklogd = -1;
-	pid_t svc_pid = getpid();
-	int pipefd[2];
-	pid_t pid;
+	static int have = -1;
 
-	/*
-	 * Use a pipe to connect to logger.  This ensures isatty()
-	 * returns false for the service, preventing programs from
-	 * emitting ANSI escape codes and other TTY-specific output.
-	 */
-	if (pipe(pipefd) == -1) {
-		dbg("Failed pipe(), errno %d: %s", errno, strerror(errno));
-		svc->log.enabled = 0;
-
-		return -1;
-	}
-
-	/*
-	 * First time, check if we have sysklogd logger tool.
-	 * It supports logging the actual PID of the service.
-	 */
-	if (have_sysklogd == -1) {
+	if (have == -1) {
 		FILE *pp;
 
-		have_sysklogd = 0;
+		have = 0;
 
 		pp = popen("logger -h 2>/dev/null", "r");
 		if (pp) {
@@ -306,7 +532,7 @@ static int lredirect(svc_t *svc)
 
 			while (fgets(buf, sizeof(buf), pp)) {
 				if (strstr(buf, "-I PID")) {
-					have_sysklogd = 1;
+					have = 1;
 					break;
 				}
 			}
@@ -314,69 +540,163 @@ static int lredirect(svc_t *svc)
 		}
 	}
 
-	pid = fork();
-	if (pid == 0) {
-		char *prio = "daemon.info";
-		char buf[MAX_IDENT_LEN];
-		char *tag;
-
-		sched_yield();
-
-		close(pipefd[1]);  /* Close write end in logger */
-		dup2(pipefd[0], STDIN_FILENO);
-		close(pipefd[0]);
-
-		/* Reset signals */
-		sig_unblock();
-
-		/* Default syslog identity name[:id] */
-		tag = svc_ident(svc, buf, sizeof(buf));
-
-		if (svc->log.ident[0])
-			tag = svc->log.ident;
-		if (svc->log.prio[0])
-			prio = svc->log.prio;
+	return have;
+}
 
-		/* Neither sysklogd logger or native logit tool available */
-		if (!have_sysklogd && !whichp(_PATH_LOGIT)) {
-			logit(LOG_INFO, _PATH_LOGIT " missing, using syslog for %s instead", svc->name);
-			fallback_logger(tag, prio);
-			_exit(0);
-		}
+/* logit -S, indexed by LOG_FSYNC_* */
+static char *fsync_policy[] = { "never", "interval", "always" };
 
-		if (svc->log.file[0] == '/') {
-			if (have_sysklogd) {
-				char rot[25], pid[16];
+/*
+ * Compose the logger command line for @svc with PID @svc_pid, either
+ * sysklogd logger, or our native logit tool.  Returns %NULL if neither
+ * is available, tag and prio are always set for fallback_logger().
+ */
+static char **logger_args(svc_t *svc, pid_t svc_pid, struct logger *lg)
+{
+	char **argv = lg->argv;
+	int sysklogd, i = 0;
 
-				snprintf(rot, sizeof(rot), "%d:%d", logfile_size_max, logfile_count_max);
-				snprintf(pid, sizeof(pid), "%d", svc_pid);
-				execlp("logger", "logger", "-f", svc->log.file, "-b", "-t", tag, "-p", prio, "-I", pid, "-r", rot, debug ? "-s" : NULL, NULL);
-			} else {
-				char sz[20], num[3];
+	/* Default syslog identity name[:id] */
+	lg->tag  = svc_ident(svc, lg->ident, sizeof(lg->ident));
+	lg->prio = "daemon.info";
 
-				snprintf(sz, sizeof(sz), "%d", logfile_size_max);
-				snprintf(num, sizeof(num), "%d", logfile_count_max);
+	if (svc->log.ident[0])
+		lg->tag = svc->log.ident;
+	if (svc->log.prio[0])
+		lg->prio = svc->log.prio;
 
-				execlp(_PATH_LOGIT, "logit", "-f", svc->log.file, "-n", sz, "-r", num, debug ? "-s" : NULL, NULL);
+	/* Neither sysklogd logger or native logit tool available */
+	if (!have_sysklogd() && !whichp(_PATH_LOGIT))
+		return NULL;
 
+	/* Only logit can do log:rate, prefer it over sysklogd logger */
+	sysklogd = have_sysklogd();
+	if (svc->log.rate && whichp(_PATH_LOGIT))
+		sysklogd = 0;
+
+	snprintf(lg->pid, sizeof(lg->pid), "%d", svc_pid);
+	if (svc->log.file[0] == '/') {
+		if (sysklogd) {
+			snprintf(lg->rot, sizeof(lg->rot), "%d:%d", logfile_size_max, logfile_count_max);
+			argv[i++] = "logger";
+			argv[i++] = "-f";
+			argv[i++] = svc->log.file;
+			argv[i++] = "-b";
+			argv[i++] = "-t";
+			argv[i++] = lg->tag;
+			argv[i++] = "-p";
+			argv[i++] = lg->prio;
+			argv[i++] = "-I";
+			argv[i++] = lg->pid;
+			argv[i++] = "-r";
+			argv[i++] = lg->rot;
+		} else {
+			snprintf(lg->sz, sizeof(lg->sz), "%d", logfile_size_max);
+			snprintf(lg->num, sizeof(lg->num), "%d", logfile_count_max);
+			argv[i++] = "logit";
+			argv[i++] = "-f";
+			argv[i++] = svc->log.file;
+			argv[i++] = "-n";
+			argv[i++] = lg->sz;
+			argv[i++] = "-r";
+			argv[i++] = lg->num;
+			if (logfile_buffer > 0) {
+				snprintf(lg->buf, sizeof(lg->buf), "%d", logfile_buffer);
+				argv[i++] = "-b";
+				argv[i++] = lg->buf;
 			}
-			_exit(1);
+			argv[i++] = "-S";
+			argv[i++] = fsync_policy[logfile_fsync];
 		}
-
+	} else if (sysklogd && svc->notify != SVC_NOTIFY_SYSTEMD) {
 		/*
 		 * For now, let systemd programs go via our native logit
 		 * tool.  It supports systemd logging defines for stderr
 		 * parsing.  The only real downside is that it cannot do
 		 * PID faking, like sysklogd's logger tool.
 		 */
-		if (have_sysklogd && svc->notify != SVC_NOTIFY_SYSTEMD) {
-			char pid[16];
+		argv[i++] = "logger";
+		argv[i++] = "-t";
+		argv[i++] = lg->tag;
+		argv[i++] = "-p";
+		argv[i++] = lg->prio;
+		argv[i++] = "-I";
+		argv[i++] = lg->pid;
+	} else {
+		argv[i++] = "logit";
+		argv[i++] = "-t";
+		argv[i++] = lg->tag;
+		argv[i++] = "-p";
+		argv[i++] = lg->prio;
+	}
+	if (!sysklogd && svc->log.rate) {
+		snprintf(lg->rate, sizeof(lg->rate), "%d/%d,%d", svc->log.rate,
+			 svc->log.interval ?: 1, svc->log.burst ?: svc->log.rate);
+		argv[i++] = "-R";
+		argv[i++] = lg->rate;
+		if (svc->log.block)
+			argv[i++] = "-w";
+	}
+	if (debug)
+		argv[i++] = "-s";
+	argv[i] = NULL;
 
-			snprintf(pid, sizeof(pid), "%d", svc_pid);
-			execlp("logger", "logger", "-t", tag, "-p", prio, "-I", pid, debug ? "-s" : NULL, NULL);
-		} else {
-			execlp(_PATH_LOGIT, "logit", "-t", tag, "-p", prio, debug ? "-s" : NULL, NULL);
+	lg->cmd = strcmp(argv[0], "logger") ? _PATH_LOGIT : "logger";
+
+	return argv;
+}
+
+/*
+ * Redirect output to syslog using the built-in log collector, set up
+ * by service_fork(), or the command line logit tool
+ */
+static int lredirect(svc_t *svc)
+{
+	pid_t svc_pid = getpid();
+	int pipefd[2];
+	pid_t pid;
+
+	if (logpipe != -1) {
+		dup2(logpipe, STDOUT_FILENO);
+		dup2(logpipe, STDERR_FILENO);
+		close(logpipe);
+		logpipe = -1;
+
+		return 0;
+	}
+
+	/*
+	 * Use a pipe to connect to logger.  This ensures isatty()
+	 * returns false for the service, preventing programs from
+	 * emitting ANSI escape codes and other TTY-specific output.
+	 */
+	if (pipe(pipefd) == -1) {
+		dbg("Failed pipe(), errno %d: %s", errno, strerror(errno));
+		svc->log.enabled = 0;
+
+		return -1;
+	}
+
+	pid = fork();
+	if (pid == 0) {
+		struct logger lg;
+
+		sched_yield();
+
+		close(pipefd[1]);  /* Close write end in logger */
+		dup2(pipefd[0], STDIN_FILENO);
+		close(pipefd[0]);
+
+		/* Reset signals */
+		sig_unblock();
+
+		if (!logger_args(svc, svc_pid, &lg)) {
+			logit(LOG_INFO, _PATH_LOGIT " missing, using syslog for %s instead", svc->name);
+			fallback_logger(lg.tag, lg.prio);
+			_exit(0);
 		}
+
+		execvp(lg.cmd, lg.argv);
 		_exit(1);
 	}
 
@@ -484,10 +804,7 @@ static void compose_cmdline(svc_t *svc, char *buf, size_t len)
 	size_t i;
 
 	strlcpy(buf, svc->cmd, len);
-	for (i = 1; i < MAX_NUM_SVC_ARGS; i++) {
-		if (!strlen(svc->args[i]))
-			break;
-
+	for (i = 1; svc->args && svc->args[i]; i++) {
 		strlcat(buf, " ", len);
 		strlcat(buf, svc->args[i], len);
 	}
@@ -501,7 +818,7 @@ static void set_uid(uid_t uid, svc_t *svc)
 	 * otherwise it would (by design) drop all capabilities,
 	 * breaking root services
 	 */
-	if (svc->capabilities[0]) {
+	if (svc->capabilities) {
 		cap_iab_t cap_iab;
 
 		if (cap_setuid(uid)) {
@@ -529,20 +846,145 @@ static void set_uid(uid_t uid, svc_t *svc)
 		err(1, "%s: failed setuid(%d)", svc_ident(svc, NULL, 0), uid);
 }
 
-static pid_t service_fork(svc_t *svc)
+/*
+ * The pidfd of a child is readable when it has exited.  Reap it and
+ * hand the status straight to its svc_t, without any PID lookup.  If
+ * the child is no longer svc->pid, e.g. a ready: script, we fall back
+ * to service_monitor(), same as for children collected on SIGCHLD.
+ */
+static void service_pidfd_cb(uev_t *w, void *arg, int events)
 {
+	struct svc_pidfd *pfd = arg;
+	siginfo_t info;
+	int status;
+	svc_t *svc;
+
+	memset(&info, 0, sizeof(info));
+	if (waitid(P_PIDFD, w->fd, &info, WEXITED | WNOHANG | __WALL) == -1) {
+		if (EINTR == errno)
+			return;
+		logit(LOG_ERR, "Failed collecting PID %d: %s", pfd->pid, strerror(errno));
+		goto done;
+	}
+	if (!info.si_pid) {
+		if (UEV_ERROR == events)
+			logit(LOG_ERR, "Lost pidfd of PID %d", pfd->pid);
+		return;
+	}
+
+	/* Same as status from waitpid() */
+	switch (info.si_code) {
+	case CLD_EXITED:
+		status = (info.si_status & 0xff) << 8;
+		break;
+	case CLD_DUMPED:
+		status = (info.si_status & 0x7f) | 0x80;
+		break;
+	default:
+		status = info.si_status & 0x7f;
+		break;
+	}
+	dbg("Collected child PID %d, status: %d", pfd->pid, status);
+
+	svc = pfd->svc;
+	if (svc) {
+		svc->pidfd = NULL;
+		service_collect(svc, pfd->pid, status);
+	} else
+		service_monitor(pfd->pid, status);
+done:
+	uev_io_stop(w);
+	close(w->fd);
+	free(pfd);
+}
+
+/*
+ * Start watching the pidfd of a new child.  With @svcpid set the child
+ * is the new svc->pid, e.g. the main process or a pre: script.  There
+ * is no SIGCHLD for these children, so if we cannot watch the pidfd we
+ * kill the child and report failure to fork.
+ */
+static int service_pidfd_watch(svc_t *svc, pid_t pid, int pidfd, int svcpid)
+{
+	struct svc_pidfd *pfd;
+
+	pfd = calloc(1, sizeof(*pfd));
+	if (!pfd || uev_io_init(ctx, &pfd->watcher, service_pidfd_cb, pfd, pidfd, UEV_READ)) {
+		siginfo_t info;
+
+		err(1, "%s: failed watching pidfd of PID %d", svc_ident(svc, NULL, 0), pid);
+		pidfd_signal(pidfd, SIGKILL);
+		waitid(P_PIDFD, pidfd, &info, WEXITED | __WALL);
+		close(pidfd);
+		free(pfd);
+		return -1;
+	}
+	pfd->pid = pid;
+
+	if (svcpid) {
+		if (svc->pidfd)
+			svc->pidfd->svc = NULL;
+		svc->pidfd = pfd;
+		pfd->svc = svc;
+	}
+
+	return 0;
+}
+
+/**
+ * service_signal - Send signal to svc->pid
+ * @svc: Service to signal
+ * @sig: Signal to send
+ *
+ * Uses the pidfd of svc->pid, when available, so there is no risk of
+ * hitting an unrelated process if the PID has been recycled.
+ *
+ * Returns:
+ * Same as kill(2).
+ */
+int service_signal(svc_t *svc, int sig)
+{
+	if (svc->pidfd && svc->pidfd->pid == svc->pid)
+		return pidfd_signal(svc->pidfd->watcher.fd, sig);
+
+	return kill(svc->pid, sig);
+}
+
+static pid_t service_fork(svc_t *svc, int svcpid)
+{
+	int logfd[2] = { -1, -1 };
 	const char *cgnm;
 	char grnam[128];
 	int cgfd = -1;
+	int pidfd;
 	pid_t pid;
 
+	/*
+	 * Output pipe for redirect() in the child, read end is handed to
+	 * the log collector.  Children that never call redirect() close
+	 * the write end on exec, and the collector drops it on EOF.
+	 */
+	if (logmux_wanted(svc) && pipe2(logfd, O_CLOEXEC))
+		dbg("Failed pipe(), errno %d: %s", errno, strerror(errno));
+
 	cgnm = cgroup_svc_name(svc, grnam, sizeof(grnam));
 	cgfd = cgroup_prepare(svc, cgnm);
 
-	pid = call_clone3(0, cgfd);
+	pid = call_clone3(0, cgfd, &pidfd);
 	if (cgfd >= 0)
 		close(cgfd);
 
+	if (pid > 0 && pidfd >= 0 && service_pidfd_watch(svc, pid, pidfd, svcpid))
+		pid = -1;
+
+	if (pid != 0 && logfd[1] != -1) {
+		close(logfd[1]);
+		if (pid > 0)
+			logmux_add(svc, pid, logfd[0]);
+		else
+			close(logfd[0]);
+	}
+
 	if (pid < 0) {
 		cgroup_del_svc(svc, cgnm);
 		return pid;
@@ -550,6 +992,11 @@ static pid_t service_fork(svc_t *svc)
 
 	if (pid == 0) {
 		char *home = NULL;
+
+		if (logfd[1] != -1) {
+			close(logfd[0]);
+			logpipe = logfd[1];
+		}
 #ifdef ENABLE_STATIC
 		int uid = 0; /* XXX: Fix better warning that dropprivs is disabled. */
 		int gid = 0;
@@ -575,8 +1022,11 @@ static pid_t service_fork(svc_t *svc)
 		sched_yield();
 
 		/* Set configured limits */
+		struct rlimit rlimit[RLIMIT_NLIMITS];
+
+		svc_get_rlimit(svc, rlimit);
 		for (int i = 0; i < RLIMIT_NLIMITS; i++) {
-			if (setrlimit(i, &svc->rlimit[i]) == -1)
+			if (setrlimit(i, &rlimit[i]) == -1)
 				logit(LOG_WARNING, "%s: rlimit: failed setting %s",
 				      svc_ident(svc, NULL, 0), rlim2str(i));
 		}
@@ -655,6 +1105,164 @@ static pid_t service_fork(svc_t *svc)
 	return pid;
 }
 
+/*
+ * Open @file for redirecting output of a spawn() child, same as
+ * fredirect(), but in PID 1.  Returns -1 to inherit our output.
+ */
+static int spawn_redirect(const char *file)
+{
+	return open(file, O_WRONLY | O_APPEND | O_NOCTTY | O_CLOEXEC);
+}
+
+/*
+ * Start the logger for @svc, which is already running as @pid, with
+ * the same identity and limits, reading from @fd.  It is a regular
+ * child of PID 1, reaped on SIGCHLD.
+ */
+static void spawn_logger(svc_t *svc, pid_t pid, int fd, struct spawn_attr *sa)
+{
+	struct spawn_attr la = *sa;
+	struct logger lg;
+	char *path;
+
+	if (!logger_args(svc, pid, &lg))
+		return;
+
+	path = spawn_path(lg.cmd, sa->envp);
+	if (!path) {
+		logit(LOG_WARNING, "%s: cannot find %s", svc_ident(svc, NULL, 0), lg.cmd);
+		return;
+	}
+
+	la.stdio[0] = fd;
+	la.stdio[1] = -1;
+	la.stdio[2] = -1;
+	la.setsid   = 0;
+	la.path     = path;
+	la.argv     = lg.argv;
+	la.nlfd     = 0;
+	memset(la.pidvar, 0, sizeof(la.pidvar));
+
+	if (spawn(&la, NULL) < 0)
+		err(1, "%s: failed starting logger", svc_ident(svc, NULL, 0));
+	else if (la.what)
+		logit(LOG_ERR, "%s: logger failed %s: %s", svc_ident(svc, NULL, 0),
+		      la.what, strerror(la.err));
+	free(path);
+}
+
+/*
+ * Low-overhead alternative to service_fork() + exec in service_start().
+ * Identity, environment and argv are resolved in PID 1, and cached by
+ * spawn_prepare(), output redirection and logger are also set up here.
+ * The child is started with CLONE_VM | CLONE_VFORK, so nothing of PID 1
+ * is copied, and only applies credentials, limits and fds before exec.
+ *
+ * Returns:
+ * Same as service_fork(), with @fallback set if the service must be
+ * started with service_fork() instead.
+ */
+static pid_t service_spawn(svc_t *svc, int nfd, int *fallback)
+{
+	struct spawn_attr sa = {
+		.stdio   = { -1, -1, -1 },
+		.cgprocs = -1,
+		.setsid  = 1,
+	};
+	int logfd[2] = { -1, -1 };
+	int out = -1, procs = -1;
+	const char *cgnm;
+	char grnam[128];
+	int cgfd, pidfd;
+	pid_t pid;
+	int rc;
+
+	*fallback = 0;
+
+	if (svc->log.enabled && !svc->log.null && !svc->log.console && !log_builtin &&
+	    !have_sysklogd() && !whichp(_PATH_LOGIT)) {
+		*fallback = 1;	/* fallback_logger() */
+		return 0;
+	}
+
+	rc = spawn_prepare(svc, nfd, &sa);
+	if (rc) {
+		*fallback = rc > 0;
+		return -1;
+	}
+
+	if (svc->log.enabled) {
+		if (svc->log.null)
+			out = spawn_redirect("/dev/null");
+		else if (svc->log.console)
+			out = spawn_redirect(console());
+		else if (pipe2(logfd, O_CLOEXEC))
+			dbg("Failed pipe(), errno %d: %s", errno, strerror(errno));
+		else
+			out = logfd[1];
+	} else if (debug)
+		out = spawn_redirect(console());
+#ifdef REDIRECT_OUTPUT
+	else
+		out = spawn_redirect("/dev/null");
+#endif
+	sa.stdio[0] = open("/dev/null", O_RDONLY | O_CLOEXEC);
+	sa.stdio[1] = out;
+	sa.stdio[2] = out;
+	sig_child_mask(&sa.sigmask);
+
+	cgnm = cgroup_svc_name(svc, grnam, sizeof(grnam));
+	cgfd = cgroup_prepare(svc, cgnm);
+	if (cgfd >= 0) {
+		procs = openat(cgfd, "cgroup.procs", O_WRONLY | O_CLOEXEC);
+		close(cgfd);
+	}
+	sa.cgprocs = procs;
+
+	pid = spawn(&sa, &pidfd);
+	if (pid > 0 && pidfd >= 0 && service_pidfd_watch(svc, pid, pidfd, 1))
+		pid = -1;
+
+	if (pid < 0) {
+		cgroup_del_svc(svc, cgnm);
+		goto done;
+	}
+
+	if (sa.what)
+		logit(LOG_ERR, "failed starting %s, %s: %s", svc_ident(svc, NULL, 0),
+		      sa.what, strerror(sa.err));
+	for (rc = 0; rc < RLIMIT_NLIMITS; rc++) {
+		if (sa.rlim_err & (1U << rc))
+			logit(LOG_WARNING, "%s: rlimit: failed setting %s",
+			      svc_ident(svc, NULL, 0), rlim2str(rc));
+	}
+
+	/* Child could not join its cgroup by itself */
+	if (sa.cgprocs < 0)
+		cgroup_service(cgnm, pid, &svc->cgroup, svc->username, svc->group);
+
+	if (logfd[0] != -1 && !sa.what) {
+		if (logmux_wanted(svc)) {
+			logmux_add(svc, pid, logfd[0]);
+			logfd[0] = -1;
+		} else {
+			sa.cgprocs = procs;
+			spawn_logger(svc, pid, logfd[0], &sa);
+		}
+	}
+done:
+	if (procs >= 0)
+		close(procs);
+	if (sa.stdio[0] >= 0)
+		close(sa.stdio[0]);
+	if (logfd[0] != -1)
+		close(logfd[0]);
+	if (out >= 0)
+		close(out);
+
+	return pid;
+}
+
 /**
  * service_start - Start service
  * @svc: Service to start
@@ -666,12 +1274,15 @@ static int service_start(svc_t *svc)
 {
 	int result = 0, do_progress = 1;
 	char cmdline[CMD_SIZE] = "";
+	int fallback;
 	sigset_t nmask, omask;
 	int pipefd[2];
 	int fd = -1;
 	int sd = -1;
+	int on = 1;
 	pid_t pid;
 	size_t i;
+	int n;
 
 	if (!svc)
 		return 1;
@@ -724,15 +1335,38 @@ static int service_start(svc_t *svc)
 		}
 		fd = pipefd[1];
 		sd = pipefd[0];
+		fcntl(sd, F_SETFD, FD_CLOEXEC);
+
+		/* Keep %n clear of the LISTEN_FDS range, see sock_dup_fds() */
+		n = sock_fds(svc, NULL, 0);
+		if (n > 0 && fd < SOCK_FDS_START + n) {
+			int nfd = fcntl(fd, F_DUPFD, SOCK_FDS_START + n);
+
+			if (nfd != -1) {
+				close(fd);
+				fd = nfd;
+			}
+		}
 		break;
 
 	case SVC_NOTIFY_SYSTEMD:
+		if (service_notify_shared())
+			break;
+
 		sd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
 		if (sd == -1) {
 			err(1, "%s: failed opening notify socket", svc_ident(svc, NULL, 0));
 			svc_missing(svc);
 			return 1;
 		}
+
+		/* Sender credentials, to verify the sender, see service_notify_cb() */
+		if (setsockopt(sd, SOL_SOCKET, SO_PASSCRED, &on, sizeof(on))) {
+			err(1, "%s: failed enabling credentials on notify socket", svc_ident(svc, NULL, 0));
+			close(sd);
+			svc_missing(svc);
+			return 1;
+		}
 		break;
 	default:
 		break;
@@ -762,7 +1396,9 @@ static int service_start(svc_t *svc)
 	sigaddset(&nmask, SIGCHLD);
 	sigprocmask(SIG_BLOCK, &nmask, &omask);
 
-	pid = service_fork(svc);
+	pid = service_spawn(svc, fd, &fallback);
+	if (fallback)
+		pid = service_fork(svc, 1);
 	if (pid < 0) {
 		if (sd != -1)
 			close(sd);
@@ -775,11 +1411,15 @@ static int service_start(svc_t *svc)
 		size_t len;
 
 		dbg("Starting %s as PID %d", svc_ident(svc, NULL, 0), pid);
-		svc->pid = pid;
+		svc_set_pid(svc, pid);
 		svc->start_time = jiffies();
+		timeline_svc(svc, INIT_TL_SVC_FORK, pid);
 
 		switch (svc->notify) {
 		case SVC_NOTIFY_SYSTEMD:
+			if (sd == -1)
+				break;	/* notify-socket shared */
+
 			memset(&sun, 0, sizeof(sun));
 			sun.sun_family = AF_UNIX;
 			snprintf(sun.sun_path, sizeof(sun.sun_path), NOTIFY_PATH, pid);
@@ -815,16 +1455,31 @@ static int service_start(svc_t *svc)
 
 		switch (svc->notify) {
 		case SVC_NOTIFY_SYSTEMD:
-			snprintf(str, sizeof(str), NOTIFY_PATH, getpid());
+			if (sd == -1)
+				strlcpy(str, NOTIFY_SHARED, sizeof(str));
+			else
+				snprintf(str, sizeof(str), NOTIFY_PATH, getpid());
 			setenv("NOTIFY_SOCKET", str, 1);
+			if (svc->watchdog > 0) {
+				snprintf(str, sizeof(str), "%lld", (long long)svc->watchdog * 1000);
+				setenv("WATCHDOG_USEC", str, 1);
+				snprintf(str, sizeof(str), "%d", getpid());
+				setenv("WATCHDOG_PID", str, 1);
+			}
 			/* fallthrough */
 		case SVC_NOTIFY_S6:
-			close(sd);
+			if (sd != -1)
+				close(sd);
 			break;
 		default:
 			break;
 		}
 
+		if (sock_export(svc)) {
+			err(1, "%s: failed passing listening sockets", svc_ident(svc, NULL, 0));
+			_exit(1);
+		}
+
 		if (!svc_is_sysv(svc)) {
 			wordexp_t we = { 0 };
 			int rc;
@@ -836,15 +1491,12 @@ static int service_start(svc_t *svc)
 				_exit(1);
 			}
 
-			for (i = 0; i < MAX_NUM_SVC_ARGS; i++) {
+			for (i = 0; svc->args && svc->args[i]; i++) {
 				char *arg = svc->args[i];
 				size_t len = strlen(arg);
 				char str[len + 2];
 				char ch = *arg;
 
-				if (len == 0)
-					break;
-
 				if (svc->notify == SVC_NOTIFY_S6) {
 					char *ptr = strstr(arg, "%n");
 
@@ -881,29 +1533,17 @@ static int service_start(svc_t *svc)
 				goto nomem;
 			}
 
-			for (i = 0; i < we.we_wordc; i++) {
-				if (strlen(we.we_wordv[i]) >= sizeof(svc->args[i])) {
-					logit(LOG_ERR, "%s: expanded %s arg. '%s' too long", svc_ident(svc, NULL, 0), svc->cmd, we.we_wordv[i]);
-					rc = WRDE_NOSPACE;
-					goto nomem;
-				}
-
-				/* overwrite the child's svc with expanded args */
-				strlcpy(svc->args[i], we.we_wordv[i], sizeof(svc->args[i]));
-				args[i] = svc->args[i];
-			}
-			wordfree(&we);
+			/* we_wordv[] is kept, the child's heap is replaced by exec() */
+			for (i = 0; i < we.we_wordc; i++)
+				args[i] = we.we_wordv[i];
 		} else {
 			size_t j;
 
 			i = 0;
 			args[i++] = svc->cmd;
 			/* this handles, e.g., bridge-stop br0 start */
-			for (j = 0; j < MAX_NUM_SVC_ARGS; j++) {
-				if (!strlen(svc->args[j]))
-					break;
+			for (j = 0; svc->args && svc->args[j]; j++)
 				args[i++] = svc->args[j];
-			}
 			args[i++] = "start";
 		}
 		args[i] = NULL;
@@ -920,9 +1560,7 @@ static int service_start(svc_t *svc)
 		buf[0] = 0;
 		strlcat(buf, svc->cmd, sizeof(buf));
 		strlcat(buf, " ", sizeof(buf));
-		for (i = 1; i < MAX_NUM_SVC_ARGS; i++) {
-			if (!strlen(svc->args[i]))
-				break;
+		for (i = 1; svc->args && svc->args[i]; i++) {
 			strlcat(buf, svc->args[i], sizeof(buf));
 			strlcat(buf, " ", sizeof(buf));
 		}
@@ -1013,7 +1651,7 @@ static void service_kill(svc_t *svc)
 	if (runlevel != 1)
 		print_desc("Killing ", svc->desc);
 
-	kill(svc->pid, SIGKILL);
+	service_signal(svc, SIGKILL);
 
 	/* Let SIGKILLs stand out, show result as [WARN] */
 	if (runlevel != 1)
@@ -1030,7 +1668,7 @@ static void service_kill(svc_t *svc)
 static int service_run_script(svc_t *svc, char *script)
 {
 	const char *id = svc_ident(svc, NULL, 0);
-	pid_t pid = service_fork(svc);
+	pid_t pid = service_fork(svc, 0);
 
 	if (pid < 0) {
 		err(1, "%s: failed forking off script %s", id, script);
@@ -1073,6 +1711,65 @@ static void service_notify_stop(svc_t *svc)
 	}
 }
 
+/*
+ * No WATCHDOG=1 keep-alive from a notify:systemd service within its
+ * watchdog:MSEC, the service is alive but hung.  Like systemd we send
+ * SIGABRT, for a core dump, and SIGKILL after kill:SEC if that is not
+ * enough.  When the process is collected it is handled like any other
+ * crash, i.e., restarted or oncrash:action.
+ */
+static void service_watchdog_cb(struct wtimer *t, void *arg)
+{
+	svc_t *svc = arg;
+
+	if (svc->pid <= 1)
+		return;
+
+	logit(LOG_CONSOLE | LOG_ERR, "%s[%d]: watchdog timeout, no keep-alive in %d msec, sending SIGABRT",
+	      svc_ident(svc, NULL, 0), svc->pid, svc->watchdog);
+	service_signal(svc, SIGABRT);
+
+	service_timeout_cancel(svc);
+	service_timeout_after(svc, svc->killdelay, service_kill);
+}
+
+/*
+ * Only a started, or running, service that has not been removed by
+ * svc_del() is watched.  Keep-alives may still arrive from a service
+ * that is being stopped, those must not re-arm the watchdog.
+ */
+static int service_watchdog_active(svc_t *svc)
+{
+	if (svc->watchdog <= 0 || svc->pid <= 1 || !svc->hlive)
+		return 0;
+
+	return svc->state == SVC_STARTING_STATE || svc->state == SVC_RUNNING_STATE;
+}
+
+/*
+ * Start, or restart, the watchdog deadline, on READY=1 and WATCHDOG=1.
+ * On the timer wheel a keep-alive is only a list move, no syscall.
+ */
+static void service_watchdog_kick(svc_t *svc)
+{
+	if (!service_watchdog_active(svc))
+		return;
+
+	wheel_timer_init(&svc->wdog, service_watchdog_cb, svc);
+	wheel_timer_set(&svc->wdog, svc->watchdog);
+}
+
+static void service_watchdog_stop(svc_t *svc)
+{
+	wheel_timer_stop(&svc->wdog);
+}
+
+/* Service is being deleted, see svc_del() */
+void service_watchdog_release(svc_t *svc)
+{
+	service_watchdog_stop(svc);
+}
+
 /*
  * Clean up any lingering state from dead/killed services
  */
@@ -1105,13 +1802,16 @@ static void service_cleanup(svc_t *svc)
 	cond_clear(mkcond(svc, cond, sizeof(cond)));
 
 	service_notify_stop(svc);
+	service_watchdog_stop(svc);
+	strset(&svc->notify_status, NULL);
 
 	/* No longer running, update books. */
 	if (svc_is_tty(svc) && svc->pid > 1)
 		utmp_set_dead(svc->pid); /* Set DEAD_PROCESS UTMP entry */
 
 	svc->oldpid = svc->pid;
-	svc->starting = svc->start_time = svc->pid = 0;
+	svc->starting = svc->start_time = 0;
+	svc_set_pid(svc, 0);
 }
 
 /**
@@ -1140,7 +1840,7 @@ int service_stop(svc_t *svc)
 
 	service_timeout_cancel(svc);
 
-	if (svc->stop_script[0]) {
+	if (svc->stop_script) {
 		logit(LOG_CONSOLE | LOG_NOTICE, "Stopping %s[%d], calling stop:%s ...", id, svc->pid, svc->stop_script);
 	} else if (!svc_is_sysv(svc)) {
 		char *nm = pid_get_name(svc->pid, NULL, 0);
@@ -1173,7 +1873,7 @@ int service_stop(svc_t *svc)
 	 * Verify there's still something there before we send the reaper.
 	 */
 	if (svc->pid > 1 && !pid_alive(svc->pid)) {
-		svc->pid = 0;
+		svc_set_pid(svc, 0);
 		return 0;
 	}
 
@@ -1187,7 +1887,7 @@ int service_stop(svc_t *svc)
 	if (runlevel != 1 && do_progress && svc_is_daemon(svc))
 		print_desc("Stopping ", svc->desc);
 
-	if (svc->stop_script[0]) {
+	if (svc->stop_script) {
 		rc = service_run_script(svc, svc->stop_script);
 	} else if (!svc_is_sysv(svc)) {
 		if (svc->pid > 1) {
@@ -1197,7 +1897,7 @@ int service_stop(svc_t *svc)
 			 * and/or forward TERM to its children.  If it does not respond
 			 * in within a reasonable timeout we SIGKILL the entire group.
 			 */
-			rc = kill(svc->pid, svc->sighalt);
+			rc = service_signal(svc, svc->sighalt);
 			dbg("kill(%d, %d) => rc %d, errno %d", svc->pid, svc->sighalt, rc, errno);
 			/* PID lost or forking process never really started */
 			if (rc == -1 && (errno == ESRCH || errno == ENOENT))
@@ -1212,15 +1912,12 @@ int service_stop(svc_t *svc)
 
 		args[i++] = svc->cmd;
 		/* this handles, e.g., bridge-stop br0 stop */
-		for (j = 0; j < MAX_NUM_SVC_ARGS; j++) {
-			if (!strlen(svc->args[j]))
-				break;
+		for (j = 0; svc->args && svc->args[j]; j++)
 			args[i++] = svc->args[j];
-		}
 		args[i++] = "stop";
 		args[i] = NULL;
 
-		switch (service_fork(svc)) {
+		switch (service_fork(svc, 0)) {
 		case 0:
 			redirect(svc);
 			setsid();
@@ -1278,18 +1975,19 @@ static int service_reload(svc_t *svc)
 	if (do_progress)
 		print_desc("Restarting ", svc->desc);
 
-	if (svc->reload_script[0]) {
+	if (svc->reload_script) {
 		logit(LOG_CONSOLE | LOG_NOTICE, "Reloading %s[%d], calling reload:%s ...", id, svc->pid, svc->reload_script);
 		rc = service_run_script(svc, svc->reload_script);
 	} else 	if (svc->sighup) {
 		if (svc->pid <= 1) {
 			dbg("%s[%d]: bad PID, cannot reload service", id, svc->pid);
-			svc->start_time = svc->pid = 0;
+			svc->start_time = 0;
+			svc_set_pid(svc, 0);
 			goto done;
 		}
 		dbg("Reloading %s[%d], sending SIGHUP", id, svc->pid);
 		logit(LOG_CONSOLE | LOG_NOTICE, "Reloading %s[%d], sending SIGHUP ...", id, svc->pid);
-		rc = kill(svc->pid, SIGHUP);
+		rc = service_signal(svc, SIGHUP);
 		if (rc == -1 && (errno == ESRCH || errno == ENOENT)) {
 			/* nobody home, reset internal state machine */
 			lost = svc->pid;
@@ -1395,12 +2093,44 @@ static char *parse_args(char **line)
 	return NULL;
 }
 
+/*
+ * log:rate=LINES/SEC, or just LINES for LINES/1, see logmux.c
+ */
+static void parse_lograte(svc_t *svc, char *arg)
+{
+	const char *errstr = NULL;
+	char *ptr;
+	int sec = 1;
+
+	if (!arg)
+		return;
+
+	ptr = strchr(arg, '/');
+	if (ptr) {
+		*ptr++ = 0;
+		sec = strtonum(ptr, 1, 3600, &errstr);
+	}
+	if (!errstr)
+		svc->log.rate = strtonum(arg, 1, INT_MAX, &errstr);
+	if (errstr) {
+		logit(LOG_WARNING, "%s: invalid log rate, %s", svc_ident(svc, NULL, 0), errstr);
+		svc->log.rate = 0;
+		return;
+	}
+	svc->log.interval = sec;
+}
+
 /*
  * log:/path/to/logfile,priority:facility.level,tag:ident
+ * log:rate=LINES/SEC,burst=N,drop|block
  */
 static void parse_log(svc_t *svc, char *arg)
 {
-	char *tok;
+	char *tok, *val;
+
+	svc->log.rate  = 0;
+	svc->log.burst = 0;
+	svc->log.block = 0;
 
 	tok = strtok(arg, ":, ");
 	while (tok) {
@@ -1416,9 +2146,20 @@ static void parse_log(svc_t *svc, char *arg)
 			strlcpy(svc->log.prio, strtok(NULL, ","), sizeof(svc->log.prio));
 		else if (!strcmp(tok, "tag") || !strcmp(tok, "identity") || !strcmp(tok, "ident"))
 			strlcpy(svc->log.ident, strtok(NULL, ","), sizeof(svc->log.ident));
+		else if (!strcmp(tok, "rate"))
+			parse_lograte(svc, strtok(NULL, ","));
+		else if (!strcmp(tok, "burst") && (val = strtok(NULL, ",")))
+			svc->log.burst = strtonum(val, 1, INT_MAX, NULL);
+		else if (!strcmp(tok, "block"))
+			svc->log.block = 1;
+		else if (!strcmp(tok, "drop"))
+			svc->log.block = 0;
 
 		tok = strtok(NULL, ":=, ");
 	}
+
+	if (svc->log.rate && !svc->log.burst)
+		svc->log.burst = svc->log.rate;
 }
 
 static svc_notify_t parse_notify(char *arg)
@@ -1437,12 +2178,8 @@ static void parse_env(svc_t *svc, char *env)
 	if (!env)
 		return;
 
-	if (strlen(env) >= sizeof(svc->env)) {
-		errx(1, "%s: env file is too long (>%zu chars)", svc_ident(svc, NULL, 0), sizeof(svc->env));
-		return;
-	}
-
-	strlcpy(svc->env, env, sizeof(svc->env));
+	if (strset(&svc->env, env))
+		err(1, "%s: failed setting env file %s", svc_ident(svc, NULL, 0), env);
 }
 
 static void parse_caps(svc_t *svc, char *caps)
@@ -1453,12 +2190,13 @@ static void parse_caps(svc_t *svc, char *caps)
 	cap_iab = cap_iab_from_text(caps);
 	if (!cap_iab) {
 		err(1, "%s: failed parsing capabilities '%s'", svc_ident(svc, NULL, 0), caps);
-		memset(svc->capabilities, 0, sizeof(svc->capabilities));
+		strset(&svc->capabilities, NULL);
 		return;
 	}
 
 	cap_free(cap_iab);
-	strlcpy(svc->capabilities, caps, sizeof(svc->capabilities));
+	if (strset(&svc->capabilities, caps))
+		err(1, "%s: failed setting capabilities", svc_ident(svc, NULL, 0));
 #else
 	(void)svc;
 	(void)caps;
@@ -1559,7 +2297,7 @@ static void parse_killdelay(svc_t *svc, char *delay)
 /*
  * pre:[0-3600,]/path/to/script
  */
-static void parse_script(svc_t *svc, char *type, char *script, int *tmo, char *buf, size_t len)
+static void parse_script(svc_t *svc, char *type, char *script, int *tmo, char **ptr)
 {
 	char *found, *path;
 
@@ -1595,15 +2333,16 @@ static void parse_script(svc_t *svc, char *type, char *script, int *tmo, char *b
 	}
 	free(found);
 
-	if (strlen(path) >= len) {
+	if (strlen(path) >= MAX_CMD_LEN) {
 		errx(1, "Command too long in %s:%s", type, path);
 		goto err;
 	}
 
-	strlcpy(buf, path, len);
-	return;
+	if (!strset(ptr, path))
+		return;
+	err(1, "%s: failed setting %s:%s", svc_ident(svc, NULL, 0), type, path);
 err:
-	memset(buf, 0, len);
+	strset(ptr, NULL);
 }
 
 /*
@@ -1641,36 +2380,33 @@ static char *parse_name(char *cmd, char *arg)
  */
 static void parse_cmdline_args(svc_t *svc, char *cmd, char **args)
 {
-	char prev[MAX_CMD_LEN];
+	char *argv[MAX_NUM_SVC_ARGS] = { cmd };
+	char tmp[MAX_CMD_LEN] = "";
+	int argc = 1, num = 0;
 	int diff = 0;
 	char sep = 0;
+	char **vec;
 	char *arg;
-	int i = 0;
-
-	if (strcmp(svc->args[i], cmd))
-		diff++;
-	strlcpy(svc->args[i++], cmd, sizeof(svc->args[0]));
+	int i;
 
 	/*
-	 * Copy supplied args. Stop at MAX_NUM_SVC_ARGS-1 to allow the args
-	 * array to be zero-terminated.
+	 * Collect supplied args. Stop at MAX_NUM_SVC_ARGS-1, as before,
+	 * quoted args are re-assembled in tmp[] before being added.
 	 */
-	while ((arg = strtok_r(NULL, " ", args)) && i < (MAX_NUM_SVC_ARGS - 1)) {
+	while ((arg = strtok_r(NULL, " ", args)) && argc < (MAX_NUM_SVC_ARGS - 1)) {
 		char ch = arg[0];
 		size_t len;
 
-		if (!sep) {
-			strlcpy(prev, svc->args[i], sizeof(prev));
-			svc->args[i][0] = 0;
-		}
+		if (!sep)
+			tmp[0] = 0;
 
 		/* XXX: ugly string arg re-concatenation, fixme */
 		if (ch == '"' || ch == '\'')
 			sep = ch;
 		else if (sep)
-			strlcat(svc->args[i], " ", sizeof(svc->args[0]));
+			strlcat(tmp, " ", sizeof(tmp));
 
-		strlcat(svc->args[i], arg, sizeof(svc->args[0]));
+		strlcat(tmp, arg, sizeof(tmp));
 
 		/* string arg contained already? */
 		len = strlen(arg);
@@ -1681,27 +2417,37 @@ static void parse_cmdline_args(svc_t *svc, char *cmd, char **args)
 		}
 
 		/* replace any @console arg with the expanded device name */
-		if (svc_is_tty(svc) && tty_isatcon(svc->args[i]))
-			strlcpy(svc->args[i], svc->dev, sizeof(svc->args[i]));
+		if (svc_is_tty(svc) && tty_isatcon(tmp))
+			strlcpy(tmp, svc->dev, sizeof(tmp));
 
-		if (strcmp(svc->args[i], prev))
-			diff++;
+		argv[argc] = strdup(tmp);
+		if (!argv[argc])
+			break;
 
 		sep = 0;
-		i++;
+		argc++;
 	}
 
-	/*
-	 * Clear remaining args in case they were set earlier.
-	 * This also zero-terminates the args array.
-	 */
-	while (i < MAX_NUM_SVC_ARGS) {
-		if (svc->args[i++][0]) {
-			svc->args[i-1][0] = 0;
+	/* Compare with previous args, if any, also those now removed */
+	while (svc->args && svc->args[num])
+		num++;
+	for (i = 0; i < argc || i < num; i++) {
+		if (i >= argc || i >= num || strcmp(svc->args[i], argv[i]))
 			diff++;
-		}
 	}
 
+	vec = strvdup(argv, argc);
+	if (!vec) {
+		err(1, "%s: failed setting args", svc_ident(svc, NULL, 0));
+	} else {
+		free(svc->args);
+		svc->args = vec;
+	}
+
+	/* argv[0] is @cmd, the rest were copied above */
+	for (i = 1; i < argc; i++)
+		free(argv[i]);
+
 	/*
 	 * Check also for changes to /etc/default/foo, because this
 	 * also constitutes changes to command line args.
@@ -1711,9 +2457,7 @@ static void parse_cmdline_args(svc_t *svc, char *cmd, char **args)
 	if (diff) {
 		char buf[256];
 
-		for (buf[0] = 0, i = 0; i < MAX_NUM_SVC_ARGS; i++) {
-			if (!strlen(svc->args[i]))
-				break;
+		for (buf[0] = 0, i = 0; svc->args && svc->args[i]; i++) {
 			strlcat(buf, " ", sizeof(buf));
 			strlcat(buf, svc->args[i], sizeof(buf));
 		}
@@ -1802,6 +2546,10 @@ int service_register(int type, char *cfg, struct rlimit rlimit[], char *file)
 	int forking = 0, manual = 0, remain = 0, nowarn = 0;
 	int restart_max = SVC_RESPAWN_MAX;
 	int restart_tmo = 0;
+	int restart_backoff = 0;
+	int restart_jitter = -1;
+	int priority = 0;
+	int watchdog = 0;
 	unsigned oncrash_action = SVC_ONCRASH_IGNORE;
 	char *line, *args;
 	svc_t *svc;
@@ -1879,6 +2627,10 @@ int service_register(int type, char *cfg, struct rlimit rlimit[], char *file)
 			restart_tmo = atoi(arg) * 1000;
 		else if (MATCH_CMD(cmd, "restart_sec:", arg))
 			restart_tmo = atoi(arg) * 1000;
+		else if (MATCH_CMD(cmd, "restart_backoff:", arg))
+			restart_backoff = atoi(arg) * 1000;
+		else if (MATCH_CMD(cmd, "restart_jitter:", arg))
+			restart_jitter = atoi(arg);
 		else if (MATCH_CMD(cmd, "norestart", arg))
 			restart_max = 0;
 		else if (MATCH_CMD(cmd, "nowarn", arg))
@@ -1895,6 +2647,10 @@ int service_register(int type, char *cfg, struct rlimit rlimit[], char *file)
 			halt = arg;
 		else if (MATCH_CMD(cmd, "kill:", arg))
 			delay = arg;
+		else if (MATCH_CMD(cmd, "priority:", arg))
+			priority = atoi(arg);
+		else if (MATCH_CMD(cmd, "watchdog:", arg))
+			watchdog = atoi(arg);
 		else if (MATCH_CMD(cmd, "pre:", arg))
 			pre_script = arg;
 		else if (MATCH_CMD(cmd, "post:", arg))
@@ -2029,7 +2785,10 @@ int service_register(int type, char *cfg, struct rlimit rlimit[], char *file)
 		svc->type = type;
 
 		/* update path, may have changed on reload */
-		strlcpy(svc->cmd, cmd, sizeof(svc->cmd));
+		if (strset(&svc->cmd, cmd)) {
+			errx(1, "Out of memory, cannot register service %s", cmd);
+			return errno = ENOMEM;
+		}
 
 		/* e.g., if missing cmd or env before */
 		if (!manual)
@@ -2074,11 +2833,17 @@ int service_register(int type, char *cfg, struct rlimit rlimit[], char *file)
 	svc->runlevels = levels;
 	dbg("Service %s runlevel 0x%02x", svc_ident(svc, NULL, 0), svc->runlevels);
 
+	/* Before conf_parse_cond(), any if:<cond> is also subscribed to */
+	if (ifstmt)
+		strlcpy(svc->ifstmt, ifstmt, sizeof(svc->ifstmt));
+	else
+		memset(svc->ifstmt, 0, sizeof(svc->ifstmt));
 	conf_parse_cond(svc, cond);
 
 	if (type == SVC_TYPE_TTY) {
 		if (dev)
 			strlcpy(svc->dev, dev, sizeof(svc->dev));
+		svc_reindex(svc);
 		if (tty.baud)
 			strlcpy(svc->baud, tty.baud, sizeof(svc->baud));
 		if (tty.term)
@@ -2110,31 +2875,31 @@ int service_register(int type, char *cfg, struct rlimit rlimit[], char *file)
 	else
 		svc->killdelay = SVC_TERM_TIMEOUT;
 	if (pre_script)
-		parse_script(svc, "pre", pre_script, &svc->pre_tmo, svc->pre_script, sizeof(svc->pre_script));
+		parse_script(svc, "pre", pre_script, &svc->pre_tmo, &svc->pre_script);
 	else
-		memset(svc->pre_script, 0, sizeof(svc->pre_script));
+		strset(&svc->pre_script, NULL);
 	if (post_script)
-		parse_script(svc, "post", post_script, &svc->post_tmo, svc->post_script, sizeof(svc->post_script));
+		parse_script(svc, "post", post_script, &svc->post_tmo, &svc->post_script);
 	else
-		memset(svc->post_script, 0, sizeof(svc->post_script));
+		strset(&svc->post_script, NULL);
 	if (ready_script)
-		parse_script(svc, "ready", ready_script, &svc->ready_tmo, svc->ready_script, sizeof(svc->ready_script));
+		parse_script(svc, "ready", ready_script, &svc->ready_tmo, &svc->ready_script);
 	else
-		memset(svc->ready_script, 0, sizeof(svc->ready_script));
+		strset(&svc->ready_script, NULL);
 	if (cleanup_script)
-		parse_script(svc, "cleanup", cleanup_script, &svc->cleanup_tmo, svc->cleanup_script, sizeof(svc->cleanup_script));
+		parse_script(svc, "cleanup", cleanup_script, &svc->cleanup_tmo, &svc->cleanup_script);
 	else
-		memset(svc->cleanup_script, 0, sizeof(svc->cleanup_script));
+		strset(&svc->cleanup_script, NULL);
 
 	if (reload_script)
-		parse_script(svc, "reload", reload_script, NULL, svc->reload_script, sizeof(svc->reload_script));
+		parse_script(svc, "reload", reload_script, NULL, &svc->reload_script);
 	else
-		memset(svc->reload_script, 0, sizeof(svc->reload_script));
+		strset(&svc->reload_script, NULL);
 
 	if (stop_script)
-		parse_script(svc, "stop", stop_script, NULL, svc->stop_script, sizeof(svc->stop_script));
+		parse_script(svc, "stop", stop_script, NULL, &svc->stop_script);
 	else
-		memset(svc->stop_script, 0, sizeof(svc->stop_script));
+		strset(&svc->stop_script, NULL);
 
 	if (!svc_is_tty(svc)) {
 		if (log)
@@ -2155,11 +2920,11 @@ int service_register(int type, char *cfg, struct rlimit rlimit[], char *file)
 	if (env)
 		parse_env(svc, env);
 	else
-		memset(svc->env, 0, sizeof(svc->env));
+		strset(&svc->env, NULL);
 	if (caps)
 		parse_caps(svc, caps);
 	else
-		memset(svc->capabilities, 0, sizeof(svc->capabilities));
+		strset(&svc->capabilities, NULL);
 	if (file)
 		strlcpy(svc->file, file, sizeof(svc->file));
 	else
@@ -2168,10 +2933,6 @@ int service_register(int type, char *cfg, struct rlimit rlimit[], char *file)
 		strlcpy(svc->conflict, conflict, sizeof(svc->conflict));
 	else
 		memset(svc->conflict, 0, sizeof(svc->conflict));
-	if (ifstmt)
-		strlcpy(svc->ifstmt, ifstmt, sizeof(svc->ifstmt));
-	else
-		memset(svc->ifstmt, 0, sizeof(svc->ifstmt));
 	svc->manual  = manual;
 	svc->nowarn  = nowarn;
 
@@ -2190,14 +2951,26 @@ int service_register(int type, char *cfg, struct rlimit rlimit[], char *file)
 	svc->forking = forking;
 	svc->restart_max = restart_max;
 	svc->restart_tmo = restart_tmo;
+	svc->restart_backoff = max(restart_backoff, 0);
+	if (restart_jitter < 0)
+		restart_jitter = restart_backoff > 0 ? 10 : 0;
+	svc->restart_jitter = min(restart_jitter, 100);
 	svc->oncrash_action = oncrash_action;
+	svc->priority = priority;
+
+	if (watchdog > 0 && svc->notify != SVC_NOTIFY_SYSTEMD) {
+		logit(LOG_WARNING, "%s: watchdog:%d requires notify:systemd, ignoring",
+		      svc_ident(svc, NULL, 0), watchdog);
+		watchdog = 0;
+	}
+	svc->watchdog = watchdog > 0 ? watchdog : 0;
 
 	/* Decode any (optional) pid:/optional/path/to/file.pid */
 	if (svc_is_daemon(svc)) {
 		char tmp[sizeof(svc->name) + 6]; /* pid:! + svc->name */
 
 		/* no pid: set, figure out a default to track this svc */
-		if (!pid && forking) {
+		if (!pid && forking && svc->notify != SVC_NOTIFY_SYSTEMD) {
 			snprintf(tmp, sizeof(tmp), "pid:!%s", svc->name);
 			pid = tmp;
 			logit(LOG_INFO, "%s: forking but no pid:!file set, guessing -> %s", svc->name, tmp);
@@ -2207,7 +2980,7 @@ int service_register(int type, char *cfg, struct rlimit rlimit[], char *file)
 			logit(LOG_WARNING, "%s: service has invalid 'pid:' config: %s", svc->name, pid);
 
 		/* only set forking based on pidfile if user supplied pid: option */
-		if (pid && svc->pidfile[0] == '!')
+		if (pid && svc->pidfile && svc->pidfile[0] == '!')
 			svc->forking = 1;
 	}
 
@@ -2223,8 +2996,9 @@ int service_register(int type, char *cfg, struct rlimit rlimit[], char *file)
 	if (svc_is_tty(svc) && svc->restart_tmo == 0)
 		svc->restart_tmo = 2000;
 
-	/* Set configured limits */
-	memcpy(svc->rlimit, rlimit, sizeof(svc->rlimit));
+	/* Set configured limits, only those that differ from global */
+	if (svc_set_rlimit(svc, rlimit))
+		err(1, "%s: failed setting rlimits", svc_ident(svc, NULL, 0));
 
 	/* Seed with currently active group, may be empty */
 	strlcpy(svc->cgroup.name, cgroup_current, sizeof(svc->cgroup.name));
@@ -2239,6 +3013,9 @@ int service_register(int type, char *cfg, struct rlimit rlimit[], char *file)
 	if (cgroup)
 		parse_cgroup(svc, cgroup);
 
+	/* Identity, env and args are resolved again on next start */
+	spawn_free(svc);
+
 	/* New, recently modified or unchanged ... used on reload. */
 	if ((file && conf_changed(file)) || conf_changed(svc_getenv(svc)) || svc->args_dirty)
 		svc_mark_dirty(svc);
@@ -2273,7 +3050,8 @@ int service_register(int type, char *cfg, struct rlimit rlimit[], char *file)
  */
 void service_unregister(svc_t *svc)
 {
-	char *c;
+	struct cond_expr ce;
+	int i;
 
 	if (!svc)
 		return;
@@ -2281,30 +3059,23 @@ void service_unregister(svc_t *svc)
 	service_stop(svc);
 	service_timeout_cancel(svc);
 
-	for (c = strtok(svc->cond, ","); c; c = strtok(NULL, ","))
-		devmon_del_cond(c);
+	if (!cond_expr_parse(svc->cond, &ce)) {
+		for (i = 0; i < ce.num; i++)
+			devmon_del_cond(ce.name[i]);
+	}
 
 	svc_del(svc);
 }
 
-void service_monitor(pid_t lost, int status)
+/*
+ * Called when @lost, the svc->pid of @svc, has been collected, either
+ * by its pidfd watcher or by service_monitor() on SIGCHLD.
+ */
+static void service_collect(svc_t *svc, pid_t lost, int status)
 {
 	int sig = WIFSIGNALED(status);
 	int rc = WEXITSTATUS(status);
 	int ok = WIFEXITED(status);
-	svc_t *svc;
-
-	if (lost <= 1)
-		return;
-
-	/* main process as well as pre: and post: scripts use svc->pid */
-	svc = svc_find_by_pid(lost);
-	if (!svc) {
-		/* Check if ready: script in assoc list */
-		if (service_script_del(lost))
-			dbg("collected unknown PID %d", lost);
-		return;
-	}
 
 	switch (svc->state) {
 	case SVC_SETUP_STATE:
@@ -2339,7 +3110,7 @@ void service_monitor(pid_t lost, int status)
 	if (svc_is_forking(svc)) {
 		/* Likely start script exiting */
 		if (svc_is_starting(svc)) {
-			svc->pid = 0;	/* Expect no more activity from this one */
+			svc_set_pid(svc, 0);	/* Expect no more activity from this one */
 			goto cont;
 		}
 
@@ -2360,13 +3131,15 @@ void service_monitor(pid_t lost, int status)
 
 done:
 	/* No longer running, update books. */
-	svc->start_time = svc->pid = 0;
+	svc->start_time = 0;
+	svc_set_pid(svc, 0);
 cont:
 	if (lost == run_block_pid) {
 		int result = ok ? rc : 1;
 
 		svc_mark_clean(svc); /* done, regardless of exit status */
 		run_block_pid = 0;
+		service_unblock_queued();
 		if (svc->desc[0])
 			print_result(result);
 		if (bootstrap)
@@ -2382,17 +3155,35 @@ cont:
 	sm_step();
 }
 
-static void svc_mark_affected(char *cond)
+void service_monitor(pid_t lost, int status)
 {
-	svc_t *svc, *iter = NULL;
+	svc_t *svc;
 
-	for (svc = svc_iterator(&iter, 1); svc; svc = svc_iterator(&iter, 0)) {
-		if (!svc_has_cond(svc))
-			continue;
+	if (lost <= 1)
+		return;
 
-		if (cond_affects(cond, svc->cond))
-			svc_mark_dirty(svc);
+	/* main process as well as pre: and post: scripts use svc->pid */
+	svc = svc_find_by_pid(lost);
+	if (!svc) {
+		/* Check if ready: script in assoc list, or log rotation */
+		if (service_script_del(lost) && !logmux_collect(lost))
+			dbg("collected unknown PID %d", lost);
+		return;
 	}
+
+	service_collect(svc, lost, status);
+}
+
+static void svc_mark_affected_cb(svc_t *svc, void *arg)
+{
+	/* Subscribers to if:<cond> are not affected */
+	if (svc_has_cond(svc) && cond_affects(arg, svc->cond))
+		svc_mark_dirty(svc);
+}
+
+static void svc_mark_affected(char *cond)
+{
+	cond_foreach_subscriber(cond, svc_mark_affected_cb, cond);
 }
 
 /*
@@ -2447,7 +3238,7 @@ static void service_kill_script(svc_t *svc)
 		return;
 
 	dbg("Timeout, killing service %s script PID %d", svc_ident(svc, NULL, 0), svc->pid);
-	kill(svc->pid, SIGKILL);
+	service_signal(svc, SIGKILL);
 }
 
 /*
@@ -2473,7 +3264,7 @@ static void set_pre_post_envs(svc_t *svc, const char *type)
 
 static void service_pre_script(svc_t *svc)
 {
-	svc->pid = service_fork(svc);
+	svc_set_pid(svc, service_fork(svc, 1));
 	if (svc->pid < 0) {
 		err(1, "Failed forking off %s pre:script %s", svc_ident(svc, NULL, 0), svc->pre_script);
 		return;
@@ -2511,7 +3302,7 @@ static void service_pre_script(svc_t *svc)
 
 static void service_post_script(svc_t *svc)
 {
-	svc->pid = service_fork(svc);
+	svc_set_pid(svc, service_fork(svc, 1));
 	if (svc->pid < 0) {
 		err(1, "Failed forking off %s post:script %s", svc_ident(svc, NULL, 0), svc->post_script);
 		return;
@@ -2573,10 +3364,10 @@ void service_ready_script(svc_t *svc)
 {
 	pid_t pid;
 
-	if (access(svc->ready_script, X_OK))
+	if (!svc->ready_script || access(svc->ready_script, X_OK))
 		return;
 
-	pid = service_fork(svc);
+	pid = service_fork(svc, 0);
 	if (pid < 0) {
 		err(1, "Failed forking off %s ready-script %s", svc_ident(svc, NULL, 0), svc->ready_script);
 		return;
@@ -2612,7 +3403,7 @@ void service_ready_script(svc_t *svc)
 
 static void service_cleanup_script(svc_t *svc)
 {
-	svc->pid = service_fork(svc);
+	svc_set_pid(svc, service_fork(svc, 1));
 	if (svc->pid < 0) {
 		err(1, "Failed forking off %s cleanup:script %s", svc_ident(svc, NULL, 0), svc->cleanup_script);
 		return;
@@ -2648,6 +3439,92 @@ static void service_cleanup_script(svc_t *svc)
 	service_timeout_after(svc, svc->cleanup_tmo, service_kill_script);
 }
 
+/*
+ * System-wide restart budget, see restart-budget in finit.conf.  A
+ * token bucket of restart_budget restarts per restart_budget_sec,
+ * shared by all crashing services, so a mass failure, e.g., when a
+ * common dependency goes away, cannot saturate the system with
+ * fork+exec.  Returns 0 if a restart may proceed now, otherwise the
+ * number of msec until the next token is available.
+ */
+static int restart_budget_wait(void)
+{
+	static struct timespec last;
+	static double tokens = -1;
+	struct timespec now;
+	double rate;
+
+	if (restart_budget <= 0)
+		return 0;
+
+	rate = (double)restart_budget / max(restart_budget_sec, 1); /* per sec */
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+	if (tokens < 0)
+		tokens = restart_budget;
+	else
+		tokens += rate * ((now.tv_sec - last.tv_sec) + (now.tv_nsec - last.tv_nsec) / 1e9);
+	if (tokens > restart_budget)
+		tokens = restart_budget;
+	last = now;
+
+	if (tokens >= 1) {
+		tokens -= 1;
+		return 0;
+	}
+
+	return (int)((1 - tokens) * 1000 / rate) + 1;
+}
+
+/*
+ * Defer restart of @svc when the restart budget is exhausted.  Waiting
+ * services are spread out over one more interval to not all compete
+ * for the next token at the same time.
+ */
+static int restart_budget_defer(svc_t *svc)
+{
+	int msec;
+
+	msec = restart_budget_wait();
+	if (!msec)
+		return 0;
+
+	msec += random() % msec;
+	dbg("%s: restart budget exhausted, deferring restart %d msec", svc_ident(svc, NULL, 0), msec);
+	service_timeout_after(svc, msec, service_retry);
+
+	return 1;
+}
+
+/* Randomize @msec by +/- restart_jitter percent */
+static int restart_jitter(svc_t *svc, int msec)
+{
+	long long delta;
+
+	if (svc->restart_jitter <= 0 || msec < 100)
+		return msec;
+
+	delta = (long long)msec * svc->restart_jitter / 100;
+	if (delta <= 0)
+		return msec;
+
+	return msec - delta + random() % (2 * delta + 1);
+}
+
+/*
+ * Exponential back-off, the restart delay starts at restart_sec, at
+ * least 2 sec, and is doubled for each retry up to restart_backoff.
+ */
+static int restart_backoff(svc_t *svc, int cnt)
+{
+	long long msec = max(svc->restart_saved, 2000);
+
+	msec <<= min(max(cnt - 1, 0), 20);
+	if (msec > svc->restart_backoff)
+		msec = max(svc->restart_backoff, svc->restart_saved);
+
+	return restart_jitter(svc, msec);
+}
+
 static void service_retry(svc_t *svc)
 {
 	char *restart_cnt = (char *)&svc->restart_cnt;
@@ -2664,6 +3541,9 @@ static void service_retry(svc_t *svc)
 		 * have already been delayed in the SVC_RUNNING_STATE handler.
 		 * Just restart now.
 		 */
+		if (restart_budget_defer(svc))
+			return;
+
 		dbg("%s crashed/exited, respawning ...", svc_ident(svc, NULL, 0));
 		svc_unblock(svc);
 		service_step(svc);
@@ -2705,15 +3585,23 @@ static void service_retry(svc_t *svc)
 		return;
 	}
 
+	if (restart_budget_defer(svc))
+		return;
+
 	(*restart_cnt)++;
 
 	dbg("%s crashed, trying to start it again, attempt %d", svc_ident(svc, NULL, 0), *restart_cnt);
 	if ((*restart_cnt) == 1)
 		svc->restart_saved = svc->restart_tmo;
-	/* Wait 2s for the first 5 respawns, then back off to 5s */
-	timeout = ((*restart_cnt) <= (svc->restart_max / 2)) ? 2000 : 5000;
-	/* If a longer timeout was specified in the conf, use that instead. */
-	svc->restart_tmo = max(svc->restart_tmo, timeout);
+	if (svc->restart_backoff) {
+		svc->restart_tmo = restart_backoff(svc, *restart_cnt);
+	} else {
+		/* Wait 2s for the first 5 respawns, then back off to 5s */
+		timeout = ((*restart_cnt) <= (svc->restart_max / 2)) ? 2000 : 5000;
+		/* If a longer timeout was specified in the conf, use that instead. */
+		timeout = max(svc->restart_saved, timeout);
+		svc->restart_tmo = restart_jitter(svc, timeout);
+	}
 	logit(LOG_CONSOLE|LOG_WARNING, "Service %s[%d] died (%s%d), restarting (retry in %d msec) (attempt: %d/%d)",
 	      svc_ident(svc, NULL, 0), svc->oldpid,
 	      WIFEXITED(svc->status) ? "with exit status: " : "by signal: ",
@@ -2744,6 +3632,29 @@ static void svc_set_state(svc_t *svc, svc_state_t new_state)
 	if (svc->state == new_state)
 		return;
 	*state = new_state;
+	timeline_state(svc, old_state, new_state);
+	api_svc_event(svc);
+
+	/* Stopping services are not expected to send keep-alives */
+	if (new_state == SVC_STOPPING_STATE || new_state == SVC_HALTED_STATE)
+		service_watchdog_stop(svc);
+
+	switch (new_state) {
+	case SVC_WAITING_STATE:
+		if (svc->slot == SVC_SLOT_ACTIVE)
+			service_slot_release(svc);
+		break;
+	case SVC_SETUP_STATE:
+	case SVC_STARTING_STATE:
+	case SVC_RUNNING_STATE:
+		break;
+	case SVC_HALTED_STATE:
+		sock_reset(svc);
+		/* fallthrough */
+	default:
+		service_slot_release(svc);
+		break;
+	}
 
 	if (svc_is_runtask(svc)) {
 		char success[MAX_COND_LEN], failure[MAX_COND_LEN];
@@ -2817,6 +3728,9 @@ void service_ready(svc_t *svc, int ready)
 
 	snprintf(buf, sizeof(buf), "service/%s/ready", svc_ident(svc, NULL, 0));
 	if (ready) {
+		timeline_svc(svc, INIT_TL_SVC_READY, 0);
+		if (svc->slot == SVC_SLOT_ACTIVE)
+			service_slot_release(svc);
 		cond_set(buf);
 
 		if (svc_has_ready(svc))
@@ -2836,16 +3750,32 @@ int service_step(svc_t *svc)
 	int changed = 0, waiting = 0;
 	svc_state_t old_state;
 	cond_state_t cond;
+	svc_state_t entry_state;
+	struct timespec now;
 	svc_cmd_t enabled;
 	int err;
 
+	/* Being stepped now, no need to remain queued */
+	if (svc->queued == SVC_QUEUED_STEP)
+		service_dequeue(svc);
+
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+	if (now.tv_sec != stats.sec) {
+		stats.last = (now.tv_sec == stats.sec + 1) ? stats.cnt : 0;
+		stats.sec  = now.tv_sec;
+		stats.cnt  = 0;
+	}
+	stats.cnt++;
+	stats.steps++;
+
+	entry_state = svc->state;
 restart:
 	old_state = svc->state;
 	enabled = svc_enabled(svc);
 
 	dbg("%20s(%4d): %8s %3sabled/%-7s cond:%-4s", svc_ident(svc, NULL, 0), svc->pid,
 	   svc_status(svc), enabled ? "en" : "dis", svc_dirtystr(svc),
-	   condstr(cond_get_agg(svc->cond)));
+	   condstr(cond_get_svc(svc)));
 
 	switch (svc->state) {
 	case SVC_HALTED_STATE:
@@ -2860,8 +3790,10 @@ restart:
 				      "%s in conflict with %s, checking again ...",
 				      svc_ident(svc, NULL, 0), svc->conflict);
 #endif
-				if (!svc_conflicts(svc))
+				if (!svc_conflicts(svc)) {
 					svc_unblock(svc);
+					service_enqueue(svc);
+				}
 			}
 		}
 		break;
@@ -2978,7 +3910,7 @@ restart:
 	case SVC_WAITING_STATE:
 		if (!enabled) {
 			svc_set_state(svc, SVC_HALTED_STATE);
-		} else if (cond_get_agg(svc->cond) == COND_ON) {
+		} else if (cond_get_svc(svc) == COND_ON) {
 			/* wait until all processes have been stopped before continuing... */
 			if (sm_in_reload())
 				break;
@@ -2996,12 +3928,23 @@ restart:
 				break;
 			}
 
+			/* Socket activated, wait for first client */
+			if (sock_wait(svc))
+				break;
+
+			/* Wait for a start slot, see start-concurrency */
+			if (!service_slot_get(svc))
+				break;
+
 			if (svc_has_pre(svc)) {
 				svc_set_state(svc, SVC_SETUP_STATE);
 				service_pre_script(svc);
 				break;
 			}
 			svc_set_state(svc, SVC_STARTING_STATE);
+		} else if (svc->slot == SVC_SLOT_QUEUED) {
+			/* Conditions lost while queued, don't block the queue */
+			service_slot_release(svc);
 		}
 		break;
 
@@ -3079,14 +4022,14 @@ restart:
 		}
 		service_timeout_cancel(svc);
 
-		cond = cond_get_agg(svc->cond);
+		cond = cond_get_svc(svc);
 		switch (cond) {
 		case COND_OFF:
 			service_stop(svc);
 			break;
 
 		case COND_FLUX:
-			kill(svc->pid, SIGSTOP);
+			service_signal(svc, SIGSTOP);
 			svc_set_state(svc, SVC_PAUSED_STATE);
 			break;
 
@@ -3119,7 +4062,7 @@ restart:
 
 	case SVC_PAUSED_STATE:
 		if (!enabled) {
-			kill(svc->pid, SIGCONT);
+			service_signal(svc, SIGCONT);
 			service_stop(svc);
 			break;
 		}
@@ -3130,10 +4073,10 @@ restart:
 			break;
 		}
 
-		cond = cond_get_agg(svc->cond);
+		cond = cond_get_svc(svc);
 		switch (cond) {
 		case COND_ON:
-			kill(svc->pid, SIGCONT);
+			service_signal(svc, SIGCONT);
 			svc_set_state(svc, SVC_RUNNING_STATE);
 
 			/*
@@ -3165,7 +4108,7 @@ restart:
 
 		case COND_OFF:
 			dbg("Condition for %s is off, sending SIGCONT + SIGTERM", svc_ident(svc, NULL, 0));
-			kill(svc->pid, SIGCONT);
+			service_signal(svc, SIGCONT);
 			service_stop(svc);
 			break;
 
@@ -3188,22 +4131,83 @@ done:
 	/*
 	 * When a run/task/service changes state, e.g. transitioning from
 	 * waiting to running, other services may need to change state too.
+	 * Dependencies by condition are stepped by the condition engine,
+	 * here we only handle services blocked by run tasks or conflicts.
 	 */
-	if (changed || waiting)
-		schedule_work(&work);
+	if (waiting && svc->state == SVC_STARTING_STATE)
+		service_enqueue_blocked(svc);
+	if (changed && entry_state >= SVC_STOPPING_STATE && svc->state < SVC_STOPPING_STATE)
+		service_enqueue_conflicts(svc);
+
+	svcmap_update(svc);
+	api_svc_event(svc);
 
 	return 0;
 }
 
+/**
+ * service_step_queued - Step all queued services
+ *
+ * Services queued while stepping are also stepped, so when this
+ * function returns the queue is empty.
+ */
+void service_step_queued(void)
+{
+	svc_t *svc;
+
+	while ((svc = TAILQ_FIRST(&step_queue)))
+		service_step(svc);	/* dequeues svc */
+}
+
+/**
+ * service_step_all - Full sweep, step all services of given types
+ * @types: Mask of service types
+ *
+ * Only for runlevel changes, reload, and similar system-wide events.
+ * For all other changes, use service_step() or service_enqueue().
+ */
 void service_step_all(int types)
 {
+	stats.sweeps++;
 	svc_foreach_type(types, service_step);
 }
 
 void service_worker(void *unused)
 {
 	(void)unused;
-	service_step_all(SVC_TYPE_RESPAWN | SVC_TYPE_RUNTASK);
+	service_step_queued();
+}
+
+/**
+ * service_stats - Get state machine and memory statistics
+ * @st: Pointer to &struct init_stats to fill in, zeroed by caller
+ */
+void service_stats(struct init_stats *st)
+{
+	svc_t *svc, *iter = NULL;
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+	st->steps     = stats.steps;
+	st->sweeps    = stats.sweeps;
+	st->queued    = stats.queued;
+	st->start_max = start_concurrency;
+	st->starting  = slot_num;
+	st->start_queued = slot_queued;
+	st->log_pipes    = logmux_count();
+	if (now.tv_sec == stats.sec)
+		st->steps_sec = stats.last;
+	else if (now.tv_sec == stats.sec + 1)
+		st->steps_sec = stats.cnt;
+	else
+		st->steps_sec = 0;
+
+	for (svc = svc_iterator(&iter, 1); svc; svc = svc_iterator(&iter, 0))
+		st->svc_num++;
+	st->svc_size  = sizeof(svc_t);
+#ifdef HAVE_MALLINFO2
+	st->heap      = mallinfo2().uordblks;
+#endif
 }
 
 /**
@@ -3359,6 +4363,175 @@ void service_notify_reconf(void)
 	}
 }
 
+/*
+ * MAINPID=, forking services can tell us their main PID instead of us
+ * waiting for a PID file.  Same as the pidfile plugin does when the PID
+ * file appears, see service_forked().
+ */
+static void service_notify_mainpid(svc_t *svc, const char *val)
+{
+	const char *id = svc_ident(svc, NULL, 0);
+	const char *errstr = NULL;
+	pid_t pid;
+
+	pid = strtonum(val, 2, INT_MAX, &errstr);
+	if (errstr || kill(pid, 0)) {
+		dbg("%s: ignoring invalid MAINPID=%s", id, val);
+		return;
+	}
+	if (pid == svc->pid)
+		return;
+
+	if (!svc_is_forking(svc)) {
+		/* We would lose track of it, it is not our child */
+		logit(LOG_WARNING, "%s: MAINPID=%d only supported with type:forking", id, pid);
+		return;
+	}
+
+	service_forked(svc);
+
+	dbg("Forking service %s changed PID from %d to %d", id, svc->pid, pid);
+	svc_set_pid(svc, pid);
+	logit(LOG_CONSOLE | LOG_NOTICE, "Started %s[%d]", id, pid);
+	cgroup_move_svc(svc);
+}
+
+/*
+ * EXTEND_TIMEOUT_USEC=, slow starting service asks for more time before
+ * we give up on it.  The timers are moved to at least @val from now.
+ */
+static void service_notify_extend(svc_t *svc, const char *val)
+{
+	unsigned long long usec;
+	int msec;
+
+	usec = strtoull(val, NULL, 10);
+	if (!usec)
+		return;
+	if (usec / 1000 > INT_MAX)
+		usec = (unsigned long long)INT_MAX * 1000;
+	msec = usec / 1000;
+
+	/* Forking service, waiting for PID file or MAINPID= */
+	if (svc_is_starting(svc) && svc->timer_cb == service_retry) {
+		service_timeout_cancel(svc);
+		service_timeout_after(svc, msec, service_retry);
+	}
+
+	/* Keep start slot, see start-concurrency */
+	if (svc->slot == SVC_SLOT_ACTIVE && wheel_clock() + msec > svc->slot_tmo.expires)
+		wheel_timer_set(&svc->slot_tmo, msec);
+}
+
+static void service_notify_ready(svc_t *svc)
+{
+	/*
+	 * native (pidfile) services are marked as started by
+	 * the pidfile plugin.
+	 */
+	svc_started(svc);
+
+	/*
+	 * On reload, and this svc is unmodified, it is up to
+	 * the service_notify_reconf() function to step the
+	 * generation of the READY condition.
+	 */
+	service_ready(svc, 1);
+	service_watchdog_kick(svc);
+}
+
+/*
+ * For notify:systemd services a datagram is a list of VAR=VALUE lines.
+ * We handle READY, RELOADING, STOPPING, STATUS, MAINPID, WATCHDOG and
+ * EXTEND_TIMEOUT_USEC, anything else is ignored.  MAINPID is applied
+ * before READY, so the watchdog is started for the right PID.
+ */
+static void service_notify_systemd(svc_t *svc, char *buf)
+{
+	char *token, *ptr = NULL, *val;
+	int ready = 0;
+
+	for (token = strtok_r(buf, "\n", &ptr); token; token = strtok_r(NULL, "\n", &ptr)) {
+		if (!strcmp(token, "READY=1")) {
+			ready = 1;
+		} else if (!strcmp(token, "RELOADING=1")) {
+			dbg("%s: reloading", svc_ident(svc, NULL, 0));
+			svc_starting(svc);
+			service_ready(svc, 0);
+		} else if (!strcmp(token, "STOPPING=1")) {
+			dbg("%s: stopping", svc_ident(svc, NULL, 0));
+			service_watchdog_stop(svc);
+			service_ready(svc, 0);
+		} else if (MATCH_CMD(token, "STATUS=", val)) {
+			/* One line in initctl status, keep API records small */
+			val[strnlen(val, 255)] = 0;
+			strset(&svc->notify_status, val);
+		} else if (MATCH_CMD(token, "MAINPID=", val)) {
+			service_notify_mainpid(svc, val);
+		} else if (MATCH_CMD(token, "EXTEND_TIMEOUT_USEC=", val)) {
+			service_notify_extend(svc, val);
+		} else if (!strcmp(token, "WATCHDOG=1")) {
+			service_watchdog_kick(svc);
+		} else if (!strcmp(token, "WATCHDOG=trigger") && service_watchdog_active(svc)) {
+			service_watchdog_cb(&svc->wdog, svc);
+		}
+	}
+
+	if (ready)
+		service_notify_ready(svc);
+}
+
+/*
+ * Receive one datagram from a notify socket.  The kernel attaches the
+ * credentials of the sender (SO_PASSCRED), returns the sender's PID,
+ * zero if no credentials, or -1 on error.  Any file descriptors passed
+ * along (FDSTORE=1) are not supported and closed.
+ */
+static pid_t service_notify_recv(int sd, char *buf, size_t len)
+{
+	char cbuf[CMSG_SPACE(sizeof(struct ucred)) + CMSG_SPACE(sizeof(int) * 16)];
+	struct ucred *cred = NULL;
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	struct iovec iov;
+	ssize_t rc;
+
+	iov.iov_base = buf;
+	iov.iov_len  = len - 1;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov        = &iov;
+	msg.msg_iovlen     = 1;
+	msg.msg_control    = cbuf;
+	msg.msg_controllen = sizeof(cbuf);
+
+	rc = recvmsg(sd, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+	if (rc < 0)
+		return -1;
+	buf[rc] = 0;
+
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level != SOL_SOCKET)
+			continue;
+
+		if (cmsg->cmsg_type == SCM_CREDENTIALS &&
+		    cmsg->cmsg_len == CMSG_LEN(sizeof(struct ucred))) {
+			cred = (struct ucred *)CMSG_DATA(cmsg);
+		} else if (cmsg->cmsg_type == SCM_RIGHTS) {
+			int *fds = (int *)CMSG_DATA(cmsg);
+			size_t i, num;
+
+			num = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+			for (i = 0; i < num; i++)
+				close(fds[i]);
+		}
+	}
+
+	if (!cred || cred->pid <= 1)
+		return 0;
+
+	return cred->pid;
+}
+
 /*
  * Called when a service sends readiness notification, or when
  * the service closes its end of the IPC connection.
@@ -3366,8 +4539,7 @@ void service_notify_reconf(void)
 static void service_notify_cb(uev_t *w, void *arg, int events)
 {
 	svc_t *svc = (svc_t *)arg;
-	int ready = 0;
-	char buf[32];
+	char buf[NOTIFY_BUFSZ];
 	ssize_t len;
 
 	if (UEV_ERROR == events) {
@@ -3376,6 +4548,29 @@ static void service_notify_cb(uev_t *w, void *arg, int events)
 		return;
 	}
 
+	/*
+	 * The socket is abstract, anyone can send to it, so only accept
+	 * messages from the service itself or its helpers in its cgroup.
+	 */
+	if (svc->notify == SVC_NOTIFY_SYSTEMD) {
+		pid_t pid;
+
+		pid = service_notify_recv(w->fd, buf, sizeof(buf));
+		if (pid < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				warn("Failed reading notification from %s", svc_ident(svc, NULL, 0));
+			return;
+		}
+		if (!pid || (pid != svc->pid && cgroup_find_svc(pid) != svc)) {
+			logit(LOG_WARNING, "%s: ignoring notification from PID %d, not ours",
+			      svc_ident(svc, NULL, 0), pid);
+			return;
+		}
+
+		service_notify_systemd(svc, buf);
+		return;
+	}
+
 	len = read(w->fd, buf, sizeof(buf) - 1);
 	if (len <= 0) {
 		warn("Failed reading notification from %s", svc_ident(svc, NULL, 0));
@@ -3383,42 +4578,100 @@ static void service_notify_cb(uev_t *w, void *arg, int events)
 	}
 	buf[len] = 0;
 
-	/* Check for systemd READY=1 or s6 newline termination */
-	if (svc->notify == SVC_NOTIFY_SYSTEMD) {
-		char *token = strtok(buf, "\n");
+	/* s6 newline termination, the pipe is only shared with the service */
+	if (svc->notify == SVC_NOTIFY_S6 && buf[len - 1] == '\n') {
+		service_notify_ready(svc);
 
-		while (token) {
-			if (!strcmp(token, "READY=1")) {
-				ready = 1;
-				break;
-			}
-			token = strtok(NULL, "\n");
-		}
-	} else if (svc->notify == SVC_NOTIFY_S6 && buf[len - 1] == '\n') {
-		ready = 1;
+		/* s6 applications close their socket after notification */
+		uev_io_stop(w);
+		close(w->fd);
+		w->fd = 0;
 	}
+}
 
-	if (ready) {
-		/*
-		 * native (pidfile) services are marked as started by
-		 * the pidfile plugin.
-		 */
-		svc_started(svc);
+/*
+ * With `notify-socket shared` all notify:systemd services send to the
+ * same socket.  The PID of the sender is mapped to its service, or for
+ * helper processes, to the service that owns its cgroup.
+ */
+static void service_notify_shared_cb(uev_t *w, void *arg, int events)
+{
+	char buf[NOTIFY_BUFSZ];
+	svc_t *svc;
+	pid_t pid;
 
-		/*
-		 * On reload, and this svc is unmodified, it is up to
-		 * the service_notify_reconf() function to step the
-		 * generation of the READY condition.
-		 */
-		service_ready(svc, 1);
+	if (UEV_ERROR == events) {
+		dbg("spurious problem with shared notify socket, restarting.");
+		uev_io_start(w);
+		return;
+	}
 
-		/* s6 applications close their socket after notification */
-		if (svc->notify == SVC_NOTIFY_S6) {
-			uev_io_stop(w);
-			close(w->fd);
-			w->fd = 0;
-		}
+	pid = service_notify_recv(w->fd, buf, sizeof(buf));
+	if (pid < 0) {
+		if (errno != EAGAIN && errno != EWOULDBLOCK)
+			warn("Failed reading from shared notify socket");
+		return;
+	}
+	if (!pid) {
+		dbg("Notification without credentials, ignoring.");
+		return;
+	}
+
+	svc = svc_find_by_pid(pid);
+	if (!svc)
+		svc = cgroup_find_svc(pid);
+	if (!svc || svc->notify != SVC_NOTIFY_SYSTEMD) {
+		dbg("Notification from unknown PID %d, ignoring.", pid);
+		return;
 	}
+
+	service_notify_systemd(svc, buf);
+}
+
+/*
+ * Open the shared notify socket on first use.  If that fails we fall
+ * back to one socket per service.  Returns non-zero in shared mode.
+ */
+static int service_notify_shared(void)
+{
+	static uev_t watcher;
+	static int sd = -1;
+	struct sockaddr_un sun;
+	int on = 1;
+	size_t len;
+
+	if (!notify_shared)
+		return 0;
+	if (sd != -1)
+		return 1;
+
+	sd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (sd == -1)
+		goto fail;
+
+	if (setsockopt(sd, SOL_SOCKET, SO_PASSCRED, &on, sizeof(on)))
+		goto fail;
+
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	strlcpy(sun.sun_path, NOTIFY_SHARED, sizeof(sun.sun_path));
+	len = strlen(sun.sun_path);
+	sun.sun_path[0] = 0;
+	if (bind(sd, (struct sockaddr *)&sun, offsetof(struct sockaddr_un, sun_path) + len))
+		goto fail;
+
+	if (uev_io_init(ctx, &watcher, service_notify_shared_cb, NULL, sd, UEV_READ))
+		goto fail;
+
+	return 1;
+fail:
+	err(1, "Failed setting up shared notify socket, using one per service");
+	if (sd != -1)
+		close(sd);
+	sd = -1;
+	notify_shared = 0;
+
+	return 0;
 }
 
 /*
@@ -3436,17 +4689,10 @@ static void service_notify_cb(uev_t *w, void *arg, int events)
  * the output from 'initctl status foo', along with this instability
  * "index" in parenthesis: total (cnt/max)
  */
-static void service_interval_cb(uev_t *w, void *arg, int events)
+static void service_interval_cb(struct wtimer *t, void *arg)
 {
 	svc_t *svc, *iter = NULL;
 
-	(void)arg;
-	if (UEV_ERROR == events) {
-		dbg("spurious problem, restarting.");
-		uev_timer_start(w);
-		return;
-	}
-
 	for (svc = svc_iterator(&iter, 1); svc; svc = svc_iterator(&iter, 0)) {
 		if (svc_is_daemon(svc)) {
 			char *restart_cnt = (char *)&svc->restart_cnt;
@@ -3471,15 +4717,15 @@ static void service_interval_cb(uev_t *w, void *arg, int events)
  */
 void service_init(uev_ctx_t *ctx)
 {
-	static int initialized = 0;
-	static uev_t watcher;
+	static struct wtimer timer;
 
-	if (!initialized)
-		uev_timer_init(ctx, &watcher, service_interval_cb, NULL, service_interval, 0);
-	else
-		uev_timer_set(&watcher, service_interval, 0);
+	if (!timer.cb)
+		wheel_timer_init(&timer, service_interval_cb, NULL);
 
-	initialized = 1;
+	if (service_interval)
+		wheel_timer_set(&timer, service_interval);
+	else
+		wheel_timer_stop(&timer);
 }
 
 /**
@@ -27,6 +27,14 @@
 
 #include "svc.h"
 
+#define NOTIFY_PATH "@run/finit/notify/%d"
+#define NOTIFY_SHARED "@run/finit/notify"	/* notify-socket shared */
+#define NOTIFY_BUFSZ 4096	/* Max size of notification we read */
+
+struct init_stats;
+
+extern int notify_shared;
+
 int	  service_register	 (int type, char *line, struct rlimit rlimit[], char *file);
 void      service_unregister     (svc_t *svc);
 
@@ -43,9 +51,16 @@ void      service_forked         (svc_t *svc);
 void      service_ready          (svc_t *svc, int ready);
 
 int       service_stop           (svc_t *svc);
+int       service_signal         (svc_t *svc, int sig);
 int       service_step           (svc_t *svc);
 void      service_step_all       (int types);
+void      service_step_queued    (void);
+void      service_enqueue        (svc_t *svc);
+void      service_dequeue        (svc_t *svc);
+void      service_slot_release   (svc_t *svc);
+void      service_watchdog_release(svc_t *svc);
 void      service_worker         (void *unused);
+void      service_stats          (struct init_stats *st);
 
 int       service_completed      (svc_t **svc);
 void      service_log_incomplete (void);
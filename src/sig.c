@@ -286,7 +286,7 @@ static int do_wait(int secs)
 
 	do {
 		do_usleep(delay);
-		while (waitpid(-1, NULL, WNOHANG) > 0)
+		while (waitpid(-1, NULL, WNOHANG | __WALL) > 0)
 			;
 		has_proc = 0;
 		iterations--;
@@ -339,7 +339,7 @@ void do_shutdown(shutop_t op)
 	cond_exit();
 
 	/* Reap 'em */
-	while (waitpid(-1, NULL, WNOHANG) > 0)
+	while (waitpid(-1, NULL, WNOHANG | __WALL) > 0)
 		;
 
 	/* All services and (non-critical) processes have stopped. */
@@ -652,27 +652,36 @@ void sig_init(void)
 	SETSIG(sa, SIGCHLD, chld_handler, SA_RESTART);
 }
 
+/*
+ * Signal mask for children: the current mask without the signals
+ * blocked by finit, for spawn() where the child cannot call us.
+ */
+void sig_child_mask(sigset_t *mask)
+{
+	sigprocmask(SIG_BLOCK, NULL, mask);
+	sigdelset(mask, SIGHUP);
+	sigdelset(mask, SIGCHLD);
+	sigdelset(mask, SIGINT);
+	sigdelset(mask, SIGPWR);
+	sigdelset(mask, SIGSTOP);
+	sigdelset(mask, SIGTSTP);
+	sigdelset(mask, SIGCONT);
+	sigdelset(mask, SIGTERM);
+	sigdelset(mask, SIGUSR1);
+	sigdelset(mask, SIGUSR2);
+}
+
 /*
  * Unblock all signals blocked by finit when starting children
  */
 void sig_unblock(void)
 {
 	struct sigaction sa;
-	sigset_t nmask;
+	sigset_t mask;
 	int i;
 
-	sigemptyset(&nmask);
-	sigaddset(&nmask, SIGHUP);
-	sigaddset(&nmask, SIGCHLD);
-	sigaddset(&nmask, SIGINT);
-	sigaddset(&nmask, SIGPWR);
-	sigaddset(&nmask, SIGSTOP);
-	sigaddset(&nmask, SIGTSTP);
-	sigaddset(&nmask, SIGCONT);
-	sigaddset(&nmask, SIGTERM);
-	sigaddset(&nmask, SIGUSR1);
-	sigaddset(&nmask, SIGUSR2);
-	sigprocmask(SIG_UNBLOCK, &nmask, NULL);
+	sig_child_mask(&mask);
+	sigprocmask(SIG_SETMASK, &mask, NULL);
 
 	/* Reset signal handlers that were set by the parent process */
 	for (i = 1; i < NSIG; i++)
@@ -69,6 +69,7 @@ void do_shutdown    (shutop_t op);
 int  sig_num        (const char *name);
 void sig_init       (void);
 void sig_unblock    (void);
+void sig_child_mask (sigset_t *mask);
 void sig_setup      (uev_ctx_t *ctx);
 
 const char *sig_name(int signo);
@@ -41,6 +41,7 @@
 #include "sig.h"
 #include "tty.h"
 #include "sm.h"
+#include "timeline.h"
 #include "utmp-api.h"
 
 typedef enum {
@@ -307,6 +308,7 @@ void sm_init(void)
 void sm_step(void)
 {
 	sm_state_t old_state;
+	int transition = 0;
 	svc_t *svc;
 
 restart:
@@ -358,13 +360,22 @@ restart:
 
 		/* System bootstrapped, launch TTYs et al */
 		bootstrap = 0;
+		timeline_add(INIT_TL_BOOT_DONE, 0, NULL);
 		service_step_all(SVC_TYPE_RESPAWN);
 		sm.state = SM_RUNNING_STATE;
 		break;
 
 	case SM_RUNNING_STATE:
-		/* We come here from bootstrap, runlevel change and conf reload */
-		service_step_all(SVC_TYPE_ANY);
+		/*
+		 * We come here from bootstrap, runlevel change and conf
+		 * reload, which require a full sweep.  Otherwise, e.g.,
+		 * after a collected child, only services with changed
+		 * inputs need to be stepped.
+		 */
+		if (transition)
+			service_step_all(SVC_TYPE_ANY);
+		else
+			service_step_queued();
 
 		/* runlevel changed? */
 		if (sm.newlevel >= 0 && sm.newlevel <= 9) {
@@ -408,6 +419,7 @@ restart:
 		else
 			logit(LOG_CONSOLE | LOG_NOTICE, "Entering runlevel %c", sm_rl2ch(runlevel));
 		runlevel_set(prevlevel, runlevel);
+		timeline_add(INIT_TL_RUNLEVEL, runlevel, NULL);
 
 		/* Disable login in single-user mode as well as shutdown/reboot */
 		nologin();
@@ -587,8 +599,10 @@ restart:
 		break;
 	}
 
-	if (sm.state != old_state)
+	if (sm.state != old_state) {
+		transition = 1;
 		goto restart;
+	}
 }
 
 /**
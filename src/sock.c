@@ -0,0 +1,645 @@
+/* Socket activation, listening sockets held by Finit for services
+ *
+ * Copyright (c) 2025  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#ifdef _LIBITE_LITE
+# include <libite/lite.h>
+# include <libite/queue.h>	/* BSD sys/queue.h API */
+#else
+# include <lite/lite.h>
+# include <lite/queue.h>	/* BSD sys/queue.h API */
+#endif
+
+#include "finit.h"
+#include "log.h"
+#include "private.h"
+#include "service.h"
+#include "sock.h"
+#include "util.h"
+
+/*
+ * A listening socket, bound by Finit when the socket stanza is read,
+ * and watched while its service is waiting to be started.  The fd is
+ * kept across reloads and restarts of the service, so clients never
+ * see the socket go away.
+ */
+struct sock {
+	TAILQ_ENTRY(sock) link;
+
+	char    ident[MAX_IDENT_LEN];	/* Owner, service name[:id] */
+	char    name[MAX_ARG_LEN];	/* For LISTEN_FDNAMES */
+	char    addr[sizeof(((struct sockaddr_un *)0)->sun_path)];
+	char    owner[MAX_USER_LEN + MAX_USER_LEN + 2];
+	int     type;			/* SOCK_STREAM, SOCK_DGRAM, ... */
+	mode_t  mode;			/* For AF_UNIX sockets */
+	int     backlog;
+
+	int     fd;
+	uev_t   watcher;
+	int     armed;			/* watcher is active */
+	int     triggered;		/* Activity, service may start */
+	int     failed;			/* Only log first error */
+	int     active;			/* for mark & sweep */
+};
+
+static TAILQ_HEAD(, sock) socks = TAILQ_HEAD_INITIALIZER(socks);
+
+static const char *sock_typestr(int type)
+{
+	switch (type) {
+	case SOCK_STREAM:
+		return "stream";
+	case SOCK_DGRAM:
+		return "dgram";
+	case SOCK_SEQPACKET:
+		return "seqpacket";
+	default:
+		break;
+	}
+
+	return "unknown";
+}
+
+static int is_unix(const char *addr)
+{
+	return addr[0] == '/' || addr[0] == '@';
+}
+
+/*
+ * Unix sockets are /path/to/sock, or @name for the abstract namespace.
+ * Inet sockets are PORT, ADDR:PORT, or [ADDR6]:PORT, where plain PORT
+ * is 0.0.0.0, use [::]:PORT for dual stack.  Only numeric addresses,
+ * we bind long before any name service is available.
+ */
+static int sock_addr(struct sock *s, struct sockaddr_storage *ss, socklen_t *len)
+{
+	struct addrinfo hints = { 0 }, *ai;
+	char *host, *port;
+	int rc;
+
+	memset(ss, 0, sizeof(*ss));
+	if (is_unix(s->addr)) {
+		struct sockaddr_un *sun = (struct sockaddr_un *)ss;
+		size_t sz = strlen(s->addr);
+
+		if (sz >= sizeof(sun->sun_path)) {
+			errno = ENAMETOOLONG;
+			return -1;
+		}
+
+		sun->sun_family = AF_UNIX;
+		memcpy(sun->sun_path, s->addr, sz);
+		if (s->addr[0] == '@')
+			sun->sun_path[0] = 0;
+		*len = offsetof(struct sockaddr_un, sun_path) + sz;
+		if (s->addr[0] == '/')
+			*len += 1;
+
+		return 0;
+	}
+
+	host = strdupa(s->addr);
+	if (host[0] == '[') {
+		port = strstr(host, "]:");
+		if (!port) {
+			errno = EINVAL;
+			return -1;
+		}
+		*port = 0;
+		port += 2;
+		host++;
+	} else if ((port = strrchr(host, ':'))) {
+		*port++ = 0;
+	} else {
+		port = host;
+		host = NULL;
+		hints.ai_family = AF_INET;
+	}
+
+	hints.ai_flags    = AI_PASSIVE | AI_NUMERICHOST | AI_NUMERICSERV;
+	hints.ai_socktype = s->type;
+	rc = getaddrinfo(host, port, &hints, &ai);
+	if (rc) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	memcpy(ss, ai->ai_addr, ai->ai_addrlen);
+	*len = ai->ai_addrlen;
+	freeaddrinfo(ai);
+
+	return 0;
+}
+
+/* Mode and owner of Unix socket in the file system */
+static void sock_perms(struct sock *s)
+{
+	char *user, *group;
+	int uid, gid = -1;
+
+	if (s->addr[0] != '/')
+		return;
+
+	if (chmod(s->addr, s->mode))
+		warn("socket %s: failed setting mode %04o", s->addr, s->mode);
+
+	if (!s->owner[0])
+		return;
+
+	user = strdupa(s->owner);
+	group = strchr(user, ':');
+	if (group) {
+		*group++ = 0;
+		gid = getgroup(group);
+		if (gid < 0) {
+			logit(LOG_WARNING, "socket %s: unknown group %s", s->addr, group);
+			gid = -1;
+		}
+	}
+
+	uid = getuser(user, NULL);
+	if (uid < 0) {
+		logit(LOG_WARNING, "socket %s: unknown user %s", s->addr, user);
+		uid = -1;
+	}
+
+	if (chown(s->addr, uid, gid))
+		warn("socket %s: failed setting owner %s", s->addr, s->owner);
+}
+
+static int sock_open(struct sock *s)
+{
+	struct sockaddr_storage ss;
+	socklen_t len;
+	int sd = -1, on = 1;
+	int rc;
+
+	if (sock_addr(s, &ss, &len))
+		goto fail;
+
+	sd = socket(ss.ss_family, s->type | SOCK_CLOEXEC, 0);
+	if (sd == -1)
+		goto fail;
+
+	if (s->addr[0] == '/') {
+		char *dir = strdupa(s->addr);
+		char *ptr = strrchr(dir, '/');
+		struct stat st;
+
+		if (ptr && ptr != dir) {
+			*ptr = 0;
+			mkpath(dir, 0755);
+		}
+
+		/* Stale socket from previous boot, or restart of Finit */
+		if (!lstat(s->addr, &st) && S_ISSOCK(st.st_mode))
+			unlink(s->addr);
+	} else if (!is_unix(s->addr))
+		setsockopt(sd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+	if (bind(sd, (struct sockaddr *)&ss, len))
+		goto fail;
+
+	if (s->type != SOCK_DGRAM && listen(sd, s->backlog))
+		goto fail;
+
+	sock_perms(s);
+
+	dbg("%s: listening on %s:%s, fd %d", s->ident, sock_typestr(s->type), s->addr, sd);
+	s->fd = sd;
+	s->failed = 0;
+
+	return 0;
+fail:
+	rc = errno;
+	if (sd != -1)
+		close(sd);
+	if (!s->failed)
+		logit(LOG_ERR, "%s: failed creating socket %s:%s: %s", s->ident,
+		      sock_typestr(s->type), s->addr, strerror(rc));
+	s->failed = 1;
+
+	return -1;
+}
+
+static void sock_disarm(struct sock *s)
+{
+	if (!s->armed)
+		return;
+
+	uev_io_stop(&s->watcher);
+	s->armed = 0;
+}
+
+static void sock_close(struct sock *s)
+{
+	sock_disarm(s);
+	if (s->fd == -1)
+		return;
+
+	close(s->fd);
+	s->fd = -1;
+	if (s->addr[0] == '/')
+		unlink(s->addr);
+}
+
+/*
+ * First connection or datagram for a waiting service.  We do not read
+ * or accept anything, that is left to the service, so the watcher must
+ * be stopped until the service has exited again, see sock_reset().
+ */
+static void sock_cb(uev_t *w, void *arg, int events)
+{
+	struct sock *s = arg;
+	svc_t *svc;
+
+	sock_disarm(s);
+	s->triggered = 1;
+
+	svc = svc_find_by_str(s->ident);
+	if (!svc)
+		return;
+
+	dbg("%s: activity on %s:%s, starting service", s->ident,
+	    sock_typestr(s->type), s->addr);
+	service_enqueue(svc);
+}
+
+static void sock_arm(struct sock *s)
+{
+	if (s->armed || s->fd == -1)
+		return;
+
+	if (uev_io_init(ctx, &s->watcher, sock_cb, s, s->fd, UEV_READ)) {
+		err(1, "%s: failed watching socket %s", s->ident, s->addr);
+		return;
+	}
+	s->armed = 1;
+}
+
+static struct sock *sock_find(const char *ident, int type, const char *addr)
+{
+	struct sock *s;
+
+	TAILQ_FOREACH(s, &socks, link) {
+		if (s->type == type && !strcmp(s->ident, ident) && !strcmp(s->addr, addr))
+			return s;
+	}
+
+	return NULL;
+}
+
+static int sock_owned(struct sock *s, svc_t *svc)
+{
+	char ident[MAX_IDENT_LEN];
+
+	if (svc->type != SVC_TYPE_SERVICE)
+		return 0;
+
+	return !strcmp(s->ident, svc_ident(svc, ident, sizeof(ident)));
+}
+
+/**
+ * sock_register - Register, or update, a listening socket
+ * @cfg: Socket stanza, type:ADDR [mode:MODE] [@user[:group]] [backlog:N] [name:NAME] SERVICE[:ID]
+ *
+ * The socket is bound and listening when this function returns, unless
+ * the address is not yet available, in which case we retry when the
+ * service is about to be started.  Sockets are kept across reloads, as
+ * long as the type, address and service are the same.
+ *
+ * Returns:
+ * POSIX OK(0), or non-zero on error.
+ */
+int sock_register(char *cfg)
+{
+	char *addr = NULL, *ident = NULL, *owner = NULL, *name = NULL;
+	char *line, *tok, *arg, *ptr = NULL;
+	int backlog = SOMAXCONN;
+	mode_t mode = 0666;
+	int type = 0;
+	struct sock *s;
+
+	if (!cfg) {
+		errx(1, "Invalid input argument");
+		return errno = EINVAL;
+	}
+
+	line = strdupa(cfg);
+	ptr = strstr(line, "--");
+	if (ptr)
+		*ptr = 0;	/* no description for sockets */
+
+	for (tok = strtok_r(line, " \t", &ptr); tok; tok = strtok_r(NULL, " \t", &ptr)) {
+		if (MATCH_CMD(tok, "stream:", arg)) {
+			type = SOCK_STREAM;
+			addr = arg;
+		} else if (MATCH_CMD(tok, "dgram:", arg)) {
+			type = SOCK_DGRAM;
+			addr = arg;
+		} else if (MATCH_CMD(tok, "seqpacket:", arg)) {
+			type = SOCK_SEQPACKET;
+			addr = arg;
+		} else if (MATCH_CMD(tok, "mode:", arg)) {
+			mode = strtoul(arg, NULL, 8) & 07777;
+		} else if (MATCH_CMD(tok, "backlog:", arg)) {
+			backlog = atoi(arg);
+			if (backlog <= 0)
+				backlog = SOMAXCONN;
+		} else if (MATCH_CMD(tok, "name:", arg)) {
+			name = arg;
+		} else if (tok[0] == '@') {
+			owner = &tok[1];
+		} else if (!ident) {
+			ident = tok;
+		} else {
+			logit(LOG_WARNING, "socket %s: unknown option '%s'", cfg, tok);
+		}
+	}
+
+	if (!addr || !addr[0] || !ident) {
+		errx(1, "Incomplete socket '%s', cannot register", cfg);
+		return errno = EINVAL;
+	}
+	if (strlen(addr) >= sizeof(s->addr)) {
+		errx(1, "Socket address %s too long, cannot register", addr);
+		return errno = ENAMETOOLONG;
+	}
+	if (name && (!name[0] || strchr(name, ':'))) {
+		errx(1, "Invalid socket name:%s, cannot register", name);
+		return errno = EINVAL;
+	}
+
+	s = sock_find(ident, type, addr);
+	if (!s) {
+		s = calloc(1, sizeof(*s));
+		if (!s) {
+			err(1, "Failed registering socket %s", addr);
+			return errno;
+		}
+
+		strlcpy(s->ident, ident, sizeof(s->ident));
+		strlcpy(s->addr, addr, sizeof(s->addr));
+		s->type = type;
+		s->fd = -1;
+		TAILQ_INSERT_TAIL(&socks, s, link);
+	}
+
+	/* Default name is the service name, without :ID */
+	if (name)
+		strlcpy(s->name, name, sizeof(s->name));
+	else
+		strlcpy(s->name, ident, sizeof(s->name));
+	s->name[strcspn(s->name, ":")] = 0;
+
+	strlcpy(s->owner, owner ? owner : "", sizeof(s->owner));
+	s->mode = mode;
+	s->active = 1;
+
+	if (s->fd == -1) {
+		s->backlog = backlog;
+		return sock_open(s);
+	}
+
+	if (s->backlog != backlog && s->type != SOCK_DGRAM)
+		listen(s->fd, backlog);
+	s->backlog = backlog;
+	sock_perms(s);
+
+	return 0;
+}
+
+/* Mark all sockets for removal (during reload) */
+void sock_mark_all(void)
+{
+	struct sock *s;
+
+	TAILQ_FOREACH(s, &socks, link)
+		s->active = 0;
+}
+
+/* Close and remove all sockets not found in .conf files after reload */
+void sock_cleanup(void)
+{
+	struct sock *s, *tmp;
+
+	TAILQ_FOREACH_SAFE(s, &socks, link, tmp) {
+		if (s->active)
+			continue;
+
+		dbg("%s: removing socket %s:%s", s->ident, sock_typestr(s->type), s->addr);
+		TAILQ_REMOVE(&socks, s, link);
+		sock_close(s);
+		free(s);
+	}
+}
+
+/**
+ * sock_wait - Check if service should wait for activity on its sockets
+ * @svc: Service about to be started
+ *
+ * Called when all other start conditions are met.  The first time we
+ * get here we start watching the service's sockets, when any of them
+ * is readable the service is stepped again and can be started.
+ *
+ * Returns:
+ * %TRUE(1) if @svc has sockets without any activity yet, otherwise
+ * %FALSE(0) and @svc can be started.
+ */
+int sock_wait(svc_t *svc)
+{
+	struct sock *s;
+	int num = 0;
+
+	TAILQ_FOREACH(s, &socks, link) {
+		if (!sock_owned(s, svc))
+			continue;
+		if (s->triggered)
+			goto start;
+		num++;
+	}
+
+	if (!num)
+		return 0;
+
+	TAILQ_FOREACH(s, &socks, link) {
+		if (!sock_owned(s, svc))
+			continue;
+		if (s->fd == -1 && sock_open(s))
+			continue;
+		sock_arm(s);
+	}
+
+	return 1;
+start:
+	/* The service takes over, stop watching all its sockets */
+	TAILQ_FOREACH(s, &socks, link) {
+		if (sock_owned(s, svc))
+			sock_disarm(s);
+	}
+
+	return 0;
+}
+
+/* Service has stopped, wait for new activity before starting again */
+void sock_reset(svc_t *svc)
+{
+	struct sock *s;
+
+	TAILQ_FOREACH(s, &socks, link) {
+		if (!sock_owned(s, svc))
+			continue;
+
+		sock_disarm(s);
+		s->triggered = 0;
+	}
+}
+
+/**
+ * sock_fds - Listening sockets to pass to a service
+ * @svc: Service to start
+ * @fds: Array to fill in, or %NULL to only count
+ * @max: Size of @fds
+ *
+ * Returns:
+ * Number of sockets, in the order they were declared, at most %SOCK_MAX.
+ */
+int sock_fds(svc_t *svc, int fds[], int max)
+{
+	struct sock *s;
+	int num = 0;
+
+	TAILQ_FOREACH(s, &socks, link) {
+		if (s->fd == -1 || !sock_owned(s, svc))
+			continue;
+		if (num == SOCK_MAX || (fds && num == max))
+			break;
+
+		if (fds)
+			fds[num] = s->fd;
+		num++;
+	}
+
+	return num;
+}
+
+/* LISTEN_FDNAMES, in the same order as sock_fds() */
+char *sock_names(svc_t *svc, char *buf, size_t len)
+{
+	struct sock *s;
+	int num = 0;
+
+	buf[0] = 0;
+	TAILQ_FOREACH(s, &socks, link) {
+		if (s->fd == -1 || !sock_owned(s, svc))
+			continue;
+		if (num++ == SOCK_MAX)
+			break;
+
+		if (buf[0])
+			strlcat(buf, ":", len);
+		strlcat(buf, s->name, len);
+	}
+
+	return buf;
+}
+
+/**
+ * sock_dup_fds - Move listening sockets into place in a new child
+ * @fds: Sockets from sock_fds()
+ * @num: Number of sockets
+ *
+ * Moves @fds to fd 3, 4, ... without close-on-exec.  Only makes
+ * syscalls, so it is safe to call from spawn_child().  The caller must
+ * make sure nothing else it needs is in the range, e.g. the s6 notify
+ * fd, since that is overwritten.
+ *
+ * Returns:
+ * POSIX OK(0), or -1 on error with errno set.
+ */
+int sock_dup_fds(const int fds[], int num)
+{
+	int tmp[SOCK_MAX];
+	int i;
+
+	if (num > SOCK_MAX)
+		num = SOCK_MAX;
+
+	/* A listening socket may already be in the target range */
+	for (i = 0; i < num; i++) {
+		tmp[i] = fcntl(fds[i], F_DUPFD_CLOEXEC, SOCK_FDS_START + num);
+		if (tmp[i] == -1)
+			return -1;
+	}
+
+	for (i = 0; i < num; i++) {
+		if (dup2(tmp[i], SOCK_FDS_START + i) == -1)
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * For service_fork(), in the child: move the sockets into place and
+ * set up LISTEN_FDS, LISTEN_PID and LISTEN_FDNAMES.
+ */
+int sock_export(svc_t *svc)
+{
+	char names[SOCK_MAX * (MAX_ARG_LEN + 1)];
+	int fds[SOCK_MAX], num;
+	char str[16];
+
+	num = sock_fds(svc, fds, NELEMS(fds));
+	if (num <= 0)
+		return 0;
+
+	if (sock_dup_fds(fds, num))
+		return -1;
+
+	snprintf(str, sizeof(str), "%d", num);
+	setenv("LISTEN_FDS", str, 1);
+	snprintf(str, sizeof(str), "%d", getpid());
+	setenv("LISTEN_PID", str, 1);
+	setenv("LISTEN_FDNAMES", sock_names(svc, names, sizeof(names)), 1);
+
+	return 0;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
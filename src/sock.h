@@ -0,0 +1,52 @@
+/* Socket activation, listening sockets held by Finit for services
+ *
+ * Copyright (c) 2025  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef FINIT_SOCK_H_
+#define FINIT_SOCK_H_
+
+#include <stddef.h>
+#include "svc.h"
+
+#define SOCK_FDS_START  3		/* SD_LISTEN_FDS_START */
+#define SOCK_MAX        16		/* Max sockets per service */
+
+int   sock_register (char *cfg);
+void  sock_mark_all (void);
+void  sock_cleanup  (void);
+
+int   sock_wait     (svc_t *svc);
+void  sock_reset    (svc_t *svc);
+
+int   sock_fds      (svc_t *svc, int fds[], int max);
+char *sock_names    (svc_t *svc, char *buf, size_t len);
+int   sock_dup_fds  (const int fds[], int num);
+int   sock_export   (svc_t *svc);
+
+#endif /* FINIT_SOCK_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
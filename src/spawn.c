@@ -0,0 +1,723 @@
+/* Low-overhead process spawning for services
+ *
+ * Copyright (c) 2025  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <grp.h>			/* setgroups() */
+#include <signal.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef _LIBITE_LITE
+# include <libite/lite.h>
+#else
+# include <lite/lite.h>
+#endif
+#include <wordexp.h>
+
+#include "clone3.h"
+#include "conf.h"
+#include "finit.h"
+#include "helpers.h"
+#include "log.h"
+#include "service.h"
+#include "sock.h"
+#include "spawn.h"
+#include "util.h"
+
+/*
+ * Per-service cache of everything service_start() used to resolve in
+ * the child after fork(): identity, environment and argv.  Valid until
+ * the service is re-registered, the global environment changes, see
+ * spawn_flush(), or its env:file is modified.
+ */
+struct svc_spawn {
+	unsigned int    gen;		/* spawn_gen when resolved */
+	struct timespec env_mtime;	/* of env:file, if any */
+	int             nfd;		/* s6 notify fd used for %n */
+	int             nlfd;		/* Number of listening sockets */
+	int             slow;		/* Needs service_fork(), e.g. $(cmd) */
+
+	uid_t           uid;
+	gid_t           gid;
+	int             ngroups;
+	gid_t          *groups;
+	char           *home;
+
+	char           *path;
+	char          **argv;
+	char          **envp;
+	char           *pidvar[SPAWN_PIDVARS]; /* PID placeholders in envp[] */
+};
+
+/* Environment vector under construction, always NULL terminated */
+struct envv {
+	char          **v;
+	size_t          num;
+	size_t          max;
+};
+
+static unsigned int spawn_gen;
+
+/* Overwrite INT_MAX placeholder at @ptr with @pid, only syscalls */
+static void spawn_putpid(char *ptr, pid_t pid)
+{
+	char num[12];
+	int len = 0;
+
+	do {
+		num[len++] = '0' + pid % 10;
+		pid /= 10;
+	} while (pid);
+	while (len)
+		*ptr++ = num[--len];
+	*ptr = 0;
+}
+
+/*
+ * Runs on the static stack from call_vfork(), sharing memory with PID 1
+ * until execve().  Must only make syscalls and touch @sa.
+ */
+static int spawn_child(void *arg)
+{
+	struct spawn_attr *sa = arg;
+	struct sigaction act;
+	int i;
+
+	memset(&act, 0, sizeof(act));
+	act.sa_handler = SIG_DFL;
+	for (i = 1; i < NSIG; i++)
+		sigaction(i, &act, NULL);
+	sigprocmask(SIG_SETMASK, &sa->sigmask, NULL);
+
+	/* Let the parent move us instead */
+	if (sa->cgprocs >= 0 && write(sa->cgprocs, "0", 1) != 1)
+		sa->cgprocs = -1;
+
+	if (sa->setsid && setsid() < 0) {
+		sa->what = "setsid";
+		goto fail;
+	}
+
+	for (i = 0; i < 3; i++) {
+		if (sa->stdio[i] < 0)
+			continue;
+		if (sa->stdio[i] == i) {
+			if (fcntl(i, F_SETFD, 0) == -1)
+				goto stdio;
+		} else if (dup2(sa->stdio[i], i) == -1) {
+		stdio:
+			sa->what = "redirecting stdio";
+			goto fail;
+		}
+	}
+
+	if (sa->nlfd > 0 && sock_dup_fds(sa->lfd, sa->nlfd)) {
+		sa->what = "passing listening sockets";
+		goto fail;
+	}
+
+	for (i = 0; sa->rlimit && i < RLIMIT_NLIMITS; i++) {
+		if (setrlimit(i, &sa->rlimit[i]) == -1)
+			sa->rlim_err |= 1U << i;
+	}
+
+	if (sa->identity) {
+		if (sa->ngroups >= 0 && setgroups(sa->ngroups, sa->groups)) {
+			sa->what = "setgroups";
+			goto fail;
+		}
+		if (setgid(sa->gid)) {
+			sa->what = "setgid";
+			goto fail;
+		}
+		if (setuid(sa->uid)) {
+			sa->what = "setuid";
+			goto fail;
+		}
+		if (!sa->home || chdir(sa->home)) {
+			if (chdir("/")) {
+				sa->what = "chdir";
+				goto fail;
+			}
+		}
+	}
+
+	for (i = 0; i < SPAWN_PIDVARS; i++) {
+		if (sa->pidvar[i])
+			spawn_putpid(sa->pidvar[i], getpid());
+	}
+
+	execve(sa->path, sa->argv, sa->envp);
+	sa->what = "execve";
+fail:
+	sa->err = errno;
+	_exit(1);
+}
+
+/**
+ * spawn - Start a process from a prepared set of attributes
+ * @sa:    Attributes for the child, also for reporting errors
+ * @pidfd: Optional pidfd, see call_clone3()
+ *
+ * Uses call_vfork(), so nothing of PID 1 is copied and we resume only
+ * when the child has called execve(), or failed.  All signals are
+ * blocked meanwhile, since the child runs on our memory, and handlers
+ * are reset in the child before the mask from @sa is restored.
+ *
+ * Returns:
+ * PID of the child, or -1 on error.  A child that fails before exec
+ * has exited with status 1 and sets @sa->err, it must still be reaped.
+ */
+pid_t spawn(struct spawn_attr *sa, int *pidfd)
+{
+	sigset_t all, omask;
+	pid_t pid;
+
+	sa->err = 0;
+	sa->what = NULL;
+	sa->rlim_err = 0;
+
+	sigfillset(&all);
+	sigprocmask(SIG_BLOCK, &all, &omask);
+	pid = call_vfork(spawn_child, sa, pidfd);
+	sigprocmask(SIG_SETMASK, &omask, NULL);
+
+	return pid;
+}
+
+/**
+ * spawn_path - Locate executable like execvp() in the child would
+ * @file: Command, absolute path or searched for in $PATH of @envp
+ * @envp: Environment of the child
+ *
+ * Returns:
+ * Heap allocated path to @file, or %NULL if not found.
+ */
+char *spawn_path(const char *file, char *const envp[])
+{
+	const char *path = _PATH_STDPATH;
+	char buf[PATH_MAX];
+	char *dirs, *dir;
+	size_t i;
+
+	if (strchr(file, '/'))
+		return strdup(file);
+
+	for (i = 0; envp && envp[i]; i++) {
+		if (!strncmp(envp[i], "PATH=", 5)) {
+			path = &envp[i][5];
+			break;
+		}
+	}
+
+	dirs = strdupa(path);
+	while ((dir = strsep(&dirs, ":"))) {
+		snprintf(buf, sizeof(buf), "%s/%s", dir[0] ? dir : ".", file);
+		if (!access(buf, X_OK))
+			return strdup(buf);
+	}
+
+	return NULL;
+}
+
+static void envv_free(struct envv *ev)
+{
+	size_t i;
+
+	for (i = 0; i < ev->num; i++)
+		free(ev->v[i]);
+	free(ev->v);
+}
+
+/* Add, or replace, "KEY=VALUE" @str, which is owned by @ev after this */
+static int envv_put(struct envv *ev, char *str)
+{
+	size_t len = strcspn(str, "=");
+	size_t i;
+
+	for (i = 0; i < ev->num; i++) {
+		if (!strncmp(ev->v[i], str, len) && ev->v[i][len] == '=') {
+			free(ev->v[i]);
+			ev->v[i] = str;
+			return 0;
+		}
+	}
+
+	if (ev->num + 1 >= ev->max) {
+		size_t max = ev->max ? ev->max * 2 : 64;
+		char **v;
+
+		v = realloc(ev->v, max * sizeof(char *));
+		if (!v) {
+			free(str);
+			return -1;
+		}
+		ev->v = v;
+		ev->max = max;
+	}
+	ev->v[ev->num++] = str;
+	ev->v[ev->num] = NULL;
+
+	return 0;
+}
+
+static int envv_set(struct envv *ev, const char *key, const char *val)
+{
+	char *str;
+
+	str = malloc(strlen(key) + strlen(val) + 2);
+	if (!str)
+		return -1;
+	sprintf(str, "%s=%s", key, val);
+
+	return envv_put(ev, str);
+}
+
+/*
+ * Same as source_env() in service.c, but into @ev.  Values are expanded
+ * with @ev as environment, but not with $(cmd) or `cmd`, those services
+ * are started with service_fork().
+ */
+static int envv_source(struct envv *ev, const char *fn)
+{
+	char line[LINE_SIZE];
+	int rc = 0;
+	FILE *fp;
+
+	fp = fopen(fn, "r");
+	if (!fp)
+		return 0;
+
+	while (!rc && fgets(line, sizeof(line), fp)) {
+		char *key, *value, val[LINE_SIZE];
+		wordexp_t we = { 0 };
+		char **saved;
+		size_t i;
+		int err;
+
+		key = chomp(line);
+		while (isspace(*key))
+			key++;
+		if (*key == '#' || *key == ';')
+			continue;
+
+		key = conf_parse_env(key, &value);
+		if (!key)
+			continue;
+
+		saved = environ;
+		environ = ev->v;
+		err = wordexp(value, &we, WRDE_NOCMD);
+		environ = saved;
+
+		if (err == WRDE_CMDSUB) {
+			rc = 1;
+			break;
+		}
+		if (err) {
+			rc = envv_set(ev, key, value);
+			continue;
+		}
+
+		for (i = 0, val[0] = 0; i < we.we_wordc; i++) {
+			if (i > 0)
+				strlcat(val, " ", sizeof(val));
+			strlcat(val, we.we_wordv[i], sizeof(val));
+		}
+		wordfree(&we);
+
+		rc = envv_set(ev, key, val);
+	}
+	fclose(fp);
+
+	return rc;
+}
+
+static int spawn_identity(svc_t *svc, struct svc_spawn *sp)
+{
+#ifdef ENABLE_STATIC
+	sp->uid = 0;
+	sp->gid = 0;
+	sp->ngroups = -1;
+#else
+	int ngroups = 32, n, i, j;
+	char *home = NULL;
+	int uid, gid;
+	gid_t *groups;
+
+	uid = getuser(svc->username, &home);
+	if (uid < 0) {
+		logit(LOG_ERR, "%s: user '%s' not found, cannot start service",
+		      svc_ident(svc, NULL, 0), svc->username);
+		return -1;
+	}
+	if (home && !(sp->home = strdup(home)))
+		return -1;
+
+	gid = getgroup(svc->group);
+	if (gid < 0) {
+		logit(LOG_ERR, "%s: group '%s' not found, cannot start service",
+		      svc_ident(svc, NULL, 0), svc->group);
+		return -1;
+	}
+	sp->uid = uid;
+	sp->gid = gid;
+
+	/* Supplementary groups from /etc/group and config */
+	do {
+		groups = realloc(sp->groups, (ngroups + MAX_NUM_SUPGROUPS) * sizeof(gid_t));
+		if (!groups)
+			return -1;
+		sp->groups = groups;
+
+		n = ngroups;
+		if (getgrouplist(svc->username, gid, groups, &ngroups) >= 0)
+			break;
+	} while (ngroups > n);
+	n = ngroups > n ? 0 : ngroups;
+
+	for (i = 0; i < svc->num_supgroups; i++) {
+		int g = getgroup(svc->supgroups[i]);
+
+		if (g < 0) {
+			logit(LOG_WARNING, "%s: unknown supplementary group '%s'",
+			      svc_ident(svc, NULL, 0), svc->supgroups[i]);
+			continue;
+		}
+		for (j = 0; j < n; j++) {
+			if (groups[j] == (gid_t)g)
+				break;
+		}
+		if (j == n)
+			groups[n++] = g;
+	}
+	sp->ngroups = n > 0 ? n : -1;
+#endif
+
+	return 0;
+}
+
+static int spawn_environ(svc_t *svc, struct svc_spawn *sp)
+{
+	struct envv ev = { 0 };
+	char notify[sizeof(NOTIFY_PATH) + 32];
+	char *fn;
+	size_t i;
+	int rc = -1;
+
+	for (i = 0; environ[i]; i++) {
+		char *str;
+
+		if (!strchr(environ[i], '='))
+			continue;
+		str = strdup(environ[i]);
+		if (!str || envv_put(&ev, str))
+			goto done;
+	}
+
+	if (sp->uid > 0) {
+		if (envv_set(&ev, "PATH", _PATH_DEFPATH) ||
+		    envv_set(&ev, "USER", svc->username) ||
+		    envv_set(&ev, "LOGNAME", svc->username))
+			goto done;
+	}
+	if (sp->home && envv_set(&ev, "HOME", sp->home))
+		goto done;
+
+	fn = svc_getenv(svc);
+	if (fn) {
+		rc = envv_source(&ev, fn);
+		if (rc)
+			goto done;
+		rc = -1;
+	}
+
+	/* Placeholder for the PID, filled in by spawn_child() */
+	if (svc->notify == SVC_NOTIFY_SYSTEMD) {
+		if (notify_shared)
+			strlcpy(notify, NOTIFY_SHARED, sizeof(notify));
+		else
+			snprintf(notify, sizeof(notify), NOTIFY_PATH, INT_MAX);
+		if (envv_set(&ev, "NOTIFY_SOCKET", notify))
+			goto done;
+
+		if (svc->watchdog > 0) {
+			char num[24];
+
+			snprintf(num, sizeof(num), "%lld", (long long)svc->watchdog * 1000);
+			if (envv_set(&ev, "WATCHDOG_USEC", num))
+				goto done;
+			snprintf(num, sizeof(num), "%d", INT_MAX);
+			if (envv_set(&ev, "WATCHDOG_PID", num))
+				goto done;
+		}
+	}
+
+	/* Socket activation, same order as sock_fds() in spawn_prepare() */
+	if (sp->nlfd > 0) {
+		char names[SOCK_MAX * (MAX_ARG_LEN + 1)];
+		char num[12];
+
+		snprintf(num, sizeof(num), "%d", sp->nlfd);
+		if (envv_set(&ev, "LISTEN_FDS", num))
+			goto done;
+		snprintf(num, sizeof(num), "%d", INT_MAX);
+		if (envv_set(&ev, "LISTEN_PID", num))
+			goto done;
+		if (envv_set(&ev, "LISTEN_FDNAMES", sock_names(svc, names, sizeof(names))))
+			goto done;
+	}
+
+	sp->envp = strvdup(ev.v, ev.num);
+	if (!sp->envp)
+		goto done;
+
+	for (i = 0; sp->envp[i]; i++) {
+		char *env = sp->envp[i];
+
+		if (svc->notify == SVC_NOTIFY_SYSTEMD && !notify_shared && !strncmp(env, "NOTIFY_SOCKET=", 14))
+			sp->pidvar[0] = &env[14 + (strstr(NOTIFY_PATH, "%d") - NOTIFY_PATH)];
+		else if (sp->nlfd > 0 && !strncmp(env, "LISTEN_PID=", 11))
+			sp->pidvar[1] = &env[11];
+		else if (svc->watchdog > 0 && !strncmp(env, "WATCHDOG_PID=", 13))
+			sp->pidvar[2] = &env[13];
+	}
+	rc = 0;
+done:
+	envv_free(&ev);
+	return rc;
+}
+
+/*
+ * Expand command and args, like service_start() used to do after
+ * fork(), but with @sp->envp as environment and no command substitution.
+ */
+static int spawn_argv(svc_t *svc, struct svc_spawn *sp)
+{
+	wordexp_t we = { 0 };
+	char **saved;
+	int rc = -1;
+	size_t i;
+
+	if (svc_is_sysv(svc)) {
+		char *args[MAX_NUM_SVC_ARGS + 2];
+
+		for (i = 0; svc->args && svc->args[i] && i < MAX_NUM_SVC_ARGS; i++)
+			args[i] = svc->args[i];
+		args[i++] = "start";
+
+		sp->path = spawn_path(svc->cmd, sp->envp);
+		sp->argv = strvdup(args, i);
+		if (!sp->path || !sp->argv)
+			return -1;
+
+		return 0;
+	}
+
+	saved = environ;
+	environ = sp->envp;
+
+	if (wordexp(svc->cmd, &we, WRDE_NOCMD))
+		goto done;
+
+	for (i = 0; svc->args && svc->args[i]; i++) {
+		char *arg = svc->args[i];
+		size_t len = strlen(arg);
+		char str[len + 16];
+		char *ptr;
+
+		/*
+		 * Escape forbidden characters in wordexp(), but allowed
+		 * in Finit run/task stanzas, leading ones only.
+		 */
+		if (strchr("|<>&:", *arg))
+			strlcpy(str, "\\", sizeof(str));
+		else
+			str[0] = 0;
+		strlcat(str, arg, sizeof(str));
+
+		if (svc->notify == SVC_NOTIFY_S6 && (ptr = strstr(str, "%n"))) {
+			char num[12];
+
+			len = snprintf(num, sizeof(num), "%d", sp->nfd);
+			if (len > 0 && len <= 2) {
+				ptr[0] = ' ';
+				ptr[1] = ' ';
+				memcpy(ptr, num, len);
+			}
+		}
+
+		if (wordexp(str, &we, WRDE_APPEND | WRDE_NOCMD))
+			goto done;
+	}
+
+	if (we.we_wordc < 2 || we.we_wordc > MAX_NUM_SVC_ARGS)
+		goto done;
+
+	sp->path = spawn_path(we.we_wordv[0], sp->envp);
+	sp->argv = strvdup(&we.we_wordv[1], we.we_wordc - 1);
+	if (sp->path && sp->argv)
+		rc = 0;
+done:
+	environ = saved;
+	wordfree(&we);
+
+	return rc;
+}
+
+static void spawn_clear(struct svc_spawn *sp)
+{
+	free(sp->groups);
+	free(sp->home);
+	free(sp->path);
+	free(sp->argv);
+	free(sp->envp);
+	memset(sp, 0, sizeof(*sp));
+}
+
+/**
+ * spawn_prepare - Prepare attributes for starting a service with spawn()
+ * @svc: Service to start
+ * @nfd: Write end of s6 notify pipe, used for %n in args, or -1
+ * @sa:  Attributes to fill in, stdio, cgroup and signal mask are left
+ *
+ * Identity, environment and argv are resolved in PID 1 and cached per
+ * service.  Services that need more than syscalls before exec, e.g. a
+ * TTY, a runtask, capabilities, or $(cmd) in args or env:file, must be
+ * started with service_fork() instead.  The same goes for services we
+ * cannot resolve, letting service_fork() log why they fail.
+ *
+ * Returns:
+ * POSIX OK(0), 1 if the service must use service_fork(), or -1 if the
+ * service cannot be started.
+ */
+int spawn_prepare(svc_t *svc, int nfd, struct spawn_attr *sa)
+{
+	static struct rlimit rlimit[RLIMIT_NLIMITS];
+	static int lfd[SOCK_MAX];
+	struct svc_spawn *sp = svc->spawn;
+	struct timespec mtime = { 0 };
+	struct stat st;
+	char *fn;
+	int nlfd;
+
+	if (svc_is_tty(svc) || svc_is_runtask(svc))
+		return 1;
+#ifdef HAVE_LIBCAP
+	if (svc->capabilities)
+		return 1;
+#endif
+
+	fn = svc_getenv(svc);
+	if (fn && !stat(fn, &st))
+		mtime = st.st_mtim;
+
+	if (svc->notify != SVC_NOTIFY_S6)
+		nfd = -1;
+	nlfd = sock_fds(svc, lfd, NELEMS(lfd));
+
+	if (sp && (sp->gen != spawn_gen || sp->nfd != nfd || sp->nlfd != nlfd ||
+		   sp->env_mtime.tv_sec  != mtime.tv_sec ||
+		   sp->env_mtime.tv_nsec != mtime.tv_nsec)) {
+		spawn_clear(sp);
+	} else if (sp) {
+		if (sp->slow)
+			return 1;
+		goto done;
+	}
+
+	if (!sp) {
+		sp = calloc(1, sizeof(*sp));
+		if (!sp)
+			return 1;
+		svc->spawn = sp;
+	}
+
+	sp->gen = spawn_gen;
+	sp->nfd = nfd;
+	sp->nlfd = nlfd;
+	sp->env_mtime = mtime;
+
+	if (spawn_identity(svc, sp)) {
+		spawn_clear(sp);
+		return -1;
+	}
+
+	if (spawn_environ(svc, sp) || spawn_argv(svc, sp)) {
+		struct svc_spawn keep = *sp;
+
+		dbg("%s: cannot prepare spawn, using fork", svc_ident(svc, NULL, 0));
+		spawn_clear(sp);
+		sp->gen = keep.gen;
+		sp->nfd = keep.nfd;
+		sp->nlfd = keep.nlfd;
+		sp->env_mtime = keep.env_mtime;
+		sp->slow = 1;
+		return 1;
+	}
+done:
+	svc_get_rlimit(svc, rlimit);
+
+	sa->identity = 1;
+	sa->uid      = sp->uid;
+	sa->gid      = sp->gid;
+	sa->ngroups  = sp->ngroups;
+	sa->groups   = sp->groups;
+	sa->home     = sp->home;
+	sa->rlimit   = rlimit;
+	sa->path     = sp->path;
+	sa->argv     = sp->argv;
+	sa->envp     = sp->envp;
+	memcpy(sa->pidvar, sp->pidvar, sizeof(sa->pidvar));
+	sa->lfd      = lfd;
+	sa->nlfd     = nlfd;
+
+	return 0;
+}
+
+/* Drop cached spawn attributes, e.g. on svc_free() or new config */
+void spawn_free(svc_t *svc)
+{
+	if (!svc->spawn)
+		return;
+
+	spawn_clear(svc->spawn);
+	free(svc->spawn);
+	svc->spawn = NULL;
+}
+
+/* The environment of PID 1 has changed, invalidate all caches */
+void spawn_flush(void)
+{
+	spawn_gen++;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
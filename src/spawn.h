@@ -0,0 +1,83 @@
+/* Low-overhead process spawning for services
+ *
+ * Copyright (c) 2025  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef FINIT_SPAWN_H_
+#define FINIT_SPAWN_H_
+
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+
+#include "svc.h"
+
+/* NOTIFY_SOCKET, LISTEN_PID and WATCHDOG_PID */
+#define SPAWN_PIDVARS 3
+
+/*
+ * Everything the child of spawn() needs is prepared by the parent, the
+ * child only makes syscalls: dup2(), setrlimit(), setgroups(), setgid(),
+ * setuid(), chdir(), setsid() and execve().  Errors in the child are
+ * reported back in @err and @what, since the child cannot log.
+ */
+struct spawn_attr {
+	int            stdio[3];       /* dup2() to 0, 1, 2, or -1 to inherit */
+	int            cgprocs;        /* cgroup.procs to join, -1 if failed */
+	int            setsid;
+	sigset_t       sigmask;        /* Signal mask to exec with */
+
+	int            identity;       /* Set uid, gid and groups below */
+	uid_t          uid;
+	gid_t          gid;
+	int            ngroups;        /* -1 to keep supplementary groups */
+	const gid_t   *groups;
+	const char    *home;           /* chdir(), falls back to "/" */
+
+	const struct rlimit *rlimit;   /* RLIMIT_NLIMITS entries, or NULL */
+
+	const char    *path;           /* Resolved argv[0] */
+	char *const   *argv;
+	char *const   *envp;
+	char          *pidvar[SPAWN_PIDVARS]; /* In envp[], child fills in its PID */
+	const int     *lfd;            /* Listening sockets, moved to 3.. */
+	int            nlfd;
+
+	/* Set by child */
+	int            err;            /* errno from failing step */
+	const char    *what;           /* failing step, e.g. "setuid" */
+	unsigned int   rlim_err;       /* bitmask of failed setrlimit() */
+};
+
+pid_t spawn            (struct spawn_attr *sa, int *pidfd);
+int   spawn_prepare    (svc_t *svc, int nfd, struct spawn_attr *sa);
+char *spawn_path       (const char *file, char *const envp[]);
+void  spawn_free       (svc_t *svc);
+void  spawn_flush      (void);
+
+#endif /* FINIT_SPAWN_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
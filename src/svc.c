@@ -44,12 +44,202 @@
 #include "util.h"
 #include "cond.h"
 #include "schedule.h"
+#include "service.h"
+#include "spawn.h"
+#include "svcmap.h"
 
 /* Each svc_t needs a unique job# */
 static int jobcounter = 1;
 static TAILQ_HEAD(, svc) svc_list = TAILQ_HEAD_INITIALIZER(svc_list);
 static TAILQ_HEAD(, svc) gc_list  = TAILQ_HEAD_INITIALIZER(gc_list);
 
+/*
+ * Lookup indexes, one chained hash table per key type.  Chains are
+ * singly linked through svc->hnext[], in insertion order, and the
+ * hash of the key each svc was inserted with is kept in svc->hval[]
+ * so it can be unlinked even if the key has since changed.
+ */
+#define SVC_HASH_SIZE 256
+static svc_t *svc_index[SVC_IDX_MAX][SVC_HASH_SIZE];
+
+static unsigned int hash_str(unsigned int h, const char *str)
+{
+	while (*str)
+		h = (h ^ (unsigned char)*str++) * 16777619u;
+
+	return h;
+}
+
+static unsigned int hash_pid(pid_t pid)
+{
+	return (unsigned int)pid * 2654435761u;
+}
+
+/* name and id hashed as name:id, id may be empty */
+static unsigned int hash_ident(const char *name, const char *id)
+{
+	return hash_str(hash_str(2166136261u, name) * 16777619u, id);
+}
+
+static void index_add(int idx, svc_t *svc, unsigned int h)
+{
+	svc_t **pp = &svc_index[idx][h % SVC_HASH_SIZE];
+
+	while (*pp)
+		pp = &(*pp)->hnext[idx];
+	*pp = svc;
+
+	svc->hnext[idx] = NULL;
+	svc->hval[idx]  = h;
+	svc->hmask     |= 1 << idx;
+}
+
+static void index_del(int idx, svc_t *svc)
+{
+	svc_t **pp;
+
+	if (!(svc->hmask & (1 << idx)))
+		return;
+
+	for (pp = &svc_index[idx][svc->hval[idx] % SVC_HASH_SIZE]; *pp; pp = &(*pp)->hnext[idx]) {
+		if (*pp == svc) {
+			*pp = svc->hnext[idx];
+			break;
+		}
+	}
+
+	svc->hnext[idx] = NULL;
+	svc->hmask     &= ~(1 << idx);
+}
+
+static svc_t *index_first(int idx, unsigned int h)
+{
+	return svc_index[idx][h % SVC_HASH_SIZE];
+}
+
+static const char *pidfile_key(svc_t *svc)
+{
+	if (!svc->pidfile)
+		return "";
+	if (svc->pidfile[0] == '!')
+		return &svc->pidfile[1];
+
+	return svc->pidfile;
+}
+
+/**
+ * svc_reindex - Update lookup indexes after a change of key fields
+ * @svc: Pointer to an &svc_t object
+ *
+ * Must be called when svc->pidfile or svc->dev is changed.  The PID
+ * index is managed by svc_set_pid().  Services that have been deleted
+ * by svc_del() are not indexed.
+ */
+void svc_reindex(svc_t *svc)
+{
+	const char *key;
+	int i;
+
+	for (i = 0; i < SVC_IDX_MAX; i++)
+		index_del(i, svc);
+
+	if (!svc->hlive)
+		return;
+
+	if (svc->pid > 0)
+		index_add(SVC_IDX_PID, svc, hash_pid(svc->pid));
+
+	index_add(SVC_IDX_NAME, svc, hash_ident(svc->name, svc->id));
+
+	key = pidfile_key(svc);
+	if (key[0])
+		index_add(SVC_IDX_PIDFILE, svc, hash_str(2166136261u, key));
+
+	if (svc_is_tty(svc) && svc->dev[0])
+		index_add(SVC_IDX_TTY, svc, hash_str(2166136261u, svc->dev));
+}
+
+/**
+ * svc_set_pid - Update PID of a service
+ * @svc: Pointer to an &svc_t object
+ * @pid: New PID, or zero
+ *
+ * All updates of svc->pid must use this function to keep the PID
+ * index, used by svc_find_by_pid(), in sync.  The pidfd watcher of
+ * the previous PID, if any, is detached from @svc.
+ */
+void svc_set_pid(svc_t *svc, pid_t pid)
+{
+	if (svc->pidfd && svc->pidfd->pid != pid) {
+		svc->pidfd->svc = NULL;
+		svc->pidfd = NULL;
+	}
+
+	index_del(SVC_IDX_PID, svc);
+	*((pid_t *)&svc->pid) = pid;
+	if (svc->hlive && pid > 0)
+		index_add(SVC_IDX_PID, svc, hash_pid(pid));
+}
+
+/**
+ * svc_set_rlimit - Set resource limits of a service
+ * @svc:    Pointer to an &svc_t object
+ * @rlimit: Array of %RLIMIT_NLIMITS limits, usually from a .conf file
+ *
+ * Only limits that differ from global_rlimit[] are stored, most
+ * services never change any limits so this is usually nothing.
+ *
+ * Returns:
+ * POSIX OK(0), or -1 with errno set on failure to allocate memory.
+ */
+int svc_set_rlimit(svc_t *svc, struct rlimit rlimit[])
+{
+	struct svc_rlimit diff[RLIMIT_NLIMITS];
+	int i, num = 0;
+
+	for (i = 0; i < RLIMIT_NLIMITS; i++) {
+		if (rlimit[i].rlim_cur == global_rlimit[i].rlim_cur &&
+		    rlimit[i].rlim_max == global_rlimit[i].rlim_max)
+			continue;
+
+		diff[num].resource = i;
+		diff[num].rlim     = rlimit[i];
+		num++;
+	}
+
+	free(svc->rlimit);
+	svc->rlimit     = NULL;
+	svc->rlimit_num = 0;
+	if (!num)
+		return 0;
+
+	svc->rlimit = malloc(num * sizeof(diff[0]));
+	if (!svc->rlimit)
+		return -1;
+
+	memcpy(svc->rlimit, diff, num * sizeof(diff[0]));
+	svc->rlimit_num = num;
+
+	return 0;
+}
+
+/**
+ * svc_get_rlimit - Get resource limits of a service
+ * @svc:    Pointer to an &svc_t object
+ * @rlimit: Array of %RLIMIT_NLIMITS limits to fill in
+ *
+ * Fills in @rlimit with global_rlimit[] and any limits that differ for
+ * this service, set with svc_set_rlimit().
+ */
+void svc_get_rlimit(svc_t *svc, struct rlimit rlimit[])
+{
+	int i;
+
+	memcpy(rlimit, global_rlimit, RLIMIT_NLIMITS * sizeof(struct rlimit));
+	for (i = 0; i < svc->rlimit_num; i++)
+		rlimit[svc->rlimit[i].resource] = svc->rlimit[i].rlim;
+}
+
 /*
  * Before gc removal of svc, make sure we don't clear an active
  * condition of a new instance of the svc.
@@ -80,6 +270,30 @@ static void maybe_clear_cond(svc_t *svc)
 	cond_clear(mkcond(svc, cond, sizeof(cond)));
 }
 
+/* Release svc and all its heap allocated strings */
+static void svc_free(svc_t *svc)
+{
+	char **str;
+	size_t i;
+
+	if (svc->pidfd)
+		svc->pidfd->svc = NULL;
+
+	/*
+	 * A pending timeout, watchdog, or start slot deadline, would be
+	 * left on the timer wheel
+	 */
+	wheel_timer_stop(&svc->timer);
+	wheel_timer_stop(&svc->wdog);
+	wheel_timer_stop(&svc->slot_tmo);
+	spawn_free(svc);
+	for (i = 0; (str = svc_strv(svc, i)); i++)
+		free(*str);
+	free(svc->args);
+	free(svc->rlimit);
+	free(svc);
+}
+
 static void svc_gc(void *arg)
 {
 	struct timespec now;
@@ -97,7 +311,7 @@ static void svc_gc(void *arg)
 
 		TAILQ_REMOVE(&gc_list, svc, link);
 		maybe_clear_cond(svc);
-		free(svc);
+		svc_free(svc);
 	}
 
 	if (!TAILQ_EMPTY(&gc_list))
@@ -139,8 +353,10 @@ svc_t *svc_new(char *cmd, char *name, char *id, int type)
 		strlcpy(svc->name, name, sizeof(svc->name));
 	if (id && id[0])
 		strlcpy(svc->id, id, sizeof(svc->id));
-	if (cmd)
-		strlcpy(svc->cmd, cmd, sizeof(svc->cmd));
+	if (cmd && strset(&svc->cmd, cmd)) {
+		free(svc);
+		return NULL;
+	}
 
 	/* Default description, if missing */
 	strlcpy(svc->desc, svc->name, sizeof(svc->desc));
@@ -155,6 +371,8 @@ svc_t *svc_new(char *cmd, char *name, char *id, int type)
 	svc->killdelay = SVC_TERM_TIMEOUT;
 
 	TAILQ_INSERT_TAIL(&svc_list, svc, link);
+	svc->hlive = 1;
+	svc_reindex(svc);
 
 	return svc;
 }
@@ -175,6 +393,13 @@ int svc_del(svc_t *svc)
 {
 	TAILQ_REMOVE(&svc_list, svc, link);
 	TAILQ_INSERT_TAIL(&gc_list, svc, link);
+	svc->hlive = 0;
+	svc_reindex(svc);
+	cond_unsubscribe(svc);
+	service_dequeue(svc);
+	service_slot_release(svc);
+	service_watchdog_release(svc);
+	svcmap_del(svc);
 
 	clock_gettime(CLOCK_MONOTONIC_COARSE, &svc->gc);
 	schedule_work(&work);
@@ -400,12 +625,16 @@ svc_t *svc_clean_completed(void)
  */
 svc_t *svc_find(char *name, char *id)
 {
-	svc_t *svc, *iter = NULL;
+	unsigned int h;
+	svc_t *svc;
 
 	if (!id)
 		id = "";
 
-	for (svc = svc_iterator(&iter, 1); svc; svc = svc_iterator(&iter, 0)) {
+	h = hash_ident(name, id);
+	for (svc = index_first(SVC_IDX_NAME, h); svc; svc = svc->hnext[SVC_IDX_NAME]) {
+		if (svc->hval[SVC_IDX_NAME] != h)
+			continue;
 		if (!strcmp(svc->name, name) && !strcmp(svc->id, id))
 			return svc;
 	}
@@ -450,6 +679,18 @@ svc_t *svc_find_by_pid(pid_t pid)
 {
 	svc_t *svc, *iter = NULL;
 
+	if (pid > 0) {
+		unsigned int h = hash_pid(pid);
+
+		for (svc = index_first(SVC_IDX_PID, h); svc; svc = svc->hnext[SVC_IDX_PID]) {
+			if (svc->pid == pid)
+				return svc;
+		}
+
+		return NULL;
+	}
+
+	/* Looking for services without a PID, not indexed */
 	for (svc = svc_iterator(&iter, 1); svc; svc = svc_iterator(&iter, 0)) {
 		if (svc->pid == pid)
 			return svc;
@@ -467,17 +708,20 @@ svc_t *svc_find_by_pid(pid_t pid)
  */
 svc_t *svc_find_by_cond(const char *cond)
 {
-	svc_t *svc, *iter = NULL;
+	char *name, *id;
 
-	for (svc = svc_iterator(&iter, 1); svc; svc = svc_iterator(&iter, 0)) {
-		char buf[MAX_COND_LEN];
+	if (!cond || strncmp(cond, COND_PID, strlen(COND_PID)))
+		return NULL;
 
-		mkcond(svc, buf, sizeof(buf));
-		if (string_compare(buf, cond))
-			return svc;
-	}
+	/* pid/name[:id] is derived from name:id, see mkcond() */
+	name = strdupa(cond + strlen(COND_PID));
+	id = strchr(name, ':');
+	if (id)
+		*id++ = 0;
+	else
+		id = "";
 
-	return NULL;
+	return svc_find(name, id);
 }
 
 /**
@@ -505,13 +749,15 @@ svc_t *svc_find_by_jobid(int job, char *id)
 
 svc_t *svc_find_by_tty(char *dev)
 {
-	svc_t *svc, *iter = NULL;
+	unsigned int h;
+	svc_t *svc;
 
 	/* rescue (notty) shells have no device node */
 	if (!dev)
 		return NULL;
 
-	for (svc = svc_iterator(&iter, 1); svc; svc = svc_iterator(&iter, 0)) {
+	h = hash_str(2166136261u, dev);
+	for (svc = index_first(SVC_IDX_TTY, h); svc; svc = svc->hnext[SVC_IDX_TTY]) {
 		if (!svc_is_tty(svc))
 			continue;
 
@@ -539,7 +785,8 @@ svc_t *svc_find_by_tty(char *dev)
  */
 svc_t *svc_find_by_pidfile(char *fn)
 {
-	svc_t *svc, *iter = NULL;
+	unsigned int h;
+	svc_t *svc;
 	pid_t pid;
 
 	pid = pid_file_read(fn);
@@ -554,12 +801,9 @@ svc_t *svc_find_by_pidfile(char *fn)
 	 * off a chiled that we don't know about.  See if we can match
 	 * the PID file to a service instead.
 	 */
-	for (svc = svc_iterator(&iter, 1); svc; svc = svc_iterator(&iter, 0)) {
-		int v = 0;
-
-		if (svc->pidfile[0] == '!')
-			v = 1;
-		if (strcmp(&svc->pidfile[v], fn))
+	h = hash_str(2166136261u, fn);
+	for (svc = index_first(SVC_IDX_PIDFILE, h); svc; svc = svc->hnext[SVC_IDX_PIDFILE]) {
+		if (strcmp(pidfile_key(svc), fn))
 			continue;
 
 		return svc;
@@ -637,7 +881,7 @@ void svc_clean_dynamic(void (*cb)(svc_t *))
 int svc_clean_bootstrap(svc_t *svc)
 {
 	if (!ISOTHER(svc->runlevels, INIT_LEVEL)) {
-		svc->pid = 0;
+		svc_set_pid(svc, 0);
 		svc_del(svc);
 		return 1;
 	}
@@ -760,33 +1004,28 @@ int svc_ifthen(int is_conf, const char *ident, char *stmt, int quiet)
 	if (!stmt || !stmt[0])
 		return 1;
 
+	/*
+	 * Same expression syntax as service conditions, but a condition in
+	 * flux does not disqualify, only a condition that is off, or for
+	 * !cond, on.
+	 */
 	if (stmt[0] == '<') {
-		enum cond_state cond;
-		char *ptr = ++stmt;
-		int i = 0;
+		enum cond_state state[MAX_NUM_SVC_COND];
+		struct cond_expr ce;
+		int i;
 
 		if (is_conf)
 			return 1;
 
-		while (ptr[i] != '>' && ptr[i] != 0)
-			i++;
-		ptr[i] = 0;
-
-		strlcpy(stmts, stmt, sizeof(stmts));
-		for (stmt = strtok(stmts, ","); stmt; stmt = strtok(NULL, ","), not = 0) {
-			if (stmt[0] == '!') {
-				stmt++;
-				not++;
-			}
+		strlcpy(stmts, &stmt[1], sizeof(stmts));
+		stmts[strcspn(stmts, ">")] = 0;
+		if (cond_expr_parse(stmts, &ce))
+			return 0;
 
-			cond = cond_get(stmt);
-			if (not && cond == COND_ON)
-				return 0;
-			if (!not && cond == COND_OFF)
-				return 0;
-		}
+		for (i = 0; i < ce.num; i++)
+			state[i] = cond_get(ce.name[i]);
 
-		return 1;
+		return cond_expr_eval(ce.op, ce.len, state) != COND_OFF;
 	}
 
 	if (!is_conf)
@@ -39,6 +39,7 @@
 
 #include "cgroup.h"
 #include "helpers.h"
+#include "wheel.h"
 
 typedef int svc_cmd_t;
 
@@ -104,6 +105,8 @@ typedef enum {
 #define MAX_NUM_SUPGROUPS 4
 #define MAX_NUM_FDS      64	     /* Max number of I/O plugins */
 #define MAX_NUM_SVC_ARGS 64
+#define MAX_NUM_SVC_COND 32
+#define MAX_COND_EXPR    (MAX_NUM_SVC_COND * 2)
 
 /* Default kill delay (msec) after SIGTERM (svc->sighalt) that we SIGKILL processes */
 #define SVC_TERM_TIMEOUT 3000
@@ -111,61 +114,152 @@ typedef enum {
 /* Prevent endless respawn of faulty services. */
 #define SVC_RESPAWN_MAX  10
 
+/* Lookup indexes maintained by svc.c, see svc_find*() */
+enum {
+	SVC_IDX_PID = 0,
+	SVC_IDX_NAME,		/* name:id, also used for pid/name:id conds */
+	SVC_IDX_PIDFILE,
+	SVC_IDX_TTY,
+	SVC_IDX_MAX
+};
+
+/* Per-service resource limit, only those differing from global_rlimit[] */
+struct svc_rlimit {
+	int            resource;
+	struct rlimit  rlim;
+};
+
 /*
  * Default enable for all services, can be stopped by means
  * of issuing an initctl call. E.g.
  *
  *   initctl <stop|start|restart> service
+ *
+ * The struct is split in a hot part, runtime state used by the service
+ * state machine on every step, and a cold part with the configuration
+ * from service_register().  Command line, scripts, and other strings
+ * that used to be fixed size buffers are heap allocated and right sized
+ * with strset(), an unset string is always %NULL, never "".
  */
 typedef struct svc {
 	TAILQ_ENTRY(svc) link;
 
+	/* Service state */
+	const svc_state_t state;       /* Paused, Reloading, Restart, Running, ... */
+	svc_block_t    block;	       /* Reason that this service is currently stopped */
+	svc_type_t     type;	       /* Service, run, task, ... */
+	const pid_t    pid;	       /* Use svc_set_pid() to update */
+	pid_t          oldpid;
+	int            status;	       /* From waitpid() when process is collected */
+	int            started;	       /* Set for run/task/sysv to track if started */
+	int            starting;       /* ... waiting for pidfile to be re-asserted */
+	const int      dirty;	       /* 0: unmodified, 1: modified */
+	const int      removed;
+	int	       runlevels;
+	int            job;	       /* For internal use only, canonical ref is NAME:ID */
+	long           start_time;     /* Start time, as seconds since boot, from sysinfo() */
+
+	/* Counters */
+	char           once;	       /* run/task, (at least) once per runlevel */
+	char           respawn;	       /* ttys, or services with `respawn`, never increment restart_cnt */
+	const char     restart_cnt;    /* Incremented for each restart by service monitor. */
+	unsigned char  oncrash_action; /* Action to perform in crashed state. */
+	unsigned int   restart_tot;    /* Total restarts ever, summarized, including `initctl restart` */
+	int            restart_max;    /* Maximum number of restarts allowed */
+	int            restart_saved;  /* INTERNAL, saved copy of .conf value */
+	int            restart_tmo;    /* Time before restarting a crashing service */
+	int            restart_backoff;/* Max restart_tmo when backing off, 0: disabled */
+	int            restart_jitter; /* Randomize restart_tmo by +/- percent */
+
+	/* Pre-parsed cond[], see conf_parse_cond() */
+	int            cond_num;
+	int            cond_nsub;      /* cond_num + any if:<cond> subscribed to */
+	unsigned int   subs_gen;       /* Dedup in cond_foreach_subscriber() */
+	int            cond_id[MAX_NUM_SVC_COND];
+	int            cond_len;       /* Ops in cond_op[], 0: AND of all cond_id[], -1: invalid */
+	signed char    cond_op[MAX_COND_EXPR];
+
+	/*
+	 * Used to forcefully kill services that won't shutdown on
+	 * termination and to delay restarts of crashing services.
+	 */
+	struct wtimer  timer;
+	void           (*timer_cb)(struct svc *svc);
+
+	/*
+	 * Readiness notification socket: systemd, s6
+	 */
+	svc_notify_t   notify;
+	uev_t	       notify_watcher; /* i/o watcher */
+	char          *notify_status;  /* Last STATUS= from service */
+
+	/* Deadline for next WATCHDOG=1, see watchdog:MSEC */
+	struct wtimer  wdog;
+
+	/* Exit watcher for svc->pid, when started with CLONE_PIDFD */
+	struct svc_pidfd *pidfd;
+
+	/* Cached identity, env and argv for spawn(), private to spawn.c */
+	struct svc_spawn *spawn;
+
+	/* Boot timeline name index + 1, private to timeline.c */
+	int            tlid;
+
+	/* Status table slot + 1, private to svcmap.c */
+	int            mapid;
+
+	/* Last svc_status() sent to monitor clients, private to api.c */
+	const char    *evstatus;
+
+	/* Hash chains for svc_find*(), private to svc.c */
+	struct svc    *hnext[SVC_IDX_MAX];
+	unsigned int   hval[SVC_IDX_MAX];
+	int            hmask;	       /* Bitmask of indexes svc is in */
+	int            hlive;	       /* Set from svc_new() until svc_del() */
+
+	/* Queued for service_step(), private to service.c */
+	TAILQ_ENTRY(svc) qlink;
+	int            queued;
+
+	/* Start slot, or waiting for one, private to service.c */
+	TAILQ_ENTRY(svc) slink;
+	int            slot;
+	struct wtimer  slot_tmo;       /* Slot released if not ready in time */
+
+	/* time at svc_del(), used by gc timer */
+	struct timespec gc;
+
+	/*
+	 * Cold part, configuration below this point
+	 */
+
 	/* Origin of service */
 	char           file[MAX_ARG_LEN];
 
+	/* Instance specifics */
+	char           name[MAX_ARG_LEN];
+	char           id[MAX_ID_LEN]; /* :ID */
+	char           ifstmt[MAX_IDENT_LEN];
+	char           cond[MAX_COND_LEN];
+
 	/* Limits and scoping */
-	struct rlimit  rlimit[RLIMIT_NLIMITS];
+	struct svc_rlimit *rlimit;     /* Diff against global_rlimit[], see svc_rlimit() */
+	int            rlimit_num;
 	struct cgroup  cgroup;
 
 	/* Service details */
 	int            sighalt;        /* Signal to stop process, default: SIGTERM */
 	int            killdelay;      /* Delay in msec before sending SIGKILL */
-	pid_t          oldpid, pid;
-	char           pidfile[MAX_CMD_LEN];
-	long           start_time;     /* Start time, as seconds since boot, from sysinfo() */
-	int            started;	       /* Set for run/task/sysv to track if started */
-	int            status;	       /* From waitpid() when process is collected */
-	const svc_state_t state;       /* Paused, Reloading, Restart, Running, ... */
-	svc_type_t     type;	       /* Service, run, task, ... */
+	int            priority;       /* Start order if start slots are limited, higher first */
+	int            watchdog;       /* Max msec between WATCHDOG=1 keep-alives, 0: off */
+	char          *pidfile;
 	char           protect;        /* Services like dbus-daemon & udev by Finit */
 	char           manual;	       /* run/task that require `initctl start foo` */
 	char           remain;	       /* run/task: stay in DONE state, run post: on stop */
 	char           nowarn;	       /* Skip or log warning if cmd missing or conflicts */
-	const int      dirty;	       /* 0: unmodified, 1: modified */
-	const int      removed;
-	int            starting;       /* ... waiting for pidfile to be re-asserted */
-	int	       runlevels;
 	int            sighup;	       /* This service supports SIGHUP :) */
 	int            flux_reload;    /* Propagate reload from dependency, '~' prefix */
 	int	       forking;	       /* This is a service/sysv daemon that forks, wait for it ... */
-	svc_block_t    block;	       /* Reason that this service is currently stopped */
-	char           cond[MAX_COND_LEN];
-
-	/* Instance specifics */
-	int            job;	       /* For internal use only, canonical ref is NAME:ID */
-	char           name[MAX_ARG_LEN];
-	char           id[MAX_ID_LEN]; /* :ID */
-	char           ifstmt[MAX_IDENT_LEN];
-
-	/* Counters */
-	char           once;	       /* run/task, (at least) once per runlevel */
-	unsigned int   restart_tot;    /* Total restarts ever, summarized, including `initctl restart` */
-	int            restart_max;    /* Maximum number of restarts allowed */
-	int            restart_saved;  /* INTERNAL, saved copy of .conf value */
-	int            restart_tmo;    /* Time before restarting a crashing service */
-	unsigned char  oncrash_action; /* Action to perform in crashed state. */
-	char           respawn;	       /* ttys, or services with `respawn`, never increment restart_cnt */
-	const char     restart_cnt;    /* Incremented for each restart by service monitor. */
 
 	union {
 		/* services we redirect stdout/stderr to syslog (not TTYs!) */
@@ -176,6 +270,10 @@ typedef struct svc {
 			char  file[64];
 			char  prio[20];
 			char  ident[20];
+			int   rate;		/* Lines per interval, 0: unlimited */
+			int   interval;		/* Rate limit interval, seconds */
+			int   burst;		/* Max lines in a burst */
+			char  block;		/* Backpressure instead of drop */
 		} log;
 
 		/* Only for TTY type services */
@@ -196,53 +294,52 @@ typedef struct svc {
 	char	       group[MAX_USER_LEN];
 	char	       supgroups[MAX_NUM_SUPGROUPS][MAX_USER_LEN];
 	int		       num_supgroups;
-	char	       capabilities[MAX_CMD_LEN];
+	char	      *capabilities;
 
 	/* Command, arguments and service description */
-	char	       cmd[MAX_CMD_LEN];
-	char	       args[MAX_NUM_SVC_ARGS][MAX_CMD_LEN];
+	char	      *cmd;
+	char	     **args;	       /* argv[] from strvdup(), args[0] is cmd */
 	int            args_dirty;
 	char           conflict[MAX_ARG_LEN];
 	char	       desc[MAX_STR_LEN];
-	char	       env[MAX_CMD_LEN];
+	char	      *env;
 
-	char	       pre_script[MAX_CMD_LEN];
+	char	      *pre_script;
 	int	       pre_tmo;
 
-	char	       post_script[MAX_CMD_LEN];
+	char	      *post_script;
 	int	       post_tmo;
 
-	char	       ready_script[MAX_CMD_LEN];
+	char	      *ready_script;
 	int	       ready_tmo;
 
-	char	       cleanup_script[MAX_CMD_LEN];
+	char	      *cleanup_script;
 	int	       cleanup_tmo;
 
 	/* When set, used instead of SIGHUP or stop-start */
-	char	       reload_script[MAX_CMD_LEN];
+	char	      *reload_script;
 
 	/* When set, used instead of SIGTERM or sysv 'stop' */
-	char	       stop_script[MAX_CMD_LEN];
-
-	/*
-	 * Used to forcefully kill services that won't shutdown on
-	 * termination and to delay restarts of crashing services.
-	 */
-	uev_t          timer;
-	void           (*timer_cb)(struct svc *svc);
-
-	/*
-	 * Readiness notification socket: systemd, s6
-	 */
-	svc_notify_t   notify;
-	uev_t	       notify_watcher; /* i/o watcher */
-
-	/* time at svc_del(), used by gc timer */
-	struct timespec gc;
+	char	      *stop_script;
 } svc_t;
 
+/*
+ * A child started with CLONE_PIDFD, reaped by service.c when its pidfd
+ * becomes readable.  Not embedded in svc_t since a child may outlive
+ * being svc->pid, e.g. a bootstrap task, then @svc is %NULL.
+ */
+struct svc_pidfd {
+	uev_t          watcher;
+	svc_t         *svc;
+	pid_t          pid;
+};
+
 svc_t      *svc_new                (char *cmd, char *name, char *id, int type);
 int	    svc_del	           (svc_t *svc);
+void        svc_set_pid            (svc_t *svc, pid_t pid);
+void        svc_reindex            (svc_t *svc);
+int         svc_set_rlimit         (svc_t *svc, struct rlimit rlimit[]);
+void        svc_get_rlimit         (svc_t *svc, struct rlimit rlimit[]);
 void	    svc_validate	   (svc_t *svc);
 
 svc_t	   *svc_find	           (char *name, char *id);
@@ -285,14 +382,14 @@ static inline int svc_is_runtask   (svc_t *svc) { return svc && (SVC_TYPE_RUNTAS
 static inline int svc_is_forking   (svc_t *svc) { return svc && svc->forking; }
 static inline int svc_is_manual    (svc_t *svc) { return svc && svc->manual; }
 static inline int svc_is_remain    (svc_t *svc) { return svc && svc->remain; }
-static inline int svc_is_noreload  (svc_t *svc) { return svc && (0 == svc->sighup && 0 == svc->reload_script[0]); }
+static inline int svc_is_noreload  (svc_t *svc) { return svc && (0 == svc->sighup && !svc->reload_script); }
 
 static inline int svc_in_runlevel  (svc_t *svc, int runlevel) { return svc && ISSET(svc->runlevels, runlevel); }
-static inline int svc_has_pidfile  (svc_t *svc) { return svc_is_daemon(svc) && svc->pidfile[0] != 0 && svc->pidfile[0] != '!'; }
-static inline int svc_has_pre      (svc_t *svc) { return svc->pre_script[0];  }
-static inline int svc_has_post     (svc_t *svc) { return svc->post_script[0]; }
-static inline int svc_has_ready    (svc_t *svc) { return svc->ready_script[0];}
-static inline int svc_has_cleanup  (svc_t *svc) { return svc->cleanup_script[0]; }
+static inline int svc_has_pidfile  (svc_t *svc) { return svc_is_daemon(svc) && svc->pidfile && svc->pidfile[0] != '!'; }
+static inline int svc_has_pre      (svc_t *svc) { return svc->pre_script != NULL;  }
+static inline int svc_has_post     (svc_t *svc) { return svc->post_script != NULL; }
+static inline int svc_has_ready    (svc_t *svc) { return svc->ready_script != NULL;}
+static inline int svc_has_cleanup  (svc_t *svc) { return svc->cleanup_script != NULL; }
 
 static inline void svc_starting    (svc_t *svc) { if (svc) svc->starting = 1;       }
 static inline void svc_started     (svc_t *svc) { if (svc) svc->starting = 0;       }
@@ -458,6 +555,32 @@ static inline const char *svc_dirtystr(svc_t *svc)
 	return "clean";
 }
 
+/*
+ * Heap allocated strings in svc_t, except args[].  Used to release them
+ * and to serialize them after the svc_t itself on the API socket.
+ */
+static inline char **svc_strv(svc_t *svc, size_t i)
+{
+	char **strv[] = {
+		&svc->cmd,
+		&svc->pidfile,
+		&svc->env,
+		&svc->capabilities,
+		&svc->pre_script,
+		&svc->post_script,
+		&svc->ready_script,
+		&svc->cleanup_script,
+		&svc->reload_script,
+		&svc->stop_script,
+		&svc->notify_status,
+	};
+
+	if (i >= NELEMS(strv))
+		return NULL;
+
+	return strv[i];
+}
+
 /*
  * Returns svc unique identifier tuple 'name:id', or just 'name',
  * if that's enough to identify the service.
@@ -514,7 +637,7 @@ static inline char *svc_getenv(svc_t *svc)
 {
 	int v = 0;
 
-	if (!svc->env[0])
+	if (!svc->env)
 		return NULL;
 
 	if (svc->env[0] == '-')
@@ -0,0 +1,234 @@
+/* Read-only service status table, shared with readers through mmap()
+ *
+ * Copyright (c) 2025  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef _LIBITE_LITE
+# include <libite/lite.h>
+#else
+# include <lite/lite.h>
+#endif
+
+#include "finit.h"
+#include "log.h"
+#include "svcmap.h"
+
+/*
+ * Room for this many services at first, doubled when full.  Slots of
+ * removed services are reused, so it rarely needs to grow.
+ */
+#define SVCMAP_INIT 64
+
+static struct svcmap *map;
+static size_t         maplen;
+
+static uint64_t boottime(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_BOOTTIME, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static struct svcmap_svc *slot(uint32_t i)
+{
+	return (struct svcmap_svc *)&map->svc[i * sizeof(struct svcmap_svc)];
+}
+
+/* Readers retry while seq is odd, and if it changed while reading */
+static void map_lock(struct svcmap *m)
+{
+	__atomic_store_n(&m->seq, m->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void map_unlock(struct svcmap *m)
+{
+	m->updated = boottime();
+	__atomic_store_n(&m->seq, m->seq + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Create a new table with room for @capacity services, copy any
+ * entries from the current table and replace the file.  Readers of
+ * the old file see @stale and reopen.
+ */
+static int map_create(uint32_t capacity)
+{
+	char tmp[] = SVCMAP_PATH ".XXXXXX";
+	struct svcmap *m;
+	size_t len;
+	int fd;
+
+	len = sizeof(*m) + capacity * sizeof(struct svcmap_svc);
+	fd = mkostemp(tmp, O_CLOEXEC);
+	if (fd == -1)
+		goto fail;
+
+	if (fchmod(fd, 0644) || ftruncate(fd, len)) {
+		close(fd);
+		goto fail_unlink;
+	}
+
+	m = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (m == MAP_FAILED)
+		goto fail_unlink;
+
+	m->magic    = SVCMAP_MAGIC;
+	m->version  = SVCMAP_VERSION;
+	m->entsize  = sizeof(struct svcmap_svc);
+	m->capacity = capacity;
+	if (map) {
+		m->count = map->count;
+		memcpy(m->svc, map->svc, map->count * sizeof(struct svcmap_svc));
+	}
+	m->updated  = boottime();
+
+	if (rename(tmp, SVCMAP_PATH)) {
+		munmap(m, len);
+		goto fail_unlink;
+	}
+
+	if (map) {
+		map_lock(map);
+		map->stale = 1;
+		map_unlock(map);
+		munmap(map, maplen);
+	}
+	map    = m;
+	maplen = len;
+
+	return 0;
+fail_unlink:
+	unlink(tmp);
+fail:
+	logit(LOG_WARNING, "Failed creating service status table %s: %s", SVCMAP_PATH, strerror(errno));
+	return -1;
+}
+
+/* Find an unused slot, grow the table when full */
+static int map_alloc(void)
+{
+	uint32_t i;
+
+	for (i = 0; i < map->count; i++) {
+		if (!slot(i)->name[0])
+			return i;
+	}
+
+	if (map->count == map->capacity && map_create(map->capacity * 2))
+		return -1;
+
+	map_lock(map);
+	map->count++;
+	map_unlock(map);
+
+	return i;
+}
+
+/**
+ * svcmap_update - Publish current state of a service
+ * @svc: Service to publish
+ *
+ * Called by the service state machine after each step, allocates a
+ * slot in the table the first time.
+ */
+void svcmap_update(svc_t *svc)
+{
+	struct svcmap_svc *s;
+
+	if (!map || !svc->hlive)
+		return;
+
+	if (!svc->mapid) {
+		int i = map_alloc();
+
+		if (i < 0)
+			return;
+		svc->mapid = i + 1;
+	}
+	s = slot(svc->mapid - 1);
+
+	map_lock(map);
+	strlcpy(s->name, svc->name, sizeof(s->name));
+	strlcpy(s->id, svc->id, sizeof(s->id));
+	s->job         = svc->job;
+	s->pid         = svc->pid;
+	s->type        = svc->type;
+	s->state       = svc->state;
+	s->block       = svc->block;
+	s->flags       = (svc->started ? SVCMAP_STARTED : 0) | (svc->manual ? SVCMAP_MANUAL : 0);
+	s->status      = svc->status;
+	s->restart_tot = svc->restart_tot;
+	s->restart_cnt = svc->restart_cnt;
+	s->restart_max = svc->restart_max;
+	s->start_time  = svc->pid ? svc->start_time : 0;
+	s->changed     = boottime();
+	map_unlock(map);
+}
+
+/**
+ * svcmap_del - Remove a service from the table
+ * @svc: Service being deleted, see svc_del()
+ */
+void svcmap_del(svc_t *svc)
+{
+	if (!map || !svc->mapid)
+		return;
+
+	map_lock(map);
+	memset(slot(svc->mapid - 1), 0, sizeof(struct svcmap_svc));
+	map_unlock(map);
+	svc->mapid = 0;
+}
+
+/**
+ * svcmap_init - Create service status table
+ *
+ * Called when /run/finit is available, after the API socket has been
+ * set up.  Services registered before this are added here, the rest
+ * when they are stepped the first time.
+ */
+void svcmap_init(void)
+{
+	svc_t *svc, *iter = NULL;
+
+	if (map || map_create(SVCMAP_INIT))
+		return;
+
+	for (svc = svc_iterator(&iter, 1); svc; svc = svc_iterator(&iter, 0))
+		svcmap_update(svc);
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -0,0 +1,206 @@
+/* Read-only service status table, shared with PID 1 through mmap()
+ *
+ * Copyright (c) 2025  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef FINIT_SVCMAP_H_
+#define FINIT_SVCMAP_H_
+
+/*
+ * Finit publishes a compact copy of its service table in a file on
+ * tmpfs, which monitoring tools can mmap() and read without asking
+ * PID 1 over the API socket.  The file is only written by PID 1, an
+ * update of any entry is protected by a sequence lock in the header:
+ * odd while an update is in progress.  Readers copy the table and
+ * retry if the sequence number changed, see svcmap_snapshot().
+ *
+ * When the table is full, PID 1 replaces the file with a larger one
+ * and sets @stale in the old one.  Readers then reopen the file.
+ *
+ * The layout is versioned, new fields are only ever appended to the
+ * end of struct svcmap_svc, so check @entsize when stepping entries.
+ * This header is self-contained, for use also outside of Finit.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SVCMAP_PATH      "/run/finit/svcmap"
+#define SVCMAP_MAGIC     0x464d4150	/* "FMAP" */
+#define SVCMAP_VERSION   1
+#define SVCMAP_RETRIES   1000		/* Reader attempts before EAGAIN */
+
+/* svcmap_svc flags */
+#define SVCMAP_STARTED   0x01		/* run/task has been started */
+#define SVCMAP_MANUAL    0x02
+
+/* One service, values are the same as in svc_t, see svc.h */
+struct svcmap_svc {
+	char     name[64];		/* Empty for unused slots */
+	char     id[72];
+	int32_t  job;
+	int32_t  pid;
+	uint8_t  type;			/* SVC_TYPE_* */
+	uint8_t  state;			/* SVC_*_STATE */
+	uint8_t  block;			/* SVC_BLOCK_*, reason for halted */
+	uint8_t  flags;			/* SVCMAP_* */
+	int32_t  status;		/* Last status from waitpid() */
+	uint32_t restart_tot;		/* Total restarts */
+	int32_t  restart_cnt;		/* Restarts of crashing service ... */
+	int32_t  restart_max;		/* ... allowed before giving up */
+	int64_t  start_time;		/* Seconds since boot, 0: not running */
+	uint64_t changed;		/* Last update, CLOCK_BOOTTIME nsec */
+};
+
+struct svcmap {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t entsize;		/* sizeof(struct svcmap_svc) */
+	uint32_t seq;			/* Sequence lock, odd while updating */
+	uint32_t stale;			/* Replaced by new file, reopen */
+	uint32_t capacity;		/* Number of slots in file */
+	uint32_t count;			/* Slots in use, incl. unused ones */
+	uint64_t updated;		/* Last update, CLOCK_BOOTTIME nsec */
+	unsigned char svc[];		/* capacity * entsize */
+};
+
+struct svcmap_reader {
+	struct svcmap *map;
+	size_t         len;
+};
+
+static inline void svcmap_close(struct svcmap_reader *r)
+{
+	if (r->map)
+		munmap(r->map, r->len);
+	r->map = NULL;
+	r->len = 0;
+}
+
+/*
+ * Map the status table read-only, the file descriptor is not needed
+ * after mmap().  Returns 0 on success, or -1 with errno set.
+ */
+static inline int svcmap_open(struct svcmap_reader *r)
+{
+	struct svcmap *map;
+	struct stat st;
+	int fd;
+
+	r->map = NULL;
+	fd = open(SVCMAP_PATH, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return -1;
+
+	if (fstat(fd, &st) || (size_t)st.st_size < sizeof(*map)) {
+		close(fd);
+		errno = ENODATA;
+		return -1;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return -1;
+
+	if (map->magic != SVCMAP_MAGIC || map->version != SVCMAP_VERSION ||
+	    map->entsize < sizeof(struct svcmap_svc) ||
+	    sizeof(*map) + (size_t)map->capacity * map->entsize > (size_t)st.st_size) {
+		munmap(map, st.st_size);
+		errno = EPROTO;
+		return -1;
+	}
+
+	r->map = map;
+	r->len = st.st_size;
+
+	return 0;
+}
+
+/*
+ * Copy a consistent snapshot of at most @max services to @svc[], the
+ * header to @hdr, if set.  Unused slots are skipped.  Returns number
+ * of services copied, or -1 with errno set.
+ */
+static inline int svcmap_snapshot(struct svcmap_reader *r, struct svcmap *hdr,
+				  struct svcmap_svc *svc, size_t max)
+{
+	int retries = SVCMAP_RETRIES;
+
+	while (retries-- > 0) {
+		struct svcmap *map = r->map;
+		uint32_t seq, i;
+		size_t num = 0;
+
+		if (!map && svcmap_open(r))
+			return -1;
+		map = r->map;
+
+		seq = __atomic_load_n(&map->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1)
+			continue;
+
+		if (__atomic_load_n(&map->stale, __ATOMIC_RELAXED)) {
+			svcmap_close(r);
+			continue;
+		}
+
+		if (hdr)
+			memcpy(hdr, map, sizeof(*hdr));
+		for (i = 0; i < map->count && i < map->capacity && num < max; i++) {
+			const struct svcmap_svc *s;
+
+			s = (const struct svcmap_svc *)&map->svc[(size_t)i * map->entsize];
+			if (!s->name[0])
+				continue;
+			memcpy(&svc[num++], s, sizeof(*s));
+		}
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&map->seq, __ATOMIC_RELAXED) == seq)
+			return num;
+	}
+
+	errno = EAGAIN;
+	return -1;
+}
+
+#ifdef __FINIT__
+#include "svc.h"
+
+void svcmap_init   (void);
+void svcmap_update (svc_t *svc);
+void svcmap_del    (svc_t *svc);
+#endif
+
+#endif /* FINIT_SVCMAP_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
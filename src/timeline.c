@@ -0,0 +1,255 @@
+/* Boot timeline recorder, for initctl analyze
+ *
+ * Copyright (c) 2025  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#ifdef _LIBITE_LITE
+# include <libite/lite.h>
+#else
+# include <lite/lite.h>
+#endif
+
+#include "finit.h"
+#include "log.h"
+#include "private.h"
+#include "timeline.h"
+
+/*
+ * The timeline is a fixed size array of events, recorded from PID 1
+ * start until it is full, which with the default size covers several
+ * hundred services.  Each service milestone is only recorded the first
+ * time it is reached, so restarts, reloads and runlevel changes do not
+ * push out the interesting part: the boot.
+ */
+#define TL_MAX_EVENTS 2048
+
+struct tl_event {
+	uint64_t ns;
+	uint16_t type;
+	uint16_t name;			/* Index in names[] */
+	int32_t  arg;
+};
+
+struct tl_name {
+	char        *name;
+	char        *cond;		/* Conditions when satisfied */
+	int          svctype;
+	unsigned int seen;		/* Bitmask of recorded INIT_TL_* */
+};
+
+static struct tl_event events[TL_MAX_EVENTS];
+static size_t          events_num;
+
+static struct tl_name *names;
+static size_t          names_num;
+static size_t          names_max;
+
+static uint64_t now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Names are never freed, services removed at runtime keep their entry */
+static int intern(const char *name)
+{
+	struct tl_name *tmp;
+	size_t i;
+
+	for (i = 0; i < names_num; i++) {
+		if (!strcmp(names[i].name, name))
+			return i;
+	}
+
+	if (names_num >= UINT16_MAX)
+		return -1;
+
+	if (names_num == names_max) {
+		size_t max = names_max ? names_max * 2 : 64;
+
+		tmp = realloc(names, max * sizeof(*names));
+		if (!tmp)
+			return -1;
+		names     = tmp;
+		names_max = max;
+	}
+
+	memset(&names[names_num], 0, sizeof(names[0]));
+	names[names_num].name = strdup(name);
+	if (!names[names_num].name)
+		return -1;
+
+	return names_num++;
+}
+
+static void record(int type, int arg, int id)
+{
+	struct tl_event *ev;
+
+	if (events_num >= NELEMS(events))
+		return;
+
+	ev = &events[events_num++];
+	ev->ns   = now();
+	ev->type = type;
+	ev->name = id < 0 ? UINT16_MAX : id;
+	ev->arg  = arg;
+}
+
+/* Called first thing in PID 1 */
+void timeline_init(void)
+{
+	events_num = 0;
+	record(INIT_TL_BOOT, 0, -1);
+}
+
+/* System events, name is optional and not deduplicated */
+void timeline_add(int type, int arg, const char *name)
+{
+	record(type, arg, name ? intern(name) : -1);
+}
+
+void timeline_hook(hook_point_t no, int done)
+{
+	int type = done ? INIT_TL_HOOK_END : INIT_TL_HOOK_BEGIN;
+	int id;
+
+	id = intern(plugin_hook_str(no));
+	if (id < 0 || (names[id].seen & (1 << type)))
+		return;
+
+	names[id].seen |= 1 << type;
+	record(type, no, id);
+}
+
+/* Record first time @svc reaches milestone @type, see INIT_TL_SVC_* */
+void timeline_svc(svc_t *svc, int type, int arg)
+{
+	struct tl_name *tn;
+	int id;
+
+	if (events_num >= NELEMS(events))
+		return;
+
+	/* Cached, but services may be re-registered or renamed */
+	id = svc->tlid - 1;
+	if (id < 0 || strcmp(names[id].name, svc_ident(svc, NULL, 0))) {
+		id = intern(svc_ident(svc, NULL, 0));
+		if (id < 0)
+			return;
+		svc->tlid = id + 1;
+	}
+
+	tn = &names[id];
+	if (tn->seen & (1 << type))
+		return;
+
+	tn->seen   |= 1 << type;
+	tn->svctype = svc->type;
+	if (type == INIT_TL_SVC_COND && svc->cond[0])
+		tn->cond = strdup(svc->cond);
+
+	record(type, arg, id);
+}
+
+/* Called from svc_set_state() on every state change */
+void timeline_state(svc_t *svc, svc_state_t old_state, svc_state_t new_state)
+{
+	switch (new_state) {
+	case SVC_WAITING_STATE:
+		timeline_svc(svc, INIT_TL_SVC_WAITING, 0);
+		break;
+
+	case SVC_SETUP_STATE:
+		timeline_svc(svc, INIT_TL_SVC_COND, 0);
+		timeline_svc(svc, INIT_TL_SVC_PRE, 0);
+		break;
+
+	case SVC_STARTING_STATE:
+		if (old_state == SVC_SETUP_STATE)
+			timeline_svc(svc, INIT_TL_SVC_PRE_DONE, 0);
+		else
+			timeline_svc(svc, INIT_TL_SVC_COND, 0);
+		break;
+
+	case SVC_RUNNING_STATE:
+		timeline_svc(svc, INIT_TL_SVC_RUNNING, 0);
+		break;
+
+	case SVC_DONE_STATE:
+		timeline_svc(svc, INIT_TL_SVC_DONE, svc->started ? WEXITSTATUS(svc->status) : -1);
+		break;
+
+	default:
+		if (old_state == SVC_SETUP_STATE)
+			timeline_svc(svc, INIT_TL_SVC_PRE_DONE, 0);
+		break;
+	}
+}
+
+/**
+ * timeline_get - Get recorded event
+ * @pos: Index of event, from zero
+ * @ev:  Event to fill in, strings are owned by the timeline
+ *
+ * Returns:
+ * POSIX OK(0), or non-zero when @pos is past the last event.
+ */
+int timeline_get(size_t pos, struct timeline_event *ev)
+{
+	struct tl_event *e;
+
+	if (pos >= events_num)
+		return -1;
+
+	e = &events[pos];
+	memset(ev, 0, sizeof(*ev));
+	ev->ns   = e->ns;
+	ev->type = e->type;
+	ev->arg  = e->arg;
+
+	if (e->name < names_num) {
+		struct tl_name *tn = &names[e->name];
+
+		ev->name    = tn->name;
+		ev->svctype = tn->svctype;
+		if (e->type == INIT_TL_SVC_COND)
+			ev->cond = tn->cond;
+	}
+
+	return 0;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -0,0 +1,55 @@
+/* Boot timeline recorder, for initctl analyze
+ *
+ * Copyright (c) 2025  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef FINIT_TIMELINE_H_
+#define FINIT_TIMELINE_H_
+
+#include <stdint.h>
+#include "plugin.h"
+#include "svc.h"
+
+/* One recorded event, see INIT_TL_* in finit.h */
+struct timeline_event {
+	uint64_t    ns;			/* CLOCK_MONOTONIC */
+	int         type;
+	int         arg;
+	int         svctype;		/* SVC_TYPE_*, for service events */
+	const char *name;
+	const char *cond;		/* For INIT_TL_SVC_COND */
+};
+
+void timeline_init  (void);
+void timeline_add   (int type, int arg, const char *name);
+void timeline_hook  (hook_point_t no, int done);
+void timeline_svc   (svc_t *svc, int type, int arg);
+void timeline_state (svc_t *svc, svc_state_t old_state, svc_state_t new_state);
+int  timeline_get   (size_t pos, struct timeline_event *ev);
+
+#endif /* FINIT_TIMELINE_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -266,6 +266,7 @@ int tty_exists(char *dev)
 
 int tty_exec(svc_t *svc)
 {
+	struct rlimit rlimit[RLIMIT_NLIMITS];
 	char *args[MAX_NUM_SVC_ARGS];
 	char *dev;
 	int i, j;
@@ -304,21 +305,18 @@ int tty_exec(svc_t *svc)
 		return EX_OSFILE;
 	}
 
+	svc_get_rlimit(svc, rlimit);
 	if (svc->nologin) {
 		dbg("%s: Starting /bin/sh ...", dev);
-		return run_sh(dev, svc->noclear, svc->nowait, svc->rlimit);
+		return run_sh(dev, svc->noclear, svc->nowait, rlimit);
 	}
 
 	dbg("%s: Starting %s ...", dev, svc->cmd);
-	for (i = 1, j = 0; i < MAX_NUM_SVC_ARGS; i++) {
-		if (!svc->args[i][0])
-			break;
-
+	for (i = 1, j = 0; svc->args && svc->args[i]; i++)
 		args[j++] = svc->args[i];
-	}
 	args[j++] = NULL;
 
-	return run_getty(dev, svc->cmd, args, svc->noclear, svc->nowait, svc->rlimit);
+	return run_getty(dev, svc->cmd, args, svc->noclear, svc->nowait, rlimit);
 }
 
 /**
@@ -651,6 +651,72 @@ void de_dotdot(char *file)
         }
 }
 
+/**
+ * strset - Replace a heap allocated string
+ * @ptr: Pointer to string to replace, previous value is free'd
+ * @str: New value, %NULL or empty string to clear
+ *
+ * Empty strings are never stored, so callers only need to check
+ * for %NULL.  On error the previous value is kept.
+ *
+ * Returns:
+ * POSIX OK(0), or -1 with errno set on failure to allocate memory.
+ */
+int strset(char **ptr, const char *str)
+{
+	char *tmp = NULL;
+
+	if (str && str[0]) {
+		if (*ptr && !strcmp(*ptr, str))
+			return 0;
+
+		tmp = strdup(str);
+		if (!tmp)
+			return -1;
+	}
+
+	free(*ptr);
+	*ptr = tmp;
+
+	return 0;
+}
+
+/**
+ * strvdup - Duplicate a string vector into a single allocation
+ * @argv: Vector of strings
+ * @argc: Number of strings in @argv
+ *
+ * The new vector is %NULL terminated and followed in the same block of
+ * memory by the length exact strings, so it is released with free().
+ *
+ * Returns:
+ * A new string vector, or %NULL with errno set on error.
+ */
+char **strvdup(char *argv[], int argc)
+{
+	size_t len = (argc + 1) * sizeof(char *);
+	char **vec, *ptr;
+	int i;
+
+	for (i = 0; i < argc; i++)
+		len += strlen(argv[i]) + 1;
+
+	vec = malloc(len);
+	if (!vec)
+		return NULL;
+
+	ptr = (char *)&vec[argc + 1];
+	for (i = 0; i < argc; i++) {
+		size_t sz = strlen(argv[i]) + 1;
+
+		vec[i] = memcpy(ptr, argv[i], sz);
+		ptr += sz;
+	}
+	vec[argc] = NULL;
+
+	return vec;
+}
+
 static int hasopt(char *opts, char *opt)
 {
 	char buf[strlen(opts) + 1];
@@ -90,6 +90,9 @@ char *memsz        (uint64_t sz, char *buf, size_t len);
 char *sanitize     (char *arg, size_t len);
 void  de_dotdot    (char *file);
 
+int   strset       (char **ptr, const char *str);
+char **strvdup     (char *argv[], int argc);
+
 int   ismnt        (char *file, char *dir, char *mode);
 int   fismnt       (char *dir);
 int   fistmpfs     (char *dir);
@@ -0,0 +1,305 @@
+/* Hierarchical timer wheel for service timeouts
+ *
+ * Copyright (c) 2025  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <time.h>
+
+#include "private.h"
+#include "wheel.h"
+
+/*
+ * Instead of one uev timer, i.e., one timerfd, per service, all service
+ * timeouts are kept on a hierarchical timer wheel driven by a single
+ * uev timer.  Starting and stopping a timeout is O(1), no syscalls, the
+ * uev timer is only reprogrammed when the next expiry moves earlier.
+ *
+ * Level 0 has one slot per millisecond, each higher level covers 64
+ * times the range of the level below.  Timers are placed on the lowest
+ * level that covers their expiry and cascade down when the wheel below
+ * wraps.  Five levels cover 2^30 msec, about 12 days, longer timeouts
+ * are parked in the top level and cascaded until they are in range.
+ */
+#define WHEEL_BITS   6
+#define WHEEL_SIZE   (1 << WHEEL_BITS)
+#define WHEEL_MASK   (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS 5
+#define WHEEL_MAX    (1ULL << (WHEEL_BITS * WHEEL_LEVELS))
+
+LIST_HEAD(wlist, wtimer);
+
+static struct {
+	uint64_t     now;			/* Last processed tick, msec */
+	uint64_t     bitmap[WHEEL_LEVELS];	/* Non-empty slots */
+	struct wlist slot[WHEEL_LEVELS][WHEEL_SIZE];
+	unsigned int count;			/* Pending timers */
+
+	uev_t        timer;
+	int          init;
+	uint64_t     armed;			/* Tick the uev timer is set for */
+} wheel;
+
+uint64_t wheel_clock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void enqueue(struct wtimer *t)
+{
+	uint64_t expires = t->expires;
+	uint64_t delta;
+	int level = 0;
+	int slot;
+
+	if (expires < wheel.now)
+		expires = wheel.now;
+	delta = expires - wheel.now;
+	if (delta >= WHEEL_MAX) {
+		expires = wheel.now + WHEEL_MAX - 1;
+		delta   = WHEEL_MAX - 1;
+	}
+
+	while (delta >> (WHEEL_BITS * (level + 1)))
+		level++;
+	slot = (expires >> (WHEEL_BITS * level)) & WHEEL_MASK;
+
+	LIST_INSERT_HEAD(&wheel.slot[level][slot], t, link);
+	wheel.bitmap[level] |= 1ULL << slot;
+	t->level = level;
+	t->slot  = slot;
+}
+
+static void dequeue(struct wtimer *t)
+{
+	LIST_REMOVE(t, link);
+	if (t->level >= 0 && !LIST_FIRST(&wheel.slot[t->level][t->slot]))
+		wheel.bitmap[t->level] &= ~(1ULL << t->slot);
+}
+
+/* Move all timers in a slot down to the level(s) below */
+static void cascade(int level, int slot)
+{
+	struct wlist *head = &wheel.slot[level][slot];
+	struct wtimer *t;
+
+	wheel.bitmap[level] &= ~(1ULL << slot);
+	while ((t = LIST_FIRST(head))) {
+		LIST_REMOVE(t, link);
+		enqueue(t);
+	}
+}
+
+/*
+ * Next tick when something happens: a level 0 slot expires, or a slot
+ * on a higher level is cascaded.  For each level that is the next
+ * non-empty slot after the current one, wrapping around to the current
+ * one, which is then a full round ahead.
+ */
+static uint64_t next_tick(void)
+{
+	uint64_t next = UINT64_MAX;
+	int level;
+
+	for (level = 0; level < WHEEL_LEVELS; level++) {
+		uint64_t bits = wheel.bitmap[level];
+		int shift = WHEEL_BITS * level;
+		uint64_t block, tick;
+		int from;
+
+		if (!bits)
+			continue;
+
+		block = wheel.now >> shift;
+		from  = (block + 1) & WHEEL_MASK;
+		if (from)
+			bits = (bits >> from) | (bits << (64 - from));
+
+		tick = (block + 1 + __builtin_ctzll(bits)) << shift;
+		if (tick < next)
+			next = tick;
+	}
+
+	return next;
+}
+
+static void wheel_cb(uev_t *w, void *arg, int events);
+
+/* Reprogram the uev timer, only if the next tick moved earlier */
+static void wheel_arm(void)
+{
+	uint64_t next, now, msec;
+
+	if (!wheel.count)
+		return;
+
+	next = next_tick();
+	if (wheel.armed && wheel.armed <= next)
+		return;
+
+	now  = wheel_clock();
+	msec = next > now ? next - now : 1;
+	if (msec > INT32_MAX)
+		msec = INT32_MAX;
+
+	if (wheel.init)
+		uev_timer_set(&wheel.timer, msec, 0);
+	else if (!uev_timer_init(ctx, &wheel.timer, wheel_cb, NULL, msec, 0))
+		wheel.init = 1;
+	wheel.armed = next;
+}
+
+/**
+ * wheel_expire - Run all timers that have expired
+ * @now: Current time, from wheel_clock()
+ *
+ * Called from the uev timer, exported for testing.  Skips straight to
+ * the next tick with something to do, so the cost depends on the number
+ * of timers, not on the time elapsed.
+ */
+void wheel_expire(uint64_t now)
+{
+	while (wheel.count) {
+		struct wlist list;
+		struct wtimer *t;
+		uint64_t tick;
+		int level;
+
+		tick = next_tick();
+		if (tick > now)
+			break;
+
+		wheel.now = tick;
+		for (level = WHEEL_LEVELS - 1; level > 0; level--) {
+			if (tick & ((1ULL << (WHEEL_BITS * level)) - 1))
+				continue;
+			cascade(level, (tick >> (WHEEL_BITS * level)) & WHEEL_MASK);
+		}
+
+		/* Callbacks may start and stop any timer, incl. this one */
+		LIST_INIT(&list);
+		wheel.bitmap[0] &= ~(1ULL << (tick & WHEEL_MASK));
+		while ((t = LIST_FIRST(&wheel.slot[0][tick & WHEEL_MASK]))) {
+			LIST_REMOVE(t, link);
+			LIST_INSERT_HEAD(&list, t, link);
+			t->level = -1;
+		}
+
+		while ((t = LIST_FIRST(&list))) {
+			LIST_REMOVE(t, link);
+			if (t->expires > tick) {
+				enqueue(t);	/* Parked, see WHEEL_MAX */
+				continue;
+			}
+
+			t->pending = 0;
+			wheel.count--;
+			t->cb(t, t->arg);
+		}
+	}
+
+	wheel.now = now;
+}
+
+static void wheel_cb(uev_t *w, void *arg, int events)
+{
+	if (UEV_ERROR == events) {
+		uev_timer_start(w);
+		return;
+	}
+
+	wheel.armed = 0;
+	wheel_expire(wheel_clock());
+	wheel_arm();
+}
+
+/**
+ * wheel_timer_init - Set up a timer
+ * @t:   Timer, e.g. embedded in svc_t
+ * @cb:  Callback when timer expires
+ * @arg: Argument to callback
+ */
+void wheel_timer_init(struct wtimer *t, void (*cb)(struct wtimer *, void *), void *arg)
+{
+	if (t->pending)
+		wheel_timer_stop(t);
+
+	t->cb  = cb;
+	t->arg = arg;
+}
+
+/**
+ * wheel_timer_set - Start, or restart, a one-shot timer
+ * @t:    Timer set up with wheel_timer_init()
+ * @msec: Timeout, in milliseconds
+ *
+ * Returns:
+ * POSIX OK(0) on success, or -1 if @t has no callback.
+ */
+int wheel_timer_set(struct wtimer *t, int msec)
+{
+	if (!t->cb)
+		return -1;
+
+	if (t->pending)
+		wheel_timer_stop(t);
+	else if (!wheel.count)
+		wheel.now = wheel_clock();
+
+	if (msec < 1)
+		msec = 1;
+	t->expires = wheel_clock() + msec;
+	t->pending = 1;
+	wheel.count++;
+	enqueue(t);
+	wheel_arm();
+
+	return 0;
+}
+
+/**
+ * wheel_timer_stop - Stop a timer
+ * @t: Timer, stopping a stopped timer is a no-op
+ *
+ * The uev timer is left as-is, at worst it fires once with nothing
+ * to do.
+ */
+void wheel_timer_stop(struct wtimer *t)
+{
+	if (!t->pending)
+		return;
+
+	dequeue(t);
+	t->pending = 0;
+	wheel.count--;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -0,0 +1,64 @@
+/* Hierarchical timer wheel for service timeouts
+ *
+ * Copyright (c) 2025  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef FINIT_WHEEL_H_
+#define FINIT_WHEEL_H_
+
+#include <stdint.h>
+#include <sys/queue.h>
+
+/*
+ * A timeout on the timer wheel, embedded in svc_t and friends.  Zeroed
+ * memory is a stopped timer, but wheel_timer_init() must be called to
+ * set the callback before the timer is started.
+ */
+struct wtimer {
+	LIST_ENTRY(wtimer) link;
+	uint64_t  expires;		/* msec, CLOCK_MONOTONIC */
+	char      pending;
+	signed char level;		/* Wheel level, -1 while expiring */
+	unsigned char slot;
+
+	void    (*cb)(struct wtimer *t, void *arg);
+	void     *arg;
+};
+
+void wheel_timer_init (struct wtimer *t, void (*cb)(struct wtimer *, void *), void *arg);
+int  wheel_timer_set  (struct wtimer *t, int msec);
+void wheel_timer_stop (struct wtimer *t);
+void wheel_expire     (uint64_t now);
+uint64_t wheel_clock  (void);
+
+static inline int wheel_timer_pending(struct wtimer *t)
+{
+	return t->pending;
+}
+
+#endif /* FINIT_WHEEL_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
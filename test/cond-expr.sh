@@ -0,0 +1,63 @@
+#!/bin/sh
+# Verify condition expressions, OR, NOT and grouping, of a service, and
+# that an invalid expression is never on, neither in Finit nor initctl.
+set -eu
+
+TEST_DIR=$(dirname "$0")
+
+test_teardown()
+{
+    say "Running test teardown."
+    run "rm -f $TEST_CONF"
+}
+
+# Aggregate state of the service's expression, as seen by initctl
+assert_expr()
+{
+    state=$1
+    assert "Service serv condition expression $state" "$(texec initctl -j cond show | jq -r '.[] | select(.identity == "serv") | .status')" = "$state"
+}
+
+# shellcheck source=/dev/null
+. "$TEST_DIR/lib/setup.sh"
+
+TEST_CONF=$FINIT_RCSD/expr.conf
+
+sep "Expression with OR, NOT and grouping"
+run "echo 'service <(usr/a|usr/b),!usr/c> serv -np -- Expression' > $TEST_CONF"
+run "initctl reload"
+
+say 'Neither usr/a nor usr/b, service must wait'
+retry 'assert_status "serv" "waiting"'
+assert_expr "off"
+
+say 'OR: usr/b is enough to start the service'
+run "initctl cond set usr/b"
+retry 'assert_status "serv" "running"'
+assert_expr "on"
+
+say 'NOT: usr/c stops the service'
+run "initctl cond set usr/c"
+retry 'assert_status "serv" "waiting"'
+assert_expr "off"
+
+say 'Clear usr/c and usr/b, set usr/a, service starts again'
+run "initctl cond clr usr/c usr/b"
+retry 'assert_status "serv" "waiting"'
+run "initctl cond set usr/a"
+retry 'assert_status "serv" "running"'
+assert_expr "on"
+
+sep "Invalid expression"
+run "echo 'service <usr/a|> serv -np -- Invalid expression' > $TEST_CONF"
+run "initctl reload"
+
+say 'An invalid expression is off, even though usr/a is set'
+retry 'assert_status "serv" "missing"'
+assert_expr "off"
+assert_num_children 0 serv
+
+say "Done, drop service from $TEST_CONF ..."
+run "initctl cond clr usr/a"
+run "rm $TEST_CONF"
+run "initctl reload"
@@ -77,6 +77,11 @@ assert_desc()
 	assert "Service description == $1" "$(texec initctl status "$2" | grep 'Description' | sed 's/Description : //')" = "$1"
 }
 
+assert_message()
+{
+	assert "Service status message == $1" "$(texec initctl status "$2" | grep 'Message' | sed 's/ *Message : //')" = "$1"
+}
+
 assert_status()
 {
 	service=$1
@@ -0,0 +1,10 @@
+#!/bin/sh
+# Verify service readiness notification, STATUS= and the watchdog, with
+# one notify socket shared by all notify:systemd services.
+set -eu
+
+# shellcheck disable=SC2034
+BOOTSTRAP="notify-socket shared"
+
+# shellcheck source=/dev/null
+. "$(dirname "$0")/notify.sh"
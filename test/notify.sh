@@ -9,6 +9,13 @@ TEST_DIR=$(dirname "$0")
 test_setup()
 {
     run "mkdir -p /etc/default"
+
+    # With BOOTSTRAP, e.g. from notify-shared.sh, setup.sh does not wait
+    # for runlevel 2
+    if [ -n "${BOOTSTRAP:-}" ]; then
+        say "Waiting for runlevel 2"
+        sleep 2
+    fi
 }
 
 test_teardown()
@@ -105,6 +112,39 @@ test_one()
 #    say "finit: number of open file descriptors after test: $num"
 }
 
+# Verify watchdog:MSEC restarts a hung service, and STATUS= in initctl
+test_watchdog()
+{
+    service=$1
+
+    if ! "$TEST_DIR/src/serv" -C | grep -q "libsystemd"; then
+        sep
+        say "Skipping watchdog test - serv built without libsystemd support"
+        return 0
+    fi
+
+    sep
+    say "Testing $(echo "$service" | sed -n -e 's/^.*-- //p')"
+    run "echo $service > $FINIT_CONF"
+
+    say 'Reload Finit'
+    run "initctl reload"
+
+    retry 'assert_status "serv" "running"' 5 1
+    retry 'assert_cond "service/serv/ready"' 5 1
+
+    say "Verify STATUS= from the service is shown in initctl status ..."
+    assert_message "Harvesting" "serv"
+
+    say "Verify serv is restarted when it stops sending WATCHDOG=1 ..."
+    retry 'assert_restarts 1 serv' 15 1
+    retry 'assert_status "serv" "running"' 5 1
+
+    say "Cleaning up after test."
+    run "rm -f $FINIT_CONF"
+    run "initctl reload"
+}
+
 # shellcheck source=/dev/null
 . "$TEST_DIR/lib/setup.sh"
 
@@ -117,4 +157,6 @@ test_one "systemd" "service log:stdout notify:systemd serv -n        -- systemd
 test_one "s6"      "service log:stdout notify:s6      serv -np -N %n -- s6 readiness with pidfile"
 test_one "systemd" "service log:stdout notify:systemd serv -np       -- systemd readiness with pidfile"
 
+test_watchdog "service log:stdout notify:systemd watchdog:2000 serv -n -S Harvesting -w 3 -- systemd watchdog"
+
 return 0
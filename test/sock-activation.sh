@@ -0,0 +1,45 @@
+#!/bin/sh
+# Verify socket activation, a service with a socket stanza must not be
+# started until a client connects, and is then given the socket.
+set -eu
+
+TEST_DIR=$(dirname "$0")
+
+test_setup()
+{
+    say "Bring up loopback for the client ..."
+    run "ip link set lo up"
+}
+
+test_teardown()
+{
+    say "Running test teardown."
+    run "rm -f $FINIT_CONF"
+}
+
+# shellcheck source=/dev/null
+. "$TEST_DIR/lib/setup.sh"
+
+run "echo 'socket stream:4711 serv' > $FINIT_CONF"
+run "echo 'service serv -np -e LISTEN_FDS:1 -- Socket activated' >> $FINIT_CONF"
+
+say 'Reload Finit'
+run "initctl reload"
+
+say 'Verify serv is not started without a client ...'
+retry 'assert_status "serv" "waiting"'
+sleep 2
+assert_status "serv" "waiting"
+assert_num_children 0 serv
+
+say 'Connect to the socket, serv should be started ...'
+run "nc -w 1 127.0.0.1 4711 </dev/null || true"
+retry 'assert_status "serv" "running"' 10 0.5
+
+pid=$(texec initctl -j status serv | jq -M .pid)
+say "Verify serv, PID $pid, got LISTEN_FDS=1 in its environment ..."
+assert_file_contains "/proc/$pid/environ" "LISTEN_FDS=1"
+
+say "Done, drop service from $FINIT_CONF ..."
+run "rm $FINIT_CONF"
+run "initctl reload"
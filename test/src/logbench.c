@@ -0,0 +1,170 @@
+/*
+ * Log rotation benchmark
+ *
+ * Writes lines as fast as possible to a log file, like the built-in log
+ * collector in PID 1, and rotates it when it grows past SIZE kiB.  The
+ * rotation, including compression of older logs, is done either inline
+ * by the writer or in a forked child while the writer keeps going.  For
+ * each mode the rotation latency and the longest stall of the writer,
+ * i.e., time between two writes, are reported.
+ *
+ *     ./logbench [SIZE] [ROTATIONS]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#ifdef _LIBITE_LITE
+# include <libite/lite.h>
+#else
+# include <lite/lite.h>
+#endif
+
+extern int logrotate(char *file, int num, off_t sz);
+
+#define LOG_SIZE      1024	/* kiB */
+#define LOG_COUNT     5
+#define NUM_ROTATIONS 10
+
+static char tmpdir[] = "/tmp/logbench.XXXXXX";
+static char file[sizeof(tmpdir) + 16];
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static int logopen(off_t *size)
+{
+	struct stat st;
+	int fd;
+
+	fd = open(file, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+	if (fd == -1) {
+		perror(file);
+		exit(1);
+	}
+
+	*size = fstat(fd, &st) ? 0 : st.st_size;
+
+	return fd;
+}
+
+/* Somewhat compressible lines, like a chatty daemon */
+static size_t line(char *buf, size_t len, unsigned long num)
+{
+	return snprintf(buf, len, "%lu bench[%d]: request %lu from 10.0.%lu.%lu served in %d usec\n",
+			num, getpid(), num * 7919, (num >> 8) & 255, num & 255, rand() % 100000);
+}
+
+static void bench(const char *mode, int forked, off_t max, int rotations)
+{
+	double start, last, t, rot = 0, sum = 0, worst = 0, stall = 0;
+	unsigned long lines = 0;
+	pid_t pid = 0;
+	char buf[256];
+	off_t size;
+	int fd, num = 0;
+
+	fd = logopen(&size);
+	start = last = now();
+
+	while (num < rotations) {
+		size_t len = line(buf, sizeof(buf), lines++);
+
+		if (write(fd, buf, len) != (ssize_t)len) {
+			perror("write");
+			exit(1);
+		}
+		size += len;
+
+		if (pid && waitpid(pid, NULL, WNOHANG) == pid) {
+			t = now() - rot;
+			sum += t;
+			if (t > worst)
+				worst = t;
+			pid = 0;
+			num++;
+
+			/* The child has rotated our file, reopen */
+			close(fd);
+			fd = logopen(&size);
+		}
+
+		if (!pid && size > max) {
+			rot = now();
+			if (forked) {
+				pid = fork();
+				if (pid == -1) {
+					perror("fork");
+					exit(1);
+				}
+				if (!pid)
+					_exit(logrotate(file, LOG_COUNT, max));
+			} else {
+				close(fd);
+				logrotate(file, LOG_COUNT, max);
+				fd = logopen(&size);
+
+				t = now() - rot;
+				sum += t;
+				if (t > worst)
+					worst = t;
+				num++;
+			}
+		}
+
+		t = now();
+		if (t - last > stall)
+			stall = t - last;
+		last = t;
+	}
+	close(fd);
+
+	printf("%-8s: %d rotations, latency avg %6.2f max %6.2f msec, "
+	       "worst stall %6.2f msec, %.0f lines/sec\n", mode, num,
+	       sum / num, worst, stall, lines / ((now() - start) / 1e3));
+}
+
+int main(int argc, char *argv[])
+{
+	off_t max;
+	int num;
+
+	max = argc > 1 ? atoi(argv[1]) : LOG_SIZE;
+	if (max < 1)
+		max = LOG_SIZE;
+	max *= 1024;
+
+	num = argc > 2 ? atoi(argv[2]) : NUM_ROTATIONS;
+	if (num < 1)
+		num = NUM_ROTATIONS;
+
+	if (!mkdtemp(tmpdir)) {
+		perror("mkdtemp");
+		return 1;
+	}
+	snprintf(file, sizeof(file), "%s/bench.log", tmpdir);
+	srand(1);
+
+	printf("Rotating %s at %lld kiB, keeping %d files\n", file, (long long)max / 1024, LOG_COUNT);
+	bench("inline", 0, max, num);
+	bench("forked", 1, max, num);
+
+	if (systemf("rm -rf %s", tmpdir))
+		return 1;
+
+	return 0;
+}
@@ -182,6 +182,8 @@ static int usage(int rc)
 		" -p       Create PID file despite running in foreground\n"
 		" -P FILE  Create PID file using FILE\n"
 		" -r SVC   Call initctl to restart service SVC (self)\n"
+		" -S TEXT  Send STATUS=TEXT with systemd readiness notification\n"
+		" -w SEC   Stop sending WATCHDOG=1 after SEC seconds, simulate hang\n"
 		"\n"
 		"By default this program daemonizes itself to the background, and,\n"
 		"when it's done setting up its signal handler(s), creates a PID file\n"
@@ -205,14 +207,19 @@ int main(int argc, char *argv[])
 	int do_restart = 0;
 	int do_notify = 0;
 	int do_crash = 0;
+#ifdef HAVE_LIBSYSTEMD
+	int watchdog = 0;
+#endif
 	int vanish = 0;
+	int hang = 0;
+	char *status = NULL;
 	char *pidfn = NULL;
 	char *melange = NULL;
 	char *spice = NULL;
 	char cmd[80];
 	int c;
 
-	while ((c = getopt(argc, argv, "cCe:E:f:F:hi:nN:pP:r:")) != EOF) {
+	while ((c = getopt(argc, argv, "cCe:E:f:F:hi:nN:pP:r:S:w:")) != EOF) {
 		switch (c) {
 		case 'c':
 			do_crash = 1;
@@ -255,6 +262,12 @@ int main(int argc, char *argv[])
 			snprintf(cmd, sizeof(cmd), "initctl restart %s", optarg);
 			do_restart = 1;
 			break;
+		case 'S':
+			status = optarg;
+			break;
+		case 'w':
+			hang = atoi(optarg);
+			break;
 		default:
 			return usage(1);
 		}
@@ -286,6 +299,17 @@ int main(int argc, char *argv[])
 	else
 		inf("No notify socket ...");
 
+#ifdef HAVE_LIBSYSTEMD
+	/* Finit sets WATCHDOG_USEC and WATCHDOG_PID for watchdog:MSEC */
+	if (!notify_s6 && sd_watchdog_enabled(0, NULL) > 0) {
+		inf("Will send WATCHDOG=1 keep-alive every second ...");
+		watchdog = 1;
+	}
+#else
+	if (status || hang)
+		inf("Skipping -S and -w, built without libsystemd support");
+#endif
+
 	if (do_crash) {
 		inf("Simulating crash, exiting with code %d", EX_SOFTWARE);
 		exit(EX_SOFTWARE);
@@ -318,7 +342,10 @@ int main(int argc, char *argv[])
 					int rc;
 
 					inf("Notifying Finit on NOTIFY_SOCKET");
-					rc = sd_notify(0, "READY=1");
+					if (status)
+						rc = sd_notifyf(0, "READY=1\nSTATUS=%s", status);
+					else
+						rc = sd_notify(0, "READY=1");
 					inf("sd_notify () => %d", rc);
 #else
 					inf("Skipping systemd notify - built without libsystemd support");
@@ -337,6 +364,16 @@ int main(int argc, char *argv[])
 		}
 
 		sleep(1);
+#ifdef HAVE_LIBSYSTEMD
+		if (watchdog) {
+			if (hang > 0 && --hang == 0) {
+				inf("Simulating hang, no more WATCHDOG=1 to Finit");
+				watchdog = 0;
+			} else {
+				sd_notify(0, "WATCHDOG=1");
+			}
+		}
+#endif
 		if (do_restart) {
 			inc_restarts();
 			if (system(cmd))
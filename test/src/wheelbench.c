@@ -0,0 +1,138 @@
+/*
+ * Timer wheel microbenchmark
+ *
+ * Arms, re-arms, cancels and expires N timeouts on the timer wheel used
+ * for service timeouts in PID 1, and reports the cost per operation.
+ * For comparison, the same is done with one uev timer per timeout, like
+ * before, but only for a few, since each needs a timerfd.
+ *
+ *     ./wheelbench [NUM]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <uev/uev.h>
+
+#include "wheel.h"
+
+#define NUM_TIMERS 100000
+#define NUM_UEV    1000
+
+uev_ctx_t *ctx;			/* Used by wheel.c */
+
+static int expired;
+
+static void cb(struct wtimer *t, void *arg)
+{
+	expired++;
+}
+
+static void uev_cb(uev_t *w, void *arg, int events)
+{
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void report(const char *what, double start, int num)
+{
+	printf("%-22s: %8.1f ns/op\n", what, (now() - start) / num);
+}
+
+/* Same mix of timeouts as PID 1: kill delays, restart backoff, scripts */
+static int timeout(void)
+{
+	switch (rand() % 4) {
+	case 0:
+		return 2000 + rand() % 3000;
+	case 1:
+		return 3000;
+	case 2:
+		return 60000 + rand() % 60000;
+	default:
+		return 1 + rand() % 3600000;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	struct wtimer *timers;
+	uev_ctx_t loop;
+	uev_t *w;
+	double start;
+	int i, num;
+
+	num = argc > 1 ? atoi(argv[1]) : NUM_TIMERS;
+	if (num < 1)
+		num = NUM_TIMERS;
+
+	timers = calloc(num, sizeof(*timers));
+	w = calloc(NUM_UEV, sizeof(*w));
+	if (!timers || !w) {
+		perror("calloc");
+		return 1;
+	}
+
+	uev_init(&loop);
+	ctx = &loop;
+	srand(1);
+
+	printf("%d timeouts on timer wheel\n", num);
+	for (i = 0; i < num; i++)
+		wheel_timer_init(&timers[i], cb, NULL);
+
+	start = now();
+	for (i = 0; i < num; i++)
+		wheel_timer_set(&timers[i], timeout());
+	report("arm", start, num);
+
+	start = now();
+	for (i = 0; i < num; i++)
+		wheel_timer_set(&timers[i], timeout());
+	report("re-arm", start, num);
+
+	start = now();
+	for (i = 0; i < num; i++)
+		wheel_timer_stop(&timers[i]);
+	report("cancel", start, num);
+
+	for (i = 0; i < num; i++)
+		wheel_timer_set(&timers[i], timeout());
+	start = now();
+	wheel_expire(wheel_clock() + 3600000);
+	report("expire", start, num);
+	if (expired != num)
+		printf("error: %d of %d timeouts expired\n", expired, num);
+
+	printf("\n%d timeouts with one uev timer each\n", NUM_UEV);
+	start = now();
+	for (i = 0; i < NUM_UEV; i++)
+		uev_timer_init(&loop, &w[i], uev_cb, NULL, timeout(), 0);
+	report("arm (init)", start, NUM_UEV);
+
+	start = now();
+	for (i = 0; i < NUM_UEV; i++)
+		uev_timer_set(&w[i], timeout(), 0);
+	report("re-arm", start, NUM_UEV);
+
+	start = now();
+	for (i = 0; i < NUM_UEV; i++)
+		uev_timer_stop(&w[i]);
+	report("cancel", start, NUM_UEV);
+
+	uev_exit(&loop);
+	free(timers);
+	free(w);
+
+	return expired != num;
+}
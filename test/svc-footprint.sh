@@ -0,0 +1,51 @@
+#!/bin/sh
+# Register a large number of synthetic services and report the size of
+# each service object and the total heap used by PID 1, from the output
+# of 'initctl -j stats'.  Verifies all services are loaded and that the
+# per-service heap cost stays well below the ~20 KiB each svc_t used to
+# be, when it embedded fixed size args[] and script buffers.
+set -eu
+
+TEST_DIR=$(dirname "$0")
+NUM=${NUM:-500}
+MAX=${MAX:-8192}
+
+test_teardown()
+{
+    say "Running test teardown."
+    run "rm -f $FINIT_CONF"
+}
+
+stats()
+{
+    texec initctl -j stats | jq -M ".$1"
+}
+
+# shellcheck source=/dev/null
+. "$TEST_DIR/lib/setup.sh"
+
+check_dep jq
+
+before=$(stats heap)
+base=$(stats services)
+
+say "Add $NUM synthetic task stanzas to $FINIT_CONF ..."
+run "i=1; while [ \$i -le $NUM ]; do echo \"task manual:yes name:synth :\$i serv -n -i synth\$i -- Synthetic \$i\"; i=\$((i + 1)); done > $FINIT_CONF"
+
+say 'Reload Finit'
+run "initctl reload"
+
+assert "$NUM synthetic services are loaded" "$(stats services)" -eq "$((base + NUM))"
+
+size=$(stats svc_size)
+after=$(stats heap)
+say "sizeof(svc_t): $size bytes, $NUM services"
+
+if [ "$after" -eq 0 ]; then
+    say "PID 1 heap unknown, C library lacks mallinfo2()"
+    exit 0
+fi
+
+each=$(((after - before) / NUM))
+say "PID 1 heap: $before -> $after bytes, $each bytes per service"
+assert "Heap per service ($each) is less than $MAX bytes" "$each" -lt "$MAX"